@@ -24,6 +24,132 @@ from bpy_extras.io_utils import (
         )
 
 
+def converter_path(tool):
+    import os
+    return os.path.join(os.path.dirname(os.path.realpath(__file__)), tool)
+
+
+def server_address(tool):
+    """Socket (named pipe on Windows) of the conversion server of a tool."""
+    import os
+    if os.name == 'nt':
+        return "\\\\.\\pipe\\nwn2mdk-" + tool
+    import tempfile
+    return os.path.join(tempfile.gettempdir(), "nwn2mdk-%d-%s.sock" % (os.getuid(), tool))
+
+
+def connect_server(tool):
+    """Returns a connection to the conversion server, or None if no server is running."""
+    import os
+    try:
+        if os.name == 'nt':
+            return open(server_address(tool), "r+b", buffering=0)
+        import socket
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        s.connect(server_address(tool))
+        # The connection stays open until the file is closed.
+        f = s.makefile("rwb", buffering=0)
+        s.close()
+        return f
+    except OSError:
+        return None
+
+
+def write_frame(conn, data):
+    import struct
+    data = struct.pack("<I", len(data)) + data
+    while data:
+        data = data[conn.write(data):]
+
+
+def read_frame(conn):
+    import struct
+
+    def read_exactly(size):
+        data = b""
+        while len(data) < size:
+            chunk = conn.read(size - len(data))
+            if not chunk:
+                raise OSError("Conversion server closed the connection")
+            data += chunk
+        return data
+
+    size, = struct.unpack("<I", read_exactly(4))
+    return read_exactly(size)
+
+
+def request_job(conn, working_dir, args):
+    """Runs a job in the server. Returns its exit code and output."""
+    import struct
+    write_frame(conn, "\0".join([working_dir] + args).encode("utf-8"))
+    response = read_frame(conn)
+    exit_code, = struct.unpack("<i", response[:4])
+    return exit_code, response[4:]
+
+
+def start_server(tool):
+    """Starts a conversion server in the background for the next conversions."""
+    import os
+    import subprocess
+    args = [converter_path(tool), "-server", server_address(tool)]
+    try:
+        if os.name == 'nt':
+            subprocess.Popen(args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                             cwd=os.path.dirname(args[0]),
+                             creationflags=subprocess.CREATE_NO_WINDOW)
+        else:
+            subprocess.Popen(args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                             cwd=os.path.dirname(args[0]), start_new_session=True)
+    except OSError:
+        pass
+
+
+def stop_server(tool):
+    conn = connect_server(tool)
+    if conn:
+        try:
+            request_job(conn, "", ["-shutdown"])
+        except OSError:
+            pass
+        conn.close()
+
+
+def use_server():
+    prefs = bpy.context.preferences.addons.get(__name__)
+    return prefs is None or prefs.preferences.use_server
+
+
+def run_converter(tool, args, working_dir):
+    """Runs nw2fbx or fbx2nw in working_dir, writing its output to log.txt.
+
+    The job is sent to the conversion server of the tool if it's running,
+    which keeps archive indexes and parsed skeletons between conversions.
+    Otherwise, the tool is started for this job, and a server is started
+    for the next ones."""
+    import os
+    log_path = os.path.join(working_dir, "log.txt")
+
+    if use_server():
+        conn = connect_server(tool)
+        if conn:
+            try:
+                exit_code, output = request_job(conn, working_dir, args)
+                with open(log_path, "wb") as log:
+                    log.write(output)
+                return exit_code
+            except OSError:
+                pass  # Server exited, run the job in a new process.
+            finally:
+                conn.close()
+        else:
+            start_server(tool)
+
+    with open(log_path, "w") as log:
+        import subprocess
+        proc = subprocess.Popen([converter_path(tool)] + args, stdout=log, cwd=working_dir)
+        return proc.wait()
+
+
 def import_custom_properties(objects):
     for obj in objects:
         for k in obj.keys():
@@ -90,8 +216,7 @@ class ImportMDBGR2(bpy.types.Operator, ImportHelper):
 
         import os
 
-        nw2fbx_path = os.path.join(os.path.dirname(os.path.realpath(__file__)), "nw2fbx")
-        args = [nw2fbx_path]
+        args = []
 
         working_dir = os.path.dirname(self.filepath)
 
@@ -102,10 +227,7 @@ class ImportMDBGR2(bpy.types.Operator, ImportHelper):
         args.append("-o");
         args.append("nwn2mdk-tmp.fbx");
 
-        with open(os.path.join(working_dir, "log.txt"), "w") as log:
-            import subprocess
-            proc = subprocess.Popen(args, stdout=log, cwd=working_dir)
-            proc.wait()
+        run_converter("nw2fbx", args, working_dir)
 
         tmpfbx = os.path.join(working_dir, "nwn2mdk-tmp.fbx")
         bpy.ops.import_scene.fbx(filepath=tmpfbx,
@@ -180,16 +302,9 @@ class ExportMDB(bpy.types.Operator, ExportHelper):
                                  add_leaf_bones=False,
                                  bake_anim=False)
 
-        import os
-
-        fbx2nw_path = os.path.join(os.path.dirname(os.path.realpath(__file__)), "fbx2nw")
-        args = [fbx2nw_path, tmpfbx, "-o", os.path.basename(self.filepath)]
-        working_dir = os.path.dirname(self.filepath)
+        args = [tmpfbx, "-o", os.path.basename(self.filepath)]
 
-        with open(os.path.join(working_dir, "log.txt"), "w") as log:
-            import subprocess
-            proc = subprocess.Popen(args, stdout=log, cwd=working_dir)
-            proc.wait()
+        run_converter("fbx2nw", args, working_dir)
 
         if os.path.exists(tmpfbx):
             os.remove(tmpfbx)
@@ -247,13 +362,9 @@ class ExportGR2(bpy.types.Operator, ExportHelper):
                                  bake_anim_simplify_factor=self.bake_anim_simplify_factor)
 
 
-        fbx2nw_path = os.path.join(os.path.dirname(os.path.realpath(__file__)), "fbx2nw")
-        args = [fbx2nw_path, tmpfbx, "-o", os.path.basename(self.filepath)]
+        args = [tmpfbx, "-o", os.path.basename(self.filepath)]
 
-        with open(os.path.join(working_dir, "log.txt"), "w") as log:
-            import subprocess
-            proc = subprocess.Popen(args, stdout=log, cwd=working_dir)
-            proc.wait()
+        run_converter("fbx2nw", args, working_dir)
 
         if os.path.exists(tmpfbx):
             os.remove(tmpfbx)
@@ -353,6 +464,20 @@ class NWN2ModelProperties(bpy.types.PropertyGroup):
             description="Indicates whether the model accepts projected textures")
 
 
+class NWN2MDK_preferences(bpy.types.AddonPreferences):
+    bl_idname = __name__
+
+    use_server: BoolProperty(
+            name="Conversion Server",
+            description="Keep nw2fbx and fbx2nw running in the background between "
+                        "conversions, so archives and skeletons are loaded once",
+            default=True,
+            )
+
+    def draw(self, context):
+        self.layout.prop(self, "use_server")
+
+
 class OBJECT_PT_nwn2mdk(bpy.types.Panel):
     """Neverwinter Night 2 Model Properties"""
     bl_label = "NWN2"
@@ -398,6 +523,7 @@ classes = (
     ExportGR2,
     NWN2MDK_PT_export_bake_animation,
     NWN2ModelProperties,
+    NWN2MDK_preferences,
     OBJECT_PT_nwn2mdk,
 )
 
@@ -413,6 +539,9 @@ def register():
 
 
 def unregister():
+    stop_server("nw2fbx")
+    stop_server("fbx2nw")
+
     bpy.types.TOPBAR_MT_file_import.remove(menu_func_import)
     bpy.types.TOPBAR_MT_file_export.remove(menu_func_export)
 
@@ -1,4 +1,3 @@
-#include <iostream>
 #include <filesystem>
 #include <set>
 #include <list>
@@ -8,26 +7,16 @@
 #include "config.h"
 #include "fbxsdk.h"
 #include "gr2_file.h"
+#include "import_glb.h"
+#include "import_info.h"
+#include "local_server.h"
 #include "log.h"
 #include "mdb_file.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
 #include "redirect_output_handle.h"
 #include "string_collection.h"
 
-enum class Output_type {
-	any,
-	mdb,
-	gr2
-};
-
-struct Import_info {
-	std::string input_path;
-	// Without extension.
-	std::string output_path;
-	Output_type output_type;
-};
-
-const double time_step = 1 / 30.0;
-
 static GR2_property_key CurveDataHeader_def[] = {
 	{ GR2_type_uint8, (char*)"Format", nullptr, 0, 0, 0, 0, 0},
 	{ GR2_type_uint8, (char*)"Degree", nullptr, 0, 0, 0, 0, 0 },
@@ -39,14 +28,14 @@ static GR2_property_key Real32_def[] = {
 	{ GR2_type_none, 0, 0, 0, 0, 0, 0, 0 }
 };
 
-static GR2_property_key DaConstant32f_def[] = {
+GR2_property_key DaConstant32f_def[] = {
 	{ GR2_type_inline, (char*)"CurveDataHeader_DaConstant32f", CurveDataHeader_def, 0, 0, 0, 0, 0 },
 	{ GR2_type_int16, (char*)"Padding", nullptr, 0, 0, 0, 0, 0 },
 	{ GR2_type_pointer, (char*)"Controls", Real32_def, 0, 0, 0, 0, 0 },
 	{ GR2_type_none, 0, 0, 0, 0, 0, 0, 0 }
 };
 
-static GR2_property_key D3Constant32f_def[] = {
+GR2_property_key D3Constant32f_def[] = {
 	{ GR2_type_inline, (char*)"CurveDataHeader_D3Constant32f", CurveDataHeader_def, 0, 0, 0, 0, 0 },
 	{ GR2_type_int16, (char*)"Padding", nullptr, 0, 0, 0, 0, 0 },
 	{ GR2_type_real32, (char*)"Controls", nullptr, 3, 0, 0, 0, 0 },
@@ -59,7 +48,7 @@ static GR2_property_key DaIdentity_def[] = {
 	{ GR2_type_none, 0, 0, 0, 0, 0, 0, 0 }
 };
 
-static GR2_property_key DaK32fC32f_def[] = {
+GR2_property_key DaK32fC32f_def[] = {
 	{ GR2_type_inline, (char*)"CurveDataHeader_DaK32fC32f", CurveDataHeader_def, 0, 0, 0, 0, 0 },
 	{ GR2_type_int16, (char*)"Padding", nullptr, 0, 0, 0, 0, 0 },
 	{ GR2_type_pointer, (char*)"Knots", Real32_def, 0, 0, 0, 0, 0 },
@@ -72,10 +61,28 @@ using namespace std::filesystem;
 
 static bool parse_args(int argc, char* argv[], Import_info& import_info)
 {
+	bool lod_ratio_set = false;
+
 	for (int i = 1; i < argc; ++i) {
 		if (argv[i][0] == '-') {
 			if (strcmp(argv[i], "-o") == 0 && i < argc - 1)
 				import_info.output_path = argv[++i];
+			else if (strcmp(argv[i], "-optimize") == 0)
+				import_info.optimize_meshes = true;
+			else if (strcmp(argv[i], "-v") == 0)
+				Log::set_level(Log::Level(Log::level + 1));
+			else if (strcmp(argv[i], "-lod") == 0 && i < argc - 1) {
+				import_info.generate_lod = true;
+				import_info.lod_options.target_ratio =
+				    float(atof(argv[++i]));
+				lod_ratio_set = true;
+			}
+			else if (strcmp(argv[i], "-lod-error") == 0 &&
+			         i < argc - 1) {
+				import_info.generate_lod = true;
+				import_info.lod_options.max_error =
+				    float(atof(argv[++i]));
+			}
 		}
 		else if (import_info.input_path.empty()) {
 			import_info.input_path = argv[i];
@@ -91,6 +98,10 @@ static bool parse_args(int argc, char* argv[], Import_info& import_info)
 		return false;
 	}
 
+	// With only an error budget, simplify as much as the budget allows.
+	if (import_info.generate_lod && !lod_ratio_set)
+		import_info.lod_options.target_ratio = 0;
+
 	if (import_info.output_path.empty()) {
 		import_info.output_path =
 		    path(import_info.input_path).stem().string();
@@ -392,28 +403,34 @@ void import_uv(FbxMesh* mesh, int polygon_index, T* poly_vertices)
 	}
 }
 
-struct Fbx_bones {
-	std::vector<FbxNode*> bones;
-	std::vector<FbxNode*> body_bones;
-	std::vector<FbxNode*> face_bones;
-	FbxNode* ribcage = nullptr;
-};
+void add_skin_bone(Skin_bones& skin_bones, const char* bone_name)
+{
+	if (strncmp(bone_name, "ap_", 3) == 0) {
+		// Discard "ap_..." bones as they are not used in skinning.
+	}
+	else if (strncmp(bone_name, "f_", 2) == 0) {
+		skin_bones.face_bones.push_back(bone_name);
+	}
+	else if (strcmp(bone_name, "Ribcage") != 0) {
+		skin_bones.body_bones.push_back(bone_name);
+	}
+}
 
-int bone_index(const char* bone_name, Fbx_bones& fbx_bones)
+int bone_index(const char* bone_name, const Skin_bones& skin_bones)
 {
 	// Ribcage bone is always the last bone.
 	if (strcmp(bone_name, "Ribcage") == 0)
-		return fbx_bones.body_bones.size();
+		return skin_bones.body_bones.size();
 
 	// Search in the body bones.
-	for (unsigned i = 0; i < fbx_bones.body_bones.size(); ++i) {
-		if (strcmp(fbx_bones.body_bones[i]->GetName(), bone_name) == 0)
+	for (unsigned i = 0; i < skin_bones.body_bones.size(); ++i) {
+		if (skin_bones.body_bones[i] == bone_name)
 			return i;		
 	}
 
 	// Search in the face bones.
-	for (unsigned i = 0; i < fbx_bones.face_bones.size(); ++i) {
-		if (strcmp(fbx_bones.face_bones[i]->GetName(), bone_name) == 0)
+	for (unsigned i = 0; i < skin_bones.face_bones.size(); ++i) {
+		if (skin_bones.face_bones[i] == bone_name)
 			return i;
 	}
 
@@ -461,7 +478,7 @@ void normalize_bone_weights(MDB_file::Skin_vertex &v)
 		v.bone_weights[i] /= sum;
 }
 
-void import_skinning(FbxMesh *mesh, int vertex_index, Fbx_bones& fbx_bones,
+void import_skinning(FbxMesh *mesh, int vertex_index, Skin_bones& skin_bones,
 	MDB_file::Skin_vertex &poly_vertex)
 {
 	auto s = skin(mesh);
@@ -478,7 +495,7 @@ void import_skinning(FbxMesh *mesh, int vertex_index, Fbx_bones& fbx_bones,
 				if (!validate_vertex_weights(cluster, bone_count))
 					return;
 
-				poly_vertex.bone_indices[bone_count] = bone_index(cluster->GetLink()->GetName(), fbx_bones);
+				poly_vertex.bone_indices[bone_count] = bone_index(cluster->GetLink()->GetName(), skin_bones);
 				poly_vertex.bone_weights[bone_count] = float(cluster->GetControlPointWeights()[j]);
 				++bone_count;
 			}
@@ -489,11 +506,11 @@ void import_skinning(FbxMesh *mesh, int vertex_index, Fbx_bones& fbx_bones,
 }
 
 void import_skinning(FbxMesh *mesh, int polygon_index,
-	Fbx_bones& fbx_bones, MDB_file::Skin_vertex *poly_vertices)
+	Skin_bones& skin_bones, MDB_file::Skin_vertex *poly_vertices)
 {
 	for (int i = 0; i < mesh->GetPolygonSize(polygon_index); ++i) {
 		int index = mesh->GetPolygonVertex(polygon_index, i);
-		import_skinning(mesh, index, fbx_bones, poly_vertices[i]);
+		import_skinning(mesh, index, skin_bones, poly_vertices[i]);
 
 	}
 }
@@ -679,10 +696,10 @@ void import_collision_mesh(MDB_file& mdb, FbxNode* node)
 	if (!mesh)
 		return;
 
-	cout << "Importing COL2|COL3: " << node->GetName() << endl;
+	Log::info() << "Importing COL2|COL3: " << node->GetName() << endl;
 
-	cout << "  Vertices: " << mesh->GetControlPointsCount() << endl;
-	cout << "  Polygons: " << mesh->GetPolygonCount() << endl;
+	Log::info() << "  Vertices: " << mesh->GetControlPointsCount() << endl;
+	Log::info() << "  Polygons: " << mesh->GetPolygonCount() << endl;
 
 	auto col_mesh = make_unique<MDB_file::Collision_mesh>(
 	    ends_with(node->GetName(), "_C2") ? MDB_file::COL2
@@ -757,7 +774,7 @@ void import_walk_mesh(MDB_file& mdb, FbxNode* node)
 	if (!mesh)
 		return;
 
-	cout << "Importing WALK: " << node->GetName() << endl;
+	Log::info() << "Importing WALK: " << node->GetName() << endl;
 
 	auto walk_mesh = make_unique<MDB_file::Walk_mesh>();
 	set_packet_name(walk_mesh->header.name, node->GetName());
@@ -770,16 +787,16 @@ void import_walk_mesh(MDB_file& mdb, FbxNode* node)
 
 static void print_vector3(const Vector3<float>& v)
 {
-	cout << v.x << ", " << v.y << ", " << v.z << endl;
+	Log::info() << v.x << ", " << v.y << ", " << v.z << endl;
 }
 
 static void print_orientation(const float orientation[3][3])
 {
 	for (int i = 0; i < 3; ++i) {
-		cout << "    ";
+		Log::info() << "    ";
 		for (int j = 0; j < 3; ++j)
-			cout << orientation[i][j] << ' ';
-		cout << endl;
+			Log::info() << orientation[i][j] << ' ';
+		Log::info() << endl;
 	}
 }
 
@@ -798,10 +815,10 @@ static bool is_hook_packet(FbxNode* node)
 
 void print_hook(MDB_file::Hook& hook)
 {
-	cout << "  Position: ";
+	Log::info() << "  Position: ";
 	print_vector3(hook.header.position);
 
-	cout << "  Orientation:\n";
+	Log::info() << "  Orientation:\n";
 	print_orientation(hook.header.orientation);	
 }
 
@@ -828,7 +845,7 @@ void transform_to_orientation(const FbxAMatrix& m, float orientation[3][3])
 
 void import_hook_point(MDB_file& mdb, FbxNode* node)
 {
-	cout << "Importing HOOK: " << node->GetName() << endl;
+	Log::info() << "Importing HOOK: " << node->GetName() << endl;
 
 	auto hook = make_unique<MDB_file::Hook>();
 	set_packet_name(hook->header.name, node->GetName());
@@ -856,23 +873,23 @@ static bool is_hair_packet(FbxNode* node)
 
 static void print_hair(const MDB_file::Hair& hair)
 {	
-	cout << "  Shortening: " << hair.header.shortening_behavior;
+	Log::info() << "  Shortening: " << hair.header.shortening_behavior;
 	switch (hair.header.shortening_behavior) {
 	case MDB_file::HSB_LOW:
-		cout << " (LOW)\n";
+		Log::info() << " (LOW)\n";
 		break;
 	case MDB_file::HSB_SHORT:
-		cout << " (SHORT)\n";
+		Log::info() << " (SHORT)\n";
 		break;
 	case MDB_file::HSB_PONYTAIL:
-		cout << " (PONYTAIL)\n";
+		Log::info() << " (PONYTAIL)\n";
 		break;
 	}
 
-	cout << "  Position: ";
+	Log::info() << "  Position: ";
 	print_vector3(hair.header.position);
 
-	cout << "  Orientation:\n";
+	Log::info() << "  Orientation:\n";
 	print_orientation(hair.header.orientation);
 }
 
@@ -895,7 +912,7 @@ MDB_file::Hair_shortening_behavior hair_shortening_behavior(FbxNode* node)
 
 void import_hair(MDB_file& mdb, FbxNode* node)
 {
-	cout << "Importing HAIR: " << node->GetName() << endl;
+	Log::info() << "Importing HAIR: " << node->GetName() << endl;
 
 	auto hair = make_unique<MDB_file::Hair>();
 	set_packet_name(hair->header.name, node->GetName());
@@ -946,32 +963,32 @@ MDB_file::Helm_hair_hiding_behavior helm_hair_hiding_behavior(FbxNode* node)
 
 static void print_helm(const MDB_file::Helm& helm)
 {	
-	cout << "  Hiding: " << helm.header.hiding_behavior;
+	Log::info() << "  Hiding: " << helm.header.hiding_behavior;
 	switch (helm.header.hiding_behavior) {
 	case MDB_file::HHHB_NONE_HIDDEN:
-		cout << " (NONE_HIDDEN)\n";
+		Log::info() << " (NONE_HIDDEN)\n";
 		break;
 	case MDB_file::HHHB_HAIR_HIDDEN:
-		cout << " (HAIR_HIDDEN)\n";
+		Log::info() << " (HAIR_HIDDEN)\n";
 		break;
 	case MDB_file::HHHB_PARTIAL_HAIR:
-		cout << " (PARTIAL_HAIR)\n";
+		Log::info() << " (PARTIAL_HAIR)\n";
 		break;
 	case MDB_file::HHHB_HEAD_HIDDEN:
-		cout << " (HEAD_HIDDEN)\n";
+		Log::info() << " (HEAD_HIDDEN)\n";
 		break;
 	}
 
-	cout << "  Position: ";
+	Log::info() << "  Position: ";
 	print_vector3(helm.header.position);
 
-	cout << "  Orientation:\n";
+	Log::info() << "  Orientation:\n";
 	print_orientation(helm.header.orientation);
 }
 
 void import_helm(MDB_file& mdb, FbxNode* node)
 {
-	cout << "Importing HELM: " << node->GetName() << endl;
+	Log::info() << "Importing HELM: " << node->GetName() << endl;
 
 	auto helm = make_unique<MDB_file::Helm>();
 	set_packet_name(helm->header.name, node->GetName());
@@ -1017,42 +1034,42 @@ void import_polygon(MDB_file::Rigid_mesh& rigid_mesh, FbxMesh* mesh,
 
 void print_mesh(FbxMesh *mesh)
 {
-	cout << "  Layers: " << mesh->GetLayerCount() << endl;
+	Log::info() << "  Layers: " << mesh->GetLayerCount() << endl;
 
-	cout << "  UV elements: " << mesh->GetElementUVCount();
+	Log::info() << "  UV elements: " << mesh->GetElementUVCount();
 	if (mesh->GetElementUVCount() > 0) {
 		FbxGeometryElementUV *e = mesh->GetElementUV(0);
-		cout << ' ' << mapping_mode_str(e->GetMappingMode()) << ' '
+		Log::info() << ' ' << mapping_mode_str(e->GetMappingMode()) << ' '
 			<< reference_mode_str(e->GetReferenceMode());
 	}
-	cout << endl;
+	Log::info() << endl;
 
-	cout << "  Normal elements: " << mesh->GetElementNormalCount();
+	Log::info() << "  Normal elements: " << mesh->GetElementNormalCount();
 	if (mesh->GetElementNormalCount() > 0) {
 		auto e = mesh->GetElementNormal(0);
-		cout << ' ' << mapping_mode_str(e->GetMappingMode()) << ' '
+		Log::info() << ' ' << mapping_mode_str(e->GetMappingMode()) << ' '
 			<< reference_mode_str(e->GetReferenceMode());
 	}
-	cout << endl;
+	Log::info() << endl;
 
-	cout << "  Tangent elements: " << mesh->GetElementTangentCount();
+	Log::info() << "  Tangent elements: " << mesh->GetElementTangentCount();
 	if (mesh->GetElementTangentCount() > 0) {
 		auto e = mesh->GetElementTangent(0);
-		cout << ' ' << mapping_mode_str(e->GetMappingMode()) << ' '
+		Log::info() << ' ' << mapping_mode_str(e->GetMappingMode()) << ' '
 			<< reference_mode_str(e->GetReferenceMode());
 	}
-	cout << endl;
+	Log::info() << endl;
 
-	cout << "  Binormal elements: " << mesh->GetElementBinormalCount();
+	Log::info() << "  Binormal elements: " << mesh->GetElementBinormalCount();
 	if (mesh->GetElementBinormalCount() > 0) {
 		auto e = mesh->GetElementBinormal(0);
-		cout << ' ' << mapping_mode_str(e->GetMappingMode()) << ' '
+		Log::info() << ' ' << mapping_mode_str(e->GetMappingMode()) << ' '
 			<< reference_mode_str(e->GetReferenceMode());
 	}
-	cout << endl;
+	Log::info() << endl;
 
-	cout << "  Vertices: " << mesh->GetControlPointsCount() << endl;
-	cout << "  Polygons: " << mesh->GetPolygonCount() << endl;
+	Log::info() << "  Vertices: " << mesh->GetControlPointsCount() << endl;
+	Log::info() << "  Polygons: " << mesh->GetPolygonCount() << endl;
 }
 
 bool validate_rigid_mesh(FbxMesh* mesh)
@@ -1114,7 +1131,7 @@ void import_rigid_mesh(MDB_file& mdb, FbxNode* node)
 	if (!mesh)
 		return;
 
-	cout << "Importing RIGD: " << node->GetName() << endl;
+	Log::info() << "Importing RIGD: " << node->GetName() << endl;
 
 	print_mesh(mesh);
 
@@ -1158,7 +1175,7 @@ FbxNode* skeleton_node(FbxMesh* mesh)
 	return skeleton_node(cluster->GetLink());
 }
 
-void import_polygon(MDB_file::Skin& skin, Fbx_bones& fbx_bones, FbxMesh* mesh,
+void import_polygon(MDB_file::Skin& skin, Skin_bones& skin_bones, FbxMesh* mesh,
 	int polygon_index)
 {
 	if (mesh->GetPolygonSize(polygon_index) != 3) {
@@ -1172,7 +1189,7 @@ void import_polygon(MDB_file::Skin& skin, Fbx_bones& fbx_bones, FbxMesh* mesh,
 	import_tangents(mesh, polygon_index, poly_vertices);
 	import_binormals(mesh, polygon_index, poly_vertices);
 	import_uv(mesh, polygon_index, poly_vertices);
-	import_skinning(mesh, polygon_index, fbx_bones, poly_vertices);
+	import_skinning(mesh, polygon_index, skin_bones, poly_vertices);
 
 	MDB_file::Face face;
 
@@ -1183,36 +1200,20 @@ void import_polygon(MDB_file::Skin& skin, Fbx_bones& fbx_bones, FbxMesh* mesh,
 	skin.faces.push_back(face);
 }
 
-void gather_fbx_bones(FbxNode* node, Fbx_bones& fbx_bones)
+void gather_fbx_bones(FbxNode* node, Skin_bones& skin_bones)
 {
-	fbx_bones.bones.push_back(node);
-
-	if (strncmp(node->GetName(), "ap_", 3) == 0) {
-		// Discard "ap_..." bones as they are not used in skinning.		
-	}
-	else if (strncmp(node->GetName(), "f_", 2) == 0) {
-		fbx_bones.face_bones.push_back(node);
-	}
-	else if (strcmp(node->GetName(), "Ribcage") == 0) {		
-		fbx_bones.ribcage = node;		
-	}
-	else {
-		fbx_bones.body_bones.push_back(node);
-	}
+	add_skin_bone(skin_bones, node->GetName());
 
 	for (int i = 0; i < node->GetChildCount(); ++i)
-		gather_fbx_bones(node->GetChild(i), fbx_bones);
+		gather_fbx_bones(node->GetChild(i), skin_bones);
 }
 
 void print_vertices(MDB_file::Skin& skin)
 {
 	for (auto& v : skin.verts) {
-		cout << "  Vertex weights:";
-
-		for (int i = 0; i < 4; ++i)
-			cout << ' ' << v.bone_weights[i];
-
-		cout << '\n';
+		LOG_TRACE << "  Vertex weights: " << v.bone_weights[0] << ' '
+		          << v.bone_weights[1] << ' ' << v.bone_weights[2] << ' '
+		          << v.bone_weights[3] << '\n';
 	}
 }
 
@@ -1223,7 +1224,7 @@ void import_skin(MDB_file& mdb, FbxNode* node)
 	if (!mesh)
 		return;
 
-	cout << "Importing SKIN: " << node->GetName() << endl;
+	Log::info() << "Importing SKIN: " << node->GetName() << endl;
 
 	print_mesh(mesh);
 
@@ -1233,17 +1234,17 @@ void import_skin(MDB_file& mdb, FbxNode* node)
 	auto skin = make_unique<MDB_file::Skin>();
 	set_packet_name(skin->header.name, node->GetName());
 	auto skel_node = skeleton_node(mesh);
-	cout << "  Skeleton name: " << skel_node->GetName() << endl;
+	Log::info() << "  Skeleton name: " << skel_node->GetName() << endl;
 
 	strncpy(skin->header.skeleton_name, skel_node->GetName(), 32);	
 
 	import_material(skin->header.material, mesh);
 
-	Fbx_bones fbx_bones;
-	gather_fbx_bones(skel_node->GetChild(0), fbx_bones);
+	Skin_bones skin_bones;
+	gather_fbx_bones(skel_node->GetChild(0), skin_bones);
 
 	for (int i = 0; i < mesh->GetPolygonCount(); ++i)
-		import_polygon(*skin.get(), fbx_bones, mesh, i);
+		import_polygon(*skin.get(), skin_bones, mesh, i);
 
 	import_user_properties(node, skin->header.material);
 
@@ -1280,34 +1281,6 @@ void import_meshes(MDB_file& mdb, FbxScene* scene)
 	import_meshes(mdb, scene->GetRootNode());
 }
 
-struct GR2_track_group_info {
-	GR2_track_group track_group;
-	std::vector<GR2_transform_track> transform_tracks;
-};
-
-struct GR2_import_info {
-	FbxAnimStack *anim_stack;
-	GR2_file_info file_info;
-	GR2_art_tool_info art_tool_info;
-	GR2_exporter_info exporter_info;
-	GR2_animation animation;
-	Virtual_ptr<GR2_animation> animations[1];
-	Vector3<double> bone_scaling;
-	std::list<GR2_skeleton> skeletons;
-	std::list<std::vector<GR2_bone>> bone_arrays;
-	std::vector<Virtual_ptr<GR2_skeleton>> skeleton_pointers;
-	std::list<GR2_model> models;
-	std::vector<Virtual_ptr<GR2_model>> model_pointers;
-	std::vector<GR2_track_group_info> track_groups;
-	std::list<GR2_curve_data_D3Constant32f> d3c_curves;
-	std::list<GR2_curve_data_DaConstant32f> dac_curves;
-	std::list<GR2_curve_data_DaK32fC32f> da_curves;
-	std::list<GR2_curve_data_DaIdentity> id_curves;
-	std::list<std::vector<float>> float_arrays;
-	String_collection strings;
-	std::vector<Virtual_ptr<GR2_track_group>> track_group_pointers;
-};
-
 void init_file_info(GR2_file_info& file_info)
 {
 	file_info.textures_count = 0;
@@ -1348,6 +1321,15 @@ void import_exporter_info(GR2_import_info& import_info)
 	import_info.file_info.exporter_info = &import_info.exporter_info;
 }
 
+void init_import_info(GR2_import_info& import_info, const Import_info& info)
+{
+	init_file_info(import_info.file_info);
+	import_art_tool_info(import_info);
+	import_exporter_info(import_info);
+	import_info.file_info.from_file_name =
+		import_info.strings.get(path(info.input_path).filename().string().c_str());
+}
+
 bool is_pivot_node(FbxNode* node)
 {
 	return ends_with(node->GetName(), ".PIVOT");
@@ -1425,26 +1407,29 @@ bool validate_skeleton(FbxNode* node)
 
 void print_bone(GR2_bone& bone)
 {
-	cout << "    Translation: " << bone.transform.translation.x;
-	cout << ' ' << bone.transform.translation.y;
-	cout << ' ' << bone.transform.translation.z << endl;
+	if (!Log::enabled(Log::LEVEL_DEBUG))
+		return;
 
-	cout << "    Rotation: " << bone.transform.rotation.x;
-	cout << ' ' << bone.transform.rotation.y;
-	cout << ' ' << bone.transform.rotation.z;
-	cout << ' ' << bone.transform.rotation.w << endl;
+	Log::debug() << "    Translation: " << bone.transform.translation.x
+	             << ' ' << bone.transform.translation.y
+	             << ' ' << bone.transform.translation.z << endl;
 
-	cout << "    Scale: " << bone.transform.scale_shear[0];
-	cout << ' ' << bone.transform.scale_shear[4];
-	cout << ' ' << bone.transform.scale_shear[8] << endl;
+	Log::debug() << "    Rotation: " << bone.transform.rotation.x
+	             << ' ' << bone.transform.rotation.y
+	             << ' ' << bone.transform.rotation.z
+	             << ' ' << bone.transform.rotation.w << endl;
 
-	cout << "    Inverse World Transform:\n";
+	Log::debug() << "    Scale: " << bone.transform.scale_shear[0]
+	             << ' ' << bone.transform.scale_shear[4]
+	             << ' ' << bone.transform.scale_shear[8] << endl;
+
+	Log::debug() << "    Inverse World Transform:\n";
 	for (int row = 0; row < 4; ++row) {
-		cout << "        ";
-		for (int col = 0; col < 4; ++col) {
-			cout << ' ' << bone.inverse_world_transform[col * 4 + row];
-		}
-		cout << endl;
+		auto line = Log::debug();
+		line << "        ";
+		for (int col = 0; col < 4; ++col)
+			line << ' ' << bone.inverse_world_transform[col * 4 + row];
+		line << endl;
 	}
 }
 
@@ -1506,7 +1491,7 @@ void import_bone_inv_world_transform(FbxNode* node, GR2_bone& bone)
 
 void import_bone(GR2_import_info& import_info, FbxNode* node, int32_t parent_index, std::vector<GR2_bone>& bones)
 {
-	cout << "  Importing bone: " << node->GetName() << endl;	
+	Log::debug() << "  Importing bone: " << node->GetName() << endl;	
 
 	auto translation = node->LclTranslation.Get();
 	translation[0] *= import_info.bone_scaling.x;
@@ -1561,7 +1546,7 @@ void import_model(GR2_import_info& import_info, GR2_skeleton* skel)
 
 void import_skeleton(GR2_import_info& import_info, FbxNode* node)
 {
-	cout << "Importing skeleton: " << node->GetName() << endl;
+	Log::info() << "Importing skeleton: " << node->GetName() << endl;
 
 	if (!validate_skeleton(node))
 		return;
@@ -1592,12 +1577,7 @@ void import_skeletons(FbxScene* scene, const Import_info& info)
 	Log::error_count = 0; // Reset error count
 
 	GR2_import_info import_info;
-
-	init_file_info(import_info.file_info);
-	import_art_tool_info(import_info);
-	import_exporter_info(import_info);
-	import_info.file_info.from_file_name =
-		import_info.strings.get(path(info.input_path).filename().string().c_str());
+	init_import_info(import_info, info);
 
 	for (int i = 0; i < scene->GetRootNode()->GetChildCount(); ++i) {
 		auto node = scene->GetRootNode()->GetChild(i);
@@ -1605,6 +1585,11 @@ void import_skeletons(FbxScene* scene, const Import_info& info)
 			import_skeleton(import_info, node);
 	}
 
+	save_skeletons(import_info, info);
+}
+
+void save_skeletons(GR2_import_info& import_info, const Import_info& info)
+{
 	if (import_info.skeletons.empty())
 		return;
 
@@ -1622,7 +1607,7 @@ void import_skeletons(FbxScene* scene, const Import_info& info)
 		gr2.read(&import_info.file_info);
 		string output_filename = string(info.output_path) + ".gr2";
 		gr2.write(output_filename.c_str());
-		cout << "\nOutput is " << output_filename << endl;
+		Log::info() << "\nOutput is " << output_filename << endl;
 	}
 }
 
@@ -1665,7 +1650,7 @@ GR2_track_group_info &track_group(GR2_import_info& import_info, const char *name
 void import_position_DaK32fC32f(GR2_import_info& import_info, FbxNode* node,
 	GR2_transform_track& tt)
 {
-	cout << "  Positions:\n";
+	Log::debug() << "  Positions:\n";
 
 	tt.position_curve.keys = DaK32fC32f_def;
 
@@ -1689,7 +1674,7 @@ void import_position_DaK32fC32f(GR2_import_info& import_info, FbxNode* node,
 		controls.push_back(float(p[1] * import_info.bone_scaling.y));
 		controls.push_back(float(p[2] * import_info.bone_scaling.z));
 
-		cout << "    " << knots.back() << ": " << p[0] << ' '
+		LOG_TRACE << "    " << knots.back() << ": " << p[0] << ' '
 			<< p[1] << ' ' << p[2] << endl;
 
 		time += dt;
@@ -1732,7 +1717,7 @@ void import_position_anim(GR2_import_info& import_info, FbxNode* node,
 void import_rotation_anim(GR2_import_info& import_info, FbxNode* node,
 	FbxAnimLayer* layer, GR2_transform_track& tt)
 {
-	cout << "  Rotations:\n";
+	Log::debug() << "  Rotations:\n";
 
 	tt.orientation_curve.keys = DaK32fC32f_def;
 
@@ -1768,9 +1753,9 @@ void import_rotation_anim(GR2_import_info& import_info, FbxNode* node,
 		controls.push_back(float(quat[3]));
 		prev_quat = quat;
 
-		cout << "    " << knots.back() << ": ";
-		cout << '[' << p[0] << ' ' << p[1] << ' ' << p[2] << "] "<< quat[0] << ' '
-		     << quat[1] << ' ' << quat[2] << ' ' << quat[3] << endl;
+		LOG_TRACE << "    " << knots.back() << ": [" << p[0] << ' ' << p[1]
+		          << ' ' << p[2] << "] " << quat[0] << ' ' << quat[1] << ' '
+		          << quat[2] << ' ' << quat[3] << endl;
 
 		time += dt;
 	}
@@ -1786,7 +1771,7 @@ void import_rotation_anim(GR2_import_info& import_info, FbxNode* node,
 void import_scaleshear_DaK32fC32f(GR2_import_info& import_info, FbxNode* node,
 	GR2_transform_track& tt)
 {
-	cout << "  Scaling:\n";
+	Log::debug() << "  Scaling:\n";
 
 	auto& knots = import_info.float_arrays.emplace_back();
 	auto& controls = import_info.float_arrays.emplace_back();
@@ -1810,7 +1795,7 @@ void import_scaleshear_DaK32fC32f(GR2_import_info& import_info, FbxNode* node,
 		controls.push_back(0);
 		controls.push_back(float(s[2]));
 
-		cout << "    " << knots.back() << ": " << s[0] << ' '
+		LOG_TRACE << "    " << knots.back() << ": " << s[0] << ' '
 			<< s[1] << ' ' << s[2] << endl;
 
 		time += dt;		
@@ -1879,7 +1864,7 @@ void import_scaleshear(GR2_import_info& import_info, FbxNode* node,
 void import_anim_layer(GR2_import_info& import_info, FbxAnimLayer* layer,
                        FbxNode* node)
 {
-	cout << "Importing animation: " << node->GetName() << endl;
+	Log::info() << "Importing animation: " << node->GetName() << endl;
 	
 	auto skel_node = skeleton_node(node);
 
@@ -1904,8 +1889,8 @@ void import_anim_layer(GR2_import_info& import_info, FbxAnimLayer* layer,
 
 void import_anim_layer(GR2_import_info& import_info, FbxAnimLayer* layer)
 {
-	cout << "    - Name: " << layer->GetName() << endl;
-	cout << "      Animation curve nodes: " << layer->GetMemberCount<FbxAnimCurveNode>() << endl;
+	Log::info() << "    - Name: " << layer->GetName() << endl;
+	Log::info() << "      Animation curve nodes: " << layer->GetMemberCount<FbxAnimCurveNode>() << endl;
 
 	import_anim_layer(import_info, layer, layer->GetScene()->GetRootNode());
 }
@@ -1917,19 +1902,22 @@ void import_animation(FbxAnimStack *stack, const Import_info& info)
 	GR2_import_info import_info;
 
 	import_info.anim_stack = stack;
+	init_import_info(import_info, info);
 
-	init_file_info(import_info.file_info);
-	import_art_tool_info(import_info);
-	import_exporter_info(import_info);
-	import_info.file_info.from_file_name =
-		import_info.strings.get(path(info.input_path).filename().string().c_str());
-
-	cout << "  Animation layers: " << stack->GetMemberCount<FbxAnimLayer>() << endl;
+	Log::info() << "  Animation layers: " << stack->GetMemberCount<FbxAnimLayer>() << endl;
 	for(int i = 0; i < stack->GetMemberCount<FbxAnimLayer>(); ++i) {
 		import_anim_layer(import_info,
 		                  stack->GetMember<FbxAnimLayer>(i));
 	}
 
+	save_animation(import_info, stack->GetName(),
+	    float(stack->LocalStop.Get().GetSecondDouble() -
+	    stack->LocalStart.Get().GetSecondDouble()), info);
+}
+
+void save_animation(GR2_import_info& import_info, const char* name,
+	float duration, const Import_info& info)
+{
 	for(auto &tg : import_info.track_groups) {
 		// GR2 animation requires transform tracks sorted by name.
 		sort(tg.transform_tracks.begin(), tg.transform_tracks.end(), 
@@ -1944,10 +1932,8 @@ void import_animation(FbxAnimStack *stack, const Import_info& info)
 	import_info.file_info.track_groups_count = import_info.track_group_pointers.size();
 	import_info.file_info.track_groups = import_info.track_group_pointers.data();
 
-	import_info.animation.name = import_info.strings.get(stack->GetName());
-	import_info.animation.duration =
-	    float(import_info.anim_stack->LocalStop.Get().GetSecondDouble() -
-	    import_info.anim_stack->LocalStart.Get().GetSecondDouble());
+	import_info.animation.name = import_info.strings.get(name);
+	import_info.animation.duration = duration;
 	import_info.animation.time_step = float(time_step);
 	import_info.animation.oversampling = 1;
 	import_info.animation.track_groups_count = import_info.track_group_pointers.size();
@@ -1969,13 +1955,13 @@ void import_animation(FbxAnimStack *stack, const Import_info& info)
 		gr2.read(&import_info.file_info);
 		string output_filename = string(info.output_path) + ".gr2";
 		gr2.write(output_filename.c_str());
-		cout << "\nOutput is " << output_filename << endl;
+		Log::info() << "\nOutput is " << output_filename << endl;
 	}
 }
 
 void import_animations(FbxScene* scene, const Import_info& import_info)
 {
-	cout << "\nAnimation stacks: " << scene->GetSrcObjectCount<FbxAnimStack>() << endl;
+	Log::info() << "\nAnimation stacks: " << scene->GetSrcObjectCount<FbxAnimStack>() << endl;
 	for(int i = 0; i < scene->GetSrcObjectCount<FbxAnimStack>(); ++i)
 		import_animation(scene->GetSrcObject<FbxAnimStack>(i), import_info);
 }
@@ -2038,7 +2024,7 @@ float sphere_radius(FbxNode *node)
 
 void import_collision_sphere(MDB_file::Collision_spheres& cs, FbxNode* node, const std::vector<Bone_info>& bone_infos)
 {
-	cout << "Importing COLS: " << node->GetName() << endl;	
+	Log::info() << "Importing COLS: " << node->GetName() << endl;	
 
 	MDB_file::Collision_sphere s;
 	s.bone_index = nearest_bone_index(bone_infos, node->EvaluateGlobalTransform().GetT());
@@ -2071,7 +2057,79 @@ void import_collision_spheres(MDB_file& mdb, FbxScene* scene)
 		mdb.add_packet(move(cs));
 }
 
-void import_models(FbxScene* scene, const char* filename)
+static void print_vertex_cache_stats(const Vertex_cache_stats& before,
+                                     const Vertex_cache_stats& after)
+{
+	Log::info() << "  ACMR: " << before.acmr << " -> " << after.acmr << endl;
+	Log::info() << "  ATVR: " << before.atvr << " -> " << after.atvr << endl;
+}
+
+template <typename T>
+static void optimize_mesh_packet(T& mesh)
+{
+	Log::info() << "Optimizing " << mesh.type_str() << ": "
+	            << string(mesh.header.name, 32).c_str() << endl;
+
+	auto before = vertex_cache_stats(mesh.faces, mesh.verts.size());
+	optimize_mesh(mesh);
+	auto after = vertex_cache_stats(mesh.faces, mesh.verts.size());
+
+	print_vertex_cache_stats(before, after);
+}
+
+static void optimize_meshes(MDB_file& mdb)
+{
+	for (uint32_t i = 0; i < mdb.packet_count(); ++i) {
+		auto packet = mdb.packet(i);
+
+		if (!packet)
+			continue;
+
+		if (packet->type == MDB_file::RIGD)
+			optimize_mesh_packet(
+			    *static_cast<MDB_file::Rigid_mesh*>(packet));
+		else if (packet->type == MDB_file::SKIN)
+			optimize_mesh_packet(*static_cast<MDB_file::Skin*>(packet));
+	}
+}
+
+static uint32_t face_count(const MDB_file& mdb)
+{
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < mdb.packet_count(); ++i) {
+		auto packet = mdb.packet(i);
+
+		if (!packet)
+			continue;
+
+		if (packet->type == MDB_file::RIGD)
+			count += static_cast<MDB_file::Rigid_mesh*>(packet)->faces.size();
+		else if (packet->type == MDB_file::SKIN)
+			count += static_cast<MDB_file::Skin*>(packet)->faces.size();
+	}
+
+	return count;
+}
+
+static void generate_lod(MDB_file& mdb, const Import_info& import_info)
+{
+	Log::info() << "\nGenerating LOD\n";
+
+	auto faces_before = face_count(mdb);
+	simplify_meshes(mdb, import_info.lod_options);
+	Log::info() << "  Faces: " << faces_before << " -> " << face_count(mdb)
+	            << endl;
+
+	if (import_info.optimize_meshes)
+		optimize_meshes(mdb);
+
+	string output_filename = import_info.output_path + "_lod.mdb";
+	mdb.save(output_filename.c_str());
+	Log::info() << "\nOutput is " << output_filename << endl;
+}
+
+void import_models(FbxScene* scene, const Import_info& import_info)
 {
 	Log::error_count = 0; // Reset error count
 
@@ -2080,13 +2138,24 @@ void import_models(FbxScene* scene, const char* filename)
 	import_meshes(mdb, scene);
 	import_collision_spheres(mdb, scene);
 
+	save_models(mdb, import_info);
+}
+
+void save_models(MDB_file& mdb, const Import_info& import_info)
+{
 	if (Log::error_count > 0) {
 		Log::error() << "MDB not generated due to errors found during the conversion.\n";
 	}
 	else if (mdb.packet_count() > 0) {
-		string output_filename = string(filename) + ".mdb";
+		if (import_info.optimize_meshes)
+			optimize_meshes(mdb);
+
+		string output_filename = import_info.output_path + ".mdb";
 		mdb.save(output_filename.c_str());
-		cout << "\nOutput is " << output_filename << endl;
+		Log::info() << "\nOutput is " << output_filename << endl;
+
+		if (import_info.generate_lod)
+			generate_lod(mdb, import_info);
 	}
 }
 
@@ -2094,7 +2163,7 @@ void import_scene(FbxScene* scene, const Import_info& import_info)
 {
 	if (import_info.output_type == Output_type::mdb ||
 	    import_info.output_type == Output_type::any)
-		import_models(scene, import_info.output_path.c_str());
+		import_models(scene, import_info);
 
 	if (import_info.output_type == Output_type::mdb)
 		return;
@@ -2105,12 +2174,12 @@ void import_scene(FbxScene* scene, const Import_info& import_info)
 		import_animations(scene, import_info);
 }
 
-bool import_fbx(const Import_info& import_info)
+static FbxManager* create_manager()
 {
 	auto manager = FbxManager::Create();
 	if (!manager) {
 		Log::error() << "Unable to create FBX manager\n";
-		return false;
+		return nullptr;
 	}
 
 	// Create an IOSettings object. This object holds all import/export
@@ -2118,11 +2187,17 @@ bool import_fbx(const Import_info& import_info)
 	auto ios = FbxIOSettings::Create(manager, IOSROOT);
 	manager->SetIOSettings(ios);
 
+	return manager;
+}
+
+bool import_fbx(FbxManager* manager, const Import_info& import_info)
+{
 	// Create an importer.
 	auto importer = FbxImporter::Create(manager, "");
 	if (!importer->Initialize(import_info.input_path.c_str(), -1,
 	                          manager->GetIOSettings())) {
 		Log::error() << importer->GetStatus().GetErrorString() << endl;
+		importer->Destroy();
 		return false;
 	}
 
@@ -2137,12 +2212,45 @@ bool import_fbx(const Import_info& import_info)
 
 	import_scene(scene, import_info);
 
-	// Destroy the sdk manager and all other objects it was handling.
-	manager->Destroy();
+	scene->Destroy();
 
 	return true;
 }
 
+// Converts a file. The FBX manager is created by the first FBX file, and
+// reused by the following jobs of a server.
+static bool run_job(FbxManager*& manager, int argc, char* argv[])
+{
+	Import_info import_info;
+
+	if (!parse_args(argc, argv, import_info))
+		return false;
+
+	// glTF files are imported without the FBX SDK
+	string ext = path(import_info.input_path).extension().string();
+	if (stricmp(ext.c_str(), ".glb") == 0 || stricmp(ext.c_str(), ".gltf") == 0)
+		return import_glb(import_info);
+
+	if (!manager)
+		manager = create_manager();
+
+	return manager && import_fbx(manager, import_info);
+}
+
+// Runs the jobs requested through a local socket (a named pipe on Windows)
+// until a client requests "-shutdown". Used by the Blender addon to avoid
+// starting a process for each export.
+static int run_server(FbxManager*& manager, const char* name)
+{
+	return serve_jobs(name, [&](vector<string>& args) {
+		vector<char*> argv = { (char*)"fbx2nw" };
+		for (auto& arg : args)
+			argv.push_back(arg.data());
+
+		return run_job(manager, int(argv.size()), argv.data());
+	});
+}
+
 int main(int argc, char* argv[])
 {
 	Redirect_output_handle redirect_output_handle;
@@ -2155,17 +2263,32 @@ int main(int argc, char* argv[])
 	GR2_file::granny2dll_filename = config.nwn2_home + "\\granny2.dll";
 
 	if(argc < 2) {
-		cout << "Usage: fbx2nw <file>\n";
+		Log::info() << "Usage: fbx2nw <file.fbx|file.glb|file.gltf> [-o <output>] [-optimize] "
+		               "[-lod <ratio>] [-lod-error <error>] [-v]\n";
+		Log::info() << "       fbx2nw -server <socket|pipe name> [-v]\n";
 		return 1;
 	}
 
-	Import_info import_info;
+	FbxManager* manager = nullptr;
+	int ret = 0;
 
-	if (!parse_args(argc, argv, import_info))
+	if (strcmp(argv[1], "-server") == 0) {
+		if (argc < 3) {
+			Log::info() << "Usage: fbx2nw -server <socket|pipe name>\n";
 			return 1;
+		}
+		for (int i = 3; i < argc; ++i) {
+			if (strcmp(argv[i], "-v") == 0)
+				Log::set_level(Log::Level(Log::level + 1));
+		}
+		ret = run_server(manager, argv[2]);
+	}
+	else if (!run_job(manager, argc, argv))
+		ret = 1;
 
-	if (!import_fbx(import_info))
-		return 1;	
+	// Destroy the sdk manager and all other objects it was handling.
+	if (manager)
+		manager->Destroy();
 
-	return 0;
+	return ret;
 }
@@ -0,0 +1,1794 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <string.h>
+
+#include "glb_view.h"
+#include "import_glb.h"
+#include "import_info.h"
+#include "log.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+using Json_value = GLB_view::Json_value;
+using Accessor_view = GLB_view::Accessor_view;
+
+// Column-major 4x4 affine transform, as in glTF
+struct Matrix {
+	double m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+	double operator()(int row, int col) const { return m[col * 4 + row]; }
+	double& operator()(int row, int col) { return m[col * 4 + row]; }
+};
+
+static Matrix operator*(const Matrix& a, const Matrix& b)
+{
+	Matrix r;
+	for (int row = 0; row < 4; ++row) {
+		for (int col = 0; col < 4; ++col) {
+			double s = 0;
+			for (int i = 0; i < 4; ++i)
+				s += a(row, i) * b(i, col);
+			r(row, col) = s;
+		}
+	}
+
+	return r;
+}
+
+static double determinant(const Matrix& a)
+{
+	return a(0, 0) * (a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1))
+		+ a(0, 1) * (a(1, 2) * a(2, 0) - a(1, 0) * a(2, 2))
+		+ a(0, 2) * (a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0));
+}
+
+// Inverse of an affine transform. Singular transforms are returned as they
+// are.
+static Matrix inverse(const Matrix& a)
+{
+	double det = determinant(a);
+	if (det == 0)
+		return a;
+
+	double d = 1 / det;
+	Matrix r;
+	r(0, 0) = (a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1)) * d;
+	r(0, 1) = (a(0, 2) * a(2, 1) - a(0, 1) * a(2, 2)) * d;
+	r(0, 2) = (a(0, 1) * a(1, 2) - a(0, 2) * a(1, 1)) * d;
+	r(1, 0) = (a(1, 2) * a(2, 0) - a(1, 0) * a(2, 2)) * d;
+	r(1, 1) = (a(0, 0) * a(2, 2) - a(0, 2) * a(2, 0)) * d;
+	r(1, 2) = (a(0, 2) * a(1, 0) - a(0, 0) * a(1, 2)) * d;
+	r(2, 0) = (a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0)) * d;
+	r(2, 1) = (a(0, 1) * a(2, 0) - a(0, 0) * a(2, 1)) * d;
+	r(2, 2) = (a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0)) * d;
+	for (int row = 0; row < 3; ++row)
+		r(row, 3) = -(r(row, 0) * a(0, 3) + r(row, 1) * a(1, 3)
+			+ r(row, 2) * a(2, 3));
+
+	return r;
+}
+
+static Matrix trs_matrix(const double t[3], const double q[4],
+	const double s[3])
+{
+	double x = q[0], y = q[1], z = q[2], w = q[3];
+
+	Matrix r;
+	r(0, 0) = (1 - 2 * (y * y + z * z)) * s[0];
+	r(1, 0) = 2 * (x * y + z * w) * s[0];
+	r(2, 0) = 2 * (x * z - y * w) * s[0];
+	r(0, 1) = 2 * (x * y - z * w) * s[1];
+	r(1, 1) = (1 - 2 * (x * x + z * z)) * s[1];
+	r(2, 1) = 2 * (y * z + x * w) * s[1];
+	r(0, 2) = 2 * (x * z + y * w) * s[2];
+	r(1, 2) = 2 * (y * z - x * w) * s[2];
+	r(2, 2) = (1 - 2 * (x * x + y * y)) * s[2];
+	r(0, 3) = t[0];
+	r(1, 3) = t[1];
+	r(2, 3) = t[2];
+
+	return r;
+}
+
+// Quaternion (x, y, z, w) of a rotation matrix
+static void rotation_to_quaternion(const double r[3][3], double q[4])
+{
+	double trace = r[0][0] + r[1][1] + r[2][2];
+
+	if (trace > 0) {
+		double s = sqrt(trace + 1) * 2;
+		q[0] = (r[2][1] - r[1][2]) / s;
+		q[1] = (r[0][2] - r[2][0]) / s;
+		q[2] = (r[1][0] - r[0][1]) / s;
+		q[3] = s / 4;
+	}
+	else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+		double s = sqrt(1 + r[0][0] - r[1][1] - r[2][2]) * 2;
+		q[0] = s / 4;
+		q[1] = (r[0][1] + r[1][0]) / s;
+		q[2] = (r[0][2] + r[2][0]) / s;
+		q[3] = (r[2][1] - r[1][2]) / s;
+	}
+	else if (r[1][1] > r[2][2]) {
+		double s = sqrt(1 + r[1][1] - r[0][0] - r[2][2]) * 2;
+		q[0] = (r[0][1] + r[1][0]) / s;
+		q[1] = s / 4;
+		q[2] = (r[1][2] + r[2][1]) / s;
+		q[3] = (r[0][2] - r[2][0]) / s;
+	}
+	else {
+		double s = sqrt(1 + r[2][2] - r[0][0] - r[1][1]) * 2;
+		q[0] = (r[0][2] + r[2][0]) / s;
+		q[1] = (r[1][2] + r[2][1]) / s;
+		q[2] = s / 4;
+		q[3] = (r[1][0] - r[0][1]) / s;
+	}
+}
+
+// From glTF's Y-up to NWN2's Z-up. It undoes the rotation of the Z-up nodes
+// written by nw2fbx.
+static Matrix z_up_matrix()
+{
+	Matrix r;
+	r(1, 1) = 0;
+	r(1, 2) = -1;
+	r(2, 1) = 1;
+	r(2, 2) = 0;
+
+	return r;
+}
+
+static Vector3<float> sub(const Vector3<float>& a, const Vector3<float>& b)
+{
+	return Vector3<float>(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static Vector3<float> mul(const Vector3<float>& v, float s)
+{
+	return Vector3<float>(v.x * s, v.y * s, v.z * s);
+}
+
+static float dot(const Vector3<float>& a, const Vector3<float>& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vector3<float> cross(const Vector3<float>& a, const Vector3<float>& b)
+{
+	return Vector3<float>(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+		a.x * b.y - a.y * b.x);
+}
+
+static Vector3<float> normalized(const Vector3<float>& v)
+{
+	float length = sqrt(dot(v, v));
+	return length > 0 ? mul(v, 1 / length) : v;
+}
+
+// Node names are UTF-8 in glTF, and Latin-1 in MDB and GR2 files.
+// Characters out of Latin-1 are replaced by '_'.
+static string latin1(const string& s)
+{
+	string r;
+
+	for (size_t i = 0; i < s.size(); ++i) {
+		auto c = (unsigned char)s[i];
+		if (c < 0x80) {
+			r += char(c);
+		}
+		else if ((c & 0xE0) == 0xC0 && i + 1 < s.size()) {
+			unsigned code = ((c & 0x1F) << 6) | (s[i + 1] & 0x3F);
+			r += code < 0x100 ? char(code) : '_';
+			++i;
+		}
+		else if ((c & 0xC0) == 0xC0) {
+			// Longer sequences are out of Latin-1
+			r += '_';
+			while (i + 1 < s.size() && (s[i + 1] & 0xC0) == 0x80)
+				++i;
+		}
+	}
+
+	return r;
+}
+
+struct Node {
+	string name;
+	int parent = -1;
+	vector<int> children;
+	int mesh = -1;
+	int skin = -1;
+	double translation[3] = { 0, 0, 0 };
+	double rotation[4] = { 0, 0, 0, 1 };
+	double scale[3] = { 1, 1, 1 };
+	Matrix world;
+	const Json_value* extras = nullptr;
+	bool is_bone = false;
+};
+
+struct Scene {
+	const GLB_view& glb;
+	const Json_value& json;
+	vector<Node> nodes;
+	// Top-level nodes of the scene, as the children of the root node of a
+	// FBX scene
+	vector<int> roots;
+
+	Scene(const GLB_view& glb) : glb(glb), json(glb.json()) {}
+};
+
+static void read_transform(const Json_value& value, Node& node)
+{
+	auto& matrix = value["matrix"];
+
+	if (matrix.size() == 16) {
+		Matrix m;
+		for (int i = 0; i < 16; ++i)
+			m.m[i] = matrix[i].get(0);
+
+		double r[3][3];
+		for (int col = 0; col < 3; ++col) {
+			node.translation[col] = m(col, 3);
+			node.scale[col] = sqrt(m(0, col) * m(0, col)
+				+ m(1, col) * m(1, col) + m(2, col) * m(2, col));
+		}
+		if (determinant(m) < 0)
+			node.scale[0] = -node.scale[0];
+		for (int row = 0; row < 3; ++row)
+			for (int col = 0; col < 3; ++col)
+				r[row][col] = node.scale[col] != 0 ?
+					m(row, col) / node.scale[col] : 0;
+		rotation_to_quaternion(r, node.rotation);
+		return;
+	}
+
+	auto& t = value["translation"];
+	auto& r = value["rotation"];
+	auto& s = value["scale"];
+	for (int i = 0; i < 3; ++i) {
+		node.translation[i] = t[i].get(0);
+		node.scale[i] = s[i].get(1);
+	}
+	for (int i = 0; i < 4; ++i)
+		node.rotation[i] = r[i].get(i == 3 ? 1 : 0);
+}
+
+static void compute_world_transforms(Scene& scene, int node,
+	const Matrix& parent_world)
+{
+	auto& n = scene.nodes[node];
+	n.world = parent_world * trs_matrix(n.translation, n.rotation, n.scale);
+
+	for (int child : n.children)
+		compute_world_transforms(scene, child, n.world);
+}
+
+static void mark_bones(Scene& scene, int node)
+{
+	auto& n = scene.nodes[node];
+	if (n.mesh >= 0)
+		return;
+
+	n.is_bone = true;
+	for (int child : n.children)
+		mark_bones(scene, child);
+}
+
+// The bones are the joints of the skins, and the nodes without meshes under
+// the top-level nodes whose first child has their name (the skeletons
+// written by nw2fbx).
+static void mark_bones(Scene& scene)
+{
+	auto& skins = scene.json["skins"];
+	for (size_t i = 0; i < skins.size(); ++i) {
+		auto& joints = skins[i]["joints"];
+		for (size_t j = 0; j < joints.size(); ++j) {
+			int joint = joints[j].get_int();
+			if (joint >= 0 && joint < int(scene.nodes.size()))
+				scene.nodes[joint].is_bone = true;
+		}
+	}
+
+	for (int root : scene.roots) {
+		auto& n = scene.nodes[root];
+		if (!n.children.empty() &&
+		    scene.nodes[n.children[0]].name == n.name)
+			mark_bones(scene, n.children[0]);
+	}
+}
+
+static bool read_scene(Scene& scene)
+{
+	auto& nodes = scene.json["nodes"];
+	scene.nodes.resize(nodes.size());
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		auto& n = scene.nodes[i];
+		n.name = latin1(nodes[i]["name"].str);
+		n.mesh = nodes[i]["mesh"].get_int();
+		n.skin = nodes[i]["skin"].get_int();
+		n.extras = &nodes[i]["extras"];
+		read_transform(nodes[i], n);
+	}
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		auto& children = nodes[i]["children"];
+		for (size_t j = 0; j < children.size(); ++j) {
+			int child = children[j].get_int();
+			if (child < 0 || child >= int(nodes.size()) ||
+			    scene.nodes[child].parent >= 0 || child == int(i)) {
+				Log::error() << "Invalid node hierarchy.\n";
+				return false;
+			}
+			scene.nodes[child].parent = int(i);
+			scene.nodes[i].children.push_back(child);
+		}
+	}
+
+	auto& scene_nodes = scene.json["scenes"]
+		[scene.json["scene"].get_int(0)]["nodes"];
+	if (scene_nodes) {
+		for (size_t i = 0; i < scene_nodes.size(); ++i) {
+			int node = scene_nodes[i].get_int();
+			if (node >= 0 && node < int(nodes.size()) &&
+			    scene.nodes[node].parent < 0)
+				scene.roots.push_back(node);
+		}
+	}
+	else {
+		for (size_t i = 0; i < nodes.size(); ++i)
+			if (scene.nodes[i].parent < 0)
+				scene.roots.push_back(int(i));
+	}
+
+	// Every node has one parent at most, so the hierarchy is a forest
+	// unless a node is its own ancestor.
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		int node = int(i);
+		for (size_t depth = 0; node >= 0; ++depth) {
+			if (depth > nodes.size()) {
+				Log::error() << "Invalid node hierarchy.\n";
+				return false;
+			}
+			node = scene.nodes[node].parent;
+		}
+	}
+
+	for (int root : scene.roots)
+		compute_world_transforms(scene, root, Matrix());
+
+	mark_bones(scene);
+
+	return true;
+}
+
+// Returns the top-level ancestor of a node, or -1 for top-level nodes. See
+// skeleton_node in fbx2nw.cpp.
+static int skeleton_node(const Scene& scene, int node)
+{
+	if (node < 0 || scene.nodes[node].parent < 0)
+		return -1;
+
+	while (scene.nodes[node].parent >= 0)
+		node = scene.nodes[node].parent;
+
+	return node;
+}
+
+// Returns a user property of a node. nw2fbx writes them in the extras of the
+// nodes, and Blender the custom properties of the objects.
+static const Json_value& property(const Node& node, const char* name)
+{
+	auto& p = (*node.extras)[(string("NWN2MDK_") + name).c_str()];
+	return p ? p : (*node.extras)[name];
+}
+
+static bool property_flag(const Node& node, const char* name)
+{
+	auto& p = property(node, name);
+	if (p.type == Json_value::JSON_STRING)
+		return !p.str.empty() && p.str != "0";
+
+	return p.number != 0;
+}
+
+static void set_vector(Vector3<float>& v, const Json_value& value)
+{
+	v.x = float(value[0].get(v.x));
+	v.y = float(value[1].get(v.y));
+	v.z = float(value[2].get(v.z));
+}
+
+// The mapped file of a DDS image is the stem of its URI, or its name if it's
+// in a buffer.
+static string image_name(const Scene& scene, const Json_value& texture_info)
+{
+	if (!texture_info)
+		return "";
+
+	auto& texture = scene.json["textures"]
+		[texture_info["index"].get_int()];
+	int source = texture["extensions"]["MSFT_texture_dds"]["source"]
+		.get_int(texture["source"].get_int());
+	auto& image = scene.json["images"][source];
+
+	if (image["uri"])
+		return latin1(path(image["uri"].str).stem().string());
+
+	return latin1(image["name"].str);
+}
+
+static void import_map(char* map_name, const Scene& scene,
+	const Json_value& texture_info)
+{
+	auto name = image_name(scene, texture_info);
+	if (!name.empty())
+		set_map_name(map_name, name.c_str());
+}
+
+static void import_map(char* map_name, const Node& node,
+	const char* property_name)
+{
+	auto& p = property(node, property_name);
+	if (p.type != Json_value::JSON_STRING)
+		return;
+
+	string s = latin1(p.str);
+	s.erase(0, s.find_first_not_of(' '));
+	s.erase(s.find_last_not_of(' ') + 1);
+	set_map_name(map_name, s.c_str());
+}
+
+static void import_user_properties(const Node& node,
+	MDB_file::Material& material)
+{
+	static const pair<const char*, uint32_t> flags[] = {
+		{ "TRANSPARENCY_MASK", MDB_file::ALPHA_TEST },
+		{ "ENVIRONMENT_MAP", MDB_file::ENVIRONMENT_MAPPING },
+		{ "HEAD", MDB_file::CUTSCENE_MESH },
+		{ "GLOW", MDB_file::GLOW },
+		{ "DONT_CAST_SHADOWS", MDB_file::CAST_NO_SHADOWS },
+		{ "PROJECTED_TEXTURES", MDB_file::PROJECTED_TEXTURES }
+	};
+
+	for (auto& flag : flags)
+		if (property(node, flag.first))
+			material.flags |= property_flag(node, flag.first) ?
+				flag.second : 0;
+}
+
+// The material of the first primitive, with the user properties of the node
+// taking precedence over it as the ones of the FBX nodes.
+static void import_material(MDB_file::Material& material,
+	const Scene& scene, const Node& node, const Json_value& mesh)
+{
+	auto& m = scene.json["materials"]
+		[mesh["primitives"][0]["material"].get_int()];
+	auto& pbr = m["pbrMetallicRoughness"];
+
+	import_map(material.diffuse_map_name, scene, pbr["baseColorTexture"]);
+	import_map(material.normal_map_name, scene, m["normalTexture"]);
+	import_map(material.tint_map_name, node, "TINT_MAP");
+	import_map(material.glow_map_name, scene, m["emissiveTexture"]);
+
+	auto& diffuse = property(node, "DIFFUSE_COLOR");
+	set_vector(material.diffuse_color,
+		diffuse ? diffuse : pbr["baseColorFactor"]);
+	set_vector(material.specular_color, property(node, "SPECULAR_COLOR"));
+	material.specular_level =
+		float(property(node, "SPECULAR_LEVEL").get(material.specular_level));
+	material.specular_power =
+		float(property(node, "GLOSSINESS").get(material.specular_power));
+
+	import_user_properties(node, material);
+
+	// Alpha tested materials of other tools
+	if (!property(node, "TRANSPARENCY_MASK") && m["alphaMode"].str == "MASK")
+		material.flags |= MDB_file::ALPHA_TEST;
+}
+
+struct Primitive {
+	Accessor_view positions;
+	Accessor_view normals;
+	Accessor_view tangents;
+	Accessor_view uvs;
+	Accessor_view joints;
+	Accessor_view weights;
+	// Empty for non-indexed primitives
+	Accessor_view indices;
+	int material;
+};
+
+static bool read_primitive(const Scene& scene, const Json_value& json,
+	Primitive& p)
+{
+	if (json["mode"].get_int(4) != 4) {
+		Log::error() << "Primitive is not a triangle list.\n";
+		return false;
+	}
+
+	auto& attributes = json["attributes"];
+	auto attribute = [&](const char* name, uint32_t components) {
+		auto a = scene.glb.accessor(attributes[name].get_int());
+		if (a && (a.components < components ||
+		          a.count != p.positions.count)) {
+			Log::error() << "Invalid " << name << " accessor.\n";
+			return Accessor_view();
+		}
+		return a;
+	};
+
+	p.positions = scene.glb.accessor(attributes["POSITION"].get_int());
+	if (!p.positions || p.positions.components < 3) {
+		Log::error() << "Primitive has no positions.\n";
+		return false;
+	}
+
+	p.normals = attribute("NORMAL", 3);
+	p.tangents = attribute("TANGENT", 4);
+	p.uvs = attribute("TEXCOORD_0", 2);
+	p.joints = attribute("JOINTS_0", 4);
+	p.weights = attribute("WEIGHTS_0", 4);
+
+	if (json["indices"]) {
+		p.indices = scene.glb.accessor(json["indices"].get_int());
+		if (!p.indices) {
+			Log::error() << "Invalid primitive indices.\n";
+			return false;
+		}
+	}
+
+	// Weights beyond the fourth
+	auto weights = scene.glb.accessor(attributes["WEIGHTS_1"].get_int());
+	for (uint32_t i = 0; i < weights.count; ++i) {
+		for (uint32_t j = 0; j < weights.components; ++j) {
+			if (weights.get(i, j) != 0) {
+				Log::error() << "Vertex has more than 4 weights.\n";
+				return false;
+			}
+		}
+	}
+
+	p.material = json["material"].get_int();
+
+	return true;
+}
+
+// Transform of the vertices of a mesh to the MDB space: the world transform
+// of the node, with Z up. Skinned vertices are blended from the transforms
+// of their joints.
+class Vertex_transform {
+public:
+	explicit Vertex_transform(const Matrix& m)
+	{
+		set(m);
+	}
+
+	explicit Vertex_transform(const vector<Matrix>& joint_matrices)
+		: joint_matrices(&joint_matrices)
+	{
+	}
+
+	void set_vertex(const Primitive& p, uint32_t vertex)
+	{
+		if (!joint_matrices || !p.joints)
+			return;
+
+		Matrix m;
+		for (int i = 0; i < 16; ++i)
+			m.m[i] = 0;
+
+		float weight_sum = 0;
+		for (uint32_t i = 0; i < 4; ++i) {
+			float w = p.weights ? p.weights.get(vertex, i) : 0;
+			uint32_t joint = p.joints.get_uint(vertex, i);
+			if (w == 0 || joint >= joint_matrices->size())
+				continue;
+			for (int j = 0; j < 16; ++j)
+				m.m[j] += w * (*joint_matrices)[joint].m[j];
+			weight_sum += w;
+		}
+
+		if (weight_sum == 0)
+			m = (*joint_matrices)[0];
+		else
+			for (int j = 0; j < 16; ++j)
+				m.m[j] /= weight_sum;
+
+		set(m);
+	}
+
+	Vector3<float> point(const Accessor_view& a, uint32_t i) const
+	{
+		double v[3] = { a.get(i, 0), a.get(i, 1), a.get(i, 2) };
+		Vector3<float> r;
+		for (int row = 0; row < 3; ++row)
+			r[row] = float(matrix(row, 0) * v[0] + matrix(row, 1) * v[1]
+				+ matrix(row, 2) * v[2] + matrix(row, 3));
+		return r;
+	}
+
+	// Normals are transformed by the inverse transpose, so they stay
+	// perpendicular to scaled surfaces.
+	Vector3<float> normal(const Accessor_view& a, uint32_t i) const
+	{
+		double v[3] = { a.get(i, 0), a.get(i, 1), a.get(i, 2) };
+		Vector3<float> r;
+		for (int row = 0; row < 3; ++row)
+			r[row] = float(inverse_matrix(0, row) * v[0]
+				+ inverse_matrix(1, row) * v[1]
+				+ inverse_matrix(2, row) * v[2]);
+		return normalized(r);
+	}
+
+	Vector3<float> tangent(const Accessor_view& a, uint32_t i) const
+	{
+		double v[3] = { a.get(i, 0), a.get(i, 1), a.get(i, 2) };
+		Vector3<float> r;
+		for (int row = 0; row < 3; ++row)
+			r[row] = float(matrix(row, 0) * v[0] + matrix(row, 1) * v[1]
+				+ matrix(row, 2) * v[2]);
+		return normalized(r);
+	}
+
+	// Mirroring transforms flip the handedness of the tangent space.
+	float handedness() const
+	{
+		return mirrored ? -1.0f : 1.0f;
+	}
+
+private:
+	Matrix matrix;
+	Matrix inverse_matrix;
+	bool mirrored = false;
+	const vector<Matrix>* joint_matrices = nullptr;
+
+	void set(const Matrix& m)
+	{
+		matrix = m;
+		inverse_matrix = inverse(m);
+		mirrored = determinant(m) < 0;
+	}
+};
+
+template <typename T>
+static void import_vertex(T& v, const Primitive& p, uint32_t i,
+	const Vertex_transform& transform)
+{
+	v.position = transform.point(p.positions, i);
+
+	if constexpr (!is_same_v<T, MDB_file::Walk_mesh_vertex>) {
+		if (p.normals)
+			v.normal = transform.normal(p.normals, i);
+		if (p.uvs)
+			v.uvw = Vector3<float>(p.uvs.get(i, 0), p.uvs.get(i, 1), 1);
+	}
+
+	if constexpr (is_same_v<T, MDB_file::Rigid_mesh_vertex> ||
+	              is_same_v<T, MDB_file::Skin_vertex>) {
+		if (p.tangents) {
+			v.tangent = transform.tangent(p.tangents, i);
+			v.binormal = mul(cross(v.normal, v.tangent),
+				p.tangents.get(i, 3) * transform.handedness());
+		}
+	}
+}
+
+// Bone weights of a vertex. joint_bones has the bone index of each joint of
+// the skin, or -1 for attachment points.
+static void import_skinning(MDB_file::Skin_vertex& v, const Primitive& p,
+	uint32_t i, const vector<int>& joint_bones,
+	const vector<string>& joint_names)
+{
+	init_skin_vertex(v);
+
+	int bone_count = 0;
+
+	for (uint32_t j = 0; j < 4 && p.weights; ++j) {
+		float w = p.weights.get(i, j);
+		uint32_t joint = p.joints ? p.joints.get_uint(i, j) : 0;
+		if (w == 0)
+			continue;
+
+		if (joint >= joint_bones.size()) {
+			Log::error() << "Vertex is weighted to a missing joint.\n";
+			return;
+		}
+		else if (joint_bones[joint] < 0) {
+			Log::error() << "Vertex is weighted to non-rendering bone ("
+			             << joint_names[joint] << ").\n";
+			return;
+		}
+
+		v.bone_indices[bone_count] = uint8_t(joint_bones[joint]);
+		v.bone_weights[bone_count] = w;
+		++bone_count;
+	}
+
+	normalize_bone_weights(v);
+}
+
+// Tangents and binormals along the texture coordinates, for meshes exported
+// without tangents.
+template <typename T>
+static void compute_tangents(T& mesh, size_t first_vertex, size_t first_face)
+{
+	size_t count = mesh.verts.size() - first_vertex;
+	vector<Vector3<float>> tangents(count), binormals(count);
+
+	for (size_t f = first_face; f < mesh.faces.size(); ++f) {
+		auto idx = mesh.faces[f].vertex_indices;
+		auto& v0 = mesh.verts[idx[0]];
+		auto& v1 = mesh.verts[idx[1]];
+		auto& v2 = mesh.verts[idx[2]];
+
+		auto e1 = sub(v1.position, v0.position);
+		auto e2 = sub(v2.position, v0.position);
+		float du1 = v1.uvw.x - v0.uvw.x, dv1 = v1.uvw.y - v0.uvw.y;
+		float du2 = v2.uvw.x - v0.uvw.x, dv2 = v2.uvw.y - v0.uvw.y;
+		float r = du1 * dv2 - du2 * dv1;
+		if (r == 0)
+			continue;
+
+		auto t = mul(sub(mul(e1, dv2), mul(e2, dv1)), 1 / r);
+		auto b = mul(sub(mul(e2, du1), mul(e1, du2)), 1 / r);
+		for (int i = 0; i < 3; ++i) {
+			auto& vt = tangents[idx[i] - first_vertex];
+			auto& vb = binormals[idx[i] - first_vertex];
+			vt = Vector3<float>(vt.x + t.x, vt.y + t.y, vt.z + t.z);
+			vb = Vector3<float>(vb.x + b.x, vb.y + b.y, vb.z + b.z);
+		}
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		auto& v = mesh.verts[first_vertex + i];
+
+		// Gram-Schmidt orthogonalization
+		auto t = sub(tangents[i], mul(v.normal, dot(v.normal, tangents[i])));
+		if (dot(t, t) == 0) {
+			t = fabs(v.normal.x) < 0.9f ? Vector3<float>(1, 0, 0)
+			                            : Vector3<float>(0, 1, 0);
+			t = sub(t, mul(v.normal, dot(v.normal, t)));
+		}
+		v.tangent = normalized(t);
+
+		auto b = cross(v.normal, v.tangent);
+		v.binormal = dot(b, binormals[i]) < 0 ? mul(b, -1) : b;
+	}
+}
+
+// Appends the vertices and the triangles of a primitive to a mesh. The
+// vertices of walk meshes are shared by position, as fbx2nw does.
+template <typename T>
+static bool import_primitive(T& mesh, const Primitive& p,
+	Vertex_transform& transform, const vector<int>& joint_bones = {},
+	const vector<string>& joint_names = {})
+{
+	size_t first_vertex = mesh.verts.size();
+	size_t first_face = mesh.faces.size();
+	vector<uint32_t> vertex_indices(p.positions.count);
+
+	for (uint32_t i = 0; i < p.positions.count; ++i) {
+		typename decltype(mesh.verts)::value_type v;
+		transform.set_vertex(p, i);
+		import_vertex(v, p, i, transform);
+
+		if constexpr (is_same_v<T, MDB_file::Skin>)
+			import_skinning(v, p, i, joint_bones, joint_names);
+
+		if constexpr (is_same_v<T, MDB_file::Walk_mesh>) {
+			auto it = find_if(mesh.verts.begin(), mesh.verts.end(),
+				[&](auto& u) { return u.position == v.position; });
+			vertex_indices[i] = uint32_t(it - mesh.verts.begin());
+			if (it != mesh.verts.end())
+				continue;
+		}
+		else {
+			vertex_indices[i] = uint32_t(mesh.verts.size());
+		}
+
+		mesh.verts.push_back(v);
+	}
+
+	// Faces index the vertices with 16 bits
+	if (mesh.verts.size() > 65536) {
+		Log::error() << "Mesh has more than 65536 vertices.\n";
+		return false;
+	}
+
+	uint32_t index_count = p.indices ? p.indices.count : p.positions.count;
+
+	for (uint32_t i = 0; i + 2 < index_count; i += 3) {
+		typename decltype(mesh.faces)::value_type face{};
+		for (uint32_t j = 0; j < 3; ++j) {
+			uint32_t index = p.indices ? p.indices.get_uint(i + j) : i + j;
+			if (index >= p.positions.count) {
+				Log::error() << "Vertex index out of range.\n";
+				return false;
+			}
+			face.vertex_indices[j] = uint16_t(vertex_indices[index]);
+		}
+		mesh.faces.push_back(face);
+	}
+
+	if constexpr (is_same_v<T, MDB_file::Rigid_mesh> ||
+	              is_same_v<T, MDB_file::Skin>) {
+		if (!p.tangents)
+			compute_tangents(mesh, first_vertex, first_face);
+	}
+
+	return true;
+}
+
+static void print_mesh(const Json_value& mesh, const Scene& scene)
+{
+	auto& primitives = mesh["primitives"];
+	uint32_t vertex_count = 0, index_count = 0;
+
+	for (size_t i = 0; i < primitives.size(); ++i) {
+		auto positions = scene.glb.accessor(
+			primitives[i]["attributes"]["POSITION"].get_int());
+		auto indices = scene.glb.accessor(primitives[i]["indices"].get_int());
+		vertex_count += positions.count;
+		index_count += indices ? indices.count : positions.count;
+	}
+
+	Log::info() << "  Primitives: " << primitives.size() << endl;
+	Log::info() << "  Vertices: " << vertex_count << endl;
+	Log::info() << "  Triangles: " << index_count / 3 << endl;
+}
+
+// Imports the primitives of the mesh of a node. on_primitive is called
+// after each primitive, with the index of its first face.
+template <typename T, typename F>
+static bool import_mesh(const Scene& scene, const Node& node, T& mesh,
+	Vertex_transform& transform, F on_primitive,
+	const vector<int>& joint_bones = {},
+	const vector<string>& joint_names = {})
+{
+	auto& primitives = scene.json["meshes"][node.mesh]["primitives"];
+
+	for (size_t i = 0; i < primitives.size(); ++i) {
+		Primitive p;
+		if (!read_primitive(scene, primitives[i], p))
+			return false;
+
+		if constexpr (is_same_v<T, MDB_file::Rigid_mesh> ||
+		              is_same_v<T, MDB_file::Skin>) {
+			if (!p.uvs) {
+				Log::error() << "There is no UV information.\n";
+				return false;
+			}
+			if (!p.normals) {
+				Log::error() << "There is no normal vector information.\n";
+				return false;
+			}
+		}
+
+		size_t first_face = mesh.faces.size();
+		if (!import_primitive(mesh, p, transform, joint_bones, joint_names))
+			return false;
+
+		on_primitive(p, first_face);
+	}
+
+	return true;
+}
+
+static void import_collision_mesh(MDB_file& mdb, const Scene& scene,
+	const Node& node)
+{
+	Log::info() << "Importing COL2|COL3: " << node.name << endl;
+	print_mesh(scene.json["meshes"][node.mesh], scene);
+
+	auto col_mesh = make_unique<MDB_file::Collision_mesh>(
+	    ends_with(node.name.c_str(), "_C2") ? MDB_file::COL2
+	                                        : MDB_file::COL3);
+	set_packet_name(col_mesh->header.name, node.name.c_str());
+
+	Vertex_transform transform(z_up_matrix() * node.world);
+	if (import_mesh(scene, node, *col_mesh, transform,
+	                [](const Primitive&, size_t) {}))
+		mdb.add_packet(move(col_mesh));
+}
+
+// Walk mesh materials are named after the walk mesh materials of nw2fbx.
+static uint16_t walk_mesh_face_flags(const Scene& scene, int material)
+{
+	auto& name = scene.json["materials"][material]["name"].str;
+
+	for (unsigned i = 0; i < size(MDB_file::walk_mesh_materials); ++i)
+		if (starts_with(name.c_str(), MDB_file::walk_mesh_materials[i].name))
+			return MDB_file::walk_mesh_materials[i].flags;
+
+	return 0;
+}
+
+static void import_walk_mesh(MDB_file& mdb, const Scene& scene,
+	const Node& node)
+{
+	Log::info() << "Importing WALK: " << node.name << endl;
+
+	auto walk_mesh = make_unique<MDB_file::Walk_mesh>();
+	set_packet_name(walk_mesh->header.name, node.name.c_str());
+
+	Vertex_transform transform(z_up_matrix() * node.world);
+	auto& faces = walk_mesh->faces;
+	auto set_flags = [&](const Primitive& p, size_t first_face) {
+		uint16_t flags = walk_mesh_face_flags(scene, p.material);
+		for (size_t i = first_face; i < faces.size(); ++i) {
+			faces[i].flags[0] = flags;
+			faces[i].flags[1] = 0;
+		}
+	};
+
+	if (import_mesh(scene, node, *walk_mesh, transform, set_flags))
+		mdb.add_packet(move(walk_mesh));
+}
+
+static bool is_hook_packet(const Node& node)
+{
+	return !node.is_bone && (strnicmp(node.name.c_str(), "HP_", 3) == 0 ||
+	                         strnicmp(node.name.c_str(), "AP_", 3) == 0);
+}
+
+static bool is_hair_packet(const Node& node)
+{
+	return (*node.extras)["HSB_LOW"] || (*node.extras)["HSB_SHORT"] ||
+	       (*node.extras)["HSB_PONYTAIL"];
+}
+
+static bool is_helm_packet(const Node& node)
+{
+	return (*node.extras)["HHHB_NONE_HIDDEN"] ||
+	       (*node.extras)["HHHB_HAIR_HIDDEN"] ||
+	       (*node.extras)["HHHB_PARTIAL_HAIR"] ||
+	       (*node.extras)["HHHB_HEAD_HIDDEN"];
+}
+
+// Position and orientation of hooks, hair and helm points. The orientation
+// matrices have the Y axis first, see transform_to_orientation in
+// fbx2nw.cpp.
+static void import_point(const Node& node, Vector3<float>& position,
+	float orientation[3][3])
+{
+	auto z_up = z_up_matrix();
+	auto m = z_up * node.world;
+
+	position = Vector3<float>(float(m(0, 3)), float(m(1, 3)),
+		float(m(2, 3)));
+
+	const int rows[3] = { 1, 0, 2 };
+	for (int col = 0; col < 3; ++col) {
+		auto axis = normalized(Vector3<float>(float(m(0, col)),
+			float(m(1, col)), float(m(2, col))));
+		for (int i = 0; i < 3; ++i)
+			orientation[rows[col]][i] = axis[i];
+	}
+}
+
+static void import_hook_point(MDB_file& mdb, const Node& node)
+{
+	Log::info() << "Importing HOOK: " << node.name << endl;
+
+	auto hook = make_unique<MDB_file::Hook>();
+	set_packet_name(hook->header.name, node.name.c_str());
+	import_point(node, hook->header.position, hook->header.orientation);
+
+	mdb.add_packet(move(hook));
+}
+
+static void import_hair(MDB_file& mdb, const Node& node)
+{
+	Log::info() << "Importing HAIR: " << node.name << endl;
+
+	auto hair = make_unique<MDB_file::Hair>();
+	set_packet_name(hair->header.name, node.name.c_str());
+	hair->header.shortening_behavior =
+		(*node.extras)["HSB_LOW"].number != 0 ? MDB_file::HSB_LOW :
+		(*node.extras)["HSB_SHORT"].number != 0 ? MDB_file::HSB_SHORT :
+		(*node.extras)["HSB_PONYTAIL"].number != 0 ? MDB_file::HSB_PONYTAIL :
+		MDB_file::HSB_LOW;
+	import_point(node, hair->header.position, hair->header.orientation);
+
+	mdb.add_packet(move(hair));
+}
+
+static void import_helm(MDB_file& mdb, const Node& node)
+{
+	Log::info() << "Importing HELM: " << node.name << endl;
+
+	auto helm = make_unique<MDB_file::Helm>();
+	set_packet_name(helm->header.name, node.name.c_str());
+	auto& extras = *node.extras;
+	helm->header.hiding_behavior =
+		extras["HHHB_NONE_HIDDEN"].number != 0 ? MDB_file::HHHB_NONE_HIDDEN :
+		extras["HHHB_HAIR_HIDDEN"].number != 0 ? MDB_file::HHHB_HAIR_HIDDEN :
+		extras["HHHB_PARTIAL_HAIR"].number != 0 ? MDB_file::HHHB_PARTIAL_HAIR :
+		extras["HHHB_HEAD_HIDDEN"].number != 0 ? MDB_file::HHHB_HEAD_HIDDEN :
+		MDB_file::HHHB_NONE_HIDDEN;
+	import_point(node, helm->header.position, helm->header.orientation);
+
+	mdb.add_packet(move(helm));
+}
+
+static void import_rigid_mesh(MDB_file& mdb, const Scene& scene,
+	const Node& node)
+{
+	Log::info() << "Importing RIGD: " << node.name << endl;
+
+	auto& mesh = scene.json["meshes"][node.mesh];
+	print_mesh(mesh, scene);
+
+	auto rigid_mesh = make_unique<MDB_file::Rigid_mesh>();
+	set_packet_name(rigid_mesh->header.name, node.name.c_str());
+	import_material(rigid_mesh->header.material, scene, node, mesh);
+
+	Vertex_transform transform(z_up_matrix() * node.world);
+	if (import_mesh(scene, node, *rigid_mesh, transform,
+	                [](const Primitive&, size_t) {}))
+		mdb.add_packet(move(rigid_mesh));
+}
+
+static void gather_skin_bones(const Scene& scene, int node,
+	Skin_bones& skin_bones)
+{
+	add_skin_bone(skin_bones, scene.nodes[node].name.c_str());
+
+	for (int child : scene.nodes[node].children)
+		gather_skin_bones(scene, child, skin_bones);
+}
+
+static void import_skin(MDB_file& mdb, const Scene& scene, const Node& node)
+{
+	Log::info() << "Importing SKIN: " << node.name << endl;
+
+	auto& mesh = scene.json["meshes"][node.mesh];
+	print_mesh(mesh, scene);
+
+	auto& gltf_skin = scene.json["skins"][node.skin];
+	auto& joints = gltf_skin["joints"];
+	int skel = skeleton_node(scene, joints[0].get_int());
+	if (skel < 0) {
+		Log::error() << "Skin is not bound to a skeleton.\n";
+		return;
+	}
+
+	auto& skel_node = scene.nodes[skel];
+	Log::info() << "  Skeleton name: " << skel_node.name << endl;
+
+	auto skin = make_unique<MDB_file::Skin>();
+	set_packet_name(skin->header.name, node.name.c_str());
+	strncpy(skin->header.skeleton_name, skel_node.name.c_str(), 32);
+
+	import_material(skin->header.material, scene, node, mesh);
+
+	Skin_bones skin_bones;
+	gather_skin_bones(scene, skel_node.children[0], skin_bones);
+
+	// The bind pose of the skin in the MDB space
+	auto ibms = scene.glb.accessor(gltf_skin["inverseBindMatrices"].get_int());
+	auto z_up = z_up_matrix();
+	vector<Matrix> joint_matrices;
+	vector<int> joint_bones;
+	vector<string> joint_names;
+
+	for (size_t i = 0; i < joints.size(); ++i) {
+		int joint = joints[i].get_int();
+		if (joint < 0 || joint >= int(scene.nodes.size())) {
+			Log::error() << "Invalid skin joint.\n";
+			return;
+		}
+
+		Matrix ibm;
+		if (i < ibms.count && ibms.components == 16)
+			for (uint32_t j = 0; j < 16; ++j)
+				ibm.m[j] = ibms.get(uint32_t(i), j);
+
+		auto& name = scene.nodes[joint].name;
+		joint_matrices.push_back(z_up * scene.nodes[joint].world * ibm);
+		joint_bones.push_back(starts_with(name.c_str(), "ap_") ? -1 :
+			bone_index(name.c_str(), skin_bones));
+		joint_names.push_back(name);
+	}
+
+	Vertex_transform transform(joint_matrices);
+	if (import_mesh(scene, node, *skin, transform,
+	                [](const Primitive&, size_t) {}, joint_bones,
+	                joint_names))
+		mdb.add_packet(move(skin));
+}
+
+static void import_meshes(MDB_file& mdb, const Scene& scene, int node)
+{
+	auto& n = scene.nodes[node];
+	auto name = n.name.c_str();
+
+	if (n.mesh >= 0 && (ends_with(name, "_C2") || ends_with(name, "_C3")))
+		import_collision_mesh(mdb, scene, n);
+	else if (n.mesh >= 0 && ends_with(name, "_W"))
+		import_walk_mesh(mdb, scene, n);
+	else if (is_hook_packet(n))
+		import_hook_point(mdb, n);
+	else if (is_hair_packet(n))
+		import_hair(mdb, n);
+	else if (is_helm_packet(n))
+		import_helm(mdb, n);
+	else if (n.mesh >= 0 && n.skin >= 0)
+		import_skin(mdb, scene, n);
+	else if (n.mesh >= 0 && !starts_with(name, "COLS"))
+		import_rigid_mesh(mdb, scene, n);
+
+	for (int child : n.children)
+		import_meshes(mdb, scene, child);
+}
+
+struct Bone_info {
+	uint32_t index;
+	double position[3];
+};
+
+// Bones are numbered in depth-first order under each top-level node, see
+// gather_bone_info in fbx2nw.cpp.
+static uint32_t gather_bone_info(const Scene& scene, int node,
+	uint32_t bone_index, vector<Bone_info>& bone_infos)
+{
+	auto& n = scene.nodes[node];
+	if (n.is_bone) {
+		Bone_info info;
+		info.index = bone_index++;
+		for (int i = 0; i < 3; ++i)
+			info.position[i] = n.world(i, 3);
+		bone_infos.push_back(info);
+	}
+
+	for (int child : n.children)
+		bone_index = gather_bone_info(scene, child, bone_index, bone_infos);
+
+	return bone_index;
+}
+
+static uint32_t nearest_bone_index(const vector<Bone_info>& bone_infos,
+	const Node& node)
+{
+	double min_distance = 1e6;
+	uint32_t bone_index = 0;
+
+	for (auto& bone_info : bone_infos) {
+		double d = 0;
+		for (int i = 0; i < 3; ++i)
+			d += pow(bone_info.position[i] - node.world(i, 3), 2);
+		if (d < min_distance) {
+			min_distance = d;
+			bone_index = bone_info.index;
+		}
+	}
+
+	return bone_index;
+}
+
+// The mesh of a collision sphere is a sphere centered at the origin, so the
+// radius is the length of any vertex.
+static float sphere_radius(const Scene& scene, const Node& node)
+{
+	auto positions = scene.glb.accessor(scene.json["meshes"]
+		[node.mesh]["primitives"][0]["attributes"]["POSITION"]
+		.get_int());
+	if (!positions)
+		return 0;
+
+	double v[3] = { positions.get(0, 0), positions.get(0, 1),
+		positions.get(0, 2) };
+	double length = 0;
+	for (int row = 0; row < 3; ++row) {
+		double c = 0;
+		for (int col = 0; col < 3; ++col)
+			c += node.world(row, col) * v[col];
+		length += c * c;
+	}
+
+	return float(sqrt(length));
+}
+
+static void import_collision_spheres(MDB_file& mdb, const Scene& scene)
+{
+	vector<Bone_info> bone_infos;
+	for (int root : scene.roots)
+		gather_bone_info(scene, root, 0, bone_infos);
+
+	auto cs = make_unique<MDB_file::Collision_spheres>();
+
+	for (int root : scene.roots) {
+		auto& node = scene.nodes[root];
+		if (!starts_with(node.name.c_str(), "COLS"))
+			continue;
+
+		Log::info() << "Importing COLS: " << node.name << endl;
+
+		MDB_file::Collision_sphere s;
+		s.bone_index = nearest_bone_index(bone_infos, node);
+		s.radius = sphere_radius(scene, node);
+		cs->spheres.push_back(s);
+	}
+
+	sort(cs->spheres.begin(), cs->spheres.end(),
+		[](MDB_file::Collision_sphere& s0, MDB_file::Collision_sphere& s1) {
+		return s0.bone_index < s1.bone_index;
+	});
+
+	cs->header.sphere_count = cs->spheres.size();
+
+	if (cs->header.sphere_count > 0)
+		mdb.add_packet(move(cs));
+}
+
+static void import_models(const Scene& scene, const Import_info& import_info)
+{
+	Log::error_count = 0; // Reset error count
+
+	MDB_file mdb;
+
+	for (int root : scene.roots)
+		import_meshes(mdb, scene, root);
+	import_collision_spheres(mdb, scene);
+
+	save_models(mdb, import_info);
+}
+
+static bool is_pivot_node(const Node& node)
+{
+	return ends_with(node.name.c_str(), ".PIVOT");
+}
+
+static bool is_skeleton(const Scene& scene, const Node& node)
+{
+	// A skeleton should have atleast a bone.
+	if (node.children.empty())
+		return false;
+
+	return scene.nodes[node.children[0]].is_bone || is_pivot_node(node);
+}
+
+static int rendering_bone_count(const Scene& scene, int node)
+{
+	auto& n = scene.nodes[node];
+	int c = n.is_bone && !starts_with(n.name.c_str(), "f_") &&
+	        !starts_with(n.name.c_str(), "ap_") ? 1 : 0;
+
+	for (int child : n.children)
+		c += rendering_bone_count(scene, child);
+
+	return c;
+}
+
+static bool validate_skeleton(const Scene& scene, int node)
+{
+	auto& n = scene.nodes[node];
+
+	if (is_pivot_node(n)) {
+		if (n.children.size() > 1) {
+			Log::error() << "PIVOT has more than one child.\n";
+			return false;
+		}
+	}
+	else if (n.children.size() > 1) {
+		Log::error() << "Skeleton has more than one root bone.\n";
+		return false;
+	}
+	else if (n.name != scene.nodes[n.children[0]].name) {
+		Log::error() << "Skeleton name is not equal to root bone name: "
+		             << n.name << " != "
+		             << scene.nodes[n.children[0]].name << '\n';
+		return false;
+	}
+	else if (rendering_bone_count(scene, node) > 54) {
+		Log::error() << "Skeleton has more than 54 render bones.\n";
+		return false;
+	}
+
+	return true;
+}
+
+static void import_bone_transform(GR2_import_info& import_info,
+	const Node& node, GR2_bone& bone)
+{
+	auto& t = bone.transform;
+	t.flags = 0;
+
+	t.translation.x = float(node.translation[0] * import_info.bone_scaling.x);
+	t.translation.y = float(node.translation[1] * import_info.bone_scaling.y);
+	t.translation.z = float(node.translation[2] * import_info.bone_scaling.z);
+	if (t.translation.x != 0 || t.translation.y != 0 || t.translation.z != 0)
+		t.flags |= GR2_has_position;
+
+	t.rotation = Vector4<float>(float(node.rotation[0]),
+		float(node.rotation[1]), float(node.rotation[2]),
+		float(node.rotation[3]));
+	if (t.rotation.x != 0 || t.rotation.y != 0 || t.rotation.z != 0 ||
+	    t.rotation.w != 1)
+		t.flags |= GR2_has_rotation;
+
+	for (int i = 0; i < 9; ++i)
+		t.scale_shear[i] = i % 4 == 0 ? float(node.scale[i / 4]) : 0;
+	if (t.scale_shear[0] != 1 || t.scale_shear[4] != 1 ||
+	    t.scale_shear[8] != 1)
+		t.flags |= GR2_has_scale_shear;
+}
+
+static void import_bones(GR2_import_info& import_info, const Scene& scene,
+	int node, const Matrix& parent_world, int32_t parent_index,
+	vector<GR2_bone>& bones)
+{
+	for (int child : scene.nodes[node].children) {
+		auto& n = scene.nodes[child];
+		Log::debug() << "  Importing bone: " << n.name << endl;
+
+		GR2_bone bone;
+		bone.name = import_info.strings.get(n.name.c_str());
+		bone.parent_index = parent_index;
+		import_bone_transform(import_info, n, bone);
+
+		// World transform in the skeleton space, with the scaled
+		// translations of the bones
+		double t[3] = { bone.transform.translation.x,
+			bone.transform.translation.y, bone.transform.translation.z };
+		auto world = parent_world * trs_matrix(t, n.rotation, n.scale);
+		auto inv_world = inverse(world);
+		for (int i = 0; i < 16; ++i)
+			bone.inverse_world_transform[i] = float(inv_world.m[i]);
+
+		bone.light_info = nullptr;
+		bone.camera_info = nullptr;
+		bone.extended_data.keys = nullptr;
+		bone.extended_data.values = nullptr;
+		bones.push_back(bone);
+
+		print_bone(bone);
+
+		import_bones(import_info, scene, child, world,
+			int32_t(bones.size() - 1), bones);
+	}
+}
+
+// GR2 skeletons are in centimeters, and glTF in meters.
+static void set_bone_scaling(GR2_import_info& import_info, const Node& node)
+{
+	import_info.bone_scaling.x = node.scale[0] * 100;
+	import_info.bone_scaling.y = node.scale[1] * 100;
+	import_info.bone_scaling.z = node.scale[2] * 100;
+}
+
+static void import_skeleton(GR2_import_info& import_info, const Scene& scene,
+	int node)
+{
+	auto& n = scene.nodes[node];
+	Log::info() << "Importing skeleton: " << n.name << endl;
+
+	if (!validate_skeleton(scene, node))
+		return;
+
+	set_bone_scaling(import_info, n);
+
+	import_info.bone_arrays.emplace_back();
+	import_bones(import_info, scene, node, Matrix(), -1,
+		import_info.bone_arrays.back());
+
+	GR2_skeleton skel;
+	skel.name = import_info.strings.get(path(n.name).stem().string().c_str());
+	skel.bones_count = import_info.bone_arrays.back().size();
+	skel.bones = import_info.bone_arrays.back().data();
+	import_info.skeletons.push_back(skel);
+	import_info.skeleton_pointers.push_back(&import_info.skeletons.back());
+
+	import_model(import_info, &import_info.skeletons.back());
+}
+
+static void import_skeletons(const Scene& scene, const Import_info& info)
+{
+	Log::error_count = 0; // Reset error count
+
+	GR2_import_info import_info;
+	init_import_info(import_info, info);
+
+	for (int root : scene.roots)
+		if (is_skeleton(scene, scene.nodes[root]))
+			import_skeleton(import_info, scene, root);
+
+	save_skeletons(import_info, info);
+}
+
+// A sampler of an animation channel. Its keys are used as the knots of the
+// GR2 curves, so linear and step keys need no resampling.
+struct Channel {
+	Accessor_view input;
+	Accessor_view output;
+	string interpolation;
+};
+
+struct Node_channels {
+	Channel translation;
+	Channel rotation;
+	Channel scale;
+};
+
+// Value of a key, skipping the tangents of cubic spline keys
+static float key_value(const Channel& channel, uint32_t key, uint32_t c)
+{
+	if (channel.interpolation == "CUBICSPLINE")
+		return channel.output.get(key * 3 + 1, c);
+
+	return channel.output.get(key, c);
+}
+
+// Knots and values of a channel, relative to the start of the animation.
+// Cubic spline keys are sampled as linear keys at the time step.
+static void channel_keys(const Channel& channel, double start,
+	uint32_t components, vector<float>& knots, vector<float>& values)
+{
+	auto& input = channel.input;
+
+	if (channel.interpolation != "CUBICSPLINE") {
+		for (uint32_t k = 0; k < input.count; ++k) {
+			knots.push_back(float(input.get(k) - start));
+			for (uint32_t c = 0; c < components; ++c)
+				values.push_back(key_value(channel, k, c));
+		}
+		return;
+	}
+
+	auto& output = channel.output;
+	uint32_t k = 0;
+	double end = input.get(input.count - 1);
+
+	for (double t = input.get(0); t <= end + time_step / 2; t += time_step) {
+		t = min(t, end);
+		while (k + 2 < input.count && input.get(k + 1) <= t)
+			++k;
+
+		double t0 = input.get(k);
+		double t1 = input.get(min(k + 1, input.count - 1));
+		double dt = t1 - t0;
+		double s = dt > 0 ? clamp((t - t0) / dt, 0.0, 1.0) : 0;
+		double s2 = s * s, s3 = s2 * s;
+
+		knots.push_back(float(t - start));
+		for (uint32_t c = 0; c < components; ++c) {
+			uint32_t k1 = min(k + 1, input.count - 1);
+			double v0 = output.get(k * 3 + 1, c);
+			double b0 = output.get(k * 3 + 2, c);
+			double v1 = output.get(k1 * 3 + 1, c);
+			double a1 = output.get(k1 * 3, c);
+			values.push_back(float((2 * s3 - 3 * s2 + 1) * v0
+				+ (s3 - 2 * s2 + s) * dt * b0
+				+ (-2 * s3 + 3 * s2) * v1 + (s3 - s2) * dt * a1));
+		}
+	}
+}
+
+static void set_curve(GR2_import_info& import_info, GR2_curve& curve,
+	const Channel& channel, float* knots, size_t knots_count,
+	float* controls, size_t controls_count)
+{
+	auto& data = import_info.da_curves.emplace_back();
+	data.curve_data_header_DaK32fC32f.format = DaK32fC32f;
+	data.curve_data_header_DaK32fC32f.degree =
+		channel.interpolation == "STEP" ? 0 : 1;
+	data.padding = 0;
+	data.knots_count = int32_t(knots_count);
+	data.knots = knots;
+	data.controls_count = int32_t(controls_count);
+	data.controls = controls;
+
+	curve.keys = DaK32fC32f_def;
+	curve.curve_data = reinterpret_cast<GR2_curve_data*>(&data);
+}
+
+static void import_position(GR2_import_info& import_info, const Node& node,
+	const Channel* channel, double start, GR2_transform_track& tt)
+{
+	auto& s = import_info.bone_scaling;
+
+	if (!channel) {
+		tt.position_curve.keys = D3Constant32f_def;
+
+		auto& curve = import_info.d3c_curves.emplace_back();
+		curve.curve_data_header_D3Constant32f.format = D3Constant32f;
+		curve.curve_data_header_D3Constant32f.degree = 0;
+		curve.controls[0] = float(node.translation[0] * s.x);
+		curve.controls[1] = float(node.translation[1] * s.y);
+		curve.controls[2] = float(node.translation[2] * s.z);
+		tt.position_curve.curve_data =
+			reinterpret_cast<GR2_curve_data*>(&curve);
+		return;
+	}
+
+	auto& knots = import_info.float_arrays.emplace_back();
+	auto& controls = import_info.float_arrays.emplace_back();
+	channel_keys(*channel, start, 3, knots, controls);
+
+	for (size_t i = 0; i < controls.size(); i += 3) {
+		controls[i] = float(controls[i] * s.x);
+		controls[i + 1] = float(controls[i + 1] * s.y);
+		controls[i + 2] = float(controls[i + 2] * s.z);
+	}
+
+	set_curve(import_info, tt.position_curve, *channel, knots.data(),
+		knots.size(), controls.data(), controls.size());
+}
+
+// GR2 animation requires two consecutive quaternions have the shortest path.
+static bool is_shortest_path(const Channel& channel)
+{
+	for (uint32_t k = 1; k < channel.input.count; ++k) {
+		float d = 0;
+		for (uint32_t c = 0; c < 4; ++c)
+			d += key_value(channel, k - 1, c) * key_value(channel, k, c);
+		if (d < 0)
+			return false;
+	}
+
+	return true;
+}
+
+static void import_rotation(GR2_import_info& import_info, const Node& node,
+	const Channel* channel, double start, GR2_transform_track& tt)
+{
+	if (!channel) {
+		auto& controls = import_info.float_arrays.emplace_back();
+		for (int i = 0; i < 4; ++i)
+			controls.push_back(float(node.rotation[i]));
+
+		auto& curve = import_info.dac_curves.emplace_back();
+		curve.curve_data_header_DaConstant32f.format = DaConstant32f;
+		curve.curve_data_header_DaConstant32f.degree = 0;
+		curve.padding = 0;
+		curve.controls_count = controls.size();
+		curve.controls = controls.data();
+
+		tt.orientation_curve.keys = DaConstant32f_def;
+		tt.orientation_curve.curve_data =
+			reinterpret_cast<GR2_curve_data*>(&curve);
+		return;
+	}
+
+	// Keys starting at 0 are used straight from the buffer of the glTF
+	// file. GR2_file::read copies them.
+	auto input = channel->input.floats();
+	auto output = channel->output.floats();
+	if (start == 0 && input && output && channel->output.components == 4 &&
+	    channel->interpolation != "CUBICSPLINE" &&
+	    is_shortest_path(*channel)) {
+		set_curve(import_info, tt.orientation_curve, *channel,
+			const_cast<float*>(input), channel->input.count,
+			const_cast<float*>(output), channel->output.count * 4);
+		return;
+	}
+
+	auto& knots = import_info.float_arrays.emplace_back();
+	auto& controls = import_info.float_arrays.emplace_back();
+	channel_keys(*channel, start, 4, knots, controls);
+
+	for (size_t i = 4; i < controls.size(); i += 4) {
+		float d = 0;
+		for (size_t c = 0; c < 4; ++c)
+			d += controls[i - 4 + c] * controls[i + c];
+		if (d < 0)
+			for (size_t c = 0; c < 4; ++c)
+				controls[i + c] = -controls[i + c];
+	}
+
+	set_curve(import_info, tt.orientation_curve, *channel, knots.data(),
+		knots.size(), controls.data(), controls.size());
+}
+
+static void push_scale_shear(vector<float>& controls, float x, float y,
+	float z)
+{
+	const float scale_shear[9] = { x, 0, 0, 0, y, 0, 0, 0, z };
+	controls.insert(controls.end(), scale_shear, scale_shear + 9);
+}
+
+static void import_scaleshear(GR2_import_info& import_info, const Node& node,
+	const Channel* channel, double start, GR2_transform_track& tt)
+{
+	if (channel) {
+		auto& knots = import_info.float_arrays.emplace_back();
+		auto& controls = import_info.float_arrays.emplace_back();
+		vector<float> scales;
+		channel_keys(*channel, start, 3, knots, scales);
+		for (size_t i = 0; i + 2 < scales.size(); i += 3)
+			push_scale_shear(controls, scales[i], scales[i + 1],
+				scales[i + 2]);
+
+		set_curve(import_info, tt.scale_shear_curve, *channel,
+			knots.data(), knots.size(), controls.data(), controls.size());
+	}
+	else if (node.scale[0] != 1 || node.scale[1] != 1 || node.scale[2] != 1) {
+		auto& controls = import_info.float_arrays.emplace_back();
+		push_scale_shear(controls, float(node.scale[0]),
+			float(node.scale[1]), float(node.scale[2]));
+
+		auto& curve = import_info.dac_curves.emplace_back();
+		curve.curve_data_header_DaConstant32f.format = DaConstant32f;
+		curve.curve_data_header_DaConstant32f.degree = 0;
+		curve.padding = 0;
+		curve.controls_count = controls.size();
+		curve.controls = controls.data();
+
+		tt.scale_shear_curve.keys = DaConstant32f_def;
+		tt.scale_shear_curve.curve_data =
+			reinterpret_cast<GR2_curve_data*>(&curve);
+	}
+	else
+		import_scaleshear_DaIdentity(import_info, tt);
+}
+
+// Adds the transform tracks of the bones, and of the nodes under pivots or
+// animated, under a top-level node. See import_anim_layer in fbx2nw.cpp.
+static void import_tracks(GR2_import_info& import_info, const Scene& scene,
+	const map<int, Node_channels>& channels, double start, int skel_node,
+	int node)
+{
+	auto& skel = scene.nodes[skel_node];
+	auto& n = scene.nodes[node];
+	auto node_channels = channels.find(node);
+
+	if (n.is_bone || is_pivot_node(skel) || node_channels != channels.end()) {
+		Log::info() << "Importing animation: " << n.name << endl;
+
+		set_bone_scaling(import_info, skel);
+
+		auto& tg = track_group(import_info,
+			path(skel.name).stem().string().c_str());
+
+		auto& tt = tg.transform_tracks.emplace_back();
+		tt.name = import_info.strings.get(n.name.c_str());
+
+		auto channel = [&](Channel Node_channels::*c) -> const Channel* {
+			if (node_channels == channels.end())
+				return nullptr;
+			auto& ch = node_channels->second.*c;
+			return ch.input ? &ch : nullptr;
+		};
+
+		import_position(import_info, n, channel(&Node_channels::translation),
+			start, tt);
+		import_rotation(import_info, n, channel(&Node_channels::rotation),
+			start, tt);
+		import_scaleshear(import_info, n, channel(&Node_channels::scale),
+			start, tt);
+	}
+
+	for (int child : n.children)
+		import_tracks(import_info, scene, channels, start, skel_node, child);
+}
+
+static bool read_channels(const Scene& scene, const Json_value& animation,
+	map<int, Node_channels>& channels)
+{
+	auto& samplers = animation["samplers"];
+	auto& anim_channels = animation["channels"];
+
+	for (size_t i = 0; i < anim_channels.size(); ++i) {
+		auto& target = anim_channels[i]["target"];
+		int node = target["node"].get_int();
+		if (node < 0 || node >= int(scene.nodes.size()))
+			continue;
+
+		Channel* channel;
+		uint32_t components;
+		if (target["path"].str == "translation") {
+			channel = &channels[node].translation;
+			components = 3;
+		}
+		else if (target["path"].str == "rotation") {
+			channel = &channels[node].rotation;
+			components = 4;
+		}
+		else if (target["path"].str == "scale") {
+			channel = &channels[node].scale;
+			components = 3;
+		}
+		else {
+			continue; // Morph target weights
+		}
+
+		auto& sampler = samplers[anim_channels[i]["sampler"].get_int()];
+		channel->input = scene.glb.accessor(sampler["input"].get_int());
+		channel->output = scene.glb.accessor(sampler["output"].get_int());
+		channel->interpolation = sampler["interpolation"] ?
+			sampler["interpolation"].str : "LINEAR";
+
+		uint32_t keys = channel->interpolation == "CUBICSPLINE" ? 3 : 1;
+		if (!channel->input || !channel->output ||
+		    channel->output.components != components ||
+		    channel->output.count != channel->input.count * keys) {
+			Log::error() << "Invalid animation sampler.\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void import_animation(const Scene& scene, size_t index,
+	const Import_info& info)
+{
+	Log::error_count = 0; // Reset error count
+
+	auto& animation = scene.json["animations"][index];
+	string name = latin1(animation["name"].str);
+	if (name.empty())
+		name = path(info.input_path).stem().string();
+
+	Log::info() << "Animation: " << name << endl;
+
+	GR2_import_info import_info;
+	import_info.anim_stack = nullptr;
+	init_import_info(import_info, info);
+
+	map<int, Node_channels> channels;
+	if (!read_channels(scene, animation, channels))
+		return;
+
+	double start = 0, stop = 0;
+	bool first = true;
+	for (auto& c : channels) {
+		for (auto ch : { &c.second.translation, &c.second.rotation,
+		                 &c.second.scale }) {
+			if (!ch->input)
+				continue;
+			double t0 = ch->input.get(0);
+			double t1 = ch->input.get(ch->input.count - 1);
+			start = first ? t0 : min(start, t0);
+			stop = first ? t1 : max(stop, t1);
+			first = false;
+		}
+	}
+
+	for (int root : scene.roots)
+		for (int child : scene.nodes[root].children)
+			import_tracks(import_info, scene, channels, start, root, child);
+
+	save_animation(import_info, name.c_str(), float(stop - start), info);
+}
+
+static void import_animations(const Scene& scene,
+	const Import_info& import_info)
+{
+	auto& animations = scene.json["animations"];
+	Log::info() << "\nAnimations: " << animations.size() << endl;
+	for (size_t i = 0; i < animations.size(); ++i)
+		import_animation(scene, i, import_info);
+}
+
+bool import_glb(const Import_info& import_info)
+{
+	GLB_view glb(import_info.input_path.c_str());
+	if (!glb) {
+		Log::error() << import_info.input_path << ": " << glb.error_str()
+		             << endl;
+		return false;
+	}
+
+	Scene scene(glb);
+	if (!read_scene(scene))
+		return false;
+
+	if (import_info.output_type == Output_type::mdb ||
+	    import_info.output_type == Output_type::any)
+		import_models(scene, import_info);
+
+	if (import_info.output_type == Output_type::mdb)
+		return true;
+
+	if (scene.json["animations"].size() == 0)
+		import_skeletons(scene, import_info);
+	else
+		import_animations(scene, import_info);
+
+	return true;
+}
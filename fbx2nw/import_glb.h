@@ -0,0 +1,7 @@
+#pragma once
+
+struct Import_info;
+
+// Imports a glTF 2.0 file (.glb or .gltf), as import_fbx does with FBX
+// files.
+bool import_glb(const Import_info& import_info);
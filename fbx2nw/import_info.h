@@ -0,0 +1,110 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "gr2_file.h"
+#include "mdb_file.h"
+#include "mesh_simplifier.h"
+#include "string_collection.h"
+
+namespace fbxsdk {
+class FbxAnimStack;
+}
+
+enum class Output_type {
+	any,
+	mdb,
+	gr2
+};
+
+struct Import_info {
+	std::string input_path;
+	// Without extension.
+	std::string output_path;
+	Output_type output_type;
+	// Reorder faces and vertices of RIGD and SKIN packets for vertex cache
+	// locality.
+	bool optimize_meshes = false;
+	// Generate a LOD MDB (<output>_lod.mdb) simplifying RIGD and SKIN
+	// packets.
+	bool generate_lod = false;
+	Simplify_options lod_options;
+};
+
+const double time_step = 1 / 30.0;
+
+extern GR2_property_key DaConstant32f_def[];
+extern GR2_property_key D3Constant32f_def[];
+extern GR2_property_key DaK32fC32f_def[];
+
+bool starts_with(const char *s1, const char *s2);
+bool ends_with(const char *s1, const char *s2);
+
+void set_packet_name(char* packet_name, const char* node_name);
+void set_map_name(char* map_name, const char* texture_filename);
+
+// Names of the bones a skin is weighted to. "f_..." (face) bones are only
+// used for head skinning, "ap_..." (attachment point) bones are not used.
+// "Ribcage" is always the last body bone.
+struct Skin_bones {
+	std::vector<std::string> body_bones;
+	std::vector<std::string> face_bones;
+};
+
+// Adds a bone, in depth-first order from the root bone.
+void add_skin_bone(Skin_bones& skin_bones, const char* bone_name);
+int bone_index(const char* bone_name, const Skin_bones& skin_bones);
+
+void init_skin_vertex(MDB_file::Skin_vertex &v);
+void normalize_bone_weights(MDB_file::Skin_vertex &v);
+
+// Writes <output>.mdb, and <output>_lod.mdb if requested, unless errors
+// were found.
+void save_models(MDB_file& mdb, const Import_info& import_info);
+
+struct GR2_track_group_info {
+	GR2_track_group track_group;
+	std::vector<GR2_transform_track> transform_tracks;
+};
+
+struct GR2_import_info {
+	fbxsdk::FbxAnimStack *anim_stack;
+	GR2_file_info file_info;
+	GR2_art_tool_info art_tool_info;
+	GR2_exporter_info exporter_info;
+	GR2_animation animation;
+	Virtual_ptr<GR2_animation> animations[1];
+	Vector3<double> bone_scaling;
+	std::list<GR2_skeleton> skeletons;
+	std::list<std::vector<GR2_bone>> bone_arrays;
+	std::vector<Virtual_ptr<GR2_skeleton>> skeleton_pointers;
+	std::list<GR2_model> models;
+	std::vector<Virtual_ptr<GR2_model>> model_pointers;
+	std::vector<GR2_track_group_info> track_groups;
+	std::list<GR2_curve_data_D3Constant32f> d3c_curves;
+	std::list<GR2_curve_data_DaConstant32f> dac_curves;
+	std::list<GR2_curve_data_DaK32fC32f> da_curves;
+	std::list<GR2_curve_data_DaIdentity> id_curves;
+	std::list<std::vector<float>> float_arrays;
+	String_collection strings;
+	std::vector<Virtual_ptr<GR2_track_group>> track_group_pointers;
+};
+
+// Initializes the file info of a GR2 file converted from the input file.
+void init_import_info(GR2_import_info& import_info,
+	const Import_info& info);
+
+void print_bone(GR2_bone& bone);
+void import_model(GR2_import_info& import_info, GR2_skeleton* skel);
+GR2_track_group_info &track_group(GR2_import_info& import_info, const char *name);
+void import_scaleshear_DaIdentity(GR2_import_info& import_info, GR2_transform_track& tt);
+
+// Writes the skeletons to <output>.gr2, unless errors were found.
+void save_skeletons(GR2_import_info& import_info, const Import_info& info);
+
+// Writes the track groups as an animation to <output>.gr2, unless errors
+// were found.
+void save_animation(GR2_import_info& import_info, const char* name,
+	float duration, const Import_info& info);
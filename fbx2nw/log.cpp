@@ -1,13 +0,0 @@
-#include <iostream>
-
-#include "log.h"
-
-namespace Log {
-	int error_count = 0;
-
-	std::ostream& error()
-	{
-		++error_count;
-		return std::cout << "ERROR: ";
-	}
-}
\ No newline at end of file
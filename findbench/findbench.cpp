@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "archive_container.h"
+#include "config.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+using Clock = chrono::steady_clock;
+
+// Substrings, then globs, as given to nw2fbx
+static const char* default_queries[] = {
+	"C_DOG", "P_HHM_CL_BODY", "_HEAD01", "PLC_MC", "A_BA", "_N.DDS",
+	"P_HHM_*_BODY01.MDB", "C_DOG*", "*_CL_HELM*", "?_E?M_*", "*.GR2"
+};
+
+static std::string to_upper(std::string s)
+{
+	for (auto& c : s)
+		c = toupper(c);
+
+	return s;
+}
+
+static std::string basename(const std::string& s)
+{
+	auto pos = s.find_last_of("/\\");
+	return pos == string::npos ? s : s.substr(pos + 1);
+}
+
+// The archive entries as the full scan before the trigram index saw them:
+// uppercase paths, and the winning copy of each basename.
+struct Scan_index {
+	vector<string> uppercase;
+	vector<bool> winner;
+	unordered_map<string, unsigned> basenames;
+
+	Scan_index(const Archive_container& archives)
+	{
+		for (unsigned a = 0; a < archives.archive_count(); ++a) {
+			for (unsigned f = 0; f < archives.file_count(a); ++f) {
+				auto name = to_upper(archives.filename(a, f));
+				bool is_directory = name.empty() || name.back() == '/';
+				winner.push_back(!is_directory
+					&& basenames.emplace(basename(name),
+					                     unsigned(uppercase.size())).second);
+				uppercase.push_back(move(name));
+			}
+		}
+	}
+
+	// Substrings are searched in the paths, globs matched against the
+	// basenames
+	unsigned find(const string& str) const
+	{
+		if (basenames.count(str))
+			return 1;
+
+		bool glob = str.find_first_of("*?") != string::npos;
+		unsigned matches = 0;
+
+		for (size_t i = 0; i < uppercase.size(); ++i) {
+			if (!winner[i])
+				continue;
+
+			if (glob ? match_glob(str.c_str(), basename(uppercase[i]).c_str())
+			         : uppercase[i].find(str) != string::npos)
+				++matches;
+		}
+
+		return matches;
+	}
+};
+
+template <typename F>
+static double time_us(unsigned repetitions, F f)
+{
+	auto start = Clock::now();
+	for (unsigned i = 0; i < repetitions; ++i)
+		f();
+	chrono::duration<double, micro> elapsed = Clock::now() - start;
+
+	return elapsed.count() / repetitions;
+}
+
+int main(int argc, char* argv[])
+{
+	Config config((path(argv[0]).parent_path() / "config.yml").string().c_str());
+	if (config.nwn2_home.empty())
+		return 1;
+
+	vector<string> queries(default_queries,
+		default_queries + sizeof(default_queries) / sizeof(char*));
+	if (argc > 1)
+		queries.assign(argv + 1, argv + argc);
+
+	// Every archive of the NWN2, X1 and X2 data
+	vector<string> filenames;
+	error_code ec;
+	for (auto& entry : directory_iterator(path(config.nwn2_home) / "Data", ec)) {
+		if (to_upper(entry.path().extension().string()) == ".ZIP")
+			filenames.push_back(entry.path().string());
+	}
+	sort(filenames.rbegin(), filenames.rend());
+
+	if (filenames.empty()) {
+		cout << "No archives found in " << config.nwn2_home << "\\Data\n";
+		return 1;
+	}
+
+	Archive_container archives;
+	auto start = Clock::now();
+	archives.add_archives(filenames);
+	chrono::duration<double, milli> index_time = Clock::now() - start;
+
+	start = Clock::now();
+	Scan_index scan(archives);
+	chrono::duration<double, milli> scan_time = Clock::now() - start;
+
+	cout << archives.archive_count() << " archives, " << scan.uppercase.size()
+	     << " files\n";
+	cout << fixed << setprecision(1) << "Indexing (with trigrams): "
+	     << index_time.count() << " ms\n";
+	cout << "Uppercase paths for the scan: " << scan_time.count()
+	     << " ms\n\n";
+
+	cout << left << setw(16) << "Query" << right << setw(10) << "Matches"
+	     << setw(12) << "Scan (us)" << setw(13) << "Index (us)"
+	     << setw(10) << "Speedup" << '\n';
+
+	const unsigned repetitions = 20;
+	bool same_matches = true;
+
+	for (auto& query : queries) {
+		auto str = to_upper(query);
+		unsigned scan_matches = scan.find(str);
+		unsigned index_matches = unsigned(archives.find_files(str.c_str()).size());
+
+		double scan_us = time_us(repetitions, [&] { scan.find(str); });
+		double index_us = time_us(repetitions,
+			[&] { archives.find_files(str.c_str()); });
+
+		cout << left << setw(16) << query << right << setw(10)
+		     << index_matches << setprecision(1) << setw(12) << scan_us
+		     << setw(13) << index_us << setw(9)
+		     << (index_us > 0 ? scan_us / index_us : 0) << "x";
+		if (scan_matches != index_matches) {
+			cout << "  (scan: " << scan_matches << " matches)";
+			same_matches = false;
+		}
+		cout << '\n';
+	}
+
+	return same_matches ? 0 : 1;
+}
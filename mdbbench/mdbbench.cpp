@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mdb_file.h"
+#include "mdb_view.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+using Clock = chrono::steady_clock;
+
+// Texture names of the materials of the MDBs, the workload of the
+// benchmark
+typedef set<string> Texture_names;
+
+static string name_str(const char name[32])
+{
+	return string(name, strnlen(name, 32));
+}
+
+static void add_texture_names(const MDB_file::Material& material,
+	Texture_names& names)
+{
+	for (auto name : { material.diffuse_map_name, material.normal_map_name,
+	                   material.tint_map_name, material.glow_map_name }) {
+		if (name[0])
+			names.insert(name_str(name));
+	}
+}
+
+static bool read_mdb_file(const fs::path& path, bool lazy,
+	Texture_names& names)
+{
+	MDB_file mdb(path.string().c_str(), lazy);
+	if (!mdb)
+		return false;
+
+	for (auto packet : mdb.packets_of_type(MDB_file::RIGD))
+		add_texture_names(
+			static_cast<MDB_file::Rigid_mesh*>(packet)->header.material,
+			names);
+
+	for (auto packet : mdb.packets_of_type(MDB_file::SKIN))
+		add_texture_names(
+			static_cast<MDB_file::Skin*>(packet)->header.material, names);
+
+	return true;
+}
+
+static bool read_mdb_view(const fs::path& path, Texture_names& names)
+{
+	MDB_view mdb(path.string().c_str());
+	if (!mdb)
+		return false;
+
+	for (uint32_t i = 0; i < mdb.packet_count(); ++i) {
+		if (auto rigd = mdb.rigid_mesh(i).header)
+			add_texture_names(rigd->material, names);
+		else if (auto skin = mdb.skin(i).header)
+			add_texture_names(skin->material, names);
+	}
+
+	return true;
+}
+
+typedef function<bool(const fs::path&, Texture_names&)> Read_function;
+
+struct Method {
+	const char* name;
+	Read_function read;
+	double best_ms = 0;
+	unsigned errors = 0;
+	Texture_names names;
+
+	Method(const char* name, Read_function read)
+		: name(name), read(move(read))
+	{
+	}
+};
+
+static vector<fs::path> mdb_paths(const char* dir)
+{
+	vector<fs::path> paths;
+
+	for (auto& entry : fs::recursive_directory_iterator(dir)) {
+		auto ext = entry.path().extension().string();
+		transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		if (entry.is_regular_file() && ext == ".mdb")
+			paths.push_back(entry.path());
+	}
+
+	return paths;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		cout << "Usage: mdbbench <directory> [runs]\n";
+		return 1;
+	}
+
+	unsigned runs = argc > 2 ? max(1, atoi(argv[2])) : 3;
+
+	vector<fs::path> paths;
+	try {
+		paths = mdb_paths(argv[1]);
+	}
+	catch (fs::filesystem_error& e) {
+		cout << e.what() << endl;
+		return 1;
+	}
+
+	if (paths.empty()) {
+		cout << "No MDB files found in " << argv[1] << endl;
+		return 1;
+	}
+
+	uintmax_t total_size = 0;
+	for (auto& path : paths)
+		total_size += fs::file_size(path);
+
+	vector<Method> methods;
+	methods.emplace_back("MDB_file",
+		[](auto& path, auto& names) {
+			return read_mdb_file(path, false, names); });
+	methods.emplace_back("MDB_file (lazy)",
+		[](auto& path, auto& names) {
+			return read_mdb_file(path, true, names); });
+	methods.emplace_back("MDB_view",
+		[](auto& path, auto& names) { return read_mdb_view(path, names); });
+
+	// Warm up the file system cache, so all the methods read the files
+	// from memory
+	for (auto& path : paths) {
+		Texture_names names;
+		read_mdb_view(path, names);
+	}
+
+	// The methods are interleaved in each run, and the best run is kept
+	for (unsigned run = 0; run < runs; ++run) {
+		for (auto& method : methods) {
+			Texture_names names;
+			unsigned errors = 0;
+
+			auto start = Clock::now();
+			for (auto& path : paths) {
+				if (!method.read(path, names))
+					++errors;
+			}
+			chrono::duration<double, milli> elapsed = Clock::now() - start;
+
+			if (run == 0 || elapsed.count() < method.best_ms)
+				method.best_ms = elapsed.count();
+			method.errors = errors;
+			method.names = move(names);
+		}
+	}
+
+	cout << paths.size() << " MDB files, " << total_size / 1024 << " KB, "
+	     << runs << " runs\n\n";
+
+	cout << left << setw(18) << "Method" << right << setw(12) << "Best (ms)"
+	     << setw(14) << "Per file (us)" << setw(10) << "MB/s"
+	     << setw(10) << "Speedup" << setw(10) << "Textures" << setw(8)
+	     << "Errors" << '\n';
+
+	double baseline_ms = methods[0].best_ms;
+	for (auto& method : methods) {
+		double ms = method.best_ms;
+		cout << left << setw(18) << method.name << right << fixed
+		     << setprecision(1) << setw(12) << ms << setw(14)
+		     << ms * 1000 / paths.size() << setw(10)
+		     << (ms > 0 ? total_size / (1024.0 * 1024.0) / (ms / 1000) : 0)
+		     << setprecision(2) << setw(9)
+		     << (ms > 0 ? baseline_ms / ms : 0) << 'x' << setw(10)
+		     << method.names.size() << setw(8) << method.errors << '\n';
+	}
+
+	for (auto& method : methods) {
+		if (method.names != methods[0].names) {
+			cout << "\nWarning: " << method.name
+			     << " found different texture names than "
+			     << methods[0].name << endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
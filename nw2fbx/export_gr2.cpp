@@ -1,13 +1,21 @@
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <string>
 
 #include "export_gr2.h"
 #include "gr2_file.h"
+#include "log.h"
+#include "parallel.h"
 
 using namespace std;
 
 const double time_step = 1 / 30.0;
 
+// Maximum error of the keys sampled adaptively with ANIMATION_KEYS_NATIVE
+const double position_tolerance = 1e-4; // Same units as LclTranslation
+const double rotation_tolerance = 0.1;  // Degrees
+
 static FbxVector4 quat_to_euler(FbxQuaternion &q)
 {
 	FbxAMatrix m;
@@ -15,291 +23,331 @@ static FbxVector4 quat_to_euler(FbxQuaternion &q)
 	return m.GetR();
 }
 
-static void export_bones(FbxScene* scene, FbxNode* parent_node,
-                         GR2_skeleton* skel, int32_t parent_index,
-                         std::vector<FbxNode*>& fbx_bones);
-
-static void export_bone_translation(FbxNode* node, GR2_bone& bone)
+static FbxDouble3 bone_translation(GR2_bone& bone)
 {
 	if (bone.transform.flags & 0x1) { // Has translation
-		node->LclTranslation.Set(FbxDouble3(bone.transform.translation[0]/100,
+		return FbxDouble3(bone.transform.translation[0]/100,
 			bone.transform.translation[1]/100,
-			bone.transform.translation[2]/100));
+			bone.transform.translation[2]/100);
 	}
 	else
-		node->LclTranslation.Set(FbxDouble3(0, 0, 0));
+		return FbxDouble3(0, 0, 0);
 }
 
-static void export_bone_rotation(FbxNode* node, GR2_bone& bone)
+static FbxDouble3 bone_rotation(GR2_bone& bone)
 {
 	if (bone.transform.flags & 0x2) { // Has rotation
 		FbxQuaternion rotation(bone.transform.rotation[0],
 			bone.transform.rotation[1],
 			bone.transform.rotation[2],
 			bone.transform.rotation[3]);
-		node->LclRotation.Set(quat_to_euler(rotation));
+		auto r = quat_to_euler(rotation);
+		return FbxDouble3(r[0], r[1], r[2]);
 	}
 	else
-		node->LclRotation.Set(FbxDouble3(0, 0, 0));
+		return FbxDouble3(0, 0, 0);
 }
 
-static void export_bone_scaleshear(FbxNode* node, GR2_bone& bone)
+static FbxDouble3 bone_scaling(GR2_bone& bone)
 {
 	if (bone.transform.flags & 0x4) { // Has scale-shear
 		// FBX doesn't support local shear. We only export scale.
-		node->LclScaling.Set(FbxDouble3(bone.transform.scale_shear[0],
+		return FbxDouble3(bone.transform.scale_shear[0],
 			bone.transform.scale_shear[4],
-			bone.transform.scale_shear[8]));
+			bone.transform.scale_shear[8]);
 	}
 	else
-		node->LclScaling.Set(FbxDouble3(1, 1, 1));
+		return FbxDouble3(1, 1, 1);
 }
 
-static void export_bone_transform(FbxNode* node, GR2_bone& bone)
+static Skeleton_bones skeleton_bones(GR2_skeleton* skel)
 {
-	export_bone_translation(node, bone);
-	export_bone_rotation(node, bone);
-	export_bone_scaleshear(node, bone);	
-}
+	Skeleton_bones sb;
+	sb.name = skel->name;
+	sb.bones.resize(skel->bones_count);
 
-static void export_bone(FbxScene *scene, FbxNode *parent_node, GR2_skeleton *skel,
-	int32_t bone_index, std::vector<FbxNode*> &fbx_bones)
-{
-	GR2_bone &bone = skel->bones[bone_index];
-	cout << "  Exporting bone: " << bone.name << endl;
-	auto node = FbxNode::Create(scene, bone.name);
-	export_bone_transform(node, bone);
-
-	FbxSkeleton *skel_attr = FbxSkeleton::Create(scene, bone.name);
-	skel_attr->SetSkeletonType(FbxSkeleton::eLimbNode);
-	node->SetNodeAttribute(skel_attr);
+	for (int32_t i = 0; i < skel->bones_count; ++i) {
+		GR2_bone &bone = skel->bones[i];
+		auto& b = sb.bones[i];
+		b.name = bone.name;
+		b.parent_index = bone.parent_index;
+		b.translation = bone_translation(bone);
+		b.rotation = bone_rotation(bone);
+		b.scaling = bone_scaling(bone);
+	}
 
-	parent_node->AddChild(node);
-	fbx_bones[bone_index] = node;
+	sb.order = bone_order(*skel);
 
-	export_bones(scene, node, skel, bone_index, fbx_bones);	
+	return sb;
 }
 
-static void export_bones(FbxScene *scene, FbxNode *parent_node, GR2_skeleton *skel,
-	int32_t parent_index, std::vector<FbxNode*> &fbx_bones)
+std::vector<Skeleton_bones> skeleton_bones(GR2_file& gr2)
 {
-	fbx_bones.resize(skel->bones_count);
+	std::vector<Skeleton_bones> skeletons;
 
-	for (int32_t i = 0; i < skel->bones_count; ++i) {
-		GR2_bone &bone = skel->bones[i];
-		if (bone.parent_index == parent_index) {
-			export_bone(scene, parent_node, skel, i, fbx_bones);			
-		}
+	auto info = gr2.file_info;
+	for (int i = 0; i < info->models_count; ++i) {
+		if (info->models[i]->skeleton)
+			skeletons.push_back(skeleton_bones(info->models[i]->skeleton));
 	}
+
+	return skeletons;
 }
 
-static void export_skeleton(FbxScene *scene, GR2_skeleton *skel,
-	std::vector<FbxNode*> &fbx_bones)
+static void export_skeleton(FbxScene *scene, const Skeleton_bones& skel,
+	std::vector<FbxNode*> &fbx_bones, Node_index& nodes)
 {
-	cout << "Exporting skeleton: " << skel->name << endl;
+	Log::info() << "Exporting skeleton: " << skel.name << endl;
 
-	auto node = FbxNode::Create(scene, skel->name);
+	auto node = FbxNode::Create(scene, skel.name.c_str());
+	nodes.add(node);
 	node->LclRotation.Set(FbxDouble3(-90, 0, 0));
 	node->LclScaling.Set(FbxDouble3(100, 100, 100));
 
-	auto null_attr = FbxNull::Create(scene, skel->name);
+	auto null_attr = FbxNull::Create(scene, skel.name.c_str());
 	node->SetNodeAttribute(null_attr);
 
 	scene->GetRootNode()->AddChild(node);
 
-	export_bones(scene, node, skel, -1, fbx_bones);	
-}
-
-static void export_skeletons(FbxScene *scene, GR2_file_info *info,
-	std::vector<FbxNode*> &fbx_bones)
-{
-	for (int i = 0; i < info->models_count; ++i) {
-		if(info->models[i]->skeleton)
-			export_skeleton(scene, info->models[i]->skeleton, fbx_bones);
+	// Parents are created before their children
+	fbx_bones.resize(skel.bones.size());
+	for (auto i : skel.order) {
+		auto& bone = skel.bones[i];
+		Log::debug() << "  Exporting bone: " << bone.name << endl;
+		auto bone_node = FbxNode::Create(scene, bone.name.c_str());
+		nodes.add(bone_node);
+		bone_node->LclTranslation.Set(bone.translation);
+		bone_node->LclRotation.Set(bone.rotation);
+		bone_node->LclScaling.Set(bone.scaling);
+
+		FbxSkeleton *skel_attr = FbxSkeleton::Create(scene, bone.name.c_str());
+		skel_attr->SetSkeletonType(FbxSkeleton::eLimbNode);
+		bone_node->SetNodeAttribute(skel_attr);
+
+		auto parent = bone.parent_index == -1 ? node
+			: fbx_bones[bone.parent_index];
+		parent->AddChild(bone_node);
+		fbx_bones[i] = bone_node;
 	}
 }
 
-std::vector<float> padded_knots(const std::vector<float>& knots, unsigned degree)
+static void export_skeletons(FbxScene *scene,
+	const std::vector<Skeleton_bones>& skeletons,
+	std::vector<FbxNode*> &fbx_bones, Node_index& nodes)
 {
-	std::vector<float> v;
-
-	v.push_back(0);
-
-	for (auto t : knots)
-		v.push_back(t);
-
-	for (unsigned i = 1; i <= degree; ++i) {
-		v[i] = 0;
-		v.push_back(knots.back());
-	}
-
-	return v;
+	for (auto& skel : skeletons)
+		export_skeleton(scene, skel, fbx_bones, nodes);
 }
 
-// De Boor's algorithm to evaluate a B-spline
-Vector3<float> de_boor_position(unsigned k, const std::vector<float>& knots, const std::vector<Vector4<float>>& controls, float t)
-{	
-	unsigned i = k;
-
-	while (i < knots.size() - k - 1 && knots[i] <= t)
-		++i;
+// Keys for the X, Y and Z curves of a property
+struct Vector_keys {
+	std::vector<float> times;
+	std::vector<Vector3<float>> values;
+	bool constant = false; // Step interpolation, otherwise linear
 
-	i = i - 1;
-
-	std::vector<Vector3<float>> d;
-
-	for (unsigned j = 0; j <= k; ++j) {
-		auto r = controls[j + i - k];
-		d.emplace_back(r.x, r.y, r.z);
+	void add(float t, const Vector3<float>& v)
+	{
+		times.push_back(t);
+		values.push_back(v);
 	}
+};
 
-	for (unsigned r = 1; r <= k; ++r) {
-		for (unsigned j = k; j >= r; --j) {
-			float alpha = 0;
-			if (knots[j + 1 + i - r] != knots[j + i - k])
-				alpha = (t - knots[j + i - k]) / (knots[j + 1 + i - r] - knots[j + i - k]);
-			d[j].x = d[j - 1].x * (1 - alpha) + d[j].x * alpha;
-			d[j].y = d[j - 1].y * (1 - alpha) + d[j].y * alpha;
-			d[j].z = d[j - 1].z * (1 - alpha) + d[j].z * alpha;
+// Sets the keys of a curve from a component of the key values. Curves
+// without keys are filled in bulk.
+static void set_curve_keys(FbxAnimCurve* curve, const Vector_keys& keys,
+	float Vector3<float>::*component)
+{
+	auto interpolation = keys.constant ?
+		FbxAnimCurveDef::eInterpolationConstant :
+		FbxAnimCurveDef::eInterpolationLinear;
+
+	curve->KeyModifyBegin();
+
+	if (curve->KeyGetCount() == 0) {
+		curve->ResizeKeyBuffer(int(keys.times.size()));
+		for (unsigned i = 0; i < keys.times.size(); ++i) {
+			FbxTime time;
+			time.SetSecondDouble(keys.times[i]);
+			curve->KeySet(i, time, keys.values[i].*component, interpolation);
+		}
+	}
+	else {
+		for (unsigned i = 0; i < keys.times.size(); ++i) {
+			FbxTime time;
+			time.SetSecondDouble(keys.times[i]);
+			auto k = curve->KeyAdd(time);
+			curve->KeySetInterpolation(k, interpolation);
+			curve->KeySetValue(k, keys.values[i].*component);
 		}
 	}
 
-	return d[k];
+	curve->KeyModifyEnd();
 }
 
-Vector3<float> de_boor_position(unsigned degree, float t, GR2_curve_view &v)
+static void set_keys(FbxProperty& property, FbxAnimLayer* anim_layer,
+	const Vector_keys& keys)
 {
-	if (v.knots().size() == 1 || v.knots().size() < degree + 1)
-		return Vector3<float>(v.controls()[0].x, v.controls()[0].y, v.controls()[0].z);
+	if (keys.times.empty())
+		return;
 
-	return de_boor_position(degree, padded_knots(v.knots(), degree), v.controls(), t);
+	set_curve_keys(property.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_X, true),
+		keys, &Vector3<float>::x);
+	set_curve_keys(property.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_Y, true),
+		keys, &Vector3<float>::y);
+	set_curve_keys(property.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_Z, true),
+		keys, &Vector3<float>::z);
 }
 
-// De Boor's algorithm to evaluate a B-spline
-FbxQuaternion de_boor_rotation(unsigned k, const std::vector<float>& knots, const std::vector<Vector4<float>>& controls, float t)
+// Samples a curve at time_step intervals, over the whole animation.
+template <typename Value>
+static Vector_keys sampled_keys(GR2_animation* anim, Value value)
 {
-	unsigned i = k;
-
-	while (i < knots.size() - k - 1 && knots[i] <= t)
-		++i;
+	Vector_keys keys;
 
-	i = i - 1;
-
-	std::vector<FbxQuaternion> d;
-
-	for (unsigned j = 0; j <= k; ++j) {
-		auto r = controls[j + i - k];
-		d.emplace_back(r.x, r.y, r.z, r.w);
-	}
-
-	for (unsigned r = 1; r <= k; ++r) {
-		for (unsigned j = k; j >= r; --j) {
-			float alpha = 1;
-			if (knots[j + 1 + i - r] != knots[j + i - k])
-				alpha = (t - knots[j + i - k]) / (knots[j + 1 + i - r] - knots[j + i - k]);
-			d[j] = d[j - 1].Slerp(d[j], alpha);
-		}
-	}
+	for (double i = 0, t = 0; t < anim->duration + time_step / 2; ++i, t = i*time_step)
+		keys.add(float(t), value(float(t)));
 
-	return d[k];
+	return keys;
 }
 
-FbxQuaternion de_boor_rotation(unsigned degree, float t, GR2_curve_view &v)
+static Vector3<float> lerp(const Vector3<float>& a, const Vector3<float>& b,
+	float alpha)
 {
-	if (v.knots().size() == 1 || v.knots().size() < degree + 1)
-		return FbxQuaternion(v.controls()[0].x, v.controls()[0].y, v.controls()[0].z, v.controls()[0].w);	
-
-	return de_boor_rotation(degree, padded_knots(v.knots(), degree), v.controls(), t);
+	return Vector3<float>(a.x + (b.x - a.x) * alpha,
+		a.y + (b.y - a.y) * alpha, a.z + (b.z - a.z) * alpha);
 }
 
-void add_position_keyframe(FbxAnimCurve* curvex, FbxAnimCurve* curvey,
-	FbxAnimCurve* curvez, GR2_curve_view &view, float t)
+// Adds keys in (t0, t1] until the linear interpolation between keys is
+// within tolerance of the curve at every frame (multiple of time_step).
+// error(t, v) is the error of value v at time t, relative to the
+// tolerance. Segments are split at frames, so there are never more keys
+// than the frames plus the knots.
+template <typename Value, typename Error>
+static void refine_keys(Vector_keys& keys, float t0, float t1,
+	const Vector3<float>& v0, const Vector3<float>& v1, Value& value,
+	Error& error)
 {
-	auto p = de_boor_position(view.degree(), t, view);
+	// Frames strictly inside the segment
+	const double epsilon = time_step / 100;
+	int first = int(ceil((t0 + epsilon) / time_step));
+	int last = int(floor((t1 - epsilon) / time_step));
 
-	FbxTime time;
-	time.SetSecondDouble(t);
+	bool within_tolerance = true;
 
-	auto k = curvex->KeyAdd(time);
-	curvex->KeySetInterpolation(k, FbxAnimCurveDef::eInterpolationLinear);
-	curvex->KeySetValue(k, p.x/100);
+	for (int i = first; i <= last && within_tolerance; ++i) {
+		float t = float(i * time_step);
+		if (error(t, lerp(v0, v1, (t - t0) / (t1 - t0))) > 1)
+			within_tolerance = false;
+	}
 
-	k = curvey->KeyAdd(time);
-	curvey->KeySetInterpolation(k, FbxAnimCurveDef::eInterpolationLinear);
-	curvey->KeySetValue(k, p.y/100);
+	if (within_tolerance) {
+		keys.add(t1, v1);
+		return;
+	}
 
-	k = curvez->KeyAdd(time);
-	curvez->KeySetInterpolation(k, FbxAnimCurveDef::eInterpolationLinear);
-	curvez->KeySetValue(k, p.z/100);
+	float tm = float((first + last) / 2 * time_step);
+	auto vm = value(tm);
+	refine_keys(keys, t0, tm, v0, vm, value, error);
+	refine_keys(keys, tm, t1, vm, v1, value, error);
 }
 
-void create_anim_position(FbxNode *node, FbxAnimLayer *anim_layer, GR2_animation *anim,
-	GR2_transform_track &transform_track)
+// Creates keys at the knots of a curve. Degree 0 curves get constant keys
+// and degree 1 curves linear keys. Segments of higher degree curves, or of
+// rotations whose Euler angles don't interpolate linearly, are sampled
+// adaptively until they are within tolerance.
+template <typename Value, typename Error>
+static Vector_keys native_keys(GR2_curve_view& view, Value value,
+	Error error)
 {
-	GR2_curve_view view(transform_track.position_curve);
-
-	if (view.knots().empty())
-		return;
-
-	auto curvex = node->LclTranslation.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_X, true);	
-	auto curvey = node->LclTranslation.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_Y, true);	
-	auto curvez = node->LclTranslation.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_Z, true);	
-
-	curvex->KeyModifyBegin();
-	curvey->KeyModifyBegin();
-	curvez->KeyModifyBegin();	
-
-	for (double i = 0, t = 0; t < anim->duration + time_step / 2; ++i, t = i*time_step)
-		add_position_keyframe(curvex, curvey, curvez, view, float(t));
+	Vector_keys keys;
+	auto& knots = view.knots();
+
+	keys.add(0, value(0));
+
+	// Constant curve
+	if (knots.size() == 1 || knots.size() < view.degree() + 1u)
+		return keys;
+
+	keys.constant = view.degree() == 0;
+
+	for (auto t : knots) {
+		if (t <= keys.times.back())
+			continue;
+		if (keys.constant)
+			keys.add(t, value(t));
+		else {
+			// Copies, refine_keys adds to keys
+			auto t0 = keys.times.back();
+			auto v0 = keys.values.back();
+			refine_keys(keys, t0, t, v0, value(t), value, error);
+		}
+	}
 
-	curvex->KeyModifyEnd();
-	curvey->KeyModifyEnd();
-	curvez->KeyModifyEnd();
+	return keys;
 }
 
-void add_rotation_keyframe(FbxAnimCurve* curvex, FbxAnimCurve* curvey,
-	FbxAnimCurve* curvez, GR2_curve_view &view, float t)
+static Vector_keys position_keys(GR2_animation *anim, GR2_curve_view &view,
+	Animation_keys mode)
 {
-	auto r = de_boor_rotation(view.degree(), t, view);
-	auto e = quat_to_euler(r);
-
-	FbxTime time;
-	time.SetSecondDouble(t);
+	auto value = [&](float t) {
+		auto p = view.value(t, false);
+		return Vector3<float>(p.x / 100, p.y / 100, p.z / 100);
+	};
 
-	auto k = curvex->KeyAdd(time);
-	curvex->KeySetInterpolation(k, FbxAnimCurveDef::eInterpolationLinear);
-	curvex->KeySetValue(k, float(e[0]));
+	if (mode == ANIMATION_KEYS_SAMPLED)
+		return sampled_keys(anim, value);
 
-	k = curvey->KeyAdd(time);
-	curvey->KeySetInterpolation(k, FbxAnimCurveDef::eInterpolationLinear);
-	curvey->KeySetValue(k, float(e[1]));
+	auto error = [&](float t, const Vector3<float>& v) {
+		auto p = value(t);
+		return max({ fabs(p.x - v.x), fabs(p.y - v.y), fabs(p.z - v.z) })
+			/ position_tolerance;
+	};
 
-	k = curvez->KeyAdd(time);
-	curvez->KeySetInterpolation(k, FbxAnimCurveDef::eInterpolationLinear);
-	curvez->KeySetValue(k, float(e[2]));
+	return native_keys(view, value, error);
 }
 
-void create_anim_rotation(FbxNode *node, FbxAnimLayer *anim_layer, GR2_animation *anim, GR2_transform_track &transform_track)
+// Angle between two rotations, in degrees
+static double rotation_angle(const FbxQuaternion& a, const FbxQuaternion& b)
 {
-	GR2_curve_view view(transform_track.orientation_curve);
-
-	if (view.knots().empty())
-		return;
+	double dot = 0, norm_a = 0, norm_b = 0;
+	for (int i = 0; i < 4; ++i) {
+		dot += a[i] * b[i];
+		norm_a += a[i] * a[i];
+		norm_b += b[i] * b[i];
+	}
 
-	auto curvex = node->LclRotation.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_X, true);	
-	auto curvey = node->LclRotation.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_Y, true);	
-	auto curvez = node->LclRotation.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_Z, true);
+	double cos_half = fabs(dot) / sqrt(norm_a * norm_b);
 
-	curvex->KeyModifyBegin();
-	curvey->KeyModifyBegin();
-	curvez->KeyModifyBegin();	
+	return 2 * acos(min(1.0, cos_half)) * 180 / FBXSDK_PI;
+}
 
-	for (double i = 0, t = 0; t < anim->duration + time_step / 2; ++i, t = i*time_step)
-		add_rotation_keyframe(curvex, curvey, curvez, view, float(t));
+static FbxQuaternion curve_rotation(const GR2_curve_view& view, float t)
+{
+	auto q = view.value(t, true);
+	return FbxQuaternion(q.x, q.y, q.z, q.w);
+}
 
-	curvex->KeyModifyEnd();
-	curvey->KeyModifyEnd();
-	curvez->KeyModifyEnd();
+static Vector_keys rotation_keys(GR2_animation *anim, GR2_curve_view &view,
+	Animation_keys mode)
+{
+	auto value = [&](float t) {
+		auto e = quat_to_euler(curve_rotation(view, t));
+		return Vector3<float>(float(e[0]), float(e[1]), float(e[2]));
+	};
+
+	if (mode == ANIMATION_KEYS_SAMPLED)
+		return sampled_keys(anim, value);
+
+	// FBX interpolates the Euler angles, the error is measured against
+	// the rotation of the curve
+	auto error = [&](float t, const Vector3<float>& v) {
+		FbxAMatrix m;
+		m.SetR(FbxVector4(v.x, v.y, v.z));
+		return rotation_angle(m.GetQ(), curve_rotation(view, t))
+			/ rotation_tolerance;
+	};
+
+	return native_keys(view, value, error);
 }
 
 std::pair<std::vector<float>, std::vector<float>> scaleshear_curve_view(GR2_transform_track &transform_track)
@@ -329,55 +377,49 @@ std::pair<std::vector<float>, std::vector<float>> scaleshear_curve_view(GR2_tran
 	return { knots, controls };
 }
 
-void add_scaling_keyframe(FbxAnimCurve* curvex, FbxAnimCurve* curvey,
-	FbxAnimCurve* curvez, std::vector<float>& knots, std::vector<float>& controls,
-	unsigned i)
+static Vector_keys scaling_keys(GR2_transform_track &transform_track)
 {
-	FbxTime time;
-	time.SetSecondDouble(knots[i]);
-
-	auto k = curvex->KeyAdd(time);
-	curvex->KeySetInterpolation(k, FbxAnimCurveDef::eInterpolationLinear);
-	curvex->KeySetValue(k, controls[i * 9 + 0]);
-
-	k = curvey->KeyAdd(time);
-	curvey->KeySetInterpolation(k, FbxAnimCurveDef::eInterpolationLinear);
-	curvey->KeySetValue(k, controls[i * 9 + 4]);
-
-	k = curvez->KeyAdd(time);
-	curvez->KeySetInterpolation(k, FbxAnimCurveDef::eInterpolationLinear);
-	curvez->KeySetValue(k, controls[i * 9 + 8]);
-}
-
-void create_anim_scaling(FbxNode *node, FbxAnimLayer *anim_layer, GR2_animation *anim, GR2_transform_track &transform_track)
-{	
 	auto [knots, controls] = scaleshear_curve_view(transform_track);
 
-	if (knots.empty())
-		return;
+	Vector_keys keys;
+	for (unsigned i = 0; i < knots.size(); ++i)
+		keys.add(knots[i], Vector3<float>(controls[i * 9 + 0],
+			controls[i * 9 + 4], controls[i * 9 + 8]));
 
-	auto curvex = node->LclScaling.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_X, true);
-	auto curvey = node->LclScaling.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_Y, true);
-	auto curvez = node->LclScaling.GetCurve(anim_layer, FBXSDK_CURVENODE_COMPONENT_Z, true);
+	return keys;
+}
 
-	curvex->KeyModifyBegin();
-	curvey->KeyModifyBegin();
-	curvez->KeyModifyBegin();
+// A transform track bound to its node, with its keys
+struct Track_keys {
+	FbxNode* node;
+	FbxAnimLayer* anim_layer;
+	GR2_animation* anim;
+	GR2_transform_track* transform_track;
+	Vector_keys position;
+	Vector_keys rotation;
+	Vector_keys scaling;
+};
+
+// Evaluates the curves of a track. It doesn't touch the scene, so tracks
+// can be evaluated concurrently.
+static void evaluate_track(Track_keys& track, Animation_keys mode)
+{
+	GR2_curve_view position_view(track.transform_track->position_curve);
+	if (!position_view.knots().empty())
+		track.position = position_keys(track.anim, position_view, mode);
 
-	for (unsigned i = 0; i < knots.size(); ++i)
-		add_scaling_keyframe(curvex, curvey, curvez, knots, controls, i);
+	GR2_curve_view rotation_view(track.transform_track->orientation_curve);
+	if (!rotation_view.knots().empty())
+		track.rotation = rotation_keys(track.anim, rotation_view, mode);
 
-	curvex->KeyModifyEnd();
-	curvey->KeyModifyEnd();
-	curvez->KeyModifyEnd();
+	track.scaling = scaling_keys(*track.transform_track);
 }
 
-static void create_animation(FbxNode* node,	FbxAnimLayer *anim_layer,
-	GR2_animation *anim, GR2_transform_track &transform_track)
+static void add_track_keys(const Track_keys& track)
 {
-	create_anim_position(node, anim_layer, anim, transform_track);
-	create_anim_rotation(node, anim_layer, anim, transform_track);
-	create_anim_scaling(node, anim_layer, anim, transform_track);
+	set_keys(track.node->LclTranslation, track.anim_layer, track.position);
+	set_keys(track.node->LclRotation, track.anim_layer, track.rotation);
+	set_keys(track.node->LclScaling, track.anim_layer, track.scaling);
 }
 
 static bool node_is_animated(FbxNode* node, GR2_transform_track &transform_track)
@@ -386,16 +428,31 @@ static bool node_is_animated(FbxNode* node, GR2_transform_track &transform_track
 		(node->GetChildCount() == 0 || strcmp(node->GetName(), node->GetChild(0)->GetName()) != 0);
 }
 
-static FbxNode* create_animation_pivot(FbxNode* node, GR2_track_group *track_group)
+// Finds the node animated by a transform track
+static FbxNode* find_animated_node(Node_index& nodes,
+	GR2_transform_track &transform_track)
+{
+	for (auto node : nodes.find(transform_track.name)) {
+		if (node_is_animated(node, transform_track))
+			return node;
+	}
+
+	return nullptr;
+}
+
+static FbxNode* create_animation_pivot(FbxNode* node, GR2_track_group *track_group,
+	Node_index& nodes)
 {
 	string pivot_name = track_group->name.get();
 	if(strcmp(node->GetName(), track_group->name) == 0)
 		pivot_name += ".PIVOT";
 
-	auto pivot = node->GetScene()->FindNodeByName(pivot_name.c_str());
+	auto& pivots = nodes.find(pivot_name.c_str());
+	auto pivot = pivots.empty() ? nullptr : pivots[0];
 
 	if (!pivot) {
 		pivot = FbxNode::Create(node->GetScene(), pivot_name.c_str());
+		nodes.add(pivot);
 		pivot->LclRotation.Set(FbxDouble3(-90, 0, 0));
 		pivot->LclScaling.Set(FbxDouble3(100, 100, 100));
 		node->GetScene()->GetRootNode()->AddChild(pivot);
@@ -404,12 +461,13 @@ static FbxNode* create_animation_pivot(FbxNode* node, GR2_track_group *track_gro
 	return pivot;
 }
 
-static void parent_to_animation_pivot(FbxNode* node, GR2_track_group *track_group)
+static void parent_to_animation_pivot(FbxNode* node, GR2_track_group *track_group,
+	Node_index& nodes)
 {
 	if (!node->GetMesh())
 		return; // Animation pivot is only for meshes
 
-	auto pivot = create_animation_pivot(node, track_group);
+	auto pivot = create_animation_pivot(node, track_group, nodes);
 
 	// Make node child of pivot
 	node->GetParent()->RemoveChild(node);
@@ -420,77 +478,126 @@ static void parent_to_animation_pivot(FbxNode* node, GR2_track_group *track_grou
 	node->LclScaling.Set(FbxDouble3(1, 1, 1));
 }
 
-static bool export_animation(FbxNode* node, FbxAnimLayer *anim_layer,
-	GR2_animation *anim, GR2_track_group *track_group, GR2_transform_track &transform_track)
+static void export_animation(GR2_animation *anim, GR2_track_group *track_group,
+	FbxAnimLayer *anim_layer, Node_index& nodes, std::vector<Track_keys>& tracks)
 {
-	if (node_is_animated(node, transform_track)) {		
-		create_animation(node, anim_layer, anim, transform_track);
-		parent_to_animation_pivot(node, track_group);
-		return true;
-	}
+	Log::info() << "  Exporting track group: " << track_group->name << endl;
 
-	for (int i = 0; i < node->GetChildCount(); ++i)
-		if (export_animation(node->GetChild(i), anim_layer, anim, track_group, transform_track))
-			return true;
+	// Bind all the tracks before pivots are added and meshes reparented
+	vector<FbxNode*> animated_nodes(track_group->transform_tracks_count);
+	for (int i = 0; i < track_group->transform_tracks_count; ++i)
+		animated_nodes[i] = find_animated_node(nodes, track_group->transform_tracks[i]);
 
-	return false;
-}
-
-static void export_animation(FbxScene *scene, GR2_animation *anim, GR2_track_group *track_group,
-	FbxAnimLayer *anim_layer)
-{
-	cout << "  Exporting track group: " << track_group->name << endl;
-	
 	for (int i = 0; i < track_group->transform_tracks_count; ++i) {
-		cout << "    Exporting transform track: " << track_group->transform_tracks[i].name << endl;
+		auto &transform_track = track_group->transform_tracks[i];
+		Log::debug() << "    Exporting transform track: " << transform_track.name << endl;
 
-		export_animation(scene->GetRootNode(), anim_layer, anim, track_group, track_group->transform_tracks[i]);
+		if (animated_nodes[i]) {
+			tracks.push_back({ animated_nodes[i], anim_layer, anim, &transform_track });
+			parent_to_animation_pivot(animated_nodes[i], track_group, nodes);
+		}
 	}
 }
 
-static void export_animation(FbxScene *scene, GR2_animation *anim)
+static void export_animation(FbxScene *scene, GR2_animation *anim,
+	Node_index& nodes, std::vector<Track_keys>& tracks)
 {
-	cout << "Exporting animation: " << anim->name << endl;
+	Log::info() << "Exporting animation: " << anim->name << endl;
 
 	auto anim_stack = FbxAnimStack::Create(scene, anim->name);
 	auto anim_layer = FbxAnimLayer::Create(scene, "Layer");
 	anim_stack->AddMember(anim_layer);
 
 	for (int i = 0; i < anim->track_groups_count; ++i)
-		export_animation(scene, anim, anim->track_groups[i], anim_layer);
+		export_animation(anim, anim->track_groups[i], anim_layer, nodes, tracks);
 }
 
-static void export_animations(FbxScene *scene, GR2_file_info *info)
+static void export_animations(FbxScene *scene, GR2_file_info *info,
+	Node_index& nodes, Animation_keys mode)
 {
+	// Picks up the meshes and skeletons added since the last animation
+	nodes.update(scene);
+
+	using Clock = chrono::steady_clock;
+	auto start = Clock::now();
+
+	// Binding and pivots depend on the scene hierarchy, they are done in
+	// order first
+	vector<Track_keys> tracks;
 	for (int i = 0; i < info->animations_count; ++i) {
-		export_animation(scene, info->animations[i]);
+		export_animation(scene, info->animations[i], nodes, tracks);
 	}
+
+	auto bound = Clock::now();
+
+	parallel_for(tracks.size(),
+		[&](size_t i) { evaluate_track(tracks[i], mode); });
+
+	auto evaluated = Clock::now();
+
+	size_t key_count = 0;
+	for (auto &track : tracks) {
+		add_track_keys(track);
+		key_count += track.position.times.size() + track.rotation.times.size()
+			+ track.scaling.times.size();
+	}
+
+	auto inserted = Clock::now();
+
+	if (tracks.empty())
+		return;
+
+	auto ms = [](Clock::duration d) {
+		return chrono::duration<double, milli>(d).count();
+	};
+
+	Log::info() << "Animation tracks: " << tracks.size() << ", keys: "
+	            << key_count * 3 << endl;
+	Log::debug() << "  Binding:    " << ms(bound - start) << " ms\n";
+	Log::debug() << "  Evaluation: " << ms(evaluated - bound) << " ms ("
+	             << parallel_thread_count(tracks.size()) << " threads)\n";
+	Log::debug() << "  Insertion:  " << ms(inserted - evaluated) << " ms\n";
 }
 
 void export_gr2(const char *filename, FbxScene *scene,
-	std::vector<FbxNode*> &fbx_bones)
+	std::vector<FbxNode*> &fbx_bones, Node_index& nodes, Animation_keys mode)
 {
 	GR2_file gr2(filename);
 	if (!gr2) {
-		cout << gr2.error_string() << endl;
+		Log::error() << gr2.error_string() << endl;
 		return;
 	}
 
-	export_gr2(gr2, scene, fbx_bones);	
+	export_gr2(gr2, scene, fbx_bones, nodes, mode);	
+}
+
+static void print_gr2_info(GR2_file& gr2)
+{
+	Log::info() << endl;
+	Log::info() << "===\n";
+	Log::info() << "GR2\n";
+	Log::info() << "===\n";
+	Log::info() << "Skeletons: " << gr2.file_info->skeletons_count << endl;
+	Log::info() << "Models: " << gr2.file_info->models_count << endl;
+	Log::info() << "Animations: " << gr2.file_info->animations_count << endl;
+	Log::info() << endl;
 }
 
 void export_gr2(GR2_file& gr2, FbxScene *scene,
-	std::vector<FbxNode*> &fbx_bones)
-{
-	cout << endl;
-	cout << "===\n";
-	cout << "GR2\n";
-	cout << "===\n";
-	cout << "Skeletons: " << gr2.file_info->skeletons_count << endl;
-	cout << "Models: " << gr2.file_info->models_count << endl;
-	cout << "Animations: " << gr2.file_info->animations_count << endl;
-	cout << endl;
-
-	export_skeletons(scene, gr2.file_info, fbx_bones);
-	export_animations(scene, gr2.file_info);
+	std::vector<FbxNode*> &fbx_bones, Node_index& nodes, Animation_keys mode)
+{
+	print_gr2_info(gr2);
+
+	export_skeletons(scene, skeleton_bones(gr2), fbx_bones, nodes);
+	export_animations(scene, gr2.file_info, nodes, mode);
+}
+
+void export_gr2(GR2_file& gr2, const std::vector<Skeleton_bones>& skeletons,
+	FbxScene *scene, std::vector<FbxNode*> &fbx_bones, Node_index& nodes,
+	Animation_keys mode)
+{
+	print_gr2_info(gr2);
+
+	export_skeletons(scene, skeletons, fbx_bones, nodes);
+	export_animations(scene, gr2.file_info, nodes, mode);
 }
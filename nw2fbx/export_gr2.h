@@ -2,11 +2,48 @@
 
 class GR2_file;
 
+#include <string>
 #include <vector>
 
 #include "fbxsdk.h"
+#include "node_index.h"
 
+// How animation curves are converted to FBX keys
+enum Animation_keys {
+	ANIMATION_KEYS_SAMPLED, // A key every 1/30 s
+	ANIMATION_KEYS_NATIVE   // Keys at the knots of the curves
+};
+
+// The bones of a GR2 skeleton, with their local transforms converted for
+// the FBX nodes
+struct Skeleton_bones {
+	struct Bone {
+		std::string name;
+		int32_t parent_index;
+		FbxDouble3 translation;
+		FbxDouble3 rotation;
+		FbxDouble3 scaling;
+	};
+
+	std::string name;
+	std::vector<Bone> bones;     // In GR2 order
+	std::vector<unsigned> order; // Parents before their children
+};
+
+// Returns the skeletons of the models of a GR2 file.
+std::vector<Skeleton_bones> skeleton_bones(GR2_file& gr2);
+
+// The nodes created are added to nodes, which must be the index of scene.
+// Animations are bound to the nodes through it.
 void export_gr2(const char *filename, FbxScene *scene,
-	std::vector<FbxNode*> &fbx_bones);
+	std::vector<FbxNode*> &fbx_bones, Node_index& nodes,
+	Animation_keys mode = ANIMATION_KEYS_SAMPLED);
 void export_gr2(GR2_file& gr2, FbxScene *scene,
-	std::vector<FbxNode*> &fbx_bones);
\ No newline at end of file
+	std::vector<FbxNode*> &fbx_bones, Node_index& nodes,
+	Animation_keys mode = ANIMATION_KEYS_SAMPLED);
+
+// Same as above, but the skeletons of gr2 were already converted by
+// skeleton_bones.
+void export_gr2(GR2_file& gr2, const std::vector<Skeleton_bones>& skeletons,
+	FbxScene *scene, std::vector<FbxNode*> &fbx_bones, Node_index& nodes,
+	Animation_keys mode = ANIMATION_KEYS_SAMPLED);
\ No newline at end of file
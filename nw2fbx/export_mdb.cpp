@@ -1,11 +1,13 @@
-#include <iostream>
 #include <algorithm>
 #include <filesystem>
+#include <set>
 
 #include "config.h"
 #include "export_gr2.h"
 #include "export_mdb.h"
+#include "log.h"
 #include "mdb_file.h"
+#include "parallel.h"
 
 using namespace std;
 using namespace std::filesystem;
@@ -255,7 +257,7 @@ static void export_collision_mesh_2(Export_info& export_info,
 	const MDB_file::Collision_mesh& cm)
 {	
 	string name(cm.header.name, 32);
-	cout << "Exporting COL2: " << name.c_str() << endl;
+	Log::info() << "Exporting COL2: " << name.c_str() << endl;
 
 	auto mesh = FbxMesh::Create(export_info.scene, name.c_str());
 
@@ -283,7 +285,7 @@ static void export_collision_mesh_3(Export_info& export_info,
 	const MDB_file::Collision_mesh& cm)
 {
 	string name(cm.header.name, 32);
-	cout << "Exporting COL3: " << name.c_str() << endl;
+	Log::info() << "Exporting COL3: " << name.c_str() << endl;
 
 	auto mesh = FbxMesh::Create(export_info.scene, name.c_str());
 
@@ -480,7 +482,7 @@ static void create_user_properties(FbxNode* node, const MDB_file::Hair& hair)
 static void export_hair(Export_info& export_info, const MDB_file::Hair& hair)
 {
 	string name(hair.header.name, 32);
-	cout << "Exporting HAIR: " << name.c_str() << endl;
+	Log::info() << "Exporting HAIR: " << name.c_str() << endl;
 
 	auto node = FbxNode::Create(export_info.scene, name.c_str());
 	node->LclTranslation.Set(FbxDouble3(hair.header.position.x * 100, hair.header.position.z * 100, -hair.header.position.y * 100));
@@ -511,7 +513,7 @@ static void create_user_properties(FbxNode* node, const MDB_file::Helm& helm)
 static void export_helm(Export_info& export_info, const MDB_file::Helm& helm)
 {
 	string name(helm.header.name, 32);
-	cout << "Exporting HELM: " << name.c_str() << endl;
+	Log::info() << "Exporting HELM: " << name.c_str() << endl;
 
 	auto node = FbxNode::Create(export_info.scene, name.c_str());
 	node->LclTranslation.Set(FbxDouble3(helm.header.position.x * 100, helm.header.position.z * 100, -helm.header.position.y * 100));
@@ -525,7 +527,7 @@ static void export_helm(Export_info& export_info, const MDB_file::Helm& helm)
 static void export_hook(Export_info& export_info, const MDB_file::Hook& hook)
 {	
 	string name(hook.header.name, 32);
-	cout << "Exporting HOOK: " << name.c_str() << endl;
+	Log::info() << "Exporting HOOK: " << name.c_str() << endl;
 
 	auto node = FbxNode::Create(export_info.scene, name.c_str());	
 	node->LclTranslation.Set(FbxDouble3(hook.header.position.x * 100, hook.header.position.z * 100, -hook.header.position.y * 100));	
@@ -538,7 +540,7 @@ static void export_rigid_mesh(Export_info& export_info,
 	const MDB_file::Rigid_mesh& rm)
 {
 	string name(rm.header.name, 32);
-	cout << "Exporting RIGD: " << name.c_str() << endl;
+	Log::info() << "Exporting RIGD: " << name.c_str() << endl;
 
 	auto mesh = FbxMesh::Create(export_info.scene, name.c_str());
 
@@ -592,7 +594,7 @@ static void fill_vertex_clusters(const MDB_file::Skin& skin, unsigned vertex_ind
 			if (bone_index < clusters.size())
 				clusters[bone_index]->AddControlPointIndex(vertex_index, v.bone_weights[j]);
 			else
-				cout << "  WARNING: bone index out of bounds (" << unsigned(bone_index) << " >= " << clusters.size() << ")\n";				
+				Log::warning() << "Bone index out of bounds (" << unsigned(bone_index) << " >= " << clusters.size() << ")\n";				
 		}
 	}
 }
@@ -637,7 +639,7 @@ static void export_skinning(Export_info& export_info,
 static void export_skin(Export_info& export_info, const MDB_file::Skin& skin)
 {
 	string name(skin.header.name, 32);
-	cout << "Exporting SKIN: " << name.c_str() << endl;
+	Log::info() << "Exporting SKIN: " << name.c_str() << endl;
 
 	auto mesh = FbxMesh::Create(export_info.scene, name.c_str());
 
@@ -708,7 +710,7 @@ static void export_faces(FbxMesh* mesh, const MDB_file::Walk_mesh& wm)
 static void export_walk_mesh(Export_info& export_info, const MDB_file::Walk_mesh& wm)
 {
 	string name(wm.header.name, 32);
-	cout << "Exporting WALK: " << name.c_str() << endl;	
+	Log::info() << "Exporting WALK: " << name.c_str() << endl;	
 
 	auto mesh = FbxMesh::Create(export_info.scene, name.c_str());
 	auto node = create_node(export_info.scene, mesh, name.c_str());
@@ -777,74 +779,21 @@ static bool exists_texture(const char* name)
 	return false;
 }
 
-static void extract_dependency(Export_info& export_info, const char* str,
-	const Archive_container& archives)
-{
-	if (export_info.dependencies.find(str) != export_info.dependencies.end())
-		return;
-
-	auto &dep = export_info.dependencies[str];
-	dep.extracted = false;
-	dep.exported = false;
-
-	auto r = archives.find_file((string(str) + '.').c_str());
-	if (r.matches > 0) {
-		path p(archives.filename(r.archive_index, r.file_index));
-		p = p.filename();
-		dep.extracted_path = p.string();
-
-		cout << "Extracting: " << p.string() << endl;
-
-		if (exists(p)) {
-			dep.extracted = true;
-			cout << "  Already exists in destination. Don't overwrite.\n";
-			return;
-		}
-
-		if (!archives.extract_file(r.archive_index, r.file_index,
-			p.string().c_str())) {
-			cout << "Cannot extract " << str << endl;
-		}
-
-		dep.extracted = true;
-	}
-	else
-		cout << str << " not found\n";
-}
-
-static void extract_textures(Export_info& export_info,
+static void collect_textures(vector<string>& names,
 	const MDB_file::Material& material)
 {
-	string diffuse_map = string(material.diffuse_map_name, 32).c_str();
-	if (!diffuse_map.empty() && !exists_texture(diffuse_map.c_str()))
-		extract_dependency(export_info, diffuse_map.c_str(), export_info.materials);
-
-	string normal_map = string(material.normal_map_name, 32).c_str();
-	if (!normal_map.empty() && !exists_texture(normal_map.c_str()))
-		extract_dependency(export_info, normal_map.c_str(), export_info.materials);
-
-	string tint_map = string(material.tint_map_name, 32).c_str();
-	if (!tint_map.empty() && !exists_texture(tint_map.c_str()))
-		extract_dependency(export_info, tint_map.c_str(), export_info.materials);
-
-	string glow_map = string(material.glow_map_name, 32).c_str();
-	if (!glow_map.empty() && !exists_texture(glow_map.c_str()))
-		extract_dependency(export_info, glow_map.c_str(), export_info.materials);
-}
-
-static void extract_textures(Export_info& export_info,
-	const MDB_file::Rigid_mesh& rm)
-{
-	extract_textures(export_info, rm.header.material);
-}
+	const char* maps[] = { material.diffuse_map_name,
+		material.normal_map_name, material.tint_map_name,
+		material.glow_map_name };
 
-static void extract_textures(Export_info& export_info,
-	const MDB_file::Skin& skin)
-{
-	extract_textures(export_info, skin.header.material);
+	for (auto map : maps) {
+		string name = string(map, 32).c_str();
+		if (!name.empty())
+			names.push_back(name);
+	}
 }
 
-static void extract_textures(Export_info& export_info,
+static void collect_textures(vector<string>& names,
 	const MDB_file::Packet* packet)
 {
 	if (!packet)
@@ -852,27 +801,88 @@ static void extract_textures(Export_info& export_info,
 
 	switch (packet->type) {
 	case MDB_file::RIGD:
-		extract_textures(export_info,
-			*static_cast<const MDB_file::Rigid_mesh*>(packet));
+		collect_textures(names,
+			static_cast<const MDB_file::Rigid_mesh*>(packet)->header.material);
 		break;
 	case MDB_file::SKIN:
-		extract_textures(export_info,
-			*static_cast<const MDB_file::Skin*>(packet));
+		collect_textures(names,
+			static_cast<const MDB_file::Skin*>(packet)->header.material);
 		break;
 	default:
 		break;
 	}
 }
 
-static void extract_textures(Export_info& export_info)
-{	
-	for (uint32_t i = 0; i < export_info.mdb->packet_count(); ++i)
-		extract_textures(export_info, export_info.mdb->packet(i));
-}
-
-static void extract_dependencies(Export_info& export_info)
+void extract_dependencies(Export_info& export_info,
+	const std::vector<const MDB_file*>& mdbs)
 {
-	extract_textures(export_info);
+	// Collect the textures of all the MDBs, once each.
+	vector<string> names;
+	for (auto mdb : mdbs) {
+		for (uint32_t i = 0; i < mdb->packet_count(); ++i)
+			collect_textures(names, mdb->packet(i));
+	}
+
+	vector<string> pending;
+	for (auto& name : names) {
+		if (export_info.dependencies.find(name) == export_info.dependencies.end()
+			&& find(pending.begin(), pending.end(), name) == pending.end())
+			pending.push_back(name);
+	}
+
+	// Textures already in the current directory don't need extraction.
+	// With an extraction cache they are still checked against the
+	// archives, and replaced if stale.
+	auto& resources = export_info.materials;
+	bool use_cache = resources.has_extraction_cache();
+
+	vector<char> on_disk(pending.size());
+	parallel_for(pending.size(), [&](size_t i) {
+		on_disk[i] = exists_texture(pending[i].c_str());
+	});
+
+	vector<Resource_vfs::Extraction> extractions;
+	set<string> destinations;
+
+	for (size_t i = 0; i < pending.size(); ++i) {
+		if (on_disk[i] && !use_cache)
+			continue;
+
+		auto &dep = export_info.dependencies[pending[i]];
+		dep.extracted = false;
+		dep.exported = false;
+
+		auto found = resources.find_by_stem(pending[i].c_str());
+		if (found.empty()) {
+			// Textures only in the current directory are used as is
+			if (!on_disk[i])
+				Log::info() << pending[i] << " not found\n";
+			continue;
+		}
+
+		dep.extracted_path = found.front()->name;
+
+		Log::info() << "Extracting: " << dep.extracted_path << endl;
+
+		// With an extraction cache, stale files are refreshed instead
+		if (!use_cache && exists(dep.extracted_path)) {
+			dep.extracted = true;
+			Log::info() << "  Already exists in destination. Don't overwrite.\n";
+			continue;
+		}
+
+		dep.extracted = true;
+
+		if (destinations.insert(dep.extracted_path).second)
+			extractions.push_back({ found.front(), dep.extracted_path });
+	}
+
+	auto status = resources.extract(extractions);
+
+	for (size_t i = 0; i < extractions.size(); ++i) {
+		if (!status[i])
+			Log::info() << "Cannot extract " << extractions[i].dest_filename << endl;
+	}
 }
 
 void create_walk_mesh_materials(FbxScene* scene)
@@ -891,7 +901,7 @@ bool export_mdb(Export_info& export_info, const MDB_file& mdb)
 {
 	export_info.mdb = &mdb;
 
-	extract_dependencies(export_info);
+	extract_dependencies(export_info, { &mdb });
 	create_walk_mesh_materials(export_info.scene);
 
 	for (uint32_t i = 0; i < mdb.packet_count(); ++i)
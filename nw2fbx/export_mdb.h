@@ -2,8 +2,10 @@
 
 #include <map>
 
-#include "archive_container.h"
+#include "export_gr2.h"
 #include "fbxsdk.h"
+#include "resource_vfs.h"
+#include "skeleton_cache.h"
 
 class Config;
 struct Export_info;
@@ -13,6 +15,7 @@ struct Dependency {
 	bool extracted;
 	std::string extracted_path;
 	bool exported;
+	std::shared_ptr<const Skeleton_file> skeleton; // Of a skeleton GR2
 	std::vector<FbxNode*> fbx_bones;
 	std::vector<FbxNode*> fbx_body_bones;
 	std::vector<FbxNode*> fbx_face_bones;
@@ -22,10 +25,19 @@ struct Export_info {
 	const Config &config;
 	std::vector<std::string> input_strings;
 	std::string output_path;
-	Archive_container materials;	
+	Resource_vfs &materials; // Shared by the jobs of a batch
+	Skeleton_cache &skeletons; // Shared by the jobs of a batch
 	const MDB_file *mdb;
 	FbxScene *scene;
 	std::map<std::string, Dependency> dependencies;
+	bool extract_inputs = true; // Write inputs extracted from archives
+	Animation_keys animation_keys = ANIMATION_KEYS_SAMPLED;
+	Node_index nodes; // Nodes of scene by name
 };
 
+// Extracts the textures used by the MDBs. Textures are collected from all
+// the MDBs first and each one is extracted once, in parallel.
+void extract_dependencies(Export_info& export_info,
+	const std::vector<const MDB_file*>& mdbs);
+
 bool export_mdb(Export_info& export_info, const MDB_file& mdb);
@@ -0,0 +1,42 @@
+#include "node_index.h"
+
+using namespace std;
+
+void Node_index::update(FbxScene* scene)
+{
+	if (scene == this->scene && scene->GetNodeCount() == node_count)
+		return;
+
+	nodes.clear();
+	add_subtree(scene->GetRootNode());
+
+	this->scene = scene;
+	node_count = scene->GetNodeCount();
+}
+
+void Node_index::add(FbxNode* node)
+{
+	// Not indexed yet, update() will find it
+	if (!scene)
+		return;
+
+	nodes[node->GetName()].push_back(node);
+	++node_count;
+}
+
+const std::vector<FbxNode*>& Node_index::find(const char* name) const
+{
+	static const vector<FbxNode*> none;
+
+	auto it = nodes.find(name);
+
+	return it == nodes.end() ? none : it->second;
+}
+
+void Node_index::add_subtree(FbxNode* node)
+{
+	nodes[node->GetName()].push_back(node);
+
+	for (int i = 0; i < node->GetChildCount(); ++i)
+		add_subtree(node->GetChild(i));
+}
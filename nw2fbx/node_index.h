@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fbxsdk.h"
+
+// Index of the nodes of a scene by name. update() rebuilds it if nodes
+// were created in the scene without being added to the index.
+class Node_index {
+public:
+	// Indexes the nodes of a scene, in depth-first order, unless the index
+	// is already up to date.
+	void update(FbxScene* scene);
+
+	// Adds a node created after the last update.
+	void add(FbxNode* node);
+
+	// Returns the nodes with the specified name.
+	const std::vector<FbxNode*>& find(const char* name) const;
+
+private:
+	FbxScene* scene = nullptr;
+	int node_count = 0; // Nodes in the scene when it was last indexed
+	std::unordered_map<std::string, std::vector<FbxNode*>> nodes;
+
+	void add_subtree(FbxNode* node);
+};
@@ -13,102 +13,110 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 #include "archive_container.h"
+#include "child_process.h"
 #include "config.h"
 #include "export_gr2.h"
 #include "export_mdb.h"
 #include "fbxsdk.h"
+#include "glb_writer.h"
 #include "gr2_file.h"
+#include "local_server.h"
+#include "log.h"
 #include "mdb_file.h"
+#include "memory_stream.h"
+#include "parallel.h"
 #include "redirect_output_handle.h"
-
-// Uncomment for print extra info
-//#define VERBOSE
+#include "resource_vfs.h"
+#include "skeleton_cache.h"
 
 using namespace std;
 using namespace std::filesystem;
 
 static void print_header(const MDB_file& mdb)
 {
-	cout << "Major Version: " << mdb.major_version() << endl;
-	cout << "Minor Version: " << mdb.minor_version() << endl;
-	cout << "Packet Count:  " << mdb.packet_count() << endl;
-	cout << endl;
+	Log::info() << "Major Version: " << mdb.major_version() << endl;
+	Log::info() << "Minor Version: " << mdb.minor_version() << endl;
+	Log::info() << "Packet Count:  " << mdb.packet_count() << endl;
+	Log::info() << endl;
 }
 
 static void print_vector3(const Vector3<float>& v)
 {
-	cout << v.x << ", " << v.y << ", " << v.z << endl;
+	Log::info() << v.x << ", " << v.y << ", " << v.z << endl;
 }
 
 static void print_material_flags(uint32_t flags)
 {
-	cout << "Flags:          0x" << hex << flags << dec << endl;
+	Log::info() << "Flags:          0x" << hex << flags << dec << endl;
 	if(flags & MDB_file::ALPHA_TEST)
-		cout << "                ALPHA_TEST\n";
+		Log::info() << "                ALPHA_TEST\n";
 	if(flags & MDB_file::ALPHA_BLEND)
-		cout << "                ALPHA_BLEND\n";
+		Log::info() << "                ALPHA_BLEND\n";
 	if(flags & MDB_file::ADDITIVE_BLEND)
-		cout << "                ADDITIVE_BLEND\n";
+		Log::info() << "                ADDITIVE_BLEND\n";
 	if(flags & MDB_file::ENVIRONMENT_MAPPING)
-		cout << "                ENVIRONMENT_MAPPING\n";
+		Log::info() << "                ENVIRONMENT_MAPPING\n";
 	if(flags & MDB_file::CUTSCENE_MESH)
-		cout << "                CUTSCENE_MESH\n";
+		Log::info() << "                CUTSCENE_MESH\n";
 	if(flags & MDB_file::GLOW)
-		cout << "                GLOW\n";
+		Log::info() << "                GLOW\n";
 	if(flags & MDB_file::CAST_NO_SHADOWS)
-		cout << "                CAST_NO_SHADOWS\n";
+		Log::info() << "                CAST_NO_SHADOWS\n";
 	if(flags & MDB_file::PROJECTED_TEXTURES)
-		cout << "                PROJECTED_TEXTURES\n";
+		Log::info() << "                PROJECTED_TEXTURES\n";
 }
 
 static void print_material(const MDB_file::Material& material)
 {
-	cout << "Diffuse Map:    " << string(material.diffuse_map_name, 32)
-	     << endl;
-	cout << "Normal Map:     " << string(material.normal_map_name, 32)
-	     << endl;
-	cout << "Tint Map:       " << string(material.tint_map_name, 32)
-	     << endl;
-	cout << "Glow Map:       " << string(material.glow_map_name, 32)
-	     << endl;
-	cout << "Diffuse Color:  ";
+	Log::info() << "Diffuse Map:    " << string(material.diffuse_map_name, 32)
+	            << endl;
+	Log::info() << "Normal Map:     " << string(material.normal_map_name, 32)
+	            << endl;
+	Log::info() << "Tint Map:       " << string(material.tint_map_name, 32)
+	            << endl;
+	Log::info() << "Glow Map:       " << string(material.glow_map_name, 32)
+	            << endl;
+	Log::info() << "Diffuse Color:  ";
 	print_vector3(material.diffuse_color);
-	cout << "Specular Color: ";
+	Log::info() << "Specular Color: ";
 	print_vector3(material.specular_color);
-	cout << "Specular Level: " << material.specular_level << endl;
-	cout << "Glossiness:     " << material.specular_power << endl;
+	Log::info() << "Specular Level: " << material.specular_level << endl;
+	Log::info() << "Glossiness:     " << material.specular_power << endl;
 	print_material_flags(material.flags);
 }
 
-#ifdef VERBOSE
+#ifdef LOG_TRACE_ENABLED
+
+static void trace_vector3(const char* prefix, const Vector3<float>& v)
+{
+	LOG_TRACE << prefix << v.x << ", " << v.y << ", " << v.z << '\n';
+}
 
 template <typename T>
 static void print_verts(const std::vector<T>& verts)
 {
-	for (auto& vert : verts) {
-		cout << "v ";
-		print_vector3(vert.position);
-	}
+	for (auto& vert : verts)
+		trace_vector3("v ", vert.position);
 }
 
 template <>
 void print_verts(const std::vector<MDB_file::Rigid_mesh_vertex>& verts)
 {
 	for (auto& vert : verts) {
-		cout << "v   ";
-		print_vector3(vert.position);
-		cout << "vn  ";
-		print_vector3(vert.normal);
-		cout << "vta ";
-		print_vector3(vert.tangent);
-		cout << "vbi ";
-		print_vector3(vert.binormal);
-		cout << "uvw ";
-		print_vector3(vert.uvw);
+		trace_vector3("v   ", vert.position);
+		trace_vector3("vn  ", vert.normal);
+		trace_vector3("vta ", vert.tangent);
+		trace_vector3("vbi ", vert.binormal);
+		trace_vector3("uvw ", vert.uvw);
 	}
 }
 
@@ -116,9 +124,9 @@ template <typename T>
 static void print_faces(const std::vector<T>& faces)
 {
 	for (auto& face : faces) {
-		cout << "p " << face.vertex_indices[0] << ' '
-		     << face.vertex_indices[1] << ' ' << face.vertex_indices[2]
-		     << endl;
+		LOG_TRACE << "p " << face.vertex_indices[0] << ' '
+		          << face.vertex_indices[1] << ' '
+		          << face.vertex_indices[2] << '\n';
 	}
 }
 
@@ -126,15 +134,15 @@ static void print_faces(const std::vector<T>& faces)
 
 static void print_collision_mesh(const MDB_file::Collision_mesh& cm)
 {
-	cout << "Signature:      " << string(cm.header.type, 4) << endl;
-	cout << "Size:           " << cm.header.packet_size << endl;
-	cout << "Name:           " << string(cm.header.name, 32).c_str()
-	     << endl;
+	Log::info() << "Signature:      " << string(cm.header.type, 4) << endl;
+	Log::info() << "Size:           " << cm.header.packet_size << endl;
+	Log::info() << "Name:           " << string(cm.header.name, 32).c_str()
+	            << endl;
 	print_material(cm.header.material);
-	cout << "Vertices:       " << cm.header.vertex_count << endl;
-	cout << "Faces:          " << cm.header.face_count << endl;
+	Log::info() << "Vertices:       " << cm.header.vertex_count << endl;
+	Log::info() << "Faces:          " << cm.header.face_count << endl;
 
-#ifdef VERBOSE
+#ifdef LOG_TRACE_ENABLED
 	print_verts(cm.verts);
 	print_faces(cm.faces);
 #endif
@@ -142,101 +150,101 @@ static void print_collision_mesh(const MDB_file::Collision_mesh& cm)
 
 static void print_collision_spheres(const MDB_file::Collision_spheres& cs)
 {
-	cout << "Signature:      " << string(cs.header.type, 4) << endl;
-	cout << "Size:           " << cs.header.packet_size << endl;		
-	cout << "Spheres:        " << cs.header.sphere_count << endl;	
+	Log::info() << "Signature:      " << string(cs.header.type, 4) << endl;
+	Log::info() << "Size:           " << cs.header.packet_size << endl;		
+	Log::info() << "Spheres:        " << cs.header.sphere_count << endl;	
 }
 
 static void print_orientation(const float orientation[3][3])
 {
 	for (int i = 0; i < 3; ++i) {
-		cout << "  ";
+		Log::info() << "  ";
 		for (int j = 0; j < 3; ++j)
-			cout << orientation[i][j] << ' ';
-		cout << endl;
+			Log::info() << orientation[i][j] << ' ';
+		Log::info() << endl;
 	}
 }
 
 static void print_hair(const MDB_file::Hair& hair)
 {
-	cout << "Signature:   " << string(hair.header.type, 4) << endl;
-	cout << "Size:        " << hair.header.packet_size << endl;
-	cout << "Name:        " << string(hair.header.name, 32).c_str() << endl;
+	Log::info() << "Signature:   " << string(hair.header.type, 4) << endl;
+	Log::info() << "Size:        " << hair.header.packet_size << endl;
+	Log::info() << "Name:        " << string(hair.header.name, 32).c_str() << endl;
 
-	cout << "Shortening:  " << hair.header.shortening_behavior;	
+	Log::info() << "Shortening:  " << hair.header.shortening_behavior;	
 	switch (hair.header.shortening_behavior) {
 	case MDB_file::HSB_LOW:
-		cout << " (LOW)\n";
+		Log::info() << " (LOW)\n";
 		break;
 	case MDB_file::HSB_SHORT:
-		cout << " (SHORT)\n";
+		Log::info() << " (SHORT)\n";
 		break;
 	case MDB_file::HSB_PONYTAIL:
-		cout << " (PONYTAIL)\n";
+		Log::info() << " (PONYTAIL)\n";
 		break;
 	}
 
-	cout << "Position:    ";
+	Log::info() << "Position:    ";
 	print_vector3(hair.header.position);
 
-	cout << "Orientation:\n";
+	Log::info() << "Orientation:\n";
 	print_orientation(hair.header.orientation);	
 }
 
 static void print_helm(const MDB_file::Helm& helm)
 {
-	cout << "Signature:   " << string(helm.header.type, 4) << endl;
-	cout << "Size:        " << helm.header.packet_size << endl;
-	cout << "Name:        " << string(helm.header.name, 32).c_str() << endl;
+	Log::info() << "Signature:   " << string(helm.header.type, 4) << endl;
+	Log::info() << "Size:        " << helm.header.packet_size << endl;
+	Log::info() << "Name:        " << string(helm.header.name, 32).c_str() << endl;
 
-	cout << "Hiding:      " << helm.header.hiding_behavior;
+	Log::info() << "Hiding:      " << helm.header.hiding_behavior;
 	switch (helm.header.hiding_behavior) {
 	case MDB_file::HHHB_NONE_HIDDEN:
-		cout << " (NONE_HIDDEN)\n";
+		Log::info() << " (NONE_HIDDEN)\n";
 		break;
 	case MDB_file::HHHB_HAIR_HIDDEN:
-		cout << " (HAIR_HIDDEN)\n";
+		Log::info() << " (HAIR_HIDDEN)\n";
 		break;
 	case MDB_file::HHHB_PARTIAL_HAIR:
-		cout << " (PARTIAL_HAIR)\n";
+		Log::info() << " (PARTIAL_HAIR)\n";
 		break;
 	case MDB_file::HHHB_HEAD_HIDDEN:
-		cout << " (HEAD_HIDDEN)\n";
+		Log::info() << " (HEAD_HIDDEN)\n";
 		break;
 	}
 
-	cout << "Position:    ";
+	Log::info() << "Position:    ";
 	print_vector3(helm.header.position);
 
-	cout << "Orientation:\n";
+	Log::info() << "Orientation:\n";
 	print_orientation(helm.header.orientation);
 }
 
 static void print_hook(const MDB_file::Hook& hook)
 {
-	cout << "Signature:   " << string(hook.header.type, 4) << endl;
-	cout << "Size:        " << hook.header.packet_size << endl;
-	cout << "Name:        " << string(hook.header.name, 32).c_str() << endl;
-	cout << "Type:        " << hook.header.point_type << endl;
-	cout << "Size:        " << hook.header.point_size << endl;
-	cout << "Position:    ";
+	Log::info() << "Signature:   " << string(hook.header.type, 4) << endl;
+	Log::info() << "Size:        " << hook.header.packet_size << endl;
+	Log::info() << "Name:        " << string(hook.header.name, 32).c_str() << endl;
+	Log::info() << "Type:        " << hook.header.point_type << endl;
+	Log::info() << "Size:        " << hook.header.point_size << endl;
+	Log::info() << "Position:    ";
 	print_vector3(hook.header.position);
 
-	cout << "Orientation:\n";
+	Log::info() << "Orientation:\n";
 	print_orientation(hook.header.orientation);
 }
 
 static void print_rigid_mesh(const MDB_file::Rigid_mesh& rm)
 {
-	cout << "Signature:      " << string(rm.header.type, 4) << endl;
-	cout << "Size:           " << rm.header.packet_size << endl;
-	cout << "Name:           " << string(rm.header.name, 32).c_str()
-	     << endl;
+	Log::info() << "Signature:      " << string(rm.header.type, 4) << endl;
+	Log::info() << "Size:           " << rm.header.packet_size << endl;
+	Log::info() << "Name:           " << string(rm.header.name, 32).c_str()
+	            << endl;
 	print_material(rm.header.material);
-	cout << "Vertices:       " << rm.header.vertex_count << endl;
-	cout << "Faces:          " << rm.header.face_count << endl;
+	Log::info() << "Vertices:       " << rm.header.vertex_count << endl;
+	Log::info() << "Faces:          " << rm.header.face_count << endl;
 
-#ifdef VERBOSE
+#ifdef LOG_TRACE_ENABLED
 	print_verts(rm.verts);
 	print_faces(rm.faces);
 #endif
@@ -244,17 +252,17 @@ static void print_rigid_mesh(const MDB_file::Rigid_mesh& rm)
 
 static void print_skin(const MDB_file::Skin& skin)
 {
-	cout << "Signature:      " << string(skin.header.type, 4) << endl;
-	cout << "Size:           " << skin.header.packet_size << endl;
-	cout << "Name:           " << string(skin.header.name, 32).c_str()
-	     << "\n";
-	cout << "Skeleton:       "
-	     << string(skin.header.skeleton_name, 32).c_str() << endl;
+	Log::info() << "Signature:      " << string(skin.header.type, 4) << endl;
+	Log::info() << "Size:           " << skin.header.packet_size << endl;
+	Log::info() << "Name:           " << string(skin.header.name, 32).c_str()
+	            << "\n";
+	Log::info() << "Skeleton:       "
+	            << string(skin.header.skeleton_name, 32).c_str() << endl;
 	print_material(skin.header.material);
-	cout << "Vertices:       " << skin.header.vertex_count << endl;
-	cout << "Faces:          " << skin.header.face_count << endl;
+	Log::info() << "Vertices:       " << skin.header.vertex_count << endl;
+	Log::info() << "Faces:          " << skin.header.face_count << endl;
 
-#ifdef VERBOSE
+#ifdef LOG_TRACE_ENABLED
 	print_verts(skin.verts);
 	print_faces(skin.faces);
 #endif
@@ -262,14 +270,14 @@ static void print_skin(const MDB_file::Skin& skin)
 
 static void print_walk_mesh(const MDB_file::Walk_mesh& wm)
 {
-	cout << "Signature:      " << string(wm.header.type, 4) << endl;
-	cout << "Size:           " << wm.header.packet_size << endl;
-	cout << "Name:           " << string(wm.header.name, 32).c_str()
-	     << endl;
-	cout << "Vertices:       " << wm.header.vertex_count << endl;
-	cout << "Faces:          " << wm.header.face_count << endl;
-
-#ifdef VERBOSE
+	Log::info() << "Signature:      " << string(wm.header.type, 4) << endl;
+	Log::info() << "Size:           " << wm.header.packet_size << endl;
+	Log::info() << "Name:           " << string(wm.header.name, 32).c_str()
+	            << endl;
+	Log::info() << "Vertices:       " << wm.header.vertex_count << endl;
+	Log::info() << "Faces:          " << wm.header.face_count << endl;
+
+#ifdef LOG_TRACE_ENABLED
 	print_verts(wm.verts);
 	print_faces(wm.faces);
 #endif
@@ -280,8 +288,8 @@ static void print_packet(const MDB_file::Packet* packet)
 	if (!packet)
 		return;
 
-	cout << packet->type_str() << endl;
-	cout << "----\n";
+	Log::info() << packet->type_str() << endl;
+	Log::info() << "----\n";
 
 	switch (packet->type) {
 	case MDB_file::COL2:
@@ -316,15 +324,15 @@ static void print_packet(const MDB_file::Packet* packet)
 		break;
 	}
 
-	cout << endl;
+	Log::info() << endl;
 }
 
 static void print_mdb(const MDB_file& mdb)
 {
-	cout << endl;
-	cout << "===\n";
-	cout << "MDB\n";
-	cout << "===\n";
+	Log::info() << endl;
+	Log::info() << "===\n";
+	Log::info() << "MDB\n";
+	Log::info() << "===\n";
 
 	print_header(mdb);
 
@@ -332,6 +340,9 @@ static void print_mdb(const MDB_file& mdb)
 		print_packet(mdb.packet(i));
 }
 
+// Mappings of every archive don't fit the address space of 32-bit builds
+static const bool map_archives = sizeof(void*) == 8;
+
 static Archive_container get_model_archives(const Config& config)
 {
 	const char* files[] = {
@@ -346,16 +357,27 @@ static Archive_container get_model_archives(const Config& config)
 		"Data/lod-merged_v121.zip",    "Data/lod-merged_v107.zip",
 		"Data/lod-merged_v101.zip",    "Data/lod-merged.zip" };
 
+	auto cache = path(config.config_dir) / "model_archives.cache";
+
+	vector<string> filenames;
+	for (unsigned i = 0; i < sizeof(files) / sizeof(char*); ++i)
+		filenames.push_back((path(config.nwn2_home) / files[i]).string());
+
 	Archive_container archives;
+	archives.set_memory_mapped(map_archives);
+	archives.load_cache(cache.string().c_str());
+	auto added = archives.add_archives(filenames);
+
 	for (unsigned i = 0; i < sizeof(files) / sizeof(char*); ++i) {
-		cout << "Indexing: " << files[i];
-		path p = path(config.nwn2_home) / path(files[i]);
-		if (!archives.add_archive(p.string().c_str())) {
-			cout << " : Cannot open zip";
-		}
-		cout << endl;
+		Log::info() << "Indexing: " << files[i];
+		if (!added[i])
+			Log::info() << " : Cannot open zip";
+		Log::info() << endl;
 	}
 
+	if (!archives.save_cache(cache.string().c_str()))
+		Log::info() << "Cannot write " << cache.string() << endl;
+
 	return archives;
 }
 
@@ -374,25 +396,65 @@ static Archive_container get_material_archives(const Config& config)
 		"Data/NWN2_Materials_v103x1.zip",
 		"Data/NWN2_Materials.zip" };
 
+	auto cache = path(config.config_dir) / "material_archives.cache";
+
+	vector<string> filenames;
+	for (unsigned i = 0; i < sizeof(files) / sizeof(char*); ++i)
+		filenames.push_back((path(config.nwn2_home) / files[i]).string());
+
 	Archive_container archives;
+	archives.set_memory_mapped(map_archives);
+	archives.load_cache(cache.string().c_str());
+	auto added = archives.add_archives(filenames);
+
 	for (unsigned i = 0; i < sizeof(files) / sizeof(char*); ++i) {
-		cout << "Indexing: " << files[i];
-		path p = path(config.nwn2_home) / path(files[i]);
-		if (!archives.add_archive(p.string().c_str())) {
-			cout << " : Cannot open zip";
-		}
-		cout << endl;
+		Log::info() << "Indexing: " << files[i];
+		if (!added[i])
+			Log::info() << " : Cannot open zip";
+		Log::info() << endl;
 	}
 
+	if (!archives.save_cache(cache.string().c_str()))
+		Log::info() << "Cannot write " << cache.string() << endl;
+
 	return archives;
 }
 
+static void add_override_dirs(Resource_vfs& resources, const Config& config)
+{
+	for (auto& dir : config.override_dirs) {
+		Log::info() << "Indexing: " << dir;
+		if (!resources.add_directory(dir.c_str()))
+			Log::info() << " : Cannot open directory";
+		Log::info() << endl;
+	}
+}
+
+static void init_model_resources(Resource_vfs& resources, const Config& config)
+{
+	add_override_dirs(resources, config);
+	resources.add_archives(get_model_archives(config));
+}
+
+static void init_material_resources(Resource_vfs& resources,
+	const Config& config)
+{
+	add_override_dirs(resources, config);
+	resources.add_archives(get_material_archives(config));
+	resources.set_extraction_cache(
+		(path(config.config_dir) / "extract_cache").string().c_str());
+}
+
 static void parse_args(Export_info& export_info, int argc, char* argv[])
 {
 	for (int i = 1; i < argc; ++i) {
 		if (argv[i][0] == '-') {
 			if (strcmp(argv[i], "-o") == 0 && i < argc - 1)
 				export_info.output_path = argv[++i];
+			else if (strcmp(argv[i], "-no-extract") == 0)
+				export_info.extract_inputs = false;
+			else if (strcmp(argv[i], "-native-keys") == 0)
+				export_info.animation_keys = ANIMATION_KEYS_NATIVE;
 		}
 		else {
 			export_info.input_strings.push_back(argv[i]);
@@ -400,41 +462,67 @@ static void parse_args(Export_info& export_info, int argc, char* argv[])
 	}
 }
 
-static bool extract_arg(const Config& config, const char* arg,
-	std::vector<std::string> &filenames)
+struct Source {
+	std::string filename;
+	// Contents, if extracted to memory
+	std::shared_ptr<const std::vector<unsigned char>> data;
+};
+
+static bool extract_arg(const Export_info& export_info, const char* arg,
+	std::vector<Source> &sources)
 {
 	if (exists(arg)) { // File is already extracted
-		filenames.push_back(arg);
+		sources.push_back({ arg });
 		return true;
 	}
 
-	static auto model_archives = get_model_archives(config);
-	auto r = model_archives.find_file(arg);
-	if (r.matches != 1)
+	static Resource_vfs model_resources;
+	if (model_resources.source_count() == 0)
+		init_model_resources(model_resources, export_info.config);
+
+	Log::info() << "Searching: \"" << arg << "\"\n";
+
+	auto matches = model_resources.search(arg);
+	for (auto r : matches)
+		Log::info() << "  " << r->name << endl;
+
+	Log::info() << "  # " << matches.size() << " total matches\n";
+
+	if (matches.size() != 1)
 		return false;
 
-	path p(model_archives.filename(r.archive_index, r.file_index));
-	p = p.filename();
-	string filename = p.string();
+	Source source;
+	source.filename = matches[0]->name;
 
-	cout << "Extracting: " << filename << endl;
+	Log::info() << "Extracting: " << source.filename << endl;
 
-	if (!model_archives.extract_file(r.archive_index, r.file_index,
-		filename.c_str())) {
-		cout << "  Cannot extract\n";
+	// The parsers read the extracted file from memory. It's also written
+	// to disk unless -no-extract was given.
+	source.data = model_resources.read(*matches[0]);
+	if (!source.data) {
+		Log::info() << "  Cannot extract\n";
 		return false;
 	}
 
-	filenames.push_back(filename);
+	if (export_info.extract_inputs) {
+		ofstream out(source.filename, ios::binary);
+		out.write((const char*)source.data->data(), source.data->size());
+		if (!out) {
+			Log::info() << "  Cannot write " << source.filename << endl;
+			return false;
+		}
+	}
+
+	sources.push_back(move(source));
 	
 	return true;
 }
 
 static bool extract_args(Export_info& export_info,
-	std::vector<std::string> &filenames)
+	std::vector<Source> &sources)
 {
 	for (auto &s : export_info.input_strings) {
-		if (!extract_arg(export_info.config, s.c_str(), filenames))
+		if (!extract_arg(export_info, s.c_str(), sources))
 			return false;
 	}
 
@@ -444,16 +532,22 @@ static bool extract_args(Export_info& export_info,
 struct Input {
 	std::string filename;
 	std::unique_ptr<MDB_file> mdb;
-	std::unique_ptr<GR2_file> gr2;
+	std::shared_ptr<GR2_file> gr2; // Without skeletons
+	std::shared_ptr<const Skeleton_file> skeleton;
 };
 
-static bool open_mdb(vector<Input>& inputs, const char* filename)
+static bool open_mdb(vector<Input>& inputs, const Source& source)
 {
 	Input input;
-	input.filename = filename;
-	input.mdb.reset(new MDB_file(filename));
+	input.filename = source.filename;
+	if (source.data) {
+		Memory_istream in(source.data->data(), source.data->size());
+		input.mdb.reset(new MDB_file(in));
+	}
+	else
+		input.mdb.reset(new MDB_file(source.filename.c_str()));
 	if (!(*input.mdb)) {
-		cout << input.mdb->error_str() << endl;
+		Log::error() << input.mdb->error_str() << endl;
 		return false;
 	}
 	inputs.push_back(move(input));
@@ -461,86 +555,103 @@ static bool open_mdb(vector<Input>& inputs, const char* filename)
 	return true;
 }
 
-static bool open_gr2(vector<Input>& inputs, const char* filename)
+// Key of a skeleton in the cache. Files read from disk are keyed by their
+// absolute path and modification time, so a server doesn't mix up files
+// of different directories, nor reuse a file that was edited.
+static string skeleton_key(const Source& source)
+{
+	if (source.data)
+		return source.filename;
+
+	error_code ec;
+	auto time = last_write_time(source.filename, ec);
+	return absolute(source.filename, ec).string() + '|'
+		+ to_string(time.time_since_epoch().count());
+}
+
+static bool open_gr2(Export_info& export_info, vector<Input>& inputs,
+	const Source& source)
 {
 	Input input;
-	input.filename = filename;
-	input.gr2.reset(new GR2_file(filename));
+	input.filename = source.filename;
+
+	// Skeletons are parsed once, and reused by the inputs and the
+	// following jobs of a batch that reference them
+	auto key = skeleton_key(source);
+	input.skeleton = export_info.skeletons.find(key);
+	if (input.skeleton) {
+		inputs.push_back(move(input));
+		return true;
+	}
+
+	if (source.data) {
+		Memory_istream in(source.data->data(), source.data->size());
+		input.gr2.reset(new GR2_file(in));
+	}
+	else
+		input.gr2.reset(new GR2_file(source.filename.c_str()));
 	if (!(*input.gr2)) {
-		cout << input.gr2->error_string() << endl;
+		Log::error() << input.gr2->error_string() << endl;
 		return false;
 	}
+	if (input.gr2->file_info->skeletons_count > 0) {
+		input.skeleton = export_info.skeletons.insert(key,
+			move(input.gr2));
+	}
 	inputs.push_back(move(input));
 
 	return true;
 }
 
-static bool open_file(vector<Input>& inputs, const char* filename)
+static bool open_file(Export_info& export_info, vector<Input>& inputs,
+	const Source& source)
 {
-	auto ext = path(filename).extension().string();
+	auto ext = path(source.filename).extension().string();
 	transform(ext.begin(), ext.end(), ext.begin(), ::toupper);
 	if (ext == ".MDB") {
-		if (!open_mdb(inputs, filename))
+		if (!open_mdb(inputs, source))
 			return false;
 	}
 	else if (ext == ".GR2") {
-		if (!open_gr2(inputs, filename))
+		if (!open_gr2(export_info, inputs, source))
 			return false;
 	}
 
 	return true;
 }
 
-static bool open_files(vector<Input>& inputs, const std::vector<std::string>& filenames)
+static bool open_files(Export_info& export_info, vector<Input>& inputs,
+	const std::vector<Source>& sources)
 {
-	for (auto &filename : filenames) {
-		if (!open_file(inputs, filename.c_str()))
+	for (auto &source : sources) {
+		if (!open_file(export_info, inputs, source))
 			return false;
 	}
 
 	return true;
 }
 
-static void process_fbx_bones(Dependency& dep)
-{
-	FbxNode* ribcage = nullptr;
-
-	for (auto it = dep.fbx_bones.begin(); it != dep.fbx_bones.end();) {
-		if (strncmp((*it)->GetName(), "ap_", 3) == 0) {
-			// "ap_..." (attachment point) bones are not used for skinning.			
-		}
-		else if (strncmp((*it)->GetName(), "f_", 2) == 0) {
-			// "f_..." (face) bones are only used for head skinning.
-			dep.fbx_face_bones.push_back(*it);			
-		}
-		else if (strcmp((*it)->GetName(), "Ribcage") == 0) {
-			// Keep "Ribcage" bone to reinsert it later.
-			ribcage = *it;			
-		}
-		else {
-			// The remaining bones are used for body skinning.
-			dep.fbx_body_bones.push_back(*it);
-		}
-			++it;
-	}
-
-	if (ribcage) {
-		// Reinsert "Ribcage" bone. For some unknown reason, it seems		
-		// this bone must be always the last one.
-		dep.fbx_body_bones.push_back(ribcage);
-	}
-}
-
 static bool export_skeletons(Export_info& export_info, vector<Input>& inputs)
 {
 	for (auto &input : inputs) {
-		if (input.gr2 && input.gr2->file_info->skeletons_count > 0) {
-			auto &dep = export_info.dependencies[input.filename];
-			export_gr2(*input.gr2, export_info.scene, dep.fbx_bones);
-			dep.exported = true;
-			dep.extracted = true;
-			process_fbx_bones(dep);
-		}
+		if (!input.skeleton)
+			continue;
+
+		auto &dep = export_info.dependencies[input.filename];
+		if (dep.exported) // Referenced twice
+			continue;
+
+		auto& skeleton = *input.skeleton;
+		export_gr2(*skeleton.gr2, skeleton.skeletons, export_info.scene,
+			dep.fbx_bones, export_info.nodes, export_info.animation_keys);
+		dep.skeleton = input.skeleton;
+		dep.exported = true;
+		dep.extracted = true;
+
+		for (auto i : skeleton.body_bones)
+			dep.fbx_body_bones.push_back(dep.fbx_bones[i]);
+		for (auto i : skeleton.face_bones)
+			dep.fbx_face_bones.push_back(dep.fbx_bones[i]);
 	}
 
 	return true;
@@ -549,9 +660,10 @@ static bool export_skeletons(Export_info& export_info, vector<Input>& inputs)
 static bool export_animations(Export_info& export_info, vector<Input>& inputs)
 {
 	for (auto &input : inputs) {
-		if (input.gr2 && input.gr2->file_info->skeletons_count == 0) {
+		if (input.gr2) {
 			vector<FbxNode*> fbx_bones;
-			export_gr2(*input.gr2, export_info.scene, fbx_bones);
+			export_gr2(*input.gr2, export_info.scene, fbx_bones,
+				export_info.nodes, export_info.animation_keys);
 		}
 	}
 
@@ -560,12 +672,20 @@ static bool export_animations(Export_info& export_info, vector<Input>& inputs)
 
 static bool export_mdb_files(Export_info& export_info, vector<Input>& inputs)
 {
+	vector<const MDB_file*> mdbs;
+	for (auto &input : inputs) {
+		if (input.mdb)
+			mdbs.push_back(input.mdb.get());
+	}
+
+	extract_dependencies(export_info, mdbs);
+
 	for (auto &input : inputs) {
 		if (input.mdb) {
 			print_mdb(*input.mdb);
 
 			if (!export_mdb(export_info, *input.mdb)) {
-				cout << "Cannot export MDB\n";
+				Log::info() << "Cannot export MDB\n";
 				return false;
 			}
 		}
@@ -574,6 +694,50 @@ static bool export_mdb_files(Export_info& export_info, vector<Input>& inputs)
 	return true;
 }
 
+static bool is_glb(const std::string& output_path)
+{
+	auto ext = path(output_path).extension().string();
+	transform(ext.begin(), ext.end(), ext.begin(), ::toupper);
+	return ext == ".GLB";
+}
+
+// Writes the inputs to a GLB file, without going through the FBX scene
+static bool export_glb(Export_info& export_info, vector<Input>& inputs)
+{
+	GLB_writer writer;
+	vector<const MDB_file*> mdbs;
+
+	for (auto &input : inputs) {
+		if (input.skeleton) {
+			auto &dep = export_info.dependencies[input.filename];
+			if (dep.exported) // Referenced twice
+				continue;
+			writer.add_gr2(*input.skeleton->gr2);
+			dep.skeleton = input.skeleton;
+			dep.exported = true;
+			dep.extracted = true;
+		}
+		else if (input.gr2)
+			writer.add_gr2(*input.gr2);
+		else if (input.mdb) {
+			writer.add_mdb(*input.mdb);
+			mdbs.push_back(input.mdb.get());
+		}
+	}
+
+	extract_dependencies(export_info, mdbs);
+
+	for (auto mdb : mdbs)
+		print_mdb(*mdb);
+
+	if (!writer.write(export_info.output_path.c_str())) {
+		Log::error() << writer.error_str() << endl;
+		return false;
+	}
+
+	return true;
+}
+
 static bool process_args(Export_info& export_info, int argc, char* argv[])
 {
 	parse_args(export_info, argc, argv);
@@ -581,19 +745,22 @@ static bool process_args(Export_info& export_info, int argc, char* argv[])
 	if (export_info.input_strings.empty())
 		return false;
 
-	vector<std::string> filenames;
+	vector<Source> sources;
 
-	if (!extract_args(export_info, filenames))
+	if (!extract_args(export_info, sources))
 		return false;
 
 	if (export_info.output_path.empty())
-		export_info.output_path = path(filenames[0]).stem().concat(".fbx").string();
+		export_info.output_path = path(sources[0].filename).stem().concat(".fbx").string();
 
 	vector<Input> inputs;
 
-	if (!open_files(inputs, filenames))
+	if (!open_files(export_info, inputs, sources))
 		return false;
 
+	if (is_glb(export_info.output_path))
+		return export_glb(export_info, inputs);
+
 	if (!export_skeletons(export_info, inputs))
 		return false;
 
@@ -606,10 +773,368 @@ static bool process_args(Export_info& export_info, int argc, char* argv[])
 	return true;
 }
 
+static bool export_scene(FbxManager* manager, FbxScene* scene,
+	const char* output_path)
+{
+	// Create an exporter.
+	auto exporter = FbxExporter::Create(manager, "");
+	if (!exporter->Initialize(output_path, -1, manager->GetIOSettings())) {
+		Log::error() << exporter->GetStatus().GetErrorString() << endl;
+		exporter->Destroy();
+		return false;
+	}
+	exporter->SetFileExportVersion(
+		FBX_2014_00_COMPATIBLE); // Blender needs this version
+	exporter->Export(scene);
+	exporter->Destroy();
+
+	return true;
+}
+
+static bool run_job(const Config& config, Resource_vfs& materials,
+	Skeleton_cache& skeletons, FbxManager* manager, int argc, char* argv[])
+{
+	// Create an FBX scene. This object holds most objects imported/exported
+	// from/to files.
+	auto scene = FbxScene::Create(manager, "Scene");
+	if (!scene) {
+		Log::error() << "Unable to create FBX scene\n";
+		return false;
+	}
+
+	scene->GetGlobalSettings().SetTimeMode(FbxTime::eFrames30);
+
+	Export_info export_info = { config, {}, "", materials, skeletons,
+		nullptr, scene };
+
+	bool ok = process_args(export_info, argc, argv)
+		&& (is_glb(export_info.output_path)
+		    || export_scene(manager, scene, export_info.output_path.c_str()));
+
+	scene->Destroy();
+
+	if (ok)
+		Log::info() << "\nOutput is " << export_info.output_path.c_str() << endl;
+
+	return ok;
+}
+
+// Splits a manifest line in arguments. Arguments are separated by
+// whitespace and can be quoted.
+static vector<string> split_args(const string& line)
+{
+	vector<string> args;
+	istringstream in(line);
+	string arg;
+
+	while (in >> ws && !in.eof()) {
+		if (in.peek() == '"') {
+			in.get();
+			getline(in, arg, '"');
+		}
+		else
+			in >> arg;
+		args.push_back(arg);
+	}
+
+	return args;
+}
+
+// Reads the jobs of a manifest file. Each line has the arguments of a
+// single nw2fbx invocation. Empty lines and lines starting with '#' are
+// ignored.
+static bool read_manifest(const char* manifest, vector<string>& jobs)
+{
+	ifstream in(manifest);
+	if (!in) {
+		Log::error() << "Cannot open " << manifest << endl;
+		return false;
+	}
+
+	for (string line; getline(in, line);) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		auto first = line.find_first_not_of(" \t");
+		if (first != string::npos && line[first] != '#')
+			jobs.push_back(line);
+	}
+
+	return true;
+}
+
+static bool run_job_args(const Config& config, Resource_vfs& materials,
+	Skeleton_cache& skeletons, FbxManager* manager, vector<string>& args)
+{
+	vector<char*> argv = { (char*)"nw2fbx" };
+	for (auto& arg : args)
+		argv.push_back(arg.data());
+
+	return run_job(config, materials, skeletons, manager, int(argv.size()),
+		argv.data());
+}
+
+static bool run_job_line(const Config& config, Resource_vfs& materials,
+	Skeleton_cache& skeletons, FbxManager* manager, const string& line)
+{
+	auto args = split_args(line);
+	return run_job_args(config, materials, skeletons, manager, args);
+}
+
+// Runs the jobs of a manifest file in this process. The configuration,
+// archive indexes, parsed skeletons and FBX manager are shared by all the
+// jobs.
+static int run_batch(const Config& config, Resource_vfs& materials,
+	Skeleton_cache& skeletons, FbxManager* manager, const char* manifest)
+{
+	vector<string> jobs;
+	if (!read_manifest(manifest, jobs))
+		return 1;
+
+	using Clock = chrono::steady_clock;
+	auto batch_start = Clock::now();
+	unsigned failed = 0;
+
+	for (unsigned i = 0; i < jobs.size(); ++i) {
+		Log::info() << "\n=== Job " << i + 1 << '/' << jobs.size() << ": "
+		            << jobs[i] << endl;
+
+		auto start = Clock::now();
+		bool ok = run_job_line(config, materials, skeletons, manager,
+			jobs[i]);
+		chrono::duration<double, milli> elapsed = Clock::now() - start;
+
+		if (!ok)
+			++failed;
+
+		Log::info() << "=== Job " << i + 1 << '/' << jobs.size()
+		            << (ok ? " done" : " FAILED") << " in " << elapsed.count()
+		            << " ms\n";
+	}
+
+	chrono::duration<double> elapsed = Clock::now() - batch_start;
+	Log::info() << "\n" << jobs.size() - failed << " of " << jobs.size()
+	            << " jobs done in " << elapsed.count() << " s\n";
+
+	return failed > 0 ? 1 : 0;
+}
+
+// Written by a worker after the output of each job, followed by the exit
+// code of the job.
+static const char job_end_marker[] = "\x1e" "nw2fbx job end ";
+
+// Runs the jobs read from the standard input, one per line, until EOF.
+static int run_worker(const Config& config, Resource_vfs& materials,
+	Skeleton_cache& skeletons, FbxManager* manager)
+{
+	for (string line; getline(cin, line);) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		bool ok = run_job_line(config, materials, skeletons, manager, line);
+
+		// The marker goes after the queued log messages, and after what
+		// the FBX SDK may write to stdout
+		Log::flush();
+		fflush(stdout);
+		cout << job_end_marker << (ok ? 0 : 1) << endl;
+	}
+
+	return 0;
+}
+
+// Runs the jobs requested through a local socket (a named pipe on Windows)
+// until a client requests "-shutdown". The Blender addon sends its
+// conversions here, so the archive indexes, the parsed skeletons and the
+// FBX manager stay warm between them. -v applies to a single job.
+static int run_server(const Config& config, Resource_vfs& materials,
+	Skeleton_cache& skeletons, FbxManager* manager, const char* name)
+{
+	return serve_jobs(name, [&](vector<string>& args) {
+		args.erase(remove_if(args.begin(), args.end(), [](auto& arg) {
+			if (arg != "-v")
+				return false;
+			Log::set_level(Log::Level(Log::level + 1));
+			return true;
+		}), args.end());
+
+		return run_job_args(config, materials, skeletons, manager, args);
+	});
+}
+
+struct Job_result {
+	bool finished = false;
+	bool ok = false;
+	bool journaled = false; // Done in a previous run
+	std::string log;
+	double milliseconds = 0;
+};
+
+// Runs the jobs of a manifest file in worker processes ("nw2fbx -worker")
+// fed through pipes. Each worker gets a new job when it finishes the
+// previous one. The outputs are printed in manifest order.
+//
+// Successful jobs are appended to <manifest>.journal, and are skipped if
+// the manifest is run again, so an interrupted run can be resumed. The
+// journal is removed once all the jobs succeed.
+static int run_parallel_batch(const char* exe, const char* manifest,
+	unsigned worker_count)
+{
+	vector<string> jobs;
+	if (!read_manifest(manifest, jobs))
+		return 1;
+
+	vector<Job_result> results(jobs.size());
+
+	// Journal lines are "<job index>\t<job>"
+	auto journal_filename = string(manifest) + ".journal";
+	{
+		ifstream in(journal_filename);
+		for (string line; getline(in, line);) {
+			auto tab = line.find('\t');
+			if (tab == string::npos)
+				continue;
+			unsigned i = strtoul(line.c_str(), nullptr, 10);
+			if (i < jobs.size() && line.compare(tab + 1, string::npos,
+			                                    jobs[i]) == 0) {
+				results[i].finished = true;
+				results[i].ok = true;
+				results[i].journaled = true;
+			}
+		}
+	}
+	ofstream journal(journal_filename, ios::app);
+
+	mutex results_mutex;
+	unsigned next_job = 0;
+	unsigned next_print = 0;
+
+	auto print_finished = [&] {
+		for (; next_print < jobs.size() && results[next_print].finished;
+		     ++next_print) {
+			auto& r = results[next_print];
+			Log::info() << "\n=== Job " << next_print + 1 << '/' << jobs.size()
+			            << ": " << jobs[next_print] << endl;
+			if (r.journaled) {
+				Log::info() << "=== Job " << next_print + 1 << '/'
+				            << jobs.size() << " done in a previous run\n";
+				continue;
+			}
+			Log::info() << r.log;
+			Log::info() << "=== Job " << next_print + 1 << '/' << jobs.size()
+			            << (r.ok ? " done" : " FAILED") << " in "
+			            << r.milliseconds << " ms\n";
+		}
+	};
+
+	using Clock = chrono::steady_clock;
+	auto batch_start = Clock::now();
+
+	// Workers log at the same level
+	vector<string> worker_args = { exe, "-worker" };
+	for (int l = Log::LEVEL_INFO; l < Log::level; ++l)
+		worker_args.push_back("-v");
+
+	auto run_worker_process = [&] {
+		Child_process worker;
+		bool started = false;
+
+		for (;;) {
+			unsigned i;
+			{
+				lock_guard<mutex> lock(results_mutex);
+				while (next_job < jobs.size() && results[next_job].finished)
+					++next_job;
+				if (next_job == jobs.size())
+					break;
+				i = next_job++;
+			}
+
+			// Workers that crashed are restarted for the next job
+			if (!started)
+				started = worker.start(worker_args);
+
+			Job_result r;
+			auto start = Clock::now();
+			bool ended = false;
+
+			if (started && worker.write(jobs[i] + '\n')) {
+				string line;
+				while (!ended && worker.read_line(line)) {
+					auto pos = line.find(job_end_marker);
+					if (pos == string::npos) {
+						r.log += line + '\n';
+						continue;
+					}
+					if (pos > 0)
+						r.log += line.substr(0, pos) + '\n';
+					ended = true;
+					r.ok = atoi(line.c_str() + pos + sizeof(job_end_marker)
+					            - 1) == 0;
+				}
+			}
+
+			if (!ended) {
+				r.log += started ? "ERROR: Worker process exited\n"
+				                 : "ERROR: Cannot start worker process\n";
+				worker.wait();
+				started = false;
+			}
+
+			r.milliseconds = chrono::duration<double, milli>(
+				Clock::now() - start).count();
+			r.finished = true;
+
+			lock_guard<mutex> lock(results_mutex);
+			if (r.ok)
+				journal << i << '\t' << jobs[i] << endl;
+			results[i] = move(r);
+			print_finished();
+		}
+	};
+
+	vector<thread> threads;
+	for (unsigned i = 0; i < parallel_thread_count(jobs.size(), worker_count);
+	     ++i)
+		threads.emplace_back(run_worker_process);
+	for (auto& t : threads)
+		t.join();
+
+	print_finished();
+
+	unsigned failed = 0, skipped = 0;
+	for (auto& r : results) {
+		failed += !r.ok;
+		skipped += r.journaled;
+	}
+
+	chrono::duration<double> elapsed = Clock::now() - batch_start;
+	Log::info() << "\n" << jobs.size() - failed << " of " << jobs.size()
+	            << " jobs done (" << skipped << " in a previous run) in "
+	            << elapsed.count() << " s\n";
+
+	if (failed > 0)
+		return 1;
+
+	journal.close();
+	remove(journal_filename);
+
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
 	Redirect_output_handle redirect_output_handle;
 
+	// -v can be anywhere, and applies to all the jobs of a batch
+	int n = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-v") == 0)
+			Log::set_level(Log::Level(Log::level + 1));
+		else
+			argv[n++] = argv[i];
+	}
+	argc = n;
+
 	Config config((path(argv[0]).parent_path() / "config.yml").string().c_str());
 
 	if (config.nwn2_home.empty())		
@@ -618,13 +1143,37 @@ int main(int argc, char* argv[])
 	GR2_file::granny2dll_filename = config.nwn2_home + "\\granny2.dll";
 
 	if (argc < 2) {
-		cout << "Usage: nw2fbx <file|substring ...>\n";
+		Log::info() << "Usage: nw2fbx <file|substring|glob ...> [-o <output.fbx|output.glb>] [-no-extract] [-native-keys] [-v]\n";
+		Log::info() << "       nw2fbx -batch <manifest> [-v]\n";
+		Log::info() << "       nw2fbx --jobs <N> <manifest> [-v]\n";
+		Log::info() << "       nw2fbx -server <socket|pipe name> [-v]\n";
 		return 1;
-	}	
+	}
+
+	bool batch = strcmp(argv[1], "-batch") == 0;
+	if (batch && argc != 3) {
+		Log::info() << "Usage: nw2fbx -batch <manifest>\n";
+		return 1;
+	}
+
+	bool server = strcmp(argv[1], "-server") == 0;
+	if (server && argc != 3) {
+		Log::info() << "Usage: nw2fbx -server <socket|pipe name>\n";
+		return 1;
+	}
+
+	// The driver doesn't convert anything itself
+	if (strcmp(argv[1], "--jobs") == 0) {
+		if (argc != 4 || atoi(argv[2]) <= 0) {
+			Log::info() << "Usage: nw2fbx --jobs <N> <manifest>\n";
+			return 1;
+		}
+		return run_parallel_batch(argv[0], argv[3], atoi(argv[2]));
+	}
 
 	auto manager = FbxManager::Create();
 	if (!manager) {
-		cout << "ERROR: Unable to create FBX manager\n";
+		Log::error() << "Unable to create FBX manager\n";
 		return 1;
 	}
 
@@ -633,34 +1182,22 @@ int main(int argc, char* argv[])
 	auto ios = FbxIOSettings::Create(manager, IOSROOT);
 	manager->SetIOSettings(ios);
 
-	// Create an FBX scene. This object holds most objects imported/exported
-	// from/to files.
-	auto scene = FbxScene::Create(manager, "Scene");
-	if (!scene) {
-		cout << "ERROR: Unable to create FBX scene\n";
-		return 1;
-	}
-
-	scene->GetGlobalSettings().SetTimeMode(FbxTime::eFrames30);
+	Resource_vfs materials;
+	init_material_resources(materials, config);
 
-	Export_info export_info = { config, {}, "",
-		get_material_archives(config), nullptr, scene };
+	Skeleton_cache skeletons;
 
-	if (!process_args(export_info, argc, argv))
-		return 1;
-
-	// Create an exporter.
-	auto exporter = FbxExporter::Create(manager, "");
-	if (!exporter->Initialize(export_info.output_path.c_str(), -1, manager->GetIOSettings())) {
-		cout << "ERROR: " << exporter->GetStatus().GetErrorString() << endl;
-		return false;
-	}
-	exporter->SetFileExportVersion(
-		FBX_2014_00_COMPATIBLE); // Blender needs this version
-	exporter->Export(scene);
-	exporter->Destroy();
+	int ret = 0;
+	if (batch)
+		ret = run_batch(config, materials, skeletons, manager, argv[2]);
+	else if (server)
+		ret = run_server(config, materials, skeletons, manager, argv[2]);
+	else if (strcmp(argv[1], "-worker") == 0)
+		ret = run_worker(config, materials, skeletons, manager);
+	else if (!run_job(config, materials, skeletons, manager, argc, argv))
+		ret = 1;
 
 	manager->Destroy();
 
-	cout << "\nOutput is " << export_info.output_path.c_str() << endl;
+	return ret;
 }
@@ -0,0 +1,75 @@
+#include <algorithm>
+
+#include "gr2_file.h"
+#include "log.h"
+#include "skeleton_cache.h"
+
+using namespace std;
+
+static string uppercase(const string& s)
+{
+	string r = s;
+	transform(r.begin(), r.end(), r.begin(), ::toupper);
+	return r;
+}
+
+static void classify_bones(Skeleton_file& file)
+{
+	// export_gr2 leaves the bones of the last skeleton
+	auto info = file.gr2->file_info;
+	for (int i = info->models_count - 1; i >= 0; --i) {
+		if (info->models[i]->skeleton) {
+			skinning_bones(*info->models[i]->skeleton, file.body_bones,
+				file.face_bones);
+			return;
+		}
+	}
+}
+
+std::shared_ptr<const Skeleton_file>
+Skeleton_cache::find(const std::string& filename)
+{
+	auto it = entries.find(uppercase(filename));
+	if (it == entries.end())
+		return nullptr;
+
+	Log::debug() << "Skeleton already parsed: " << filename << endl;
+	it->second.last_use = ++use_count;
+
+	return it->second.skeleton;
+}
+
+std::shared_ptr<const Skeleton_file>
+Skeleton_cache::insert(const std::string& filename,
+	std::shared_ptr<GR2_file> gr2)
+{
+	auto file = make_shared<Skeleton_file>();
+	file->skeletons = skeleton_bones(*gr2);
+	file->gr2 = move(gr2);
+	classify_bones(*file);
+
+	auto& entry = entries[uppercase(filename)];
+	entry.skeleton = file;
+	entry.last_use = ++use_count;
+
+	release_unused();
+
+	return file;
+}
+
+void Skeleton_cache::release_unused()
+{
+	while (entries.size() > capacity) {
+		auto lru = entries.end();
+		for (auto it = entries.begin(); it != entries.end(); ++it) {
+			// Only the cache holds it
+			if (it->second.skeleton.use_count() == 1
+				&& (lru == entries.end()
+				    || it->second.last_use < lru->second.last_use))
+				lru = it;
+		}
+		if (lru == entries.end())
+			break;
+		entries.erase(lru);
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "export_gr2.h"
+
+class GR2_file;
+
+// A skeleton GR2 file, parsed once, and the bone hierarchies built from it
+struct Skeleton_file {
+	std::shared_ptr<GR2_file> gr2;
+	std::vector<Skeleton_bones> skeletons;
+
+	// Indices of the bones used for skinning, in the bones exported by
+	// export_gr2. See skinning_bones in gr2.h.
+	std::vector<unsigned> body_bones;
+	std::vector<unsigned> face_bones;
+};
+
+// Skeleton files by name, shared by the inputs and the jobs of a batch
+// that reference them. A skeleton is released when it's neither in use
+// nor among the most recently used ones.
+class Skeleton_cache {
+public:
+	Skeleton_cache(unsigned capacity = 32) : capacity(capacity) {}
+
+	// Returns the cached skeleton file, or nullptr if it isn't cached.
+	std::shared_ptr<const Skeleton_file> find(const std::string& filename);
+
+	// Builds the bone hierarchies of a parsed GR2 file and caches them.
+	std::shared_ptr<const Skeleton_file> insert(const std::string& filename,
+		std::shared_ptr<GR2_file> gr2);
+
+private:
+	struct Entry {
+		std::shared_ptr<const Skeleton_file> skeleton;
+		unsigned long long last_use;
+	};
+
+	std::map<std::string, Entry> entries; // By uppercase filename
+	unsigned capacity;
+	unsigned long long use_count = 0;
+
+	void release_unused();
+};
@@ -0,0 +1,581 @@
+#include <algorithm>
+#include <charconv>
+#include <ctype.h>
+#include <filesystem>
+#include <string.h>
+
+#include "glb_view.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+using Json_value = GLB_view::Json_value;
+
+const uint32_t glb_magic = 0x46546C67; // "glTF"
+const uint32_t json_chunk = 0x4E4F534A; // "JSON"
+const uint32_t bin_chunk = 0x004E4942; // "BIN\0"
+
+enum Component_type {
+	BYTE = 5120,
+	UNSIGNED_BYTE = 5121,
+	SHORT = 5122,
+	UNSIGNED_SHORT = 5123,
+	UNSIGNED_INT = 5125,
+	FLOAT = 5126
+};
+
+static const Json_value null_value;
+
+const Json_value& Json_value::operator[](const char* name) const
+{
+	for (auto& member : members) {
+		if (member.first == name)
+			return member.second;
+	}
+
+	return null_value;
+}
+
+const Json_value& Json_value::operator[](size_t index) const
+{
+	return index < items.size() ? items[index] : null_value;
+}
+
+const Json_value& Json_value::operator[](int index) const
+{
+	return index >= 0 ? (*this)[size_t(index)] : null_value;
+}
+
+size_t Json_value::size() const
+{
+	return items.size();
+}
+
+double Json_value::get(double default_value) const
+{
+	return type == JSON_NUMBER ? number : default_value;
+}
+
+int Json_value::get_int(int default_value) const
+{
+	return type == JSON_NUMBER ? int(number) : default_value;
+}
+
+Json_value::operator bool() const
+{
+	return type != JSON_NULL;
+}
+
+// Recursive descent parser of a JSON document. Strings are unescaped to
+// UTF-8.
+class Json_parser {
+public:
+	Json_parser(const char* begin, const char* end) : p(begin), begin(begin),
+		end(end)
+	{
+	}
+
+	bool parse(Json_value& value)
+	{
+		if (!parse_value(value, 0))
+			return false;
+		skip_spaces();
+		return p == end;
+	}
+
+	size_t offset() const
+	{
+		return size_t(p - begin);
+	}
+
+private:
+	const char* p;
+	const char* begin;
+	const char* end;
+
+	static const int max_depth = 256;
+
+	void skip_spaces()
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n'
+			|| *p == '\r'))
+			++p;
+	}
+
+	bool consume(char c)
+	{
+		skip_spaces();
+		if (p < end && *p == c) {
+			++p;
+			return true;
+		}
+		return false;
+	}
+
+	bool parse_literal(const char* literal)
+	{
+		size_t length = strlen(literal);
+		if (size_t(end - p) < length || strncmp(p, literal, length) != 0)
+			return false;
+		p += length;
+		return true;
+	}
+
+	static void append_utf8(string& s, uint32_t c)
+	{
+		if (c < 0x80)
+			s += char(c);
+		else if (c < 0x800) {
+			s += char(0xC0 | (c >> 6));
+			s += char(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000) {
+			s += char(0xE0 | (c >> 12));
+			s += char(0x80 | ((c >> 6) & 0x3F));
+			s += char(0x80 | (c & 0x3F));
+		}
+		else {
+			s += char(0xF0 | (c >> 18));
+			s += char(0x80 | ((c >> 12) & 0x3F));
+			s += char(0x80 | ((c >> 6) & 0x3F));
+			s += char(0x80 | (c & 0x3F));
+		}
+	}
+
+	bool parse_hex4(uint32_t& c)
+	{
+		if (end - p < 4)
+			return false;
+		auto r = from_chars(p, p + 4, c, 16);
+		if (r.ptr != p + 4)
+			return false;
+		p += 4;
+		return true;
+	}
+
+	bool parse_string(string& s)
+	{
+		if (!consume('"'))
+			return false;
+
+		while (p < end && *p != '"') {
+			if (*p != '\\') {
+				s += *p++;
+				continue;
+			}
+
+			if (++p == end)
+				return false;
+			switch (*p++) {
+			case '"': s += '"'; break;
+			case '\\': s += '\\'; break;
+			case '/': s += '/'; break;
+			case 'b': s += '\b'; break;
+			case 'f': s += '\f'; break;
+			case 'n': s += '\n'; break;
+			case 'r': s += '\r'; break;
+			case 't': s += '\t'; break;
+			case 'u': {
+				uint32_t c;
+				if (!parse_hex4(c))
+					return false;
+				// Surrogate pair
+				if (c >= 0xD800 && c < 0xDC00 && end - p >= 2 && p[0] == '\\'
+					&& p[1] == 'u') {
+					p += 2;
+					uint32_t low;
+					if (!parse_hex4(low) || low < 0xDC00 || low >= 0xE000)
+						return false;
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				}
+				append_utf8(s, c);
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+
+		if (p == end)
+			return false;
+		++p;
+
+		return true;
+	}
+
+	bool parse_number(double& number)
+	{
+		const char* first = p;
+		if (p < end && *p == '-')
+			++p;
+		while (p < end && (isdigit((unsigned char)*p) || *p == '.'
+			|| *p == 'e' || *p == 'E' || *p == '+' || *p == '-'))
+			++p;
+
+		auto r = from_chars(first, p, number);
+		return r.ec == errc() && r.ptr == p;
+	}
+
+	bool parse_value(Json_value& value, int depth)
+	{
+		if (depth > max_depth)
+			return false;
+
+		skip_spaces();
+		if (p == end)
+			return false;
+
+		switch (*p) {
+		case '{':
+			++p;
+			value.type = Json_value::JSON_OBJECT;
+			if (consume('}'))
+				return true;
+			do {
+				auto& member = value.members.emplace_back();
+				if (!parse_string(member.first) || !consume(':')
+					|| !parse_value(member.second, depth + 1))
+					return false;
+			} while (consume(','));
+			return consume('}');
+		case '[':
+			++p;
+			value.type = Json_value::JSON_ARRAY;
+			if (consume(']'))
+				return true;
+			do {
+				if (!parse_value(value.items.emplace_back(), depth + 1))
+					return false;
+			} while (consume(','));
+			return consume(']');
+		case '"':
+			value.type = Json_value::JSON_STRING;
+			return parse_string(value.str);
+		case 't':
+			value.type = Json_value::JSON_BOOL;
+			value.number = 1;
+			return parse_literal("true");
+		case 'f':
+			value.type = Json_value::JSON_BOOL;
+			return parse_literal("false");
+		case 'n':
+			return parse_literal("null");
+		default:
+			value.type = Json_value::JSON_NUMBER;
+			return parse_number(value.number);
+		}
+	}
+};
+
+static uint32_t component_size(uint32_t component_type)
+{
+	switch (component_type) {
+	case BYTE:
+	case UNSIGNED_BYTE:
+		return 1;
+	case SHORT:
+	case UNSIGNED_SHORT:
+		return 2;
+	case UNSIGNED_INT:
+	case FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t component_count(const string& type)
+{
+	if (type == "SCALAR")
+		return 1;
+	else if (type == "VEC2")
+		return 2;
+	else if (type == "VEC3")
+		return 3;
+	else if (type == "VEC4" || type == "MAT2")
+		return 4;
+	else if (type == "MAT3")
+		return 9;
+	else if (type == "MAT4")
+		return 16;
+
+	return 0;
+}
+
+template <typename T>
+static T read_component(const unsigned char* p)
+{
+	T value;
+	memcpy(&value, p, sizeof(T));
+	return value;
+}
+
+float GLB_view::Accessor_view::get(uint32_t index, uint32_t component) const
+{
+	auto p = data + size_t(index) * stride
+		+ component * component_size(component_type);
+
+	switch (component_type) {
+	case BYTE: {
+		float c = read_component<int8_t>(p);
+		return normalized ? max(c / 127.0f, -1.0f) : c;
+	}
+	case UNSIGNED_BYTE: {
+		float c = read_component<uint8_t>(p);
+		return normalized ? c / 255.0f : c;
+	}
+	case SHORT: {
+		float c = read_component<int16_t>(p);
+		return normalized ? max(c / 32767.0f, -1.0f) : c;
+	}
+	case UNSIGNED_SHORT: {
+		float c = read_component<uint16_t>(p);
+		return normalized ? c / 65535.0f : c;
+	}
+	case UNSIGNED_INT:
+		return float(read_component<uint32_t>(p));
+	case FLOAT:
+		return read_component<float>(p);
+	default:
+		return 0;
+	}
+}
+
+uint32_t GLB_view::Accessor_view::get_uint(uint32_t index,
+	uint32_t component) const
+{
+	auto p = data + size_t(index) * stride
+		+ component * component_size(component_type);
+
+	switch (component_type) {
+	case UNSIGNED_BYTE:
+		return read_component<uint8_t>(p);
+	case UNSIGNED_SHORT:
+		return read_component<uint16_t>(p);
+	case UNSIGNED_INT:
+		return read_component<uint32_t>(p);
+	default:
+		return uint32_t(get(index, component));
+	}
+}
+
+const float* GLB_view::Accessor_view::floats() const
+{
+	if (component_type != FLOAT || stride != components * sizeof(float)
+		|| reinterpret_cast<uintptr_t>(data) % alignof(float) != 0)
+		return nullptr;
+
+	return reinterpret_cast<const float*>(data);
+}
+
+GLB_view::Accessor_view::operator bool() const
+{
+	return data && count > 0;
+}
+
+GLB_view::GLB_view(const char* filename)
+{
+	is_good_ = false;
+
+	auto& file = *files.emplace_back(new Mapped_file(filename));
+	if (!file) {
+		error_str_ = "can't open file";
+		return;
+	}
+
+	if (file.size() >= 4 && read_component<uint32_t>(file.data()) == glb_magic) {
+		if (!parse_glb(filename, file))
+			return;
+	}
+	else {
+		auto json = reinterpret_cast<const char*>(file.data());
+		Json_parser parser(json, json + file.size());
+		if (!parser.parse(json_)) {
+			error_str_ = "invalid JSON at offset " + to_string(parser.offset());
+			return;
+		}
+		if (!map_buffers(filename, nullptr, 0))
+			return;
+	}
+
+	if (json_["asset"]["version"].str != "2.0") {
+		error_str_ = "unsupported glTF version";
+		return;
+	}
+
+	is_good_ = true;
+}
+
+bool GLB_view::parse_glb(const char* filename, const Mapped_file& file)
+{
+	auto data = file.data();
+	size_t size = file.size();
+
+	if (size < 20 || read_component<uint32_t>(data + 4) != 2) {
+		error_str_ = "unsupported GLB version";
+		return false;
+	}
+
+	size = min(size, size_t(read_component<uint32_t>(data + 8)));
+
+	const unsigned char* bin = nullptr;
+	size_t bin_size = 0;
+	bool has_json = false;
+
+	for (size_t offset = 12; offset + 8 <= size;) {
+		size_t length = read_component<uint32_t>(data + offset);
+		uint32_t type = read_component<uint32_t>(data + offset + 4);
+		offset += 8;
+
+		if (length > size - offset) {
+			error_str_ = "truncated chunk";
+			return false;
+		}
+
+		if (type == json_chunk && !has_json) {
+			auto json = reinterpret_cast<const char*>(data + offset);
+			Json_parser parser(json, json + length);
+			if (!parser.parse(json_)) {
+				error_str_ = "invalid JSON at offset "
+					+ to_string(parser.offset());
+				return false;
+			}
+			has_json = true;
+		}
+		else if (type == bin_chunk && !bin) {
+			bin = data + offset;
+			bin_size = length;
+		}
+
+		// Chunks are 4-byte aligned
+		offset += (length + 3) & ~size_t(3);
+	}
+
+	if (!has_json) {
+		error_str_ = "missing JSON chunk";
+		return false;
+	}
+
+	return map_buffers(filename, bin, bin_size);
+}
+
+// Decodes the percent-encoded characters of a relative URI
+static string uri_path(const string& uri)
+{
+	string s;
+
+	for (size_t i = 0; i < uri.size(); ++i) {
+		unsigned c;
+		if (uri[i] == '%' && i + 2 < uri.size()
+			&& from_chars(uri.data() + i + 1, uri.data() + i + 3, c, 16).ptr
+				== uri.data() + i + 3) {
+			s += char(c);
+			i += 2;
+		}
+		else
+			s += uri[i];
+	}
+
+	return s;
+}
+
+bool GLB_view::map_buffers(const char* filename, const unsigned char* bin,
+	size_t bin_size)
+{
+	auto& json_buffers = json_["buffers"];
+
+	for (size_t i = 0; i < json_buffers.size(); ++i) {
+		auto& buffer = json_buffers[i];
+		size_t length = size_t(buffer["byteLength"].get(0));
+		auto& uri = buffer["uri"];
+
+		if (!uri) {
+			// The binary chunk of a GLB file
+			if (i > 0 || !bin || length > bin_size) {
+				error_str_ = "missing binary chunk";
+				return false;
+			}
+			buffers.emplace_back(bin, length);
+		}
+		else if (uri.str.compare(0, 5, "data:") == 0) {
+			error_str_ = "embedded buffers aren't supported";
+			return false;
+		}
+		else {
+			auto p = path(filename).parent_path() / uri_path(uri.str);
+			auto& file = *files.emplace_back(
+				new Mapped_file(p.string().c_str()));
+			if (!file || file.size() < length) {
+				error_str_ = "can't open buffer " + uri.str;
+				return false;
+			}
+			buffers.emplace_back(file.data(), length);
+		}
+	}
+
+	return true;
+}
+
+const char* GLB_view::error_str() const
+{
+	return error_str_.c_str();
+}
+
+const Json_value& GLB_view::json() const
+{
+	return json_;
+}
+
+GLB_view::Accessor_view GLB_view::accessor(int accessor_index) const
+{
+	if (accessor_index < 0)
+		return {};
+
+	auto& accessor = json_["accessors"][size_t(accessor_index)];
+	if (!accessor || accessor["sparse"])
+		return {};
+
+	// Accessors without buffer view are all zeros, not supported
+	int view_index = accessor["bufferView"].get_int();
+	if (view_index < 0)
+		return {};
+
+	auto& view = json_["bufferViews"][size_t(view_index)];
+	int buffer_index = view["buffer"].get_int();
+	if (buffer_index < 0 || size_t(buffer_index) >= buffers.size())
+		return {};
+
+	auto& buffer = buffers[buffer_index];
+	uint64_t view_offset = uint64_t(view["byteOffset"].get(0));
+	uint64_t view_length = uint64_t(view["byteLength"].get(0));
+	if (view_offset + view_length > buffer.second)
+		return {};
+
+	Accessor_view r;
+	r.component_type = uint32_t(accessor["componentType"].get_int(0));
+	r.components = component_count(accessor["type"].str);
+	r.normalized = accessor["normalized"].number != 0;
+
+	uint64_t element_size = uint64_t(component_size(r.component_type))
+		* r.components;
+	if (element_size == 0)
+		return {};
+
+	uint64_t stride = uint64_t(view["byteStride"].get(double(element_size)));
+	uint64_t offset = uint64_t(accessor["byteOffset"].get(0));
+	uint64_t count = uint64_t(accessor["count"].get(0));
+	if (count == 0 || stride < element_size
+		|| offset + stride * (count - 1) + element_size > view_length)
+		return {};
+
+	r.data = buffer.first + view_offset + offset;
+	r.count = uint32_t(count);
+	r.stride = uint32_t(stride);
+
+	return r;
+}
+
+GLB_view::operator bool() const
+{
+	return is_good_;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+
+/// Read-only view of a glTF 2.0 file mapped in memory.
+///
+/// The JSON document is parsed, but the buffers are not copied. Accessors
+/// are strided views into the binary chunk of a GLB file, or into the
+/// external buffer files of a .gltf file, which are mapped too. The
+/// returned values and views are valid while the view exists.
+class GLB_view {
+public:
+	/// A value of the JSON document.
+	class Json_value {
+	public:
+		enum Type {
+			JSON_NULL,
+			JSON_BOOL,
+			JSON_NUMBER,
+			JSON_STRING,
+			JSON_ARRAY,
+			JSON_OBJECT
+		};
+
+		Type type = JSON_NULL;
+		double number = 0; ///< Also 0 or 1 for booleans.
+		std::string str;
+		std::vector<Json_value> items;
+		std::vector<std::pair<std::string, Json_value>> members;
+
+		/// Returns the member with the specified name. If the value isn't
+		/// an object or doesn't have the member, returns a null value.
+		const Json_value& operator[](const char* name) const;
+
+		/// Returns the specified item. If the value isn't an array or the
+		/// item doesn't exist, returns a null value.
+		const Json_value& operator[](size_t index) const;
+		const Json_value& operator[](int index) const;
+
+		/// Returns the number of items of an array, or 0.
+		size_t size() const;
+
+		/// Returns the number, or default_value if the value isn't a
+		/// number.
+		double get(double default_value) const;
+
+		/// Returns the number as an integer, or default_value if the
+		/// value isn't a number.
+		int get_int(int default_value = -1) const;
+
+		/// Checks if the value isn't null.
+		explicit operator bool() const;
+	};
+
+	/// Strided view of the elements of an accessor.
+	struct Accessor_view {
+		const unsigned char* data = nullptr;
+		uint32_t count = 0;
+		/// Bytes between the first bytes of two consecutive elements.
+		uint32_t stride = 0;
+		uint32_t component_type = 0;
+		/// Components per element (e.g. 3 for VEC3).
+		uint32_t components = 0;
+		bool normalized = false;
+
+		/// Returns a component of an element as float. Normalized
+		/// integers are converted to [0, 1] or [-1, 1].
+		float get(uint32_t index, uint32_t component = 0) const;
+
+		/// Returns a component of an element as an unsigned integer.
+		uint32_t get_uint(uint32_t index, uint32_t component = 0) const;
+
+		/// Returns the elements as an array of floats, or null pointer if
+		/// they aren't tightly packed aligned floats.
+		const float* floats() const;
+
+		/// Checks if the view has elements.
+		explicit operator bool() const;
+	};
+
+	/// Maps the glTF (.gltf) or GLB (.glb) file at the specified path.
+	///
+	/// @param filename The name of the file to be opened.
+	GLB_view(const char* filename);
+
+	/// Returns the error string.
+	const char* error_str() const;
+
+	/// Returns the root object of the JSON document.
+	const Json_value& json() const;
+
+	/// Returns a view of the specified accessor.
+	///
+	/// @return If the accessor exists and fits in its buffer, returns a
+	/// view of its elements. Otherwise (or for sparse accessors), returns
+	/// an empty view.
+	Accessor_view accessor(int accessor_index) const;
+
+	/// Checks if no error has occurred.
+	operator bool() const;
+
+private:
+	// The file itself, and the external buffers of .gltf files
+	std::vector<std::unique_ptr<Mapped_file>> files;
+	std::vector<std::pair<const unsigned char*, size_t>> buffers;
+	Json_value json_;
+	bool is_good_;
+	std::string error_str_;
+
+	bool parse_glb(const char* filename, const Mapped_file& file);
+	bool map_buffers(const char* filename, const unsigned char* bin,
+		size_t bin_size);
+};
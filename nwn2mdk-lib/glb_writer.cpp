@@ -0,0 +1,1501 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+
+#include "glb_writer.h"
+#include "gr2_file.h"
+#include "mdb_file.h"
+#include "parallel.h"
+
+using namespace std;
+
+// glTF enums
+const unsigned ARRAY_BUFFER = 34962;
+const unsigned ELEMENT_ARRAY_BUFFER = 34963;
+const unsigned UNSIGNED_BYTE = 5121;
+const unsigned UNSIGNED_SHORT = 5123;
+const unsigned FLOAT = 5126;
+
+const double pi = 3.14159265358979323846;
+const double time_step = 1 / 30.0;
+
+// -90 degrees around the X axis, from the Z-up packets and skeletons to
+// glTF's Y-up. It's the rotation of the nodes at the root of the FBX scenes.
+const float z_up_rotation[4] = { -0.70710678f, 0, 0, 0.70710678f };
+
+static_assert(sizeof(MDB_file::Face) == 6);
+
+// 4x4 matrix, in column major order as in glTF
+struct Matrix {
+	float m[16];
+
+	float operator()(int row, int col) const
+	{
+		return m[col * 4 + row];
+	}
+};
+
+static Matrix operator*(const Matrix& a, const Matrix& b)
+{
+	Matrix r;
+	for (int col = 0; col < 4; ++col) {
+		for (int row = 0; row < 4; ++row) {
+			float s = 0;
+			for (int k = 0; k < 4; ++k)
+				s += a(row, k) * b(k, col);
+			r.m[col * 4 + row] = s;
+		}
+	}
+
+	return r;
+}
+
+// Translation, rotation (quaternion x, y, z, w) and scale
+static Matrix trs(const float t[3], const float q[4], const float s[3])
+{
+	float x = q[0], y = q[1], z = q[2], w = q[3];
+
+	return { {
+		(1 - 2 * (y * y + z * z)) * s[0], 2 * (x * y + z * w) * s[0],
+		2 * (x * z - y * w) * s[0], 0,
+		2 * (x * y - z * w) * s[1], (1 - 2 * (x * x + z * z)) * s[1],
+		2 * (y * z + x * w) * s[1], 0,
+		2 * (x * z + y * w) * s[2], 2 * (y * z - x * w) * s[2],
+		(1 - 2 * (x * x + y * y)) * s[2], 0,
+		t[0], t[1], t[2], 1 } };
+}
+
+static Matrix affine_inverse(const Matrix& a)
+{
+	Matrix r = {};
+
+	// Transposed cofactors of the 3x3 part
+	for (int i = 0; i < 3; ++i) {
+		int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+		for (int j = 0; j < 3; ++j) {
+			int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+			r.m[j * 4 + i] = a(j1, i1) * a(j2, i2) - a(j1, i2) * a(j2, i1);
+		}
+	}
+
+	float det = a(0, 0) * r.m[0] + a(0, 1) * r.m[1] + a(0, 2) * r.m[2];
+	if (det != 0) {
+		for (int i = 0; i < 3; ++i)
+			for (int j = 0; j < 3; ++j)
+				r.m[j * 4 + i] /= det;
+	}
+
+	for (int i = 0; i < 3; ++i)
+		r.m[12 + i] = -(r(i, 0) * a.m[12] + r(i, 1) * a.m[13]
+			+ r(i, 2) * a.m[14]);
+	r.m[15] = 1;
+
+	return r;
+}
+
+// Rotation matrix, given by its columns, to quaternion (x, y, z, w)
+static void rotation_to_quaternion(const Vector3<float> c[3], float q[4])
+{
+	float m00 = c[0].x, m11 = c[1].y, m22 = c[2].z;
+	float trace = m00 + m11 + m22;
+
+	if (trace > 0) {
+		float s = 2 * sqrt(trace + 1);
+		q[3] = s / 4;
+		q[0] = (c[1].z - c[2].y) / s;
+		q[1] = (c[2].x - c[0].z) / s;
+		q[2] = (c[0].y - c[1].x) / s;
+	}
+	else if (m00 > m11 && m00 > m22) {
+		float s = 2 * sqrt(1 + m00 - m11 - m22);
+		q[3] = (c[1].z - c[2].y) / s;
+		q[0] = s / 4;
+		q[1] = (c[1].x + c[0].y) / s;
+		q[2] = (c[2].x + c[0].z) / s;
+	}
+	else if (m11 > m22) {
+		float s = 2 * sqrt(1 + m11 - m00 - m22);
+		q[3] = (c[2].x - c[0].z) / s;
+		q[0] = (c[1].x + c[0].y) / s;
+		q[1] = s / 4;
+		q[2] = (c[2].y + c[1].z) / s;
+	}
+	else {
+		float s = 2 * sqrt(1 + m22 - m00 - m11);
+		q[3] = (c[0].y - c[1].x) / s;
+		q[0] = (c[2].x + c[0].z) / s;
+		q[1] = (c[2].y + c[1].z) / s;
+		q[2] = s / 4;
+	}
+}
+
+static Vector4<float> normalized(Vector4<float> q)
+{
+	float n = sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	if (n == 0)
+		return Vector4<float>(0, 0, 0, 1);
+
+	return Vector4<float>(q.x / n, q.y / n, q.z / n, q.w / n);
+}
+
+static bool equal_nocase(const char* a, const char* b)
+{
+	for (; *a && *b; ++a, ++b) {
+		if (tolower((unsigned char)*a) != tolower((unsigned char)*b))
+			return false;
+	}
+
+	return *a == *b;
+}
+
+static string packet_name(const char name[32])
+{
+	return string(name, 32).c_str();
+}
+
+// JSON string. Names in the files are Latin-1, they're converted to UTF-8.
+static string json_string(const string& s)
+{
+	string r = "\"";
+	for (unsigned char c : s) {
+		if (c == '"' || c == '\\') {
+			r += '\\';
+			r += char(c);
+		}
+		else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			r += buf;
+		}
+		else if (c >= 0x80) {
+			r += char(0xc0 | (c >> 6));
+			r += char(0x80 | (c & 0x3f));
+		}
+		else
+			r += char(c);
+	}
+
+	return r + '"';
+}
+
+static string json_number(double x)
+{
+	if (!isfinite(x))
+		return "0";
+
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.9g", x);
+
+	return buf;
+}
+
+static string json_numbers(const float* v, unsigned count)
+{
+	string r = "[";
+	for (unsigned i = 0; i < count; ++i) {
+		if (i > 0)
+			r += ',';
+		r += json_number(v[i]);
+	}
+
+	return r + ']';
+}
+
+// Round to 3 decimals, as nw2fbx does for the user properties.
+static double round3(double x)
+{
+	return round(x * 1000.0) / 1000.0;
+}
+
+static string joined(const vector<string>& v)
+{
+	string r = "[";
+	for (size_t i = 0; i < v.size(); ++i) {
+		if (i > 0)
+			r += ',';
+		r += v[i];
+	}
+
+	return r + ']';
+}
+
+// The BIN chunk. Blocks are written as they are, at 4-byte aligned offsets,
+// so they can point to the data of the packets and the curves.
+class Binary_chunk {
+public:
+	// Returns the offset of the block.
+	size_t add(const void* data, size_t size)
+	{
+		size_t offset = size_;
+		blocks.push_back({ static_cast<const char*>(data), size });
+		size_ += (size + 3) & ~size_t(3);
+		return offset;
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+	void write(ostream& out) const
+	{
+		const char padding[4] = {};
+		for (auto& block : blocks) {
+			out.write(block.data, block.size);
+			out.write(padding, ((block.size + 3) & ~size_t(3)) - block.size);
+		}
+	}
+
+private:
+	struct Block {
+		const char* data;
+		size_t size;
+	};
+
+	vector<Block> blocks;
+	size_t size_ = 0;
+};
+
+struct Node {
+	string name;
+	int parent = -1;
+	vector<int> children;
+	int mesh = -1;
+	int skin = -1;
+	bool has_translation = false;
+	bool has_rotation = false;
+	bool has_scale = false;
+	float translation[3] = { 0, 0, 0 };
+	float rotation[4] = { 0, 0, 0, 1 };
+	float scale[3] = { 1, 1, 1 };
+	string extras; // Members of the extras object
+
+	void set_translation(float x, float y, float z)
+	{
+		translation[0] = x;
+		translation[1] = y;
+		translation[2] = z;
+		has_translation = true;
+	}
+
+	void set_rotation(const float q[4])
+	{
+		copy(q, q + 4, rotation);
+		has_rotation = true;
+	}
+
+	void set_scale(float x, float y, float z)
+	{
+		scale[0] = x;
+		scale[1] = y;
+		scale[2] = z;
+		has_scale = true;
+	}
+};
+
+// The nodes of the last skeleton of a GR2 file
+struct Skeleton_nodes {
+	int root = -1;
+	vector<int> bones;    // Node of each bone, -1 if it isn't exported
+	vector<Matrix> world; // Transform of each bone, relative to root
+	vector<unsigned> body_bones;
+	vector<unsigned> face_bones;
+	int skins[2] = { -1, -1 }; // Body and head skins
+};
+
+// Keys of a sampler. They point to the curve data, or to storage if the
+// curve data can't be written as it is.
+struct Keys {
+	const float* times = nullptr;
+	const float* values = nullptr;
+	size_t count = 0;
+	bool step = false;
+	vector<float> time_storage;
+	vector<float> value_storage;
+
+	void add(float t, const float* v, unsigned components)
+	{
+		time_storage.push_back(t);
+		value_storage.insert(value_storage.end(), v, v + components);
+	}
+
+	void use_storage()
+	{
+		times = time_storage.data();
+		values = value_storage.data();
+		count = time_storage.size();
+	}
+};
+
+// A transform track bound to its node, with its keys
+struct Track {
+	int node;
+	GR2_animation* anim;
+	GR2_transform_track* transform_track;
+	unique_ptr<GR2_curve_view> position_view;
+	unique_ptr<GR2_curve_view> rotation_view;
+	Keys translation;
+	Keys rotation;
+	Keys scale;
+
+	Track(int node, GR2_animation* anim,
+	      GR2_transform_track* transform_track)
+		: node(node), anim(anim), transform_track(transform_track)
+	{
+	}
+};
+
+// An animation and the range of its tracks
+struct Animation {
+	GR2_animation* anim;
+	size_t first_track;
+	size_t track_count;
+};
+
+// Data of a packet computed before the document is assembled. Packets are
+// prepared concurrently.
+struct Packet_data {
+	const MDB_file::Packet* packet;
+	float min[3] = { 0, 0, 0 }; // Bounds of the positions
+	float max[3] = { 0, 0, 0 };
+	vector<Vector3<float>> positions;  // Walk mesh positions, clamped
+	vector<vector<uint16_t>> indices; // Walk mesh faces, by material
+
+	Packet_data(const MDB_file::Packet* packet) : packet(packet) {}
+};
+
+template <typename T>
+static void compute_bounds(const vector<T>& verts, Packet_data& data)
+{
+	if (verts.empty())
+		return;
+
+	for (int i = 0; i < 3; ++i)
+		data.min[i] = data.max[i] = (&verts[0].position.x)[i];
+
+	for (auto& v : verts) {
+		for (int i = 0; i < 3; ++i) {
+			data.min[i] = min(data.min[i], (&v.position.x)[i]);
+			data.max[i] = max(data.max[i], (&v.position.x)[i]);
+		}
+	}
+}
+
+// Returns the walk mesh material of a face.
+static unsigned material_index(const MDB_file::Walk_mesh_face& f)
+{
+	for (unsigned i = 0; i < size(MDB_file::walk_mesh_materials); ++i)
+		if (f.flags[0] == MDB_file::walk_mesh_materials[i].flags)
+			return i;
+
+	return 0;
+}
+
+static void prepare_walk_mesh(const MDB_file::Walk_mesh& wm,
+	Packet_data& data)
+{
+	// Some walk mesh vertices have z=-1000000. We clamp z to -20.
+	data.positions.reserve(wm.verts.size());
+	for (auto& v : wm.verts)
+		data.positions.emplace_back(v.position.x, v.position.y,
+			max(v.position.z, -20.0f));
+
+	compute_bounds(wm.verts, data);
+	data.min[2] = max(data.min[2], -20.0f);
+	data.max[2] = max(data.max[2], -20.0f);
+
+	data.indices.resize(size(MDB_file::walk_mesh_materials));
+	for (auto& f : wm.faces) {
+		auto& indices = data.indices[material_index(f)];
+		indices.insert(indices.end(), f.vertex_indices, f.vertex_indices + 3);
+	}
+}
+
+static void prepare_packet(Packet_data& data)
+{
+	switch (data.packet->type) {
+	case MDB_file::COL2:
+	case MDB_file::COL3:
+		compute_bounds(
+			static_cast<const MDB_file::Collision_mesh*>(data.packet)->verts,
+			data);
+		break;
+	case MDB_file::RIGD:
+		compute_bounds(
+			static_cast<const MDB_file::Rigid_mesh*>(data.packet)->verts,
+			data);
+		break;
+	case MDB_file::SKIN:
+		compute_bounds(
+			static_cast<const MDB_file::Skin*>(data.packet)->verts, data);
+		break;
+	case MDB_file::WALK:
+		prepare_walk_mesh(
+			*static_cast<const MDB_file::Walk_mesh*>(data.packet), data);
+		break;
+	default:
+		break;
+	}
+}
+
+// Keys of a position or rotation curve. Linear curves are written at their
+// knots, straight from the controls when they need no conversion. Constant
+// curves are written at their knots with step interpolation, and curves of
+// higher degree are sampled at 30 fps.
+static void curve_keys(GR2_animation* anim, const GR2_curve_view& view,
+	bool rotation, Keys& keys)
+{
+	auto& knots = view.knots();
+	auto& controls = view.controls();
+	unsigned degree = view.degree();
+	unsigned components = rotation ? 4 : 3;
+
+	auto add = [&](float t, Vector4<float> v) {
+		if (rotation)
+			v = normalized(v);
+		else
+			v = Vector4<float>(v.x / 100, v.y / 100, v.z / 100, 0);
+		keys.add(t, &v.x, components);
+	};
+
+	if (controls.empty())
+		return;
+
+	// Constant curve
+	if (knots.size() == 1 || knots.size() < degree + 1) {
+		add(0, controls[0]);
+		keys.use_storage();
+		return;
+	}
+
+	if (degree == 1 && controls.size() == knots.size()) {
+		bool increasing = true;
+		for (size_t i = 1; i < knots.size() && increasing; ++i)
+			increasing = knots[i] > knots[i - 1];
+
+		if (rotation && increasing) {
+			keys.times = knots.data();
+			keys.values = &controls[0].x;
+			keys.count = knots.size();
+			return;
+		}
+
+		for (size_t i = 0; i < knots.size(); ++i) {
+			if (i == 0 || knots[i] > keys.time_storage.back())
+				add(knots[i], controls[i]);
+		}
+		keys.use_storage();
+		return;
+	}
+
+	auto value = [&](float t) {
+		return view.value(t, rotation);
+	};
+
+	if (degree == 0) {
+		keys.step = true;
+		add(0, value(0));
+		for (auto t : knots) {
+			if (t > keys.time_storage.back())
+				add(t, value(t));
+		}
+	}
+	else {
+		for (double i = 0, t = 0; t < anim->duration + time_step / 2;
+		     ++i, t = i * time_step)
+			add(float(t), value(float(t)));
+	}
+
+	keys.use_storage();
+}
+
+// Keys of the scale of a scale-shear curve. FBX and glTF have no shear.
+static void scale_keys(GR2_transform_track& transform_track, Keys& keys)
+{
+	auto curve_data = transform_track.scale_shear_curve.curve_data.get();
+	vector<float> knots;
+	vector<float> controls;
+
+	if (curve_data->curve_data_header.format == DaConstant32f) {
+		auto data = (GR2_curve_data_DaConstant32f*)curve_data;
+		knots.push_back(0);
+		for (int i = 0; i < 9 && i < data->controls_count; ++i)
+			controls.push_back(data->controls[i]);
+	}
+	else if (curve_data->curve_data_header.format == DaK16uC16u) {
+		GR2_DaK16uC16u_view view(*(GR2_curve_data_DaK16uC16u*)curve_data);
+		knots = view.knots();
+		controls = view.controls();
+	}
+	else if (curve_data->curve_data_header.format == DaK32fC32f) {
+		auto data = (GR2_curve_data_DaK32fC32f*)curve_data;
+		for (int i = 0; i < data->knots_count; ++i)
+			knots.push_back(data->knots[i]);
+		for (int i = 0; i < data->controls_count; ++i)
+			controls.push_back(data->controls[i]);
+	}
+
+	for (size_t i = 0; i < knots.size() && i * 9 + 8 < controls.size(); ++i) {
+		if (i > 0 && knots[i] <= keys.time_storage.back())
+			continue;
+		float s[3] = { controls[i * 9 + 0], controls[i * 9 + 4],
+			controls[i * 9 + 8] };
+		keys.add(knots[i], s, 3);
+	}
+
+	keys.use_storage();
+}
+
+// Evaluates the curves of a track. Tracks are evaluated concurrently.
+static void evaluate_track(Track& track)
+{
+	track.position_view.reset(
+		new GR2_curve_view(track.transform_track->position_curve));
+	if (!track.position_view->knots().empty())
+		curve_keys(track.anim, *track.position_view, false, track.translation);
+
+	track.rotation_view.reset(
+		new GR2_curve_view(track.transform_track->orientation_curve));
+	if (!track.rotation_view->knots().empty())
+		curve_keys(track.anim, *track.rotation_view, true, track.rotation);
+
+	scale_keys(*track.transform_track, track.scale);
+}
+
+// Builds the glTF document
+class Document {
+public:
+	Document()
+	{
+		fill(begin(walk_mesh_materials), end(walk_mesh_materials), -1);
+	}
+
+	bool write(const char* filename, string& error_str);
+
+	void add_skeletons(GR2_file& gr2);
+	void add_packet(const Packet_data& data);
+	void add_animations(const vector<GR2_file*>& gr2s, unsigned thread_count);
+
+private:
+	vector<Node> nodes;
+	unordered_map<string, vector<int>> nodes_by_name;
+	vector<string> meshes, materials, textures, images, skins, animations;
+	vector<string> accessors, buffer_views;
+	unordered_map<string, int> textures_by_name;
+	int walk_mesh_materials[size(MDB_file::walk_mesh_materials)];
+	Binary_chunk bin;
+
+	// Skeletons by GR2 file, in the order they were added
+	vector<pair<GR2_file*, Skeleton_nodes>> skeletons;
+
+	// Generated data, such as collision spheres and bind matrices
+	deque<vector<float>> float_storage;
+	deque<vector<uint16_t>> index_storage;
+	int sphere_indices = -1;
+	int sphere_material = -1;
+
+	vector<Track> tracks;
+
+	int add_node(const string& name, int parent = -1);
+	int add_buffer_view(const void* data, size_t size, unsigned stride,
+		unsigned target);
+	int add_accessor(int buffer_view, size_t offset, unsigned component_type,
+		size_t count, const char* type, const float* min = nullptr,
+		const float* max = nullptr, unsigned components = 0);
+	int add_indices(const void* data, size_t count);
+	int add_texture(const char* map_name);
+	int add_material(const string& material);
+	int add_material(const string& name, const MDB_file::Material& material);
+	int add_material(const string& name, float r, float g, float b,
+		float a);
+
+	template <typename T>
+	string vertex_attributes(const vector<T>& verts, const Packet_data& data,
+		bool skinned);
+	template <typename T>
+	int add_mesh(const string& name, const vector<T>& verts,
+		const vector<MDB_file::Face>& faces, const Packet_data& data,
+		int material, bool skinned = false);
+
+	void add_point(const string& name, const Vector3<float>& position,
+		const float orientation[3][3], const string& extras);
+	void add_collision_mesh(const MDB_file::Collision_mesh& cm,
+		const Packet_data& data);
+	void add_collision_sphere(const MDB_file::Collision_sphere& sphere);
+	void add_rigid_mesh(const MDB_file::Rigid_mesh& rm,
+		const Packet_data& data);
+	void add_skin(const MDB_file::Skin& skin, const Packet_data& data);
+	void add_walk_mesh(const MDB_file::Walk_mesh& wm,
+		const Packet_data& data);
+	int skin_for(const MDB_file::Skin& skin);
+
+	void bind_track_group(GR2_animation* anim, GR2_track_group* track_group);
+	int add_sampler_accessors(const Keys& keys, unsigned components,
+		int& output);
+	string json() const;
+};
+
+int Document::add_node(const string& name, int parent)
+{
+	int index = int(nodes.size());
+	nodes.emplace_back();
+	nodes.back().name = name;
+	nodes.back().parent = parent;
+	if (parent >= 0)
+		nodes[parent].children.push_back(index);
+	nodes_by_name[name].push_back(index);
+
+	return index;
+}
+
+int Document::add_buffer_view(const void* data, size_t size, unsigned stride,
+	unsigned target)
+{
+	string view = "{\"buffer\":0,\"byteOffset\":"
+		+ to_string(bin.add(data, size)) + ",\"byteLength\":"
+		+ to_string(size);
+	if (stride > 0)
+		view += ",\"byteStride\":" + to_string(stride);
+	if (target > 0)
+		view += ",\"target\":" + to_string(target);
+	buffer_views.push_back(view + '}');
+
+	return int(buffer_views.size() - 1);
+}
+
+int Document::add_accessor(int buffer_view, size_t offset,
+	unsigned component_type, size_t count, const char* type,
+	const float* min, const float* max, unsigned components)
+{
+	string accessor = "{\"bufferView\":" + to_string(buffer_view);
+	if (offset > 0)
+		accessor += ",\"byteOffset\":" + to_string(offset);
+	accessor += ",\"componentType\":" + to_string(component_type)
+		+ ",\"count\":" + to_string(count) + ",\"type\":\"" + type + '"';
+	if (min && max)
+		accessor += ",\"min\":" + json_numbers(min, components) + ",\"max\":"
+			+ json_numbers(max, components);
+	accessors.push_back(accessor + '}');
+
+	return int(accessors.size() - 1);
+}
+
+int Document::add_indices(const void* data, size_t count)
+{
+	int view = add_buffer_view(data, count * sizeof(uint16_t), 0,
+		ELEMENT_ARRAY_BUFFER);
+
+	return add_accessor(view, 0, UNSIGNED_SHORT, count, "SCALAR");
+}
+
+// Textures are referenced by name, as DDS files next to the GLB file
+int Document::add_texture(const char* map_name)
+{
+	string name = packet_name(map_name);
+	if (name.empty())
+		return -1;
+
+	auto it = textures_by_name.find(name);
+	if (it != textures_by_name.end())
+		return it->second;
+
+	images.push_back("{\"name\":" + json_string(name) + ",\"uri\":"
+		+ json_string(name + ".dds") + ",\"mimeType\":\"image/vnd-ms.dds\"}");
+	textures.push_back("{\"extensions\":{\"MSFT_texture_dds\":{\"source\":"
+		+ to_string(images.size() - 1) + "}}}");
+
+	int texture = int(textures.size() - 1);
+	textures_by_name[name] = texture;
+
+	return texture;
+}
+
+int Document::add_material(const string& material)
+{
+	materials.push_back(material);
+	return int(materials.size() - 1);
+}
+
+int Document::add_material(const string& name,
+	const MDB_file::Material& material)
+{
+	float color[4] = { material.diffuse_color.x, material.diffuse_color.y,
+		material.diffuse_color.z, 1 };
+
+	string pbr = "{\"baseColorFactor\":" + json_numbers(color, 4)
+		+ ",\"metallicFactor\":0";
+	int diffuse_map = add_texture(material.diffuse_map_name);
+	if (diffuse_map >= 0)
+		pbr += ",\"baseColorTexture\":{\"index\":" + to_string(diffuse_map)
+			+ '}';
+	pbr += '}';
+
+	string m = "{\"name\":" + json_string(name) + ",\"pbrMetallicRoughness\":"
+		+ pbr;
+	int normal_map = add_texture(material.normal_map_name);
+	if (normal_map >= 0)
+		m += ",\"normalTexture\":{\"index\":" + to_string(normal_map) + '}';
+	if (material.flags & MDB_file::ALPHA_TEST)
+		m += ",\"alphaMode\":\"MASK\"";
+	else if (material.flags & MDB_file::ALPHA_BLEND)
+		m += ",\"alphaMode\":\"BLEND\"";
+
+	return add_material(m + '}');
+}
+
+int Document::add_material(const string& name, float r, float g, float b,
+	float a)
+{
+	float color[4] = { r, g, b, a };
+
+	string m = "{\"name\":" + json_string(name)
+		+ ",\"pbrMetallicRoughness\":{\"baseColorFactor\":"
+		+ json_numbers(color, 4) + ",\"metallicFactor\":0}";
+	if (a < 1)
+		m += ",\"alphaMode\":\"BLEND\"";
+
+	return add_material(m + '}');
+}
+
+// The user properties of nw2fbx for the colors of a material
+static string color_properties(const MDB_file::Material& material)
+{
+	float diffuse[3] = { float(round3(material.diffuse_color.x)),
+		float(round3(material.diffuse_color.y)),
+		float(round3(material.diffuse_color.z)) };
+	float specular[3] = { float(round3(material.specular_color.x)),
+		float(round3(material.specular_color.y)),
+		float(round3(material.specular_color.z)) };
+
+	return "\"DIFFUSE_COLOR\":" + json_numbers(diffuse, 3)
+		+ ",\"SPECULAR_COLOR\":" + json_numbers(specular, 3)
+		+ ",\"SPECULAR_LEVEL\":" + json_number(material.specular_level)
+		+ ",\"GLOSSINESS\":" + json_number(material.specular_power);
+}
+
+// The user properties of nw2fbx for a material
+static string material_properties(const MDB_file::Material& material)
+{
+	auto flag = [&](const char* name, uint32_t flag) {
+		return string(",\"") + name + "\":"
+			+ (material.flags & flag ? "1" : "0");
+	};
+
+	return color_properties(material) + ",\"TINT_MAP\":"
+		+ json_string(packet_name(material.tint_map_name))
+		+ flag("TRANSPARENCY_MASK", MDB_file::ALPHA_TEST)
+		+ flag("ENVIRONMENT_MAP", MDB_file::ENVIRONMENT_MAPPING)
+		+ flag("HEAD", MDB_file::CUTSCENE_MESH)
+		+ flag("GLOW", MDB_file::GLOW)
+		+ flag("DONT_CAST_SHADOWS", MDB_file::CAST_NO_SHADOWS)
+		+ flag("PROJECTED_TEXTURES", MDB_file::PROJECTED_TEXTURES);
+}
+
+// The vertices are written as they are, interleaved, and the attributes
+// are strided accessors into them. Tangents are left out, glTF needs them
+// with the handedness in a fourth component.
+template <typename T>
+string Document::vertex_attributes(const vector<T>& verts,
+	const Packet_data& data, bool skinned)
+{
+	int view = add_buffer_view(verts.data(), verts.size() * sizeof(T),
+		sizeof(T), ARRAY_BUFFER);
+
+	string attributes = "{\"POSITION\":"
+		+ to_string(add_accessor(view, offsetof(T, position), FLOAT,
+			verts.size(), "VEC3", data.min, data.max, 3))
+		+ ",\"NORMAL\":"
+		+ to_string(add_accessor(view, offsetof(T, normal), FLOAT,
+			verts.size(), "VEC3"))
+		+ ",\"TEXCOORD_0\":"
+		+ to_string(add_accessor(view, offsetof(T, uvw), FLOAT,
+			verts.size(), "VEC2"));
+
+	if constexpr (is_same_v<T, MDB_file::Skin_vertex>) {
+		if (skinned) {
+			attributes += ",\"JOINTS_0\":"
+				+ to_string(add_accessor(view, offsetof(T, bone_indices),
+					UNSIGNED_BYTE, verts.size(), "VEC4"))
+				+ ",\"WEIGHTS_0\":"
+				+ to_string(add_accessor(view, offsetof(T, bone_weights),
+					FLOAT, verts.size(), "VEC4"));
+		}
+	}
+
+	return attributes + '}';
+}
+
+template <typename T>
+int Document::add_mesh(const string& name, const vector<T>& verts,
+	const vector<MDB_file::Face>& faces, const Packet_data& data,
+	int material, bool skinned)
+{
+	if (verts.empty() || faces.empty())
+		return -1;
+
+	string primitive = "{\"attributes\":"
+		+ vertex_attributes(verts, data, skinned) + ",\"indices\":"
+		+ to_string(add_indices(faces.data(), faces.size() * 3))
+		+ ",\"material\":" + to_string(material) + '}';
+
+	meshes.push_back("{\"name\":" + json_string(name) + ",\"primitives\":["
+		+ primitive + "]}");
+
+	return int(meshes.size() - 1);
+}
+
+// Hooks, hair and helm points. Their orientation matrices have the Y axis
+// first, see transform_to_orientation in fbx2nw.
+void Document::add_point(const string& name, const Vector3<float>& position,
+	const float orientation[3][3], const string& extras)
+{
+	auto& node = nodes[add_node(name)];
+	node.set_translation(position.x, position.z, -position.y);
+
+	Vector3<float> axes[3];
+	const int rows[3] = { 1, 0, 2 };
+	for (int i = 0; i < 3; ++i) {
+		auto r = orientation[rows[i]];
+		axes[i] = Vector3<float>(r[0], r[2], -r[1]);
+	}
+	rotation_to_quaternion(axes, node.rotation);
+	node.has_rotation = true;
+
+	node.extras = extras;
+}
+
+void Document::add_collision_mesh(const MDB_file::Collision_mesh& cm,
+	const Packet_data& data)
+{
+	string name = packet_name(cm.header.name);
+	int material = cm.type == MDB_file::COL2 ?
+		add_material(name, 0.9f, 0.4f, 0.09f, 0.5f) :
+		add_material(name, 0.76f, 0.11f, 0.09f, 0.5f);
+
+	auto& node = nodes[add_node(name)];
+	node.set_rotation(z_up_rotation);
+	node.mesh = add_mesh(name, cm.verts, cm.faces, data, material);
+	node.extras = color_properties(cm.header.material);
+}
+
+void Document::add_collision_sphere(const MDB_file::Collision_sphere& sphere)
+{
+	// Bound to the bones of the first skeleton, as in nw2fbx
+	const Skeleton_nodes* skel = nullptr;
+	for (auto& s : skeletons) {
+		if (s.second.root >= 0) {
+			skel = &s.second;
+			break;
+		}
+	}
+	if (!skel)
+		return;
+
+	int bone = sphere.bone_index < skel->bones.size() ?
+		skel->bones[sphere.bone_index] : -1;
+
+	string name = "COLS_";
+	if (bone >= 0)
+		name += nodes[bone].name;
+	else
+		name += to_string(sphere.bone_index);
+
+	// Same sphere as nw2fbx
+	const int rings = 16;
+	const int segments = 32;
+	const int vertex_count = 2 + (rings - 1) * segments;
+
+	auto& positions = float_storage.emplace_back();
+	positions.reserve(vertex_count * 3);
+	auto add_vertex = [&](double x, double y, double z) {
+		positions.push_back(float(x));
+		positions.push_back(float(y));
+		positions.push_back(float(z));
+	};
+
+	double radius = sphere.radius;
+	add_vertex(0, 0, radius);
+	for (int i = 1; i < rings; ++i) {
+		double inclination = pi / rings * i;
+		for (int j = 0; j < segments; ++j) {
+			double azimuth = 2 * pi / segments * j;
+			add_vertex(radius * sin(inclination) * cos(azimuth),
+				radius * sin(inclination) * sin(azimuth),
+				radius * cos(inclination));
+		}
+	}
+	add_vertex(0, 0, -radius);
+
+	// The faces are the same for all the spheres
+	if (sphere_indices < 0) {
+		auto& indices = index_storage.emplace_back();
+		auto add_face = [&](int a, int b, int c) {
+			indices.push_back(uint16_t(a));
+			indices.push_back(uint16_t(b));
+			indices.push_back(uint16_t(c));
+		};
+		for (int i = 1; i <= segments; ++i)
+			add_face(0, i, i % segments + 1);
+		for (int r = 1; r <= rings - 2; ++r) {
+			int base = 1 + (r - 1) * segments;
+			for (int i = 0; i < segments; ++i) {
+				int a = base + i, b = base + segments + i;
+				int c = base + segments + (i + 1) % segments;
+				int d = base + (i + 1) % segments;
+				add_face(a, b, c);
+				add_face(a, c, d);
+			}
+		}
+		for (int i = 0; i < segments; ++i)
+			add_face(vertex_count - 1 - segments + i, vertex_count - 1,
+				vertex_count - 1 - segments + (i + 1) % segments);
+		sphere_indices = add_indices(indices.data(), indices.size());
+	}
+
+	float r = sphere.radius;
+	float min[3] = { -r, -r, -r };
+	float max[3] = { r, r, r };
+	int view = add_buffer_view(positions.data(),
+		positions.size() * sizeof(float), 0, ARRAY_BUFFER);
+	int accessor = add_accessor(view, 0, FLOAT, vertex_count, "VEC3", min,
+		max, 3);
+
+	if (sphere_material < 0)
+		sphere_material = add_material("COLS", 0.5f, 0.5f, 0.5f, 1);
+
+	meshes.push_back("{\"name\":" + json_string(name)
+		+ ",\"primitives\":[{\"attributes\":{\"POSITION\":"
+		+ to_string(accessor) + "},\"indices\":" + to_string(sphere_indices)
+		+ ",\"material\":" + to_string(sphere_material) + "}]}");
+
+	auto& node = nodes[add_node(name)];
+	node.set_rotation(z_up_rotation);
+	node.mesh = int(meshes.size() - 1);
+
+	if (bone >= 0) {
+		auto& t = skel->world[sphere.bone_index].m;
+		node.set_translation(t[12], t[14], -t[13]);
+	}
+}
+
+void Document::add_rigid_mesh(const MDB_file::Rigid_mesh& rm,
+	const Packet_data& data)
+{
+	string name = packet_name(rm.header.name);
+
+	auto& node = nodes[add_node(name)];
+	node.set_rotation(z_up_rotation);
+	node.mesh = add_mesh(name, rm.verts, rm.faces, data,
+		add_material(name, rm.header.material));
+	node.extras = material_properties(rm.header.material);
+}
+
+// Returns the skin of the skeleton of a skin packet, or -1. As in nw2fbx,
+// the vertices index the body bones, or the face bones first for heads.
+int Document::skin_for(const MDB_file::Skin& skin)
+{
+	Skeleton_nodes* skel = nullptr;
+	for (auto& s : skeletons) {
+		if (!s.second.bones.empty() && s.second.bones[0] >= 0
+			&& equal_nocase(nodes[s.second.bones[0]].name.c_str(),
+				packet_name(skin.header.skeleton_name).c_str())) {
+			skel = &s.second;
+			break;
+		}
+	}
+	if (!skel || skel->body_bones.empty())
+		return -1;
+
+	bool head = skin.header.material.flags & MDB_file::CUTSCENE_MESH;
+	if (skel->skins[head] >= 0)
+		return skel->skins[head];
+
+	// The skinned mesh nodes have no transform, the inverse bind matrices
+	// map to the bones from the mesh space of the other meshes
+	auto& matrices = float_storage.emplace_back();
+	string joints;
+	for (unsigned i = 0; i < skel->body_bones.size(); ++i) {
+		auto bone = head && i < skel->face_bones.size() ?
+			skel->face_bones[i] : skel->body_bones[i];
+		int node = skel->bones[bone];
+		auto m = node >= 0 ? affine_inverse(skel->world[bone]) :
+			Matrix{ { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } };
+
+		if (!joints.empty())
+			joints += ',';
+		joints += to_string(node >= 0 ? node : skel->root);
+		matrices.insert(matrices.end(), m.m, m.m + 16);
+	}
+
+	int view = add_buffer_view(matrices.data(),
+		matrices.size() * sizeof(float), 0, 0);
+	int accessor = add_accessor(view, 0, FLOAT, skel->body_bones.size(),
+		"MAT4");
+
+	skins.push_back("{\"inverseBindMatrices\":" + to_string(accessor)
+		+ ",\"skeleton\":" + to_string(skel->root) + ",\"joints\":["
+		+ joints + "]}");
+	skel->skins[head] = int(skins.size() - 1);
+
+	return skel->skins[head];
+}
+
+void Document::add_skin(const MDB_file::Skin& skin, const Packet_data& data)
+{
+	string name = packet_name(skin.header.name);
+	int s = skin_for(skin);
+
+	auto& node = nodes[add_node(name)];
+	if (s < 0)
+		node.set_rotation(z_up_rotation);
+	node.skin = s;
+	node.mesh = add_mesh(name, skin.verts, skin.faces, data,
+		add_material(name, skin.header.material), s >= 0);
+	if (node.mesh < 0)
+		node.skin = -1;
+	node.extras = material_properties(skin.header.material);
+}
+
+void Document::add_walk_mesh(const MDB_file::Walk_mesh& wm,
+	const Packet_data& data)
+{
+	string name = packet_name(wm.header.name);
+
+	int node = add_node(name);
+	nodes[node].set_rotation(z_up_rotation);
+
+	if (wm.verts.empty() || wm.faces.empty())
+		return;
+
+	// Shared by the primitives of each material
+	int view = add_buffer_view(data.positions.data(),
+		data.positions.size() * sizeof(Vector3<float>), 0, ARRAY_BUFFER);
+	int positions = add_accessor(view, 0, FLOAT, data.positions.size(),
+		"VEC3", data.min, data.max, 3);
+
+	string primitives;
+	for (unsigned i = 0; i < data.indices.size(); ++i) {
+		if (data.indices[i].empty())
+			continue;
+
+		if (walk_mesh_materials[i] < 0) {
+			auto& m = MDB_file::walk_mesh_materials[i];
+			walk_mesh_materials[i] = add_material(m.name, m.color.x,
+				m.color.y, m.color.z, 0.5f);
+		}
+
+		if (!primitives.empty())
+			primitives += ',';
+		primitives += "{\"attributes\":{\"POSITION\":"
+			+ to_string(positions) + "},\"indices\":"
+			+ to_string(add_indices(data.indices[i].data(),
+				data.indices[i].size()))
+			+ ",\"material\":" + to_string(walk_mesh_materials[i]) + '}';
+	}
+
+	meshes.push_back("{\"name\":" + json_string(name) + ",\"primitives\":["
+		+ primitives + "]}");
+	nodes[node].mesh = int(meshes.size() - 1);
+}
+
+void Document::add_packet(const Packet_data& data)
+{
+	auto packet = data.packet;
+
+	switch (packet->type) {
+	case MDB_file::COL2:
+	case MDB_file::COL3:
+		add_collision_mesh(
+			*static_cast<const MDB_file::Collision_mesh*>(packet), data);
+		break;
+	case MDB_file::COLS: {
+		auto& cs = *static_cast<const MDB_file::Collision_spheres*>(packet);
+		for (auto& sphere : cs.spheres)
+			add_collision_sphere(sphere);
+		break;
+	}
+	case MDB_file::HAIR: {
+		auto& hair = static_cast<const MDB_file::Hair*>(packet)->header;
+		auto hsb = [&](const char* name, MDB_file::Hair_shortening_behavior b) {
+			return string(",\"") + name + "\":"
+				+ (hair.shortening_behavior == b ? "1" : "0");
+		};
+		add_point(packet_name(hair.name), hair.position, hair.orientation,
+			(hsb("HSB_LOW", MDB_file::HSB_LOW)
+				+ hsb("HSB_SHORT", MDB_file::HSB_SHORT)
+				+ hsb("HSB_PONYTAIL", MDB_file::HSB_PONYTAIL)).substr(1));
+		break;
+	}
+	case MDB_file::HELM: {
+		auto& helm = static_cast<const MDB_file::Helm*>(packet)->header;
+		auto hhhb = [&](const char* name,
+			MDB_file::Helm_hair_hiding_behavior b) {
+			return string(",\"") + name + "\":"
+				+ (helm.hiding_behavior == b ? "1" : "0");
+		};
+		add_point(packet_name(helm.name), helm.position, helm.orientation,
+			(hhhb("HHHB_NONE_HIDDEN", MDB_file::HHHB_NONE_HIDDEN)
+				+ hhhb("HHHB_HAIR_HIDDEN", MDB_file::HHHB_HAIR_HIDDEN)
+				+ hhhb("HHHB_PARTIAL_HAIR", MDB_file::HHHB_PARTIAL_HAIR)
+				+ hhhb("HHHB_HEAD_HIDDEN", MDB_file::HHHB_HEAD_HIDDEN))
+				.substr(1));
+		break;
+	}
+	case MDB_file::HOOK: {
+		auto& hook = static_cast<const MDB_file::Hook*>(packet)->header;
+		add_point(packet_name(hook.name), hook.position, hook.orientation,
+			"");
+		break;
+	}
+	case MDB_file::RIGD:
+		add_rigid_mesh(*static_cast<const MDB_file::Rigid_mesh*>(packet),
+			data);
+		break;
+	case MDB_file::SKIN:
+		add_skin(*static_cast<const MDB_file::Skin*>(packet), data);
+		break;
+	case MDB_file::WALK:
+		add_walk_mesh(*static_cast<const MDB_file::Walk_mesh*>(packet),
+			data);
+		break;
+	default:
+		break;
+	}
+}
+
+// Same nodes as export_skeleton of nw2fbx: a node for the skeleton, and
+// the bones under it in meters. Bones whose parents don't exist aren't
+// exported.
+void Document::add_skeletons(GR2_file& gr2)
+{
+	for (auto& s : skeletons) {
+		if (s.first == &gr2)
+			return;
+	}
+
+	auto& skel = skeletons.emplace_back(&gr2, Skeleton_nodes()).second;
+
+	auto info = gr2.file_info;
+	for (int m = 0; m < info->models_count; ++m) {
+		GR2_skeleton* gr2_skel = info->models[m]->skeleton;
+		if (!gr2_skel)
+			continue;
+
+		skel = Skeleton_nodes();
+		skel.root = add_node(gr2_skel->name.get());
+		nodes[skel.root].set_rotation(z_up_rotation);
+
+		unsigned bone_count = unsigned(max(0, gr2_skel->bones_count));
+		skel.bones.assign(bone_count, -1);
+		skel.world.resize(bone_count);
+
+		for (auto i : bone_order(*gr2_skel)) {
+			GR2_bone& bone = gr2_skel->bones[i];
+			int parent = bone.parent_index;
+			int node = add_node(bone.name.get(),
+				parent >= 0 ? skel.bones[parent] : skel.root);
+			skel.bones[i] = node;
+
+			auto& n = nodes[node];
+			auto& transform = bone.transform;
+			if (transform.flags & GR2_has_position) {
+				n.set_translation(transform.translation.x / 100,
+					transform.translation.y / 100,
+					transform.translation.z / 100);
+			}
+			if (transform.flags & GR2_has_rotation) {
+				auto q = normalized(transform.rotation);
+				n.set_rotation(&q.x);
+			}
+			if (transform.flags & GR2_has_scale_shear) {
+				// glTF doesn't support shear. We only export scale.
+				n.set_scale(transform.scale_shear[0],
+					transform.scale_shear[4], transform.scale_shear[8]);
+			}
+
+			auto local = trs(n.translation, n.rotation, n.scale);
+			skel.world[i] = parent >= 0 ? skel.world[parent] * local : local;
+		}
+
+		skinning_bones(*gr2_skel, skel.body_bones, skel.face_bones);
+	}
+}
+
+// Binds the tracks of a track group to the nodes named after them. As in
+// nw2fbx, the animated meshes are moved under a pivot node named after the
+// track group, which has their transform.
+void Document::bind_track_group(GR2_animation* anim,
+	GR2_track_group* track_group)
+{
+	vector<int> animated(track_group->transform_tracks_count, -1);
+
+	for (int i = 0; i < track_group->transform_tracks_count; ++i) {
+		auto& track = track_group->transform_tracks[i];
+		string name = track.name.get();
+		auto it = nodes_by_name.find(name);
+		if (it == nodes_by_name.end())
+			continue;
+		for (auto node : it->second) {
+			auto& children = nodes[node].children;
+			if (children.empty() || nodes[children[0]].name != name) {
+				animated[i] = node;
+				break;
+			}
+		}
+	}
+
+	for (int i = 0; i < track_group->transform_tracks_count; ++i) {
+		int node = animated[i];
+		if (node < 0)
+			continue;
+
+		tracks.emplace_back(node, anim, &track_group->transform_tracks[i]);
+
+		if (nodes[node].mesh < 0)
+			continue;
+
+		string pivot_name = track_group->name.get();
+		if (nodes[node].name == pivot_name)
+			pivot_name += ".PIVOT";
+
+		auto& pivots = nodes_by_name[pivot_name];
+		int pivot = pivots.empty() ? -1 : pivots[0];
+		if (pivot < 0) {
+			pivot = add_node(pivot_name);
+			nodes[pivot].set_rotation(z_up_rotation);
+		}
+
+		auto& n = nodes[node];
+		if (n.parent >= 0) {
+			auto& siblings = nodes[n.parent].children;
+			siblings.erase(find(siblings.begin(), siblings.end(), node));
+		}
+		n.parent = pivot;
+		nodes[pivot].children.push_back(node);
+
+		// The node is not at the root anymore
+		n.has_rotation = false;
+		n.has_scale = false;
+	}
+}
+
+int Document::add_sampler_accessors(const Keys& keys, unsigned components,
+	int& output)
+{
+	float min = keys.times[0], max = keys.times[keys.count - 1];
+	int times = add_buffer_view(keys.times, keys.count * sizeof(float), 0,
+		0);
+	int input = add_accessor(times, 0, FLOAT, keys.count, "SCALAR", &min,
+		&max, 1);
+
+	int values = add_buffer_view(keys.values,
+		keys.count * components * sizeof(float), 0, 0);
+	output = add_accessor(values, 0, FLOAT, keys.count,
+		components == 4 ? "VEC4" : "VEC3");
+
+	return input;
+}
+
+void Document::add_animations(const vector<GR2_file*>& gr2s,
+	unsigned thread_count)
+{
+	// Binding depends on the node hierarchy, it's done in order first
+	vector<Animation> anims;
+	for (auto gr2 : gr2s) {
+		auto info = gr2->file_info;
+		for (int i = 0; i < info->animations_count; ++i) {
+			GR2_animation* anim = info->animations[i];
+			size_t first = tracks.size();
+			for (int j = 0; j < anim->track_groups_count; ++j)
+				bind_track_group(anim, anim->track_groups[j]);
+			anims.push_back({ anim, first, tracks.size() - first });
+		}
+	}
+
+	parallel_for(tracks.size(),
+		[&](size_t i) { evaluate_track(tracks[i]); }, thread_count);
+
+	for (auto& anim : anims) {
+		string channels, samplers;
+		int sampler_count = 0;
+
+		auto add_channel = [&](int node, const char* path, const Keys& keys,
+			unsigned components) {
+			if (keys.count == 0)
+				return;
+			int output;
+			int input = add_sampler_accessors(keys, components, output);
+			if (sampler_count > 0) {
+				channels += ',';
+				samplers += ',';
+			}
+			samplers += "{\"input\":" + to_string(input) + ",\"output\":"
+				+ to_string(output) + ",\"interpolation\":"
+				+ (keys.step ? "\"STEP\"" : "\"LINEAR\"") + '}';
+			channels += "{\"sampler\":" + to_string(sampler_count)
+				+ ",\"target\":{\"node\":" + to_string(node)
+				+ ",\"path\":\"" + path + "\"}}";
+			++sampler_count;
+		};
+
+		for (size_t i = anim.first_track;
+		     i < anim.first_track + anim.track_count; ++i) {
+			auto& track = tracks[i];
+			add_channel(track.node, "translation", track.translation, 3);
+			add_channel(track.node, "rotation", track.rotation, 4);
+			add_channel(track.node, "scale", track.scale, 3);
+		}
+
+		if (sampler_count == 0)
+			continue;
+
+		animations.push_back("{\"name\":" + json_string(anim.anim->name.get())
+			+ ",\"channels\":[" + channels + "],\"samplers\":[" + samplers
+			+ "]}");
+	}
+}
+
+string Document::json() const
+{
+	vector<string> node_objects;
+	string roots;
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		auto& n = nodes[i];
+		string o = "{\"name\":" + json_string(n.name);
+		if (!n.children.empty()) {
+			o += ",\"children\":[";
+			for (size_t c = 0; c < n.children.size(); ++c)
+				o += (c > 0 ? "," : "") + to_string(n.children[c]);
+			o += ']';
+		}
+		if (n.mesh >= 0)
+			o += ",\"mesh\":" + to_string(n.mesh);
+		if (n.skin >= 0)
+			o += ",\"skin\":" + to_string(n.skin);
+		if (n.has_translation)
+			o += ",\"translation\":" + json_numbers(n.translation, 3);
+		if (n.has_rotation)
+			o += ",\"rotation\":" + json_numbers(n.rotation, 4);
+		if (n.has_scale)
+			o += ",\"scale\":" + json_numbers(n.scale, 3);
+		if (!n.extras.empty())
+			o += ",\"extras\":{" + n.extras + '}';
+		node_objects.push_back(o + '}');
+
+		if (n.parent < 0)
+			roots += (roots.empty() ? "" : ",") + to_string(i);
+	}
+
+	string json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"nwn2mdk\"}";
+	if (!textures.empty())
+		json += ",\"extensionsUsed\":[\"MSFT_texture_dds\"]";
+	json += ",\"scene\":0,\"scenes\":[{\"nodes\":[" + roots + "]}]";
+
+	auto add_array = [&](const char* name, const vector<string>& v) {
+		if (!v.empty())
+			json += string(",\"") + name + "\":" + joined(v);
+	};
+
+	add_array("nodes", node_objects);
+	add_array("meshes", meshes);
+	add_array("materials", materials);
+	add_array("textures", textures);
+	add_array("images", images);
+	add_array("skins", skins);
+	add_array("animations", animations);
+	add_array("accessors", accessors);
+	add_array("bufferViews", buffer_views);
+	if (bin.size() > 0)
+		json += ",\"buffers\":[{\"byteLength\":" + to_string(bin.size())
+			+ "}]";
+
+	return json + '}';
+}
+
+bool Document::write(const char* filename, string& error_str)
+{
+	auto json = this->json();
+	json.append(((json.size() + 3) & ~size_t(3)) - json.size(), ' ');
+
+	uint64_t length = 12 + 8 + json.size();
+	if (bin.size() > 0)
+		length += 8 + bin.size();
+	if (length > UINT32_MAX) {
+		error_str = "the GLB file would be larger than 4 GB";
+		return false;
+	}
+
+	ofstream out(filename, ios::binary);
+	if (!out) {
+		error_str = "can't open file";
+		return false;
+	}
+
+	uint32_t header[5] = { 0x46546c67, 2, uint32_t(length),
+		uint32_t(json.size()), 0x4e4f534a }; // "glTF", "JSON"
+	out.write((const char*)header, sizeof(header));
+	out.write(json.data(), json.size());
+
+	if (bin.size() > 0) {
+		uint32_t chunk_header[2] = { uint32_t(bin.size()), 0x004e4942 };
+		out.write((const char*)chunk_header, sizeof(chunk_header));
+		bin.write(out);
+	}
+
+	if (!out) {
+		error_str = "write error";
+		return false;
+	}
+
+	return true;
+}
+
+void GLB_writer::add_mdb(const MDB_file& mdb)
+{
+	mdbs.push_back(&mdb);
+}
+
+void GLB_writer::add_gr2(GR2_file& gr2)
+{
+	if (find(gr2s.begin(), gr2s.end(), &gr2) == gr2s.end())
+		gr2s.push_back(&gr2);
+}
+
+bool GLB_writer::write(const char* filename, unsigned thread_count)
+{
+	auto doc = make_unique<Document>();
+
+	// Skeletons first, skins and collision spheres are bound to them
+	for (auto gr2 : gr2s)
+		doc->add_skeletons(*gr2);
+
+	vector<Packet_data> packets;
+	for (auto mdb : mdbs) {
+		for (uint32_t i = 0; i < mdb->packet_count(); ++i) {
+			if (mdb->packet(i))
+				packets.emplace_back(mdb->packet(i));
+		}
+	}
+
+	parallel_for(packets.size(),
+		[&](size_t i) { prepare_packet(packets[i]); }, thread_count);
+
+	for (auto& packet : packets)
+		doc->add_packet(packet);
+
+	doc->add_animations(gr2s, thread_count);
+
+	error_str_.clear();
+	return doc->write(filename, error_str_);
+}
+
+const char* GLB_writer::error_str() const
+{
+	return error_str_.c_str();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class GR2_file;
+class MDB_file;
+
+/// Writes MDB and GR2 files as a binary glTF 2.0 (GLB) file.
+///
+/// The scene has the same nodes as the FBX scenes of nw2fbx, in meters and
+/// with the Z-up nodes rotated to glTF's Y-up: meshes, hooks, hair and
+/// helm points, collision spheres, skeletons, and the animations bound to
+/// them by node name.
+///
+/// Vertex and index data is written straight from the packets, through
+/// strided buffer views, and linear animation curves are written as
+/// samplers at their knots. The files added must outlive write().
+class GLB_writer {
+public:
+	/// Adds the packets of a MDB file.
+	void add_mdb(const MDB_file& mdb);
+
+	/// Adds the skeletons and the animations of a GR2 file. Skin packets
+	/// are bound to the last skeleton of the GR2 file whose first bone is
+	/// named after their skeleton.
+	void add_gr2(GR2_file& gr2);
+
+	/// Writes the GLB file.
+	///
+	/// @param filename The name of the file.
+	/// @param thread_count Maximum number of threads used to prepare the
+	/// packets and the animation tracks. If 0, the number of hardware
+	/// threads is used.
+	/// @return False if an error has occurred.
+	bool write(const char* filename, unsigned thread_count = 0);
+
+	/// Returns the error string.
+	const char* error_str() const;
+
+private:
+	std::vector<const MDB_file*> mdbs;
+	std::vector<GR2_file*> gr2s;
+	std::string error_str_;
+};
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <string.h>
 
@@ -452,6 +453,80 @@ const std::vector<Vector4<float>>& GR2_DaK32fC32f_view::controls() const
 	return controls_;
 }
 
+static Vector4<float> slerp(const Vector4<float>& a, Vector4<float> b,
+	float alpha)
+{
+	float cos_theta = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+
+	// Shortest path
+	if (cos_theta < 0) {
+		b = Vector4<float>(-b.x, -b.y, -b.z, -b.w);
+		cos_theta = -cos_theta;
+	}
+
+	float wa = 1 - alpha, wb = alpha;
+	if (cos_theta < 0.9999f) {
+		float theta = acos(cos_theta);
+		float sin_theta = sin(theta);
+		wa = sin((1 - alpha) * theta) / sin_theta;
+		wb = sin(alpha * theta) / sin_theta;
+	}
+
+	return Vector4<float>(a.x * wa + b.x * wb, a.y * wa + b.y * wb,
+		a.z * wa + b.z * wb, a.w * wa + b.w * wb);
+}
+
+// The knots of GR2 curves, clamped for de Boor's algorithm
+static std::vector<float> padded_knots(const std::vector<float>& knots,
+	unsigned degree)
+{
+	std::vector<float> v;
+
+	v.push_back(0);
+
+	for (auto t : knots)
+		v.push_back(t);
+
+	for (unsigned i = 1; i <= degree; ++i) {
+		v[i] = 0;
+		v.push_back(knots.back());
+	}
+
+	return v;
+}
+
+// De Boor's algorithm to evaluate a B-spline
+static Vector4<float> de_boor(unsigned k, const std::vector<float>& knots,
+	const std::vector<Vector4<float>>& controls, float t, bool rotation)
+{
+	unsigned i = k;
+
+	while (i < knots.size() - k - 1 && knots[i] <= t)
+		++i;
+
+	i = i - 1;
+
+	std::vector<Vector4<float>> d(controls.begin() + (i - k),
+		controls.begin() + (i + 1));
+
+	for (unsigned r = 1; r <= k; ++r) {
+		for (unsigned j = k; j >= r; --j) {
+			float alpha = rotation ? 1.0f : 0.0f;
+			if (knots[j + 1 + i - r] != knots[j + i - k])
+				alpha = (t - knots[j + i - k])
+					/ (knots[j + 1 + i - r] - knots[j + i - k]);
+			if (rotation)
+				d[j] = slerp(d[j - 1], d[j], alpha);
+			else {
+				for (unsigned c = 0; c < 4; ++c)
+					d[j][c] = d[j - 1][c] * (1 - alpha) + d[j][c] * alpha;
+			}
+		}
+	}
+
+	return d[k];
+}
+
 GR2_curve_view::GR2_curve_view(GR2_curve& curve)
 {
 	degree_ = curve.curve_data->curve_data_header.degree;
@@ -502,6 +577,9 @@ GR2_curve_view::GR2_curve_view(GR2_curve& curve)
 		for (auto &c : view.controls())
 			controls_.emplace_back(c.x, c.y, c.z, 1.0f);
 	}
+
+	if (knots_.size() > 1 && knots_.size() >= degree_ + 1u)
+		padded_knots_ = padded_knots(knots_, degree_);
 }
 
 uint8_t GR2_curve_view::degree() const
@@ -518,3 +596,66 @@ const std::vector<Vector4<float>>& GR2_curve_view::controls() const
 {
 	return controls_;
 }
+
+Vector4<float> GR2_curve_view::value(float t, bool rotation) const
+{
+	if (controls_.empty())
+		return Vector4<float>(0, 0, 0, 1);
+
+	// Constant curve
+	if (padded_knots_.empty())
+		return controls_[0];
+
+	return de_boor(degree_, padded_knots_, controls_, t, rotation);
+}
+
+// Appends to order the descendants of a bone, depth first.
+static void order_bones(const std::vector<std::vector<unsigned>>& children,
+	unsigned bone_index, std::vector<unsigned>& order)
+{
+	for (auto child : children[bone_index]) {
+		order.push_back(child);
+		order_bones(children, child, order);
+	}
+}
+
+std::vector<unsigned> bone_order(GR2_skeleton& skel)
+{
+	unsigned bone_count = unsigned(std::max(0, skel.bones_count));
+
+	// The last one has the roots
+	std::vector<std::vector<unsigned>> children(bone_count + 1);
+	for (unsigned i = 0; i < bone_count; ++i) {
+		int parent = skel.bones[i].parent_index;
+		if (parent == -1)
+			children.back().push_back(i);
+		else if (parent >= 0 && unsigned(parent) < bone_count)
+			children[parent].push_back(i);
+	}
+
+	std::vector<unsigned> order;
+	order_bones(children, bone_count, order);
+
+	return order;
+}
+
+void skinning_bones(GR2_skeleton& skel, std::vector<unsigned>& body_bones,
+	std::vector<unsigned>& face_bones)
+{
+	int ribcage = -1;
+
+	for (int i = 0; i < skel.bones_count; ++i) {
+		const char* name = skel.bones[i].name;
+		if (strncmp(name, "ap_", 3) == 0)
+			continue;
+		else if (strncmp(name, "f_", 2) == 0)
+			face_bones.push_back(i);
+		else if (strcmp(name, "Ribcage") == 0)
+			ribcage = i;
+		else
+			body_bones.push_back(i);
+	}
+
+	if (ribcage >= 0)
+		body_bones.push_back(ribcage);
+}
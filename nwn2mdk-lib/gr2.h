@@ -322,10 +322,15 @@ public:
 	const std::vector<float>& knots() const;
 	const std::vector<Vector4<float>>& controls() const;
 
+	/// Value of the curve at time t, evaluated with de Boor's algorithm.
+	/// Rotation controls are quaternions, interpolated with slerp.
+	Vector4<float> value(float t, bool rotation) const;
+
 private:
 	uint8_t degree_;
 	std::vector<float> knots_;
 	std::vector<Vector4<float>> controls_;
+	std::vector<float> padded_knots_; // Clamped for de Boor's algorithm
 };
 
 struct GR2_vector_track {
@@ -410,5 +415,16 @@ struct GR2_file_info {
 	GR2_extended_data extended_data;
 };
 
+/// Indices of the bones of a skeleton, parents before children, depth
+/// first. Bones whose parents don't exist are left out.
+std::vector<unsigned> bone_order(GR2_skeleton& skel);
+
+/// Indices of the bones of a skeleton used for skinning. "f_..." (face)
+/// bones are only used for head skinning, "ap_..." (attachment point)
+/// bones are not used. For some unknown reason, "Ribcage" must be always
+/// the last body bone.
+void skinning_bones(GR2_skeleton& skel, std::vector<unsigned>& body_bones,
+	std::vector<unsigned>& face_bones);
+
 const char* curve_format_to_str(uint8_t format);
 const char* property_type_to_str(GR2_property_type type);
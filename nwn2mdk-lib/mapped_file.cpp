@@ -0,0 +1,99 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+
+Mapped_file::Mapped_file(const char* filename)
+{
+	data_ = nullptr;
+	size_ = 0;
+	mapping_handle = nullptr;
+
+	file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
+	                          nullptr, OPEN_EXISTING,
+	                          FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+		return;
+
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY,
+	                                    0, 0, nullptr);
+	if (!mapping_handle)
+		return;
+
+	data_ = static_cast<const unsigned char*>(
+	    MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	if (data_)
+		size_ = size_t(file_size.QuadPart);
+}
+
+Mapped_file::~Mapped_file()
+{
+	if (data_)
+		UnmapViewOfFile(data_);
+
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+
+	if (file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(file_handle);
+}
+
+#else
+
+Mapped_file::Mapped_file(const char* filename)
+{
+	data_ = nullptr;
+	size_ = 0;
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* p = mmap(nullptr, size_t(st.st_size), PROT_READ,
+		               MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			data_ = static_cast<const unsigned char*>(p);
+			size_ = size_t(st.st_size);
+		}
+	}
+
+	// The mapping keeps a reference to the file.
+	close(fd);
+}
+
+Mapped_file::~Mapped_file()
+{
+	if (data_)
+		munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+#endif
+
+const unsigned char* Mapped_file::data() const
+{
+	return data_;
+}
+
+size_t Mapped_file::size() const
+{
+	return size_;
+}
+
+Mapped_file::operator bool() const
+{
+	return data_ != nullptr;
+}
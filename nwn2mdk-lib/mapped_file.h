@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+/// Read-only memory mapping of a whole file.
+class Mapped_file {
+public:
+	/// Maps the file at the specified path.
+	///
+	/// @param filename The name of the file to be mapped.
+	Mapped_file(const char* filename);
+	~Mapped_file();
+
+	Mapped_file(const Mapped_file&) = delete;
+	Mapped_file& operator=(const Mapped_file&) = delete;
+
+	/// Returns a pointer to the first byte of the file.
+	const unsigned char* data() const;
+
+	/// Returns the size of the file in bytes.
+	size_t size() const;
+
+	/// Checks if the file was successfully mapped.
+	operator bool() const;
+
+private:
+	const unsigned char* data_;
+	size_t size_;
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#endif
+};
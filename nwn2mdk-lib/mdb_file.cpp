@@ -15,6 +15,7 @@
 #include <string.h>
 
 #include "mdb_file.h"
+#include "mdb_writer.h"
 
 template <typename T>
 static void read(std::istream& in, T& x)
@@ -79,6 +80,23 @@ MDB_file::MDB_file(const char* filename)
 
 }
 
+MDB_file::MDB_file(const char* filename, bool lazy)
+{
+	is_good_ = false;
+
+	auto in = std::make_unique<std::ifstream>(
+	    filename, std::ios::in | std::ios::binary);
+	if (!*in) {
+		error_str_ = "can't open file";
+		return;
+	}
+
+	if (lazy)
+		lazy_in = move(in);
+
+	read(lazy ? *lazy_in : *in);
+}
+
 MDB_file::MDB_file(std::istream& in)
 {
 	read(in);
@@ -95,6 +113,7 @@ void MDB_file::add_packet(std::unique_ptr<Packet> packet)
 	packet_keys.push_back(packet_key);
 
 	packets.push_back(move(packet));
+	index_packet(uint32_t(packet_keys.size() - 1));
 
 	++header.packet_count;
 }
@@ -104,6 +123,26 @@ const char* MDB_file::error_str() const
 	return error_str_.c_str();
 }
 
+bool MDB_file::str_to_packet_type(const char* s, Packet_type& type)
+{
+	static const struct {
+		const char* str;
+		Packet_type type;
+	} types[] = { { "COL2", COL2 }, { "COL3", COL3 }, { "COLS", COLS },
+		{ "HAIR", HAIR }, { "HELM", HELM }, { "HOOK", HOOK },
+		{ "RIGD", RIGD }, { "SKIN", SKIN }, { "TRRN", TRRN },
+		{ "WALK", WALK } };
+
+	for (auto& t : types) {
+		if (strncmp(s, t.str, 4) == 0) {
+			type = t.type;
+			return true;
+		}
+	}
+
+	return false;
+}
+
 uint16_t MDB_file::major_version() const
 {
 	return header.major_version;
@@ -119,6 +158,10 @@ MDB_file::Packet* MDB_file::packet(uint32_t packet_index) const
 	if (packet_index >= packet_keys.size())
 		return nullptr;
 
+	if (!packets[packet_index] && lazy_in)
+		packets[packet_index] =
+		    read_packet(packet_keys[packet_index], *lazy_in);
+
 	return packets[packet_index].get();
 }
 
@@ -127,6 +170,22 @@ uint32_t MDB_file::packet_count() const
 	return header.packet_count;
 }
 
+std::vector<MDB_file::Packet*> MDB_file::packets_of_type(Packet_type type) const
+{
+	std::vector<Packet*> v;
+
+	if (type < 0 || type > WALK)
+		return v;
+
+	for (auto packet_index : type_index[type]) {
+		auto p = packet(packet_index);
+		if (p)
+			v.push_back(p);
+	}
+
+	return v;
+}
+
 void MDB_file::read(std::istream& in)
 {
 	is_good_ = false;
@@ -141,7 +200,18 @@ void MDB_file::read(std::istream& in)
 	packet_keys.resize(header.packet_count);
 	::read(in, packet_keys);
 
-	read_packets(in);
+	if (!in) {
+		error_str_ = "truncated packet table";
+		return;
+	}
+
+	for (uint32_t i = 0; i < packet_keys.size(); ++i)
+		index_packet(i);
+
+	if (lazy_in)
+		packets.resize(packet_keys.size());
+	else
+		read_packets(in);
 
 	is_good_ = true;
 }
@@ -149,54 +219,59 @@ void MDB_file::read(std::istream& in)
 void MDB_file::read_packets(std::istream& in)
 {
 	for (auto& packet_key : packet_keys)
-		read_packet(packet_key, in);
+		packets.push_back(read_packet(packet_key, in));
 }
 
-void MDB_file::read_packet(Packet_key& packet_key, std::istream& in)
+std::unique_ptr<MDB_file::Packet>
+MDB_file::read_packet(const Packet_key& packet_key, std::istream& in) const
 {
+	in.clear();
 	in.seekg(packet_key.offset);
 
 	if (strncmp(packet_key.type, "COL2", 4) == 0)
-		packets.emplace_back(new Collision_mesh(in));
+		return std::make_unique<Collision_mesh>(in);
 	else if (strncmp(packet_key.type, "COL3", 4) == 0)
-		packets.emplace_back(new Collision_mesh(in));
+		return std::make_unique<Collision_mesh>(in);
 	else if (strncmp(packet_key.type, "COLS", 4) == 0)
-		packets.emplace_back(new Collision_spheres(in));
+		return std::make_unique<Collision_spheres>(in);
 	else if (strncmp(packet_key.type, "HAIR", 4) == 0)
-		packets.emplace_back(new Hair(in));
+		return std::make_unique<Hair>(in);
 	else if (strncmp(packet_key.type, "HELM", 4) == 0)
-		packets.emplace_back(new Helm(in));
+		return std::make_unique<Helm>(in);
 	else if (strncmp(packet_key.type, "HOOK", 4) == 0)
-		packets.emplace_back(new Hook(in));
+		return std::make_unique<Hook>(in);
 	else if (strncmp(packet_key.type, "RIGD", 4) == 0)
-		packets.emplace_back(new Rigid_mesh(in));
+		return std::make_unique<Rigid_mesh>(in);
 	else if (strncmp(packet_key.type, "SKIN", 4) == 0)
-		packets.emplace_back(new Skin(in));
+		return std::make_unique<Skin>(in);
 	else if (strncmp(packet_key.type, "WALK", 4) == 0)
-		packets.emplace_back(new Walk_mesh(in));
-	else
-		packets.push_back(nullptr);
+		return std::make_unique<Walk_mesh>(in);
+
+	return nullptr;
+}
+
+void MDB_file::index_packet(uint32_t packet_index)
+{
+	Packet_type type;
+	if (str_to_packet_type(packet_keys[packet_index].type, type))
+		type_index[type].push_back(packet_index);
 }
 
 void MDB_file::save(const char* filename)
 {
-	header.packet_count = packets.size();
+	// Lazy MDBs must have all their packets in memory before writing
+	for (uint32_t i = 0; i < packet_keys.size(); ++i)
+		packet(i);
 
-	uint32_t offset =
-	    sizeof(Header) + sizeof(Packet_key) * packet_keys.size();
+	header.packet_count = packets.size();
 
-	for(unsigned i = 0; i < packet_keys.size(); ++i) {
-		packet_keys[i].offset = offset;
-		offset += packets[i]->packet_size();
-	}
+	MDB_writer writer(filename, header.packet_count);
+	writer.set_version(header.major_version, header.minor_version);
 
-	std::ofstream out(filename, std::ios::binary);
-	out.write((char*)&header, sizeof(Header));
-	out.write((char*)packet_keys.data(),
-	          sizeof(Packet_key) * packet_keys.size());
+	for (auto& packet : packets)
+		writer.write_packet(*packet);
 
-	for(unsigned i = 0; i < packets.size(); ++i)
-		packets[i]->write(out);
+	writer.close();
 }
 
 MDB_file::operator bool() const
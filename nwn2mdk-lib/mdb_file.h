@@ -353,6 +353,16 @@ public:
 	/// @param filename The name of the file to be opened.
 	MDB_file(const char* filename);
 
+	/// Opens a MDB file at the specified path.
+	///
+	/// In lazy mode only the header and the packet table are read. Each
+	/// packet is parsed the first time it is requested and the file stays
+	/// open until the MDB is destroyed.
+	///
+	/// @param filename The name of the file to be opened.
+	/// @param lazy True to read the packets on demand.
+	MDB_file(const char* filename, bool lazy);
+
 	/// Reads a MDB from a stream.
 	MDB_file(std::istream& in);
 
@@ -364,6 +374,12 @@ public:
 	/// Returns the error string.
 	const char* error_str() const;
 
+	/// Converts a packet type string ("RIGD", "SKIN", ...) to a packet
+	/// type.
+	///
+	/// @return True if the string is a known packet type.
+	static bool str_to_packet_type(const char* s, Packet_type& type);
+
 	/// Returns the major version of the MDB file.
 	uint16_t major_version() const;
 
@@ -379,6 +395,9 @@ public:
 	/// Returns the number of packets contained in the MDB file.
 	uint32_t packet_count() const;
 
+	/// Returns the packets of the specified type, in file order.
+	std::vector<Packet*> packets_of_type(Packet_type type) const;
+
 	/// Saves to a file.
 	///
 	/// @param filename The name of the file.
@@ -388,6 +407,9 @@ public:
 	operator bool() const;
 
 private:
+	friend class MDB_view;
+	friend class MDB_writer;
+
 	struct Header {
 		char signature[4]; // Should be "NWN2"
 		uint16_t major_version;
@@ -424,9 +446,13 @@ private:
 	std::string error_str_;
 	Header header;
 	std::vector<Packet_key> packet_keys;
-	std::vector<std::unique_ptr<Packet>> packets;
+	mutable std::vector<std::unique_ptr<Packet>> packets;
+	std::vector<uint32_t> type_index[WALK + 1];
+	mutable std::unique_ptr<std::ifstream> lazy_in;
 
 	void read(std::istream& in);
 	void read_packets(std::istream& in);
-	void read_packet(Packet_key& packet_key, std::istream& in);
+	std::unique_ptr<Packet> read_packet(const Packet_key& packet_key,
+	                                    std::istream& in) const;
+	void index_packet(uint32_t packet_index);
 };
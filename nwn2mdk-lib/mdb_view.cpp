@@ -0,0 +1,205 @@
+#include <string.h>
+#include <type_traits>
+
+#include "mdb_view.h"
+
+MDB_view::MDB_view(const char* filename) : file(filename)
+{
+	is_good_ = false;
+	header = nullptr;
+
+	if (!file) {
+		error_str_ = "can't open file";
+		return;
+	}
+
+	if (file.size() < sizeof(MDB_file::Header)) {
+		error_str_ = "invalid file type";
+		return;
+	}
+
+	header = reinterpret_cast<const MDB_file::Header*>(file.data());
+
+	if (strncmp(header->signature, "NWN2", 4) != 0) {
+		error_str_ = "invalid file type";
+		return;
+	}
+
+	packet_keys = array<MDB_file::Packet_key>(header + 1,
+	                                          header->packet_count);
+
+	if (packet_keys.size() != header->packet_count) {
+		error_str_ = "truncated packet table";
+		return;
+	}
+
+	is_good_ = true;
+}
+
+const char* MDB_view::error_str() const
+{
+	return error_str_.c_str();
+}
+
+uint16_t MDB_view::major_version() const
+{
+	return header ? header->major_version : 0;
+}
+
+uint16_t MDB_view::minor_version() const
+{
+	return header ? header->minor_version : 0;
+}
+
+uint32_t MDB_view::packet_count() const
+{
+	return uint32_t(packet_keys.size());
+}
+
+const MDB_file::Packet_header*
+MDB_view::packet_header(uint32_t packet_index) const
+{
+	if (packet_index >= packet_keys.size())
+		return nullptr;
+
+	size_t offset = packet_keys[packet_index].offset;
+
+	if (offset + sizeof(MDB_file::Packet_header) > file.size())
+		return nullptr;
+
+	return reinterpret_cast<const MDB_file::Packet_header*>(file.data() +
+	                                                        offset);
+}
+
+bool MDB_view::packet_type(uint32_t packet_index,
+                           MDB_file::Packet_type& type) const
+{
+	if (packet_index >= packet_keys.size())
+		return false;
+
+	return MDB_file::str_to_packet_type(packet_keys[packet_index].type,
+	                                    type);
+}
+
+template <typename T>
+const T* MDB_view::packet(uint32_t packet_index, const char* type) const
+{
+	if (packet_index >= packet_keys.size())
+		return nullptr;
+
+	if (strncmp(packet_keys[packet_index].type, type, 4) != 0)
+		return nullptr;
+
+	size_t offset = packet_keys[packet_index].offset;
+
+	if (offset + sizeof(T) > file.size())
+		return nullptr;
+
+	return reinterpret_cast<const T*>(file.data() + offset);
+}
+
+template <typename T>
+std::span<const T> MDB_view::array(const void* begin, uint32_t count) const
+{
+	auto p = static_cast<const unsigned char*>(begin);
+	size_t available = file.data() + file.size() - p;
+
+	if (sizeof(T) * size_t(count) > available)
+		return {};
+
+	return { reinterpret_cast<const T*>(p), count };
+}
+
+template <typename View>
+View MDB_view::mesh(uint32_t packet_index, const char* type) const
+{
+	using Header = std::remove_const_t<
+	    std::remove_pointer_t<decltype(View::header)>>;
+	using Vertex = typename decltype(View::verts)::value_type;
+	using Face = typename decltype(View::faces)::value_type;
+
+	View view;
+
+	auto h = packet<Header>(packet_index, type);
+	if (!h)
+		return view;
+
+	auto verts = array<Vertex>(h + 1, h->vertex_count);
+	if (verts.size() != h->vertex_count)
+		return view;
+
+	auto faces = array<Face>(verts.data() + verts.size(), h->face_count);
+	if (faces.size() != h->face_count)
+		return view;
+
+	view.header = h;
+	view.verts = verts;
+	view.faces = faces;
+
+	return view;
+}
+
+MDB_view::Rigid_mesh_view MDB_view::rigid_mesh(uint32_t packet_index) const
+{
+	return mesh<Rigid_mesh_view>(packet_index, "RIGD");
+}
+
+MDB_view::Skin_view MDB_view::skin(uint32_t packet_index) const
+{
+	return mesh<Skin_view>(packet_index, "SKIN");
+}
+
+MDB_view::Collision_mesh_view
+MDB_view::collision_mesh(uint32_t packet_index) const
+{
+	auto view = mesh<Collision_mesh_view>(packet_index, "COL2");
+	if (view.header)
+		return view;
+
+	return mesh<Collision_mesh_view>(packet_index, "COL3");
+}
+
+MDB_view::Walk_mesh_view MDB_view::walk_mesh(uint32_t packet_index) const
+{
+	return mesh<Walk_mesh_view>(packet_index, "WALK");
+}
+
+MDB_view::Collision_spheres_view
+MDB_view::collision_spheres(uint32_t packet_index) const
+{
+	Collision_spheres_view view;
+
+	auto h = packet<MDB_file::Collision_spheres_header>(packet_index,
+	                                                    "COLS");
+	if (!h)
+		return view;
+
+	auto spheres = array<MDB_file::Collision_sphere>(h + 1, h->sphere_count);
+	if (spheres.size() != h->sphere_count)
+		return view;
+
+	view.header = h;
+	view.spheres = spheres;
+
+	return view;
+}
+
+const MDB_file::Hook_header* MDB_view::hook(uint32_t packet_index) const
+{
+	return packet<MDB_file::Hook_header>(packet_index, "HOOK");
+}
+
+const MDB_file::Hair_header* MDB_view::hair(uint32_t packet_index) const
+{
+	return packet<MDB_file::Hair_header>(packet_index, "HAIR");
+}
+
+const MDB_file::Helm_header* MDB_view::helm(uint32_t packet_index) const
+{
+	return packet<MDB_file::Helm_header>(packet_index, "HELM");
+}
+
+MDB_view::operator bool() const
+{
+	return is_good_;
+}
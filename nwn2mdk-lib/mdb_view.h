@@ -0,0 +1,100 @@
+#pragma once
+
+#include <span>
+#include <string>
+
+#include "mapped_file.h"
+#include "mdb_file.h"
+
+/// Read-only view of a MDB file mapped in memory.
+///
+/// Unlike MDB_file, packets are not parsed nor copied. Headers and arrays
+/// are accessed in place, so scanning many MDBs for a few fields (e.g.
+/// material and texture names) only touches the pages it reads. The
+/// returned pointers and spans are valid while the view exists.
+class MDB_view {
+public:
+	/// View of a mesh packet (RIGD, SKIN, COL2, COL3, WALK). If the
+	/// packet doesn't have the requested type, header is null and the
+	/// spans are empty.
+	template <typename Header, typename Vertex, typename Face>
+	struct Mesh_view {
+		const Header* header = nullptr;
+		std::span<const Vertex> verts;
+		std::span<const Face> faces;
+	};
+
+	using Rigid_mesh_view =
+	    Mesh_view<MDB_file::Rigid_mesh_header, MDB_file::Rigid_mesh_vertex,
+	              MDB_file::Face>;
+	using Skin_view = Mesh_view<MDB_file::Skin_header, MDB_file::Skin_vertex,
+	                            MDB_file::Face>;
+	using Collision_mesh_view =
+	    Mesh_view<MDB_file::Collision_mesh_header,
+	              MDB_file::Collision_mesh_vertex, MDB_file::Face>;
+	using Walk_mesh_view =
+	    Mesh_view<MDB_file::Walk_mesh_header, MDB_file::Walk_mesh_vertex,
+	              MDB_file::Walk_mesh_face>;
+
+	/// View of a collision spheres packet (COLS).
+	struct Collision_spheres_view {
+		const MDB_file::Collision_spheres_header* header = nullptr;
+		std::span<const MDB_file::Collision_sphere> spheres;
+	};
+
+	/// Maps the MDB file at the specified path.
+	///
+	/// @param filename The name of the file to be opened.
+	MDB_view(const char* filename);
+
+	/// Returns the error string.
+	const char* error_str() const;
+
+	/// Returns the major version of the MDB file.
+	uint16_t major_version() const;
+
+	/// Returns the minor version of the MDB file.
+	uint16_t minor_version() const;
+
+	/// Returns the number of packets contained in the MDB file.
+	uint32_t packet_count() const;
+
+	/// Returns the header of the specified packet.
+	///
+	/// @return If the packet exists and fits in the file, returns a
+	/// pointer to its header. Otherwise, returns null pointer.
+	const MDB_file::Packet_header* packet_header(uint32_t packet_index) const;
+
+	/// Gets the type of the specified packet.
+	///
+	/// @return False if the packet doesn't exist or its type is unknown.
+	bool packet_type(uint32_t packet_index, MDB_file::Packet_type& type) const;
+
+	Rigid_mesh_view rigid_mesh(uint32_t packet_index) const;
+	Skin_view skin(uint32_t packet_index) const;
+	Collision_mesh_view collision_mesh(uint32_t packet_index) const;
+	Walk_mesh_view walk_mesh(uint32_t packet_index) const;
+	Collision_spheres_view collision_spheres(uint32_t packet_index) const;
+	const MDB_file::Hook_header* hook(uint32_t packet_index) const;
+	const MDB_file::Hair_header* hair(uint32_t packet_index) const;
+	const MDB_file::Helm_header* helm(uint32_t packet_index) const;
+
+	/// Checks if no error has occurred.
+	operator bool() const;
+
+private:
+	Mapped_file file;
+	bool is_good_;
+	std::string error_str_;
+	const MDB_file::Header* header;
+	std::span<const MDB_file::Packet_key> packet_keys;
+
+	template <typename T>
+	const T* packet(uint32_t packet_index, const char* type) const;
+
+	template <typename T>
+	std::span<const T> array(const void* begin, uint32_t count) const;
+
+	template <typename View>
+	View mesh(uint32_t packet_index, const char* type) const;
+};
@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include "mdb_writer.h"
+
+MDB_writer::MDB_writer(const char* filename, uint32_t max_packet_count)
+    : out(filename, std::ios::binary), max_packet_count(max_packet_count)
+{
+	is_good_ = false;
+	major_version = 1;
+	minor_version = 12;
+
+	if (!out) {
+		error_str_ = "can't open file";
+		return;
+	}
+
+	// Header and packet table are rewritten by close()
+	std::vector<char> reserved(sizeof(MDB_file::Header) +
+	                           sizeof(MDB_file::Packet_key) *
+	                               max_packet_count);
+	out.write(reserved.data(), reserved.size());
+
+	is_good_ = bool(out);
+	if (!is_good_)
+		error_str_ = "write error";
+}
+
+MDB_writer::~MDB_writer()
+{
+	if (out.is_open())
+		close();
+}
+
+void MDB_writer::set_version(uint16_t major_version,
+                             uint16_t minor_version)
+{
+	this->major_version = major_version;
+	this->minor_version = minor_version;
+}
+
+bool MDB_writer::write_packet(MDB_file::Packet& packet)
+{
+	if (!is_good_)
+		return false;
+
+	if (packet_keys.size() >= max_packet_count) {
+		is_good_ = false;
+		error_str_ = "too many packets";
+		return false;
+	}
+
+	MDB_file::Packet_key packet_key;
+	memcpy(packet_key.type, packet.type_str(), 4);
+	packet_key.offset = uint32_t(out.tellp());
+	packet_keys.push_back(packet_key);
+
+	packet.write(out);
+
+	if (!out) {
+		is_good_ = false;
+		error_str_ = "write error";
+	}
+
+	return is_good_;
+}
+
+bool MDB_writer::close()
+{
+	if (!out.is_open())
+		return is_good_;
+
+	if (is_good_) {
+		MDB_file::Header header;
+		memcpy(header.signature, "NWN2", 4);
+		header.major_version = major_version;
+		header.minor_version = minor_version;
+		header.packet_count = uint32_t(packet_keys.size());
+
+		out.seekp(0);
+		out.write((char*)&header, sizeof(header));
+		out.write((char*)packet_keys.data(),
+		          sizeof(MDB_file::Packet_key) * packet_keys.size());
+
+		if (!out) {
+			is_good_ = false;
+			error_str_ = "write error";
+		}
+	}
+
+	out.close();
+
+	return is_good_;
+}
+
+const char* MDB_writer::error_str() const
+{
+	return error_str_.c_str();
+}
+
+MDB_writer::operator bool() const
+{
+	return is_good_;
+}
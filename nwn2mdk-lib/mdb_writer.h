@@ -0,0 +1,52 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "mdb_file.h"
+
+/// Writes a MDB file one packet at a time.
+///
+/// The packet table is reserved when the file is opened and each packet is
+/// written as soon as it is passed to write_packet, so the caller can free
+/// it right away. The packet offsets and the packet count are written by
+/// close().
+class MDB_writer {
+public:
+	/// Opens a MDB file for writing.
+	///
+	/// @param filename The name of the file.
+	/// @param max_packet_count Number of entries to reserve in the packet
+	/// table. Unused entries are left as padding.
+	MDB_writer(const char* filename, uint32_t max_packet_count);
+	~MDB_writer();
+
+	/// Sets the version written in the header. Defaults to 1.12.
+	void set_version(uint16_t major_version, uint16_t minor_version);
+
+	/// Appends a packet to the file.
+	///
+	/// @return False if the packet table is full or a write error occurred.
+	bool write_packet(MDB_file::Packet& packet);
+
+	/// Writes the packet table and closes the file.
+	///
+	/// @return False if an error has occurred.
+	bool close();
+
+	/// Returns the error string.
+	const char* error_str() const;
+
+	/// Checks if no error has occurred.
+	operator bool() const;
+
+private:
+	std::ofstream out;
+	bool is_good_;
+	std::string error_str_;
+	uint32_t max_packet_count;
+	uint16_t major_version;
+	uint16_t minor_version;
+	std::vector<MDB_file::Packet_key> packet_keys;
+};
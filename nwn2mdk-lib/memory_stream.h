@@ -0,0 +1,54 @@
+#pragma once
+
+#include <istream>
+#include <streambuf>
+
+/// Stream buffer reading from a memory block, without copying it.
+class Memory_streambuf : public std::streambuf {
+public:
+	Memory_streambuf(const void* data, size_t size)
+	{
+		auto p = const_cast<char*>(static_cast<const char*>(data));
+		setg(p, p, p + size);
+	}
+
+protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+	                 std::ios_base::openmode which) override
+	{
+		if (!(which & std::ios_base::in))
+			return pos_type(off_type(-1));
+
+		off_type base = 0;
+		if (dir == std::ios_base::cur)
+			base = gptr() - eback();
+		else if (dir == std::ios_base::end)
+			base = egptr() - eback();
+
+		return seekpos(pos_type(base + off), which);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+	{
+		off_type off = off_type(pos);
+
+		if (!(which & std::ios_base::in) || off < 0 ||
+		    off > egptr() - eback())
+			return pos_type(off_type(-1));
+
+		setg(eback(), eback() + off, egptr());
+
+		return pos;
+	}
+};
+
+/// Input stream reading from a memory block, without copying it. The
+/// memory block must outlive the stream.
+class Memory_istream : private Memory_streambuf, public std::istream {
+public:
+	Memory_istream(const void* data, size_t size)
+	    : Memory_streambuf(data, size),
+	      std::istream(static_cast<Memory_streambuf*>(this))
+	{
+	}
+};
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "mesh_optimizer.h"
+
+// Tuning values from Tom Forsyth's "Linear-Speed Vertex Cache
+// Optimisation".
+const unsigned max_cache_size = 32;
+const float cache_decay_power = 1.5f;
+const float last_tri_score = 0.75f;
+const float valence_boost_scale = 2.0f;
+const float valence_boost_power = 0.5f;
+
+using namespace std;
+
+struct Forsyth_vertex {
+	int cache_position = -1;
+	float score = 0;
+	// Triangles that use this vertex and have not been emitted yet.
+	unsigned remaining = 0;
+	// Offset of the first triangle in the adjacency array.
+	unsigned adjacency_offset = 0;
+};
+
+static float vertex_score(const Forsyth_vertex& v)
+{
+	if (v.remaining == 0)
+		return -1.0f; // No triangle needs this vertex
+
+	float score = 0.0f;
+
+	if (v.cache_position >= 0) {
+		if (v.cache_position < 3) {
+			// The vertex was used in the last triangle. Give it a
+			// fixed score to avoid favouring the same triangle strip
+			// direction.
+			score = last_tri_score;
+		}
+		else {
+			float s = 1.0f - float(v.cache_position - 3) /
+			                     (max_cache_size - 3);
+			score = pow(s, cache_decay_power);
+		}
+	}
+
+	// Boost vertices with few remaining triangles, so they are removed
+	// from the mesh as soon as possible.
+	score += valence_boost_scale *
+	         pow(float(v.remaining), -valence_boost_power);
+
+	return score;
+}
+
+Vertex_cache_stats vertex_cache_stats(
+    const std::vector<MDB_file::Face>& faces, size_t vertex_count,
+    unsigned cache_size)
+{
+	// Timestamp of the last time each vertex entered the FIFO cache.
+	vector<unsigned> timestamps(vertex_count, 0);
+	unsigned timestamp = cache_size + 1;
+	unsigned misses = 0;
+
+	for (auto& face : faces) {
+		for (int i = 0; i < 3; ++i) {
+			auto index = face.vertex_indices[i];
+
+			if (index >= vertex_count)
+				continue;
+
+			if (timestamp - timestamps[index] > cache_size) {
+				timestamps[index] = timestamp++;
+				++misses;
+			}
+		}
+	}
+
+	Vertex_cache_stats stats;
+	stats.acmr = faces.empty() ? 0 : float(misses) / faces.size();
+	stats.atvr = vertex_count == 0 ? 0 : float(misses) / vertex_count;
+
+	return stats;
+}
+
+void optimize_vertex_cache(std::vector<MDB_file::Face>& faces,
+                           size_t vertex_count)
+{
+	if (faces.empty() || vertex_count == 0)
+		return;
+
+	vector<Forsyth_vertex> verts(vertex_count);
+
+	for (auto& face : faces)
+		for (int i = 0; i < 3; ++i)
+			if (face.vertex_indices[i] < vertex_count)
+				++verts[face.vertex_indices[i]].remaining;
+
+	unsigned offset = 0;
+	for (auto& v : verts) {
+		v.adjacency_offset = offset;
+		offset += v.remaining;
+	}
+
+	// Triangles adjacent to each vertex. The first "remaining" entries of
+	// each vertex are the triangles not emitted yet.
+	vector<uint32_t> adjacency(offset);
+	vector<unsigned> filled(vertex_count, 0);
+
+	for (uint32_t t = 0; t < faces.size(); ++t) {
+		for (int i = 0; i < 3; ++i) {
+			auto index = faces[t].vertex_indices[i];
+			if (index < vertex_count) {
+				auto& v = verts[index];
+				adjacency[v.adjacency_offset + filled[index]++] = t;
+			}
+		}
+	}
+
+	for (auto& v : verts)
+		v.score = vertex_score(v);
+
+	auto triangle_score = [&](uint32_t t) {
+		float score = 0;
+		for (int i = 0; i < 3; ++i) {
+			auto index = faces[t].vertex_indices[i];
+			if (index < vertex_count)
+				score += verts[index].score;
+		}
+		return score;
+	};
+
+	vector<float> scores(faces.size());
+	for (uint32_t t = 0; t < faces.size(); ++t)
+		scores[t] = triangle_score(t);
+
+	vector<bool> emitted(faces.size(), false);
+	vector<MDB_file::Face> sorted_faces;
+	sorted_faces.reserve(faces.size());
+
+	vector<uint32_t> cache;
+	vector<uint32_t> new_cache;
+	cache.reserve(max_cache_size + 3);
+	new_cache.reserve(max_cache_size + 3);
+
+	uint32_t best_triangle = 0;
+	uint32_t next_unemitted = 0;
+
+	while (sorted_faces.size() < faces.size()) {
+		auto& face = faces[best_triangle];
+		emitted[best_triangle] = true;
+		sorted_faces.push_back(face);
+
+		// Remove the triangle from the adjacency of its vertices.
+		for (int i = 0; i < 3; ++i) {
+			auto index = face.vertex_indices[i];
+			if (index >= vertex_count)
+				continue;
+
+			auto& v = verts[index];
+			auto begin = adjacency.begin() + v.adjacency_offset;
+			auto end = begin + v.remaining;
+			auto it = find(begin, end, best_triangle);
+			if (it != end) {
+				*it = *(end - 1);
+				--v.remaining;
+			}
+		}
+
+		// Move the triangle vertices to the front of the LRU cache.
+		new_cache.clear();
+		for (int i = 0; i < 3; ++i)
+			if (face.vertex_indices[i] < vertex_count)
+				new_cache.push_back(face.vertex_indices[i]);
+
+		for (auto index : cache)
+			if (find(new_cache.begin(), new_cache.end(), index) ==
+			    new_cache.end())
+				new_cache.push_back(index);
+
+		for (unsigned i = max_cache_size; i < new_cache.size(); ++i)
+			verts[new_cache[i]].cache_position = -1;
+
+		if (new_cache.size() > max_cache_size)
+			new_cache.resize(max_cache_size);
+
+		for (unsigned i = 0; i < new_cache.size(); ++i)
+			verts[new_cache[i]].cache_position = i;
+
+		// Update the scores of the vertices that were in the cache
+		// (including the evicted ones) and their triangles.
+		for (auto index : cache)
+			verts[index].score = vertex_score(verts[index]);
+
+		for (auto index : new_cache)
+			verts[index].score = vertex_score(verts[index]);
+
+		float best_score = -1;
+		bool found = false;
+
+		auto update_triangles = [&](uint32_t index) {
+			auto& v = verts[index];
+			for (unsigned j = 0; j < v.remaining; ++j) {
+				auto t = adjacency[v.adjacency_offset + j];
+				scores[t] = triangle_score(t);
+				if (scores[t] > best_score) {
+					best_score = scores[t];
+					best_triangle = t;
+					found = true;
+				}
+			}
+		};
+
+		for (auto index : cache)
+			if (verts[index].cache_position < 0)
+				update_triangles(index);
+
+		for (auto index : new_cache)
+			update_triangles(index);
+
+		swap(cache, new_cache);
+
+		if (!found) {
+			// Dead end: no triangle uses a cached vertex. Continue
+			// with the next triangle in the original order.
+			while (next_unemitted < faces.size() &&
+			       emitted[next_unemitted])
+				++next_unemitted;
+
+			if (next_unemitted >= faces.size())
+				break;
+
+			best_triangle = next_unemitted;
+		}
+	}
+
+	faces = move(sorted_faces);
+}
+
+template <typename T>
+static void optimize_vertex_fetch_impl(std::vector<T>& verts,
+                                       std::vector<MDB_file::Face>& faces)
+{
+	const uint32_t unused = UINT32_MAX;
+	vector<uint32_t> remap(verts.size(), unused);
+	vector<T> sorted_verts;
+	sorted_verts.reserve(verts.size());
+
+	for (auto& face : faces) {
+		for (int i = 0; i < 3; ++i) {
+			auto& index = face.vertex_indices[i];
+			if (index >= verts.size())
+				continue;
+
+			if (remap[index] == unused) {
+				remap[index] = sorted_verts.size();
+				sorted_verts.push_back(verts[index]);
+			}
+
+			index = uint16_t(remap[index]);
+		}
+	}
+
+	for (uint32_t i = 0; i < verts.size(); ++i)
+		if (remap[i] == unused)
+			sorted_verts.push_back(verts[i]);
+
+	verts = move(sorted_verts);
+}
+
+void optimize_vertex_fetch(std::vector<MDB_file::Rigid_mesh_vertex>& verts,
+                           std::vector<MDB_file::Face>& faces)
+{
+	optimize_vertex_fetch_impl(verts, faces);
+}
+
+void optimize_vertex_fetch(std::vector<MDB_file::Skin_vertex>& verts,
+                           std::vector<MDB_file::Face>& faces)
+{
+	optimize_vertex_fetch_impl(verts, faces);
+}
+
+void optimize_mesh(MDB_file::Rigid_mesh& mesh)
+{
+	optimize_vertex_cache(mesh.faces, mesh.verts.size());
+	optimize_vertex_fetch(mesh.verts, mesh.faces);
+}
+
+void optimize_mesh(MDB_file::Skin& skin)
+{
+	optimize_vertex_cache(skin.faces, skin.verts.size());
+	optimize_vertex_fetch(skin.verts, skin.faces);
+}
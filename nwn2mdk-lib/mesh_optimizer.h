@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "mdb_file.h"
+
+/// Vertex cache efficiency of a triangle list.
+struct Vertex_cache_stats {
+	/// Average cache miss ratio: transformed vertices per triangle.
+	/// Lower is better, the theoretical minimum is ~0.5.
+	float acmr;
+	/// Average transform to vertex ratio: transformed vertices per
+	/// vertex. Lower is better, the minimum is 1.
+	float atvr;
+};
+
+/// Simulates a FIFO post-transform vertex cache of the specified size and
+/// returns the ACMR/ATVR of the faces.
+Vertex_cache_stats vertex_cache_stats(
+    const std::vector<MDB_file::Face>& faces, size_t vertex_count,
+    unsigned cache_size = 16);
+
+/// Reorders the faces for post-transform vertex cache locality using Tom
+/// Forsyth's linear-speed vertex cache optimisation.
+void optimize_vertex_cache(std::vector<MDB_file::Face>& faces,
+                           size_t vertex_count);
+
+/// Reorders the vertices by first use in the faces for pre-transform
+/// vertex fetch locality. Unreferenced vertices are moved to the end.
+void optimize_vertex_fetch(std::vector<MDB_file::Rigid_mesh_vertex>& verts,
+                           std::vector<MDB_file::Face>& faces);
+void optimize_vertex_fetch(std::vector<MDB_file::Skin_vertex>& verts,
+                           std::vector<MDB_file::Face>& faces);
+
+/// Optimizes the vertex cache and then the vertex fetch of a mesh.
+void optimize_mesh(MDB_file::Rigid_mesh& mesh);
+void optimize_mesh(MDB_file::Skin& skin);
@@ -0,0 +1,641 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <set>
+#include <tuple>
+
+#include "mesh_simplifier.h"
+#include "parallel.h"
+
+using namespace std;
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes,
+// weighted by the area of their faces.
+struct Quadric {
+	double a2 = 0, ab = 0, ac = 0, ad = 0;
+	double b2 = 0, bc = 0, bd = 0;
+	double c2 = 0, cd = 0;
+	double d2 = 0;
+	double w = 0; // Sum of the weights
+
+	Quadric() {}
+
+	Quadric(double a, double b, double c, double d, double w) : w(w)
+	{
+		a2 = w * a * a; ab = w * a * b; ac = w * a * c; ad = w * a * d;
+		b2 = w * b * b; bc = w * b * c; bd = w * b * d;
+		c2 = w * c * c; cd = w * c * d;
+		d2 = w * d * d;
+	}
+
+	Quadric& operator+=(const Quadric& q)
+	{
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+		w += q.w;
+		return *this;
+	}
+
+	// Mean squared distance to the planes
+	double error(const Vector3<float>& p) const
+	{
+		if (w <= 0)
+			return 0;
+
+		double x = p.x, y = p.y, z = p.z;
+		double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z +
+		           2 * ad * x + b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+		           c2 * z * z + 2 * cd * z + d2;
+		return e > 0 ? e / w : 0;
+	}
+};
+
+static Vector3<double> sub(const Vector3<float>& a, const Vector3<float>& b)
+{
+	return Vector3<double>(double(a.x) - b.x, double(a.y) - b.y,
+	                       double(a.z) - b.z);
+}
+
+static Vector3<double> cross(const Vector3<double>& a,
+                             const Vector3<double>& b)
+{
+	return Vector3<double>(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+	                       a.x * b.y - a.y * b.x);
+}
+
+static double dot(const Vector3<double>& a, const Vector3<double>& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static double dot(const Vector3<float>& a, const Vector3<float>& b)
+{
+	return double(a.x) * b.x + double(a.y) * b.y + double(a.z) * b.z;
+}
+
+static double length(const Vector3<double>& v)
+{
+	return sqrt(dot(v, v));
+}
+
+static double uv_distance2(const Vector3<float>& a, const Vector3<float>& b)
+{
+	double du = double(a.x) - b.x;
+	double dv = double(a.y) - b.y;
+	return du * du + dv * dv;
+}
+
+// Checks if two vertices are on the same side of any UV or normal seam.
+// Vertices are also split by tangents and binormals, but those splits
+// aren't preserved.
+template <typename T>
+static bool same_uv_and_normal(const T& a, const T& b)
+{
+	return uv_distance2(a.uvw, b.uvw) <= 1e-10 &&
+	       dot(a.normal, b.normal) >= 1 - 1e-4;
+}
+
+// Deviation of the attributes shared by rigid and skin vertices.
+template <typename T>
+static double common_attribute_deviation(const T& a, const T& b)
+{
+	return (1 - dot(a.normal, b.normal)) + (1 - dot(a.tangent, b.tangent)) +
+	       uv_distance2(a.uvw, b.uvw);
+}
+
+static double attribute_deviation(const MDB_file::Rigid_mesh_vertex& a,
+                                  const MDB_file::Rigid_mesh_vertex& b)
+{
+	return common_attribute_deviation(a, b);
+}
+
+static float bone_weight(const MDB_file::Skin_vertex& v, unsigned char bone)
+{
+	float w = 0;
+	for (int i = 0; i < 4; ++i)
+		if (v.bone_indices[i] == bone)
+			w += v.bone_weights[i];
+
+	return w;
+}
+
+static double bone_weights_deviation(const MDB_file::Skin_vertex& a,
+                                     const MDB_file::Skin_vertex& b)
+{
+	// L1 distance between the weights of the bones influencing any of
+	// both vertices.
+	double d = 0;
+
+	for (int i = 0; i < 4; ++i) {
+		if (a.bone_weights[i] > 0)
+			d += fabs(a.bone_weights[i] - bone_weight(b, a.bone_indices[i]));
+	}
+
+	for (int i = 0; i < 4; ++i) {
+		if (b.bone_weights[i] > 0 && bone_weight(a, b.bone_indices[i]) == 0)
+			d += b.bone_weights[i];
+	}
+
+	return d;
+}
+
+static double attribute_deviation(const MDB_file::Skin_vertex& a,
+                                  const MDB_file::Skin_vertex& b)
+{
+	// Moving a vertex to another bone is much more noticeable than a
+	// small normal deviation once the mesh is animated.
+	return common_attribute_deviation(a, b) +
+	       4 * bone_weights_deviation(a, b);
+}
+
+// Collapses are done between positions. The vertices of a position (one
+// per side of a seam, or per tangent split) all move at once, each one
+// merged into a vertex of the destination position on its side of the
+// seam.
+template <typename T>
+class Simplifier {
+public:
+	Simplifier(std::vector<T>& verts, std::vector<MDB_file::Face>& faces,
+	           const Simplify_options& options)
+	    : verts(verts), faces(faces), options(options)
+	{
+	}
+
+	uint32_t simplify();
+
+private:
+	struct Collapse {
+		double cost;
+		uint32_t from; // Position ids
+		uint32_t to;
+		uint32_t stamp;
+
+		bool operator<(const Collapse& c) const
+		{
+			return cost > c.cost; // Min-heap
+		}
+	};
+
+	// Vertices of the collapsed position, and the vertices they are
+	// merged into.
+	typedef std::vector<std::pair<uint32_t, uint32_t>> Vertex_map;
+
+	std::vector<T>& verts;
+	std::vector<MDB_file::Face>& faces;
+	const Simplify_options& options;
+
+	// Index of the first vertex with the same position, used as id of
+	// the position.
+	std::vector<uint32_t> position_ids;
+	// Vertices of each position (indexed by position id).
+	std::vector<std::vector<uint32_t>> position_verts;
+	// Indexed by position id.
+	std::vector<Quadric> quadrics;
+	std::vector<bool> locked;
+	std::vector<bool> position_removed;
+	std::vector<uint32_t> stamps;
+
+	std::vector<std::vector<uint32_t>> vertex_faces;
+	std::vector<bool> face_removed;
+	std::priority_queue<Collapse> heap;
+	double attribute_scale = 0;
+	double max_error2 = 0;
+	uint32_t face_count = 0;
+
+	void weld_positions();
+	void compute_quadrics();
+	void lock_borders();
+	bool has_position(const MDB_file::Face& face, uint32_t p) const;
+	bool is_used(uint32_t v) const;
+	std::set<uint32_t> neighbours(uint32_t p) const;
+	bool map_vertices(uint32_t from, uint32_t to, Vertex_map& map) const;
+	bool is_valid(uint32_t from, uint32_t to) const;
+	void push_collapses(uint32_t from);
+	void collapse(uint32_t from, uint32_t to, const Vertex_map& map);
+	void compact();
+};
+
+template <typename T>
+void Simplifier<T>::weld_positions()
+{
+	map<tuple<float, float, float>, uint32_t> positions;
+	position_ids.resize(verts.size());
+	position_verts.assign(verts.size(), {});
+
+	for (uint32_t i = 0; i < verts.size(); ++i) {
+		auto& p = verts[i].position;
+		auto r = positions.insert({{p.x, p.y, p.z}, i});
+		position_ids[i] = r.first->second;
+		position_verts[position_ids[i]].push_back(i);
+	}
+}
+
+template <typename T>
+void Simplifier<T>::compute_quadrics()
+{
+	quadrics.assign(verts.size(), Quadric());
+
+	for (auto& face : faces) {
+		auto& p0 = verts[face.vertex_indices[0]].position;
+		auto& p1 = verts[face.vertex_indices[1]].position;
+		auto& p2 = verts[face.vertex_indices[2]].position;
+
+		auto n = cross(sub(p1, p0), sub(p2, p0));
+		double area2 = length(n);
+		if (area2 == 0)
+			continue;
+
+		n = Vector3<double>(n.x / area2, n.y / area2, n.z / area2);
+		double d = -(n.x * p0.x + n.y * p0.y + n.z * p0.z);
+		Quadric q(n.x, n.y, n.z, d, area2 / 2);
+
+		for (int i = 0; i < 3; ++i)
+			quadrics[position_ids[face.vertex_indices[i]]] += q;
+	}
+}
+
+template <typename T>
+void Simplifier<T>::lock_borders()
+{
+	locked.assign(verts.size(), false);
+
+	// An edge used by a single face (ignoring seams) is an open border,
+	// and one used by more than two faces is non-manifold.
+	map<pair<uint32_t, uint32_t>, unsigned> edge_faces;
+
+	for (auto& face : faces) {
+		for (int i = 0; i < 3; ++i) {
+			uint32_t a = position_ids[face.vertex_indices[i]];
+			uint32_t b = position_ids[face.vertex_indices[(i + 1) % 3]];
+			++edge_faces[{min(a, b), max(a, b)}];
+		}
+	}
+
+	for (auto& e : edge_faces) {
+		if (e.second != 2) {
+			locked[e.first.first] = true;
+			locked[e.first.second] = true;
+		}
+	}
+}
+
+template <typename T>
+bool Simplifier<T>::has_position(const MDB_file::Face& face, uint32_t p) const
+{
+	return position_ids[face.vertex_indices[0]] == p ||
+	       position_ids[face.vertex_indices[1]] == p ||
+	       position_ids[face.vertex_indices[2]] == p;
+}
+
+template <typename T>
+bool Simplifier<T>::is_used(uint32_t v) const
+{
+	for (auto f : vertex_faces[v])
+		if (!face_removed[f])
+			return true;
+
+	return false;
+}
+
+template <typename T>
+std::set<uint32_t> Simplifier<T>::neighbours(uint32_t p) const
+{
+	set<uint32_t> positions;
+
+	for (auto v : position_verts[p]) {
+		for (auto f : vertex_faces[v]) {
+			if (face_removed[f])
+				continue;
+
+			for (int i = 0; i < 3; ++i)
+				positions.insert(position_ids[faces[f].vertex_indices[i]]);
+		}
+	}
+
+	positions.erase(p);
+
+	return positions;
+}
+
+template <typename T>
+bool Simplifier<T>::map_vertices(uint32_t from, uint32_t to,
+                                 Vertex_map& map) const
+{
+	for (auto vf : position_verts[from]) {
+		// Vertices of the destination sharing a face with vf are on its
+		// side of the seams.
+		vector<uint32_t> partners;
+		bool used = false;
+
+		for (auto f : vertex_faces[vf]) {
+			if (face_removed[f])
+				continue;
+
+			used = true;
+			for (int i = 0; i < 3; ++i) {
+				auto v = faces[f].vertex_indices[i];
+				if (position_ids[v] == to &&
+				    find(partners.begin(), partners.end(), v) ==
+				        partners.end())
+					partners.push_back(v);
+			}
+		}
+
+		if (!used)
+			continue;
+
+		if (partners.size() == 1) {
+			map.push_back({vf, partners[0]});
+			continue;
+		}
+
+		// Otherwise a vertex of the destination can only take the place
+		// of vf if it has its UVs and normal. Collapsing across a seam
+		// would move it.
+		if (partners.empty()) {
+			for (auto v : position_verts[to])
+				if (is_used(v))
+					partners.push_back(v);
+		}
+
+		uint32_t best = UINT32_MAX;
+		double best_deviation = 0;
+
+		for (auto v : partners) {
+			if (!same_uv_and_normal(verts[vf], verts[v]))
+				continue;
+
+			double deviation = attribute_deviation(verts[vf], verts[v]);
+			if (best == UINT32_MAX || deviation < best_deviation) {
+				best = v;
+				best_deviation = deviation;
+			}
+		}
+
+		if (best == UINT32_MAX)
+			return false;
+
+		map.push_back({vf, best});
+	}
+
+	return !map.empty();
+}
+
+template <typename T>
+bool Simplifier<T>::is_valid(uint32_t from, uint32_t to) const
+{
+	set<uint32_t> shared_faces;
+	set<uint32_t> opposite;
+	auto& target = verts[to].position;
+
+	for (auto v : position_verts[from]) {
+		for (auto f : vertex_faces[v]) {
+			if (face_removed[f])
+				continue;
+
+			auto& face = faces[f];
+
+			if (has_position(face, to)) {
+				shared_faces.insert(f);
+				for (int i = 0; i < 3; ++i) {
+					auto p = position_ids[face.vertex_indices[i]];
+					if (p != from && p != to)
+						opposite.insert(p);
+				}
+				continue;
+			}
+
+			// Reject collapses that flip a face.
+			Vector3<float> p[3];
+			Vector3<float> q[3];
+
+			for (int i = 0; i < 3; ++i) {
+				auto u = face.vertex_indices[i];
+				p[i] = verts[u].position;
+				q[i] = position_ids[u] == from ? target : p[i];
+			}
+
+			auto n0 = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+			auto n1 = cross(sub(q[1], q[0]), sub(q[2], q[0]));
+
+			if (dot(n0, n1) <= 0)
+				return false;
+		}
+	}
+
+	// The edge must be manifold, and its faces must have different
+	// opposite positions, or the collapse leaves duplicated faces.
+	if (shared_faces.empty() || shared_faces.size() > 2 ||
+	    opposite.size() != shared_faces.size())
+		return false;
+
+	// Link condition: the only positions adjacent to both ends of the
+	// edge are the opposite positions of its faces. Otherwise the
+	// collapse pinches the mesh.
+	auto to_neighbours = neighbours(to);
+
+	for (auto p : neighbours(from)) {
+		if (p != to && to_neighbours.count(p) && !opposite.count(p))
+			return false;
+	}
+
+	return true;
+}
+
+template <typename T>
+void Simplifier<T>::push_collapses(uint32_t from)
+{
+	if (locked[from] || position_removed[from])
+		return;
+
+	++stamps[from];
+
+	for (auto to : neighbours(from)) {
+		Vertex_map map;
+		if (!map_vertices(from, to, map))
+			continue;
+
+		Quadric q = quadrics[from];
+		q += quadrics[to];
+
+		double error = q.error(verts[to].position);
+		if (error > max_error2)
+			continue;
+
+		double deviation = 0;
+		for (auto& m : map)
+			deviation += attribute_deviation(verts[m.first], verts[m.second]);
+
+		double cost = error + options.attribute_weight * attribute_scale *
+		                          deviation;
+
+		heap.push({cost, from, to, stamps[from]});
+	}
+}
+
+template <typename T>
+void Simplifier<T>::collapse(uint32_t from, uint32_t to, const Vertex_map& map)
+{
+	for (auto& m : map) {
+		for (auto f : vertex_faces[m.first]) {
+			if (face_removed[f])
+				continue;
+
+			auto& face = faces[f];
+
+			if (has_position(face, to)) {
+				face_removed[f] = true;
+				--face_count;
+				continue;
+			}
+
+			for (int i = 0; i < 3; ++i)
+				if (face.vertex_indices[i] == m.first)
+					face.vertex_indices[i] = uint16_t(m.second);
+
+			vertex_faces[m.second].push_back(f);
+		}
+
+		vertex_faces[m.first].clear();
+	}
+
+	position_removed[from] = true;
+	quadrics[to] += quadrics[from];
+
+	// The cost of the collapses around the position has changed.
+	push_collapses(to);
+
+	for (auto p : neighbours(to))
+		push_collapses(p);
+}
+
+template <typename T>
+void Simplifier<T>::compact()
+{
+	const uint32_t unused = UINT32_MAX;
+	vector<uint32_t> remap(verts.size(), unused);
+	vector<T> new_verts;
+	vector<MDB_file::Face> new_faces;
+
+	for (uint32_t f = 0; f < faces.size(); ++f) {
+		if (face_removed[f])
+			continue;
+
+		auto face = faces[f];
+
+		for (int i = 0; i < 3; ++i) {
+			auto& index = face.vertex_indices[i];
+
+			if (remap[index] == unused) {
+				remap[index] = new_verts.size();
+				new_verts.push_back(verts[index]);
+			}
+
+			index = uint16_t(remap[index]);
+		}
+
+		new_faces.push_back(face);
+	}
+
+	verts = move(new_verts);
+	faces = move(new_faces);
+}
+
+template <typename T>
+uint32_t Simplifier<T>::simplify()
+{
+	face_count = faces.size();
+
+	uint32_t target_face_count = options.target_face_count;
+	if (target_face_count == 0)
+		target_face_count = uint32_t(ceil(faces.size() * options.target_ratio));
+
+	if (face_count <= target_face_count || verts.empty())
+		return face_count;
+
+	// Attribute deviations are dimensionless. Scale them by the squared
+	// size of the mesh so they are comparable to the quadric errors.
+	Vector3<float> lo = verts[0].position;
+	Vector3<float> hi = verts[0].position;
+	for (auto& v : verts) {
+		lo = Vector3<float>(min(lo.x, v.position.x), min(lo.y, v.position.y),
+		                    min(lo.z, v.position.z));
+		hi = Vector3<float>(max(hi.x, v.position.x), max(hi.y, v.position.y),
+		                    max(hi.z, v.position.z));
+	}
+	auto diagonal = sub(hi, lo);
+	attribute_scale = dot(diagonal, diagonal) * 0.001;
+	max_error2 = double(options.max_error) * options.max_error;
+
+	weld_positions();
+	compute_quadrics();
+	lock_borders();
+
+	vertex_faces.assign(verts.size(), {});
+	for (uint32_t f = 0; f < faces.size(); ++f)
+		for (int i = 0; i < 3; ++i)
+			vertex_faces[faces[f].vertex_indices[i]].push_back(f);
+
+	face_removed.assign(faces.size(), false);
+	position_removed.assign(verts.size(), false);
+	stamps.assign(verts.size(), 0);
+
+	for (uint32_t v = 0; v < verts.size(); ++v) {
+		if (position_ids[v] == v)
+			push_collapses(v);
+	}
+
+	while (face_count > target_face_count && !heap.empty()) {
+		auto c = heap.top();
+		heap.pop();
+
+		if (c.stamp != stamps[c.from] || position_removed[c.from] ||
+		    position_removed[c.to])
+			continue; // Outdated
+
+		Vertex_map map;
+		if (!is_valid(c.from, c.to) || !map_vertices(c.from, c.to, map))
+			continue;
+
+		collapse(c.from, c.to, map);
+	}
+
+	compact();
+
+	return faces.size();
+}
+
+uint32_t simplify_mesh(MDB_file::Rigid_mesh& mesh,
+                       const Simplify_options& options)
+{
+	return Simplifier(mesh.verts, mesh.faces, options).simplify();
+}
+
+uint32_t simplify_mesh(MDB_file::Skin& skin, const Simplify_options& options)
+{
+	return Simplifier(skin.verts, skin.faces, options).simplify();
+}
+
+void simplify_meshes(MDB_file& mdb, const Simplify_options& options)
+{
+	std::vector<MDB_file::Packet*> packets;
+
+	for (uint32_t i = 0; i < mdb.packet_count(); ++i) {
+		auto packet = mdb.packet(i);
+		if (packet &&
+		    (packet->type == MDB_file::RIGD || packet->type == MDB_file::SKIN))
+			packets.push_back(packet);
+	}
+
+	parallel_for(packets.size(), [&](size_t i) {
+		if (packets[i]->type == MDB_file::RIGD)
+			simplify_mesh(*static_cast<MDB_file::Rigid_mesh*>(packets[i]),
+			              options);
+		else
+			simplify_mesh(*static_cast<MDB_file::Skin*>(packets[i]),
+			              options);
+	});
+}
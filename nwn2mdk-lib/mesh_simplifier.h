@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cfloat>
+#include <cstdint>
+
+#include "mdb_file.h"
+
+/// Options of the mesh simplification.
+struct Simplify_options {
+	/// Fraction of faces to keep when target_face_count is 0.
+	float target_ratio = 0.5f;
+	/// Number of faces to keep. If 0, target_ratio is used instead.
+	uint32_t target_face_count = 0;
+	/// Maximum geometric error of a single collapse: the root mean square
+	/// distance (in model units) from the new position to the planes of
+	/// the original faces around the collapsed vertices, weighted by
+	/// their area. Collapses exceeding it are skipped.
+	float max_error = FLT_MAX;
+	/// Weight of the attribute (normal, tangent, UV, bone weights)
+	/// deviation relative to the geometric error. It only changes the
+	/// order of the collapses, max_error ignores it.
+	float attribute_weight = 1.0f;
+};
+
+/// Simplifies a mesh with quadric error metrics by collapsing vertices
+/// into their neighbours.
+///
+/// Collapsed vertices take the attributes of the vertex they are
+/// collapsed into, so normals, tangents, UVs and bone weights are never
+/// interpolated. Open borders are kept locked. Vertices on UV or normal
+/// seams only collapse along the seam, with both sides at once, so seams
+/// keep their shape. Vertices split by tangents only collapse freely.
+///
+/// @return The number of faces after the simplification.
+uint32_t simplify_mesh(MDB_file::Rigid_mesh& mesh,
+                       const Simplify_options& options);
+uint32_t simplify_mesh(MDB_file::Skin& skin, const Simplify_options& options);
+
+/// Simplifies all the RIGD and SKIN packets of a MDB in parallel.
+void simplify_meshes(MDB_file& mdb, const Simplify_options& options);
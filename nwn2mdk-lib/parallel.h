@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/// Returns the number of threads used by parallel_for for the specified
+/// number of work items.
+///
+/// @param count Number of work items.
+/// @param thread_count Maximum number of threads. If 0, the number of
+/// hardware threads is used.
+inline unsigned parallel_thread_count(size_t count, unsigned thread_count = 0)
+{
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	if (count < thread_count)
+		thread_count = unsigned(count);
+
+	return std::max(1u, thread_count);
+}
+
+/// Calls f(worker, i) for each i in [0, count), distributing the calls
+/// among several threads. worker is the index of the calling thread, in
+/// [0, parallel_thread_count(count, thread_count)), so f can keep
+/// per-thread state that isn't safe to share.
+///
+/// @param count Number of work items.
+/// @param f Function to call with the worker and work item indices.
+/// @param thread_count Maximum number of threads. If 0, the number of
+/// hardware threads is used.
+template <typename F>
+void parallel_for_worker(size_t count, F f, unsigned thread_count = 0)
+{
+	thread_count = parallel_thread_count(count, thread_count);
+
+	if (thread_count <= 1) {
+		for (size_t i = 0; i < count; ++i)
+			f(0u, i);
+		return;
+	}
+
+	std::atomic<size_t> next_index = 0;
+
+	auto worker = [&](unsigned worker_index) {
+		for (size_t i = next_index++; i < count; i = next_index++)
+			f(worker_index, i);
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < thread_count; ++i)
+		threads.emplace_back(worker, i);
+
+	worker(0);
+
+	for (auto& t : threads)
+		t.join();
+}
+
+/// Calls f(i) for each i in [0, count), distributing the calls among
+/// several threads. The calling thread also takes part in the work.
+///
+/// @param count Number of work items.
+/// @param f Function to call with the index of each work item.
+/// @param thread_count Maximum number of threads. If 0, the number of
+/// hardware threads is used.
+template <typename F>
+void parallel_for(size_t count, F f, unsigned thread_count = 0)
+{
+	parallel_for_worker(
+	    count, [&](unsigned, size_t i) { f(i); }, thread_count);
+}
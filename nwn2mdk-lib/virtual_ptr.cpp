@@ -1,7 +1,15 @@
+#include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 
 #include "virtual_ptr.h"
 
+#ifdef VIRTUAL_PTR
+
+// GR2 files can be read in several threads, while others decode the
+// pointers of the files already read.
+static std::shared_mutex map_mutex;
+
 static uint32_t counter = 0;
 
 static std::unordered_map<uint32_t, void*>& decoding_map()
@@ -10,9 +18,19 @@ static std::unordered_map<uint32_t, void*>& decoding_map()
 	return m;
 }
 
+static std::unordered_map<const void*, uint32_t>& encoding_map()
+{
+	static std::unordered_map<const void*, uint32_t> m;
+	return m;
+}
+
+#endif
+
 void* decode_ptr(uint32_t encoded_ptr)
 {
 #ifdef VIRTUAL_PTR
+	std::shared_lock<std::shared_mutex> lock(map_mutex);
+
 	auto it = decoding_map().find(encoded_ptr);
 	if (it != decoding_map().end())
 		return it->second;
@@ -29,15 +47,15 @@ uint32_t encode_ptr(const void *p)
 	if (!p)
 		return 0;
 
-	static std::unordered_map<const void*, uint32_t> encoding_map;
+	std::unique_lock<std::shared_mutex> lock(map_mutex);
 
-	auto it = encoding_map.find(p);
-	if (it != encoding_map.end())
+	auto it = encoding_map().find(p);
+	if (it != encoding_map().end())
 		return it->second;
 
-	auto encoded_ptr = ++counter;	
+	auto encoded_ptr = ++counter;
 
-	encoding_map.emplace(p, encoded_ptr);
+	encoding_map().emplace(p, encoded_ptr);
 	decoding_map().emplace(encoded_ptr, const_cast<void*>(p));
 
 	return encoded_ptr;
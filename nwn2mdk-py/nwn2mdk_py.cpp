@@ -0,0 +1,1032 @@
+// Python bindings of nwn2mdk-lib
+//
+// The module "nwn2mdk" reads MDB and GR2 files, and exposes the vertex,
+// face, bone and curve arrays through the buffer protocol, as read-only
+// strided views of the parsed data. They can be wrapped as NumPy arrays
+// without copying:
+//
+//     mdb = nwn2mdk.MDB("c_dog.mdb")
+//     for packet in mdb.packets:
+//         if packet.type == "RIGD":
+//             positions = numpy.asarray(packet.positions) # (n, 3) float32
+//             faces = numpy.asarray(packet.faces)         # (m, 3) uint16
+//
+// Vertex attributes are interleaved in the packets, so their views are
+// strided. Blender's foreach_set only takes the fast path with contiguous
+// buffers of the type of the property, so they must be packed first:
+//
+//     co = numpy.ascontiguousarray(packet.positions)
+//     mesh.vertices.add(len(co))
+//     mesh.vertices.foreach_set("co", co.ravel())
+//
+// The views keep their MDB or GR2 object alive. Compressed GR2 curves are
+// decoded when the GR2 object is created. Uncompressed curves are not
+// copied.
+//
+// Like the tools, the Win32 build decompresses GR2 files with the
+// granny2.dll of the NWN2 installation, which must be set before the
+// first compressed GR2 is read (the DLL is loaded once):
+//
+//     nwn2mdk.set_nwn2_home("C:\\GOG Games\\Neverwinter Nights 2 Complete")
+//
+// Otherwise granny2.dll is searched in the DLL search path of the process.
+// The x64 build decompresses them itself.
+//
+// test_nwn2mdk.py has the tests of the module.
+//
+// The module is built as nwn2mdk.pyd, against the Python found in
+// PYTHON_HOME. It must be the same version as the Python of Blender, and
+// Blender needs the x64 build.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "gr2_file.h"
+#include "mdb_file.h"
+#include "memory_stream.h"
+
+using namespace std;
+
+// Owners of the data of the views
+
+struct MDB_object {
+	PyObject_HEAD
+	MDB_file* mdb;
+	PyObject* packets;
+};
+
+struct GR2_object {
+	PyObject_HEAD
+	GR2_file* gr2;
+	PyObject* skeletons;
+	PyObject* animations;
+};
+
+// Decoded curve data
+struct Floats_object {
+	PyObject_HEAD
+	vector<float> floats;
+};
+
+// A strided array of one or two dimensions
+struct View_object {
+	PyObject_HEAD
+	PyObject* owner;
+	const char* data;
+	const char* format; // struct module syntax
+	Py_ssize_t itemsize;
+	int ndim;
+	Py_ssize_t shape[2];
+	Py_ssize_t strides[2];
+};
+
+static PyObject* simple_namespace;
+
+static void Floats_dealloc(Floats_object* self)
+{
+	self->floats.~vector<float>();
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyTypeObject Floats_type = {
+	PyVarObject_HEAD_INIT(nullptr, 0)
+	"nwn2mdk._Floats",         // tp_name
+	sizeof(Floats_object),     // tp_basicsize
+	0,                         // tp_itemsize
+	(destructor)Floats_dealloc // tp_dealloc
+};
+
+static Floats_object* new_floats()
+{
+	auto self = PyObject_New(Floats_object, &Floats_type);
+	if (self)
+		new (&self->floats) vector<float>();
+
+	return self;
+}
+
+static bool is_contiguous(const View_object* self)
+{
+	Py_ssize_t stride = self->itemsize;
+	for (int i = self->ndim - 1; i >= 0; --i) {
+		if (self->shape[i] > 1 && self->strides[i] != stride)
+			return false;
+		stride *= self->shape[i];
+	}
+
+	return true;
+}
+
+static int View_getbuffer(View_object* self, Py_buffer* view, int flags)
+{
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "view is read-only");
+		return -1;
+	}
+
+	bool strided = (flags & PyBUF_STRIDES) == PyBUF_STRIDES;
+	if (!strided && !is_contiguous(self)) {
+		PyErr_SetString(PyExc_BufferError,
+			"view is not contiguous, request a strided buffer");
+		return -1;
+	}
+
+	Py_ssize_t len = self->itemsize;
+	for (int i = 0; i < self->ndim; ++i)
+		len *= self->shape[i];
+
+	view->buf = (void*)self->data;
+	view->obj = (PyObject*)self;
+	Py_INCREF(self);
+	view->len = len;
+	view->readonly = 1;
+	view->itemsize = self->itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? (char*)self->format : nullptr;
+	view->ndim = self->ndim;
+	view->shape = (flags & PyBUF_ND) ? self->shape : nullptr;
+	view->strides = strided ? self->strides : nullptr;
+	view->suboffsets = nullptr;
+	view->internal = nullptr;
+
+	return 0;
+}
+
+// The owners cache the views of their packets, skeletons and animations,
+// so a view and its owner are a reference cycle
+static int View_traverse(View_object* self, visitproc visit, void* arg)
+{
+	Py_VISIT(self->owner);
+	return 0;
+}
+
+static int View_clear(View_object* self)
+{
+	Py_CLEAR(self->owner);
+	return 0;
+}
+
+static void View_dealloc(View_object* self)
+{
+	PyObject_GC_UnTrack(self);
+	View_clear(self);
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static Py_ssize_t View_length(View_object* self)
+{
+	return self->shape[0];
+}
+
+static PyObject* View_get_shape(View_object* self, void*)
+{
+	if (self->ndim == 1)
+		return Py_BuildValue("(n)", self->shape[0]);
+
+	return Py_BuildValue("(nn)", self->shape[0], self->shape[1]);
+}
+
+static PyBufferProcs View_as_buffer = {
+	(getbufferproc)View_getbuffer, // bf_getbuffer
+	nullptr                        // bf_releasebuffer
+};
+
+static PySequenceMethods View_as_sequence = {
+	(lenfunc)View_length // sq_length
+};
+
+static PyGetSetDef View_getset[] = {
+	{ "shape", (getter)View_get_shape, nullptr, "Shape of the array", nullptr },
+	{ nullptr }
+};
+
+static PyTypeObject View_type = {
+	PyVarObject_HEAD_INIT(nullptr, 0)
+	"nwn2mdk.View",          // tp_name
+	sizeof(View_object),     // tp_basicsize
+	0,                       // tp_itemsize
+	(destructor)View_dealloc // tp_dealloc
+};
+
+// Creates a view of count elements of the specified size (1 or 2
+// dimensions), stride bytes apart.
+static PyObject* new_view(PyObject* owner, const void* data, Py_ssize_t count,
+	Py_ssize_t stride, const char* format, Py_ssize_t itemsize,
+	Py_ssize_t components = 0)
+{
+	auto self = PyObject_GC_New(View_object, &View_type);
+	if (!self)
+		return nullptr;
+
+	Py_INCREF(owner);
+	self->owner = owner;
+	self->data = (const char*)data;
+	self->format = format;
+	self->itemsize = itemsize;
+	self->ndim = components > 0 ? 2 : 1;
+	self->shape[0] = count;
+	self->shape[1] = components;
+	self->strides[0] = stride;
+	self->strides[1] = itemsize;
+	PyObject_GC_Track(self);
+
+	return (PyObject*)self;
+}
+
+template <typename T, typename V>
+static PyObject* float_view(PyObject* owner, const std::vector<T>& verts,
+	const V T::*member, Py_ssize_t components)
+{
+	auto data = verts.empty() ? nullptr : &(verts.data()->*member);
+	return new_view(owner, data, verts.size(), sizeof(T), "f", sizeof(float),
+		components);
+}
+
+// Sets an attribute, stealing the reference to value
+static bool set_attr(PyObject* obj, const char* name, PyObject* value)
+{
+	if (!value)
+		return false;
+
+	int ret = PyObject_SetAttrString(obj, name, value);
+	Py_DECREF(value);
+
+	return ret == 0;
+}
+
+static PyObject* new_namespace()
+{
+	return PyObject_CallNoArgs(simple_namespace);
+}
+
+// Fixed size strings of MDB files aren't always null terminated
+static PyObject* fixed_string(const char* s, size_t size)
+{
+	size_t n = 0;
+	while (n < size && s[n])
+		++n;
+
+	return PyUnicode_DecodeLatin1(s, n, nullptr);
+}
+
+static PyObject* vector3(const Vector3<float>& v)
+{
+	return Py_BuildValue("(fff)", v.x, v.y, v.z);
+}
+
+static PyObject* orientation(const float m[3][3])
+{
+	return Py_BuildValue("((fff)(fff)(fff))", m[0][0], m[0][1], m[0][2],
+		m[1][0], m[1][1], m[1][2], m[2][0], m[2][1], m[2][2]);
+}
+
+static PyObject* material(const MDB_file::Material& m)
+{
+	auto obj = new_namespace();
+	if (!obj)
+		return nullptr;
+
+	if (set_attr(obj, "diffuse_map", fixed_string(m.diffuse_map_name, 32))
+	    && set_attr(obj, "normal_map", fixed_string(m.normal_map_name, 32))
+	    && set_attr(obj, "tint_map", fixed_string(m.tint_map_name, 32))
+	    && set_attr(obj, "glow_map", fixed_string(m.glow_map_name, 32))
+	    && set_attr(obj, "diffuse_color", vector3(m.diffuse_color))
+	    && set_attr(obj, "specular_color", vector3(m.specular_color))
+	    && set_attr(obj, "specular_level", PyFloat_FromDouble(m.specular_level))
+	    && set_attr(obj, "specular_power", PyFloat_FromDouble(m.specular_power))
+	    && set_attr(obj, "flags", PyLong_FromUnsignedLong(m.flags)))
+		return obj;
+
+	Py_DECREF(obj);
+	return nullptr;
+}
+
+template <typename T>
+static bool set_faces(PyObject* obj, PyObject* owner,
+	const std::vector<T>& faces)
+{
+	auto data = faces.empty() ? nullptr : faces.data()->vertex_indices;
+	return set_attr(obj, "faces", new_view(owner, data, faces.size(),
+		sizeof(T), "H", sizeof(uint16_t), 3));
+}
+
+// Attributes shared by RIGD, SKIN, COL2 and COL3 packets
+template <typename P>
+static bool set_mesh(PyObject* obj, PyObject* owner, const P& p)
+{
+	using V = typename decltype(p.verts)::value_type;
+
+	return set_attr(obj, "name", fixed_string(p.header.name, 32))
+		&& set_attr(obj, "material", material(p.header.material))
+		&& set_attr(obj, "positions", float_view(owner, p.verts, &V::position, 3))
+		&& set_attr(obj, "normals", float_view(owner, p.verts, &V::normal, 3))
+		&& set_attr(obj, "uvw", float_view(owner, p.verts, &V::uvw, 3))
+		&& set_faces(obj, owner, p.faces);
+}
+
+template <typename P>
+static bool set_tangents(PyObject* obj, PyObject* owner, const P& p)
+{
+	using V = typename decltype(p.verts)::value_type;
+
+	return set_attr(obj, "tangents", float_view(owner, p.verts, &V::tangent, 3))
+		&& set_attr(obj, "binormals", float_view(owner, p.verts, &V::binormal, 3));
+}
+
+static bool set_skin(PyObject* obj, PyObject* owner, const MDB_file::Skin& p)
+{
+	using V = MDB_file::Skin_vertex;
+	auto v = p.verts.empty() ? nullptr : p.verts.data();
+
+	return set_mesh(obj, owner, p)
+		&& set_tangents(obj, owner, p)
+		&& set_attr(obj, "skeleton", fixed_string(p.header.skeleton_name, 32))
+		&& set_attr(obj, "bone_weights", new_view(owner,
+			v ? v->bone_weights : nullptr, p.verts.size(), sizeof(V), "f",
+			sizeof(float), 4))
+		&& set_attr(obj, "bone_indices", new_view(owner,
+			v ? v->bone_indices : nullptr, p.verts.size(), sizeof(V), "B",
+			sizeof(uint8_t), 4))
+		&& set_attr(obj, "bone_counts", float_view(owner, p.verts,
+			&V::bone_count, 0));
+}
+
+static bool set_walk_mesh(PyObject* obj, PyObject* owner,
+	const MDB_file::Walk_mesh& p)
+{
+	using V = MDB_file::Walk_mesh_vertex;
+	auto f = p.faces.empty() ? nullptr : p.faces.data();
+
+	return set_attr(obj, "name", fixed_string(p.header.name, 32))
+		&& set_attr(obj, "ui_flags", PyLong_FromUnsignedLong(p.header.ui_flags))
+		&& set_attr(obj, "positions", float_view(owner, p.verts, &V::position, 3))
+		&& set_faces(obj, owner, p.faces)
+		&& set_attr(obj, "face_flags", new_view(owner, f ? f->flags : nullptr,
+			p.faces.size(), sizeof(*f), "H", sizeof(uint16_t), 2));
+}
+
+static bool set_collision_spheres(PyObject* obj, PyObject* owner,
+	const MDB_file::Collision_spheres& p)
+{
+	using S = MDB_file::Collision_sphere;
+	auto s = p.spheres.empty() ? nullptr : p.spheres.data();
+
+	return set_attr(obj, "bone_indices", new_view(owner,
+			s ? &s->bone_index : nullptr, p.spheres.size(), sizeof(S), "I",
+			sizeof(uint32_t)))
+		&& set_attr(obj, "radii", new_view(owner, s ? &s->radius : nullptr,
+			p.spheres.size(), sizeof(S), "f", sizeof(float)));
+}
+
+// HOOK, HAIR and HELM packets
+template <typename H>
+static bool set_point(PyObject* obj, const H& header)
+{
+	return set_attr(obj, "name", fixed_string(header.name, 32))
+		&& set_attr(obj, "position", vector3(header.position))
+		&& set_attr(obj, "orientation", orientation(header.orientation));
+}
+
+static bool set_packet(PyObject* obj, PyObject* owner,
+	const MDB_file::Packet& packet)
+{
+	if (!set_attr(obj, "type", PyUnicode_FromString(packet.type_str())))
+		return false;
+
+	switch (packet.type) {
+	case MDB_file::COL2:
+	case MDB_file::COL3:
+		return set_mesh(obj, owner, (const MDB_file::Collision_mesh&)packet);
+	case MDB_file::COLS:
+		return set_collision_spheres(obj, owner,
+			(const MDB_file::Collision_spheres&)packet);
+	case MDB_file::HAIR: {
+		auto& h = ((const MDB_file::Hair&)packet).header;
+		return set_point(obj, h) && set_attr(obj, "shortening_behavior",
+			PyLong_FromLong(h.shortening_behavior));
+	}
+	case MDB_file::HELM: {
+		auto& h = ((const MDB_file::Helm&)packet).header;
+		return set_point(obj, h) && set_attr(obj, "hiding_behavior",
+			PyLong_FromLong(h.hiding_behavior));
+	}
+	case MDB_file::HOOK: {
+		auto& h = ((const MDB_file::Hook&)packet).header;
+		return set_point(obj, h)
+			&& set_attr(obj, "point_type", PyLong_FromLong(h.point_type))
+			&& set_attr(obj, "point_size", PyLong_FromLong(h.point_size));
+	}
+	case MDB_file::RIGD: {
+		auto& p = (const MDB_file::Rigid_mesh&)packet;
+		return set_mesh(obj, owner, p) && set_tangents(obj, owner, p);
+	}
+	case MDB_file::SKIN:
+		return set_skin(obj, owner, (const MDB_file::Skin&)packet);
+	case MDB_file::WALK:
+		return set_walk_mesh(obj, owner, (const MDB_file::Walk_mesh&)packet);
+	default:
+		return true;
+	}
+}
+
+static PyObject* packets(MDB_object* self)
+{
+	auto list = PyList_New(0);
+	if (!list)
+		return nullptr;
+
+	for (uint32_t i = 0; i < self->mdb->packet_count(); ++i) {
+		auto packet = self->mdb->packet(i);
+		if (!packet) // Unknown type
+			continue;
+
+		auto obj = new_namespace();
+		if (!obj || !set_packet(obj, (PyObject*)self, *packet)
+		    || PyList_Append(list, obj) != 0) {
+			Py_XDECREF(obj);
+			Py_DECREF(list);
+			return nullptr;
+		}
+		Py_DECREF(obj);
+	}
+
+	return list;
+}
+
+// Reads a file from a path or from a bytes-like object
+template <typename T>
+static T* read_file(PyObject* source)
+{
+	if (PyUnicode_Check(source)) {
+		PyObject* bytes;
+		if (!PyUnicode_FSConverter(source, &bytes))
+			return nullptr;
+		T* file;
+		Py_BEGIN_ALLOW_THREADS
+		file = new (nothrow) T(PyBytes_AS_STRING(bytes));
+		Py_END_ALLOW_THREADS
+		Py_DECREF(bytes);
+		return file ? file : (T*)PyErr_NoMemory();
+	}
+
+	Py_buffer buffer;
+	if (PyObject_GetBuffer(source, &buffer, PyBUF_SIMPLE) != 0)
+		return nullptr;
+
+	// The file is parsed from the buffer, and keeps its own copy
+	T* file;
+	Py_BEGIN_ALLOW_THREADS
+	Memory_istream in(buffer.buf, buffer.len);
+	file = new (nothrow) T(in);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&buffer);
+
+	return file ? file : (T*)PyErr_NoMemory();
+}
+
+static int MDB_init(MDB_object* self, PyObject* args, PyObject* kwds)
+{
+	static const char* keywords[] = { "source", nullptr };
+	PyObject* source;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", (char**)keywords,
+	                                 &source))
+		return -1;
+
+	unique_ptr<MDB_file> mdb(read_file<MDB_file>(source));
+	if (!mdb)
+		return -1;
+	if (!*mdb) {
+		PyErr_SetString(PyExc_OSError, mdb->error_str());
+		return -1;
+	}
+
+	delete self->mdb;
+	self->mdb = mdb.release();
+	Py_CLEAR(self->packets);
+	self->packets = packets(self);
+
+	return self->packets ? 0 : -1;
+}
+
+static int MDB_traverse(MDB_object* self, visitproc visit, void* arg)
+{
+	Py_VISIT(self->packets);
+	return 0;
+}
+
+static int MDB_clear(MDB_object* self)
+{
+	Py_CLEAR(self->packets);
+	return 0;
+}
+
+static void MDB_dealloc(MDB_object* self)
+{
+	PyObject_GC_UnTrack(self);
+	MDB_clear(self);
+	delete self->mdb;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* MDB_get_packets(MDB_object* self, void*)
+{
+	if (!self->packets)
+		return PyList_New(0);
+
+	Py_INCREF(self->packets);
+	return self->packets;
+}
+
+static PyObject* MDB_get_major_version(MDB_object* self, void*)
+{
+	return PyLong_FromLong(self->mdb ? self->mdb->major_version() : 0);
+}
+
+static PyObject* MDB_get_minor_version(MDB_object* self, void*)
+{
+	return PyLong_FromLong(self->mdb ? self->mdb->minor_version() : 0);
+}
+
+static PyGetSetDef MDB_getset[] = {
+	{ "packets", (getter)MDB_get_packets, nullptr,
+	  "Packets, in file order", nullptr },
+	{ "major_version", (getter)MDB_get_major_version, nullptr, nullptr,
+	  nullptr },
+	{ "minor_version", (getter)MDB_get_minor_version, nullptr, nullptr,
+	  nullptr },
+	{ nullptr }
+};
+
+static PyTypeObject MDB_type = {
+	PyVarObject_HEAD_INIT(nullptr, 0)
+	"nwn2mdk.MDB",          // tp_name
+	sizeof(MDB_object),     // tp_basicsize
+	0,                      // tp_itemsize
+	(destructor)MDB_dealloc // tp_dealloc
+};
+
+// GR2
+
+static PyObject* gr2_string(Virtual_ptr<char> s)
+{
+	const char* p = s ? s.get() : "";
+	return PyUnicode_DecodeLatin1(p, strlen(p), nullptr);
+}
+
+static PyObject* skeleton(PyObject* owner, GR2_skeleton& skel)
+{
+	auto obj = new_namespace();
+	if (!obj)
+		return nullptr;
+
+	int count = skel.bones_count;
+	GR2_bone* bones = skel.bones;
+	auto bone_names = PyList_New(count);
+	for (int i = 0; bone_names && i < count; ++i)
+		PyList_SET_ITEM(bone_names, i, gr2_string(bones[i].name));
+
+	if (set_attr(obj, "name", gr2_string(skel.name))
+	    && set_attr(obj, "bone_names", bone_names)
+	    && set_attr(obj, "parent_indices", new_view(owner,
+	        bones ? &bones->parent_index : nullptr, count, sizeof(GR2_bone), "i",
+	        sizeof(int32_t)))
+	    && set_attr(obj, "flags", new_view(owner,
+	        bones ? &bones->transform.flags : nullptr, count,
+	        sizeof(GR2_bone), "I", sizeof(uint32_t)))
+	    && set_attr(obj, "translations", new_view(owner,
+	        bones ? &bones->transform.translation : nullptr, count,
+	        sizeof(GR2_bone), "f", sizeof(float), 3))
+	    && set_attr(obj, "rotations", new_view(owner,
+	        bones ? &bones->transform.rotation : nullptr, count,
+	        sizeof(GR2_bone), "f", sizeof(float), 4))
+	    && set_attr(obj, "scale_shears", new_view(owner,
+	        bones ? bones->transform.scale_shear : nullptr, count,
+	        sizeof(GR2_bone), "f", sizeof(float), 9))
+	    && set_attr(obj, "inverse_world_transforms", new_view(owner,
+	        bones ? bones->inverse_world_transform : nullptr, count,
+	        sizeof(GR2_bone), "f", sizeof(float), 16)))
+		return obj;
+
+	Py_DECREF(obj);
+	return nullptr;
+}
+
+// Controls of a decoded curve, dimension floats per knot
+struct Decoded_curve {
+	vector<float> knots;
+	vector<float> controls;
+};
+
+template <typename C>
+static void append_controls(Decoded_curve& d, const C& controls,
+	int dimension)
+{
+	for (auto& c : controls) {
+		const float v[4] = { c.x, c.y, c.z, dimension == 4 ? c.w : 0 };
+		d.controls.insert(d.controls.end(), v, v + dimension);
+	}
+}
+
+static void append_controls(Decoded_curve& d,
+	const std::vector<Vector3<float>>& controls, int dimension)
+{
+	for (auto& c : controls)
+		d.controls.insert(d.controls.end(), { c.x, c.y, c.z });
+}
+
+// Decodes a compressed curve. Returns false if the format is unknown.
+static bool decode_curve(GR2_curve_data* data, Decoded_curve& d,
+	int& dimension)
+{
+	switch (data->curve_data_header.format) {
+	case D3K16uC16u: {
+		GR2_D3K16uC16u_view view(*(GR2_curve_data_D3K16uC16u*)data);
+		d.knots = view.knots();
+		dimension = 3;
+		append_controls(d, view.controls(), dimension);
+		return true;
+	}
+	case D3K8uC8u: {
+		GR2_D3K8uC8u_view view(*(GR2_curve_data_D3K8uC8u*)data);
+		d.knots = view.knots();
+		dimension = 3;
+		append_controls(d, view.controls(), dimension);
+		return true;
+	}
+	case D4nK16uC15u: {
+		GR2_D4nK16uC15u_view view(*(GR2_curve_data_D4nK16uC15u*)data);
+		d.knots = view.knots();
+		dimension = 4;
+		append_controls(d, view.controls(), dimension);
+		return true;
+	}
+	case D4nK8uC7u: {
+		GR2_D4nK8uC7u_view view(*(GR2_curve_data_D4nK8uC7u*)data);
+		d.knots = view.knots();
+		dimension = 4;
+		append_controls(d, view.controls(), dimension);
+		return true;
+	}
+	case DaK16uC16u: {
+		GR2_DaK16uC16u_view view(*(GR2_curve_data_DaK16uC16u*)data);
+		d.knots = view.knots();
+		d.controls = view.controls();
+		dimension = d.knots.empty() ? 0 : int(d.controls.size() / d.knots.size());
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+// Views of the knots and the controls of a curve. dimension is the
+// dimension expected by the track (3 for positions, 4 for rotations and 9
+// for scale-shears).
+static bool set_curve_data(PyObject* obj, PyObject* owner, GR2_curve& curve,
+	int dimension)
+{
+	auto data = curve.curve_data.get();
+	auto format = data->curve_data_header.format;
+
+	// Uncompressed data is viewed in place
+	if (format == DaK32fC32f) {
+		auto c = (GR2_curve_data_DaK32fC32f*)data;
+		int dim = c->knots_count > 0 ? c->controls_count / c->knots_count : 0;
+		return set_attr(obj, "dimension", PyLong_FromLong(dim))
+			&& set_attr(obj, "knots", new_view(owner, c->knots.get(),
+				c->knots_count, sizeof(float), "f", sizeof(float)))
+			&& set_attr(obj, "controls", new_view(owner, c->controls.get(),
+				c->knots_count, dim * sizeof(float), "f", sizeof(float), dim));
+	}
+	if (format == DaConstant32f || format == D3Constant32f) {
+		static const float zero = 0;
+		int dim = 3;
+		const float* controls;
+		if (format == DaConstant32f) {
+			auto c = (GR2_curve_data_DaConstant32f*)data;
+			dim = c->controls_count;
+			controls = c->controls.get();
+		}
+		else
+			controls = ((GR2_curve_data_D3Constant32f*)data)->controls;
+		return set_attr(obj, "dimension", PyLong_FromLong(dim))
+			&& set_attr(obj, "knots", new_view(owner, &zero, 1,
+				sizeof(float), "f", sizeof(float)))
+			&& set_attr(obj, "controls", new_view(owner, controls, 1,
+				dim * sizeof(float), "f", sizeof(float), dim));
+	}
+
+	auto floats = new_floats();
+	if (!floats)
+		return false;
+
+	Decoded_curve d;
+	int dim = dimension;
+	if (format == DaIdentity) // No keys, the track keeps the rest pose
+		dim = ((GR2_curve_data_DaIdentity*)data)->dimension;
+	else if (!decode_curve(data, d, dim)) {
+		PyErr_Format(PyExc_ValueError, "Unsupported curve format %s",
+			curve_format_to_str(format));
+		Py_DECREF(floats);
+		return false;
+	}
+
+	// Knots and controls in the same block
+	size_t count = d.knots.size();
+	floats->floats = move(d.knots);
+	floats->floats.insert(floats->floats.end(), d.controls.begin(),
+		d.controls.end());
+	auto knots = floats->floats.data();
+	auto controls = knots + count;
+
+	bool ok = set_attr(obj, "dimension", PyLong_FromLong(dim))
+		&& set_attr(obj, "knots", new_view((PyObject*)floats, knots, count,
+			sizeof(float), "f", sizeof(float)))
+		&& set_attr(obj, "controls", new_view((PyObject*)floats, controls,
+			count, dim * sizeof(float), "f", sizeof(float), dim));
+	Py_DECREF(floats);
+
+	return ok;
+}
+
+static PyObject* curve(PyObject* owner, GR2_curve& curve, int dimension)
+{
+	auto obj = new_namespace();
+	if (!obj)
+		return nullptr;
+
+	auto& header = curve.curve_data->curve_data_header;
+	if (set_attr(obj, "format",
+	             PyUnicode_FromString(curve_format_to_str(header.format)))
+	    && set_attr(obj, "degree", PyLong_FromLong(header.degree))
+	    && set_curve_data(obj, owner, curve, dimension))
+		return obj;
+
+	Py_DECREF(obj);
+	return nullptr;
+}
+
+static PyObject* track(PyObject* owner, GR2_transform_track& tt)
+{
+	auto obj = new_namespace();
+	if (!obj)
+		return nullptr;
+
+	if (set_attr(obj, "name", gr2_string(tt.name))
+	    && set_attr(obj, "position", curve(owner, tt.position_curve, 3))
+	    && set_attr(obj, "rotation", curve(owner, tt.orientation_curve, 4))
+	    && set_attr(obj, "scale_shear", curve(owner, tt.scale_shear_curve, 9)))
+		return obj;
+
+	Py_DECREF(obj);
+	return nullptr;
+}
+
+static PyObject* track_group(PyObject* owner, GR2_track_group& tg)
+{
+	auto obj = new_namespace();
+	if (!obj)
+		return nullptr;
+
+	GR2_transform_track* tracks = tg.transform_tracks;
+	auto list = PyList_New(tg.transform_tracks_count);
+	for (int i = 0; list && i < tg.transform_tracks_count; ++i) {
+		auto t = track(owner, tracks[i]);
+		if (!t) {
+			Py_CLEAR(list);
+			break;
+		}
+		PyList_SET_ITEM(list, i, t);
+	}
+
+	if (set_attr(obj, "name", gr2_string(tg.name))
+	    && set_attr(obj, "tracks", list))
+		return obj;
+
+	Py_DECREF(obj);
+	return nullptr;
+}
+
+static PyObject* animation(PyObject* owner, GR2_animation& anim)
+{
+	auto obj = new_namespace();
+	if (!obj)
+		return nullptr;
+
+	auto list = PyList_New(anim.track_groups_count);
+	for (int i = 0; list && i < anim.track_groups_count; ++i) {
+		auto tg = track_group(owner, *anim.track_groups[i]);
+		if (!tg) {
+			Py_CLEAR(list);
+			break;
+		}
+		PyList_SET_ITEM(list, i, tg);
+	}
+
+	if (set_attr(obj, "name", gr2_string(anim.name))
+	    && set_attr(obj, "duration", PyFloat_FromDouble(anim.duration))
+	    && set_attr(obj, "time_step", PyFloat_FromDouble(anim.time_step))
+	    && set_attr(obj, "oversampling", PyFloat_FromDouble(anim.oversampling))
+	    && set_attr(obj, "track_groups", list))
+		return obj;
+
+	Py_DECREF(obj);
+	return nullptr;
+}
+
+static int GR2_init(GR2_object* self, PyObject* args, PyObject* kwds)
+{
+	static const char* keywords[] = { "source", nullptr };
+	PyObject* source;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", (char**)keywords,
+	                                 &source))
+		return -1;
+
+	unique_ptr<GR2_file> gr2(read_file<GR2_file>(source));
+	if (!gr2)
+		return -1;
+	if (!*gr2) {
+		PyErr_SetString(PyExc_OSError, gr2->error_string().c_str());
+		return -1;
+	}
+
+	delete self->gr2;
+	self->gr2 = gr2.release();
+	Py_CLEAR(self->skeletons);
+	Py_CLEAR(self->animations);
+
+	auto owner = (PyObject*)self;
+	auto info = self->gr2->file_info;
+
+	self->skeletons = PyList_New(info->skeletons_count);
+	for (int i = 0; self->skeletons && i < info->skeletons_count; ++i) {
+		auto s = skeleton(owner, *info->skeletons[i]);
+		if (!s)
+			return -1;
+		PyList_SET_ITEM(self->skeletons, i, s);
+	}
+
+	self->animations = PyList_New(info->animations_count);
+	for (int i = 0; self->animations && i < info->animations_count; ++i) {
+		auto a = animation(owner, *info->animations[i]);
+		if (!a)
+			return -1;
+		PyList_SET_ITEM(self->animations, i, a);
+	}
+
+	return self->skeletons && self->animations ? 0 : -1;
+}
+
+static int GR2_traverse(GR2_object* self, visitproc visit, void* arg)
+{
+	Py_VISIT(self->skeletons);
+	Py_VISIT(self->animations);
+	return 0;
+}
+
+static int GR2_clear(GR2_object* self)
+{
+	Py_CLEAR(self->skeletons);
+	Py_CLEAR(self->animations);
+	return 0;
+}
+
+static void GR2_dealloc(GR2_object* self)
+{
+	PyObject_GC_UnTrack(self);
+	GR2_clear(self);
+	delete self->gr2;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* get_list(PyObject* list)
+{
+	if (!list)
+		return PyList_New(0);
+
+	Py_INCREF(list);
+	return list;
+}
+
+static PyObject* GR2_get_skeletons(GR2_object* self, void*)
+{
+	return get_list(self->skeletons);
+}
+
+static PyObject* GR2_get_animations(GR2_object* self, void*)
+{
+	return get_list(self->animations);
+}
+
+static PyGetSetDef GR2_getset[] = {
+	{ "skeletons", (getter)GR2_get_skeletons, nullptr, nullptr, nullptr },
+	{ "animations", (getter)GR2_get_animations, nullptr, nullptr, nullptr },
+	{ nullptr }
+};
+
+static PyTypeObject GR2_type = {
+	PyVarObject_HEAD_INIT(nullptr, 0)
+	"nwn2mdk.GR2",          // tp_name
+	sizeof(GR2_object),     // tp_basicsize
+	0,                      // tp_itemsize
+	(destructor)GR2_dealloc // tp_dealloc
+};
+
+static PyObject* set_nwn2_home(PyObject*, PyObject* args)
+{
+	const char* path;
+	if (!PyArg_ParseTuple(args, "s", &path))
+		return nullptr;
+
+	GR2_file::granny2dll_filename = string(path) + "\\granny2.dll";
+
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef module_methods[] = {
+	{ "set_nwn2_home", set_nwn2_home, METH_VARARGS,
+	  "set_nwn2_home(path)\n\nSets the NWN2 installation directory, whose "
+	  "granny2.dll decompresses GR2 files. It must be called before reading "
+	  "the first compressed GR2." },
+	{ nullptr }
+};
+
+static PyModuleDef module_def = {
+	PyModuleDef_HEAD_INIT,
+	"nwn2mdk",                                 // m_name
+	"Zero-copy access to NWN2 MDB and GR2 files", // m_doc
+	-1,                                        // m_size
+	module_methods                             // m_methods
+};
+
+static bool add_type(PyObject* module, PyTypeObject* type, const char* name)
+{
+	if (PyType_Ready(type) < 0)
+		return false;
+
+	Py_INCREF(type);
+	if (PyModule_AddObject(module, name, (PyObject*)type) < 0) {
+		Py_DECREF(type);
+		return false;
+	}
+
+	return true;
+}
+
+PyMODINIT_FUNC PyInit_nwn2mdk()
+{
+	View_type.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC;
+	View_type.tp_doc = "Read-only strided array, exposed through the "
+		"buffer protocol";
+	View_type.tp_as_buffer = &View_as_buffer;
+	View_type.tp_as_sequence = &View_as_sequence;
+	View_type.tp_getset = View_getset;
+	View_type.tp_traverse = (traverseproc)View_traverse;
+	View_type.tp_clear = (inquiry)View_clear;
+
+	Floats_type.tp_flags = Py_TPFLAGS_DEFAULT;
+
+	MDB_type.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC;
+	MDB_type.tp_doc = "MDB(source)\n\nMDB file read from a path or from "
+		"a bytes-like object";
+	MDB_type.tp_traverse = (traverseproc)MDB_traverse;
+	MDB_type.tp_clear = (inquiry)MDB_clear;
+	MDB_type.tp_getset = MDB_getset;
+	MDB_type.tp_init = (initproc)MDB_init;
+	MDB_type.tp_new = PyType_GenericNew;
+
+	GR2_type.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC;
+	GR2_type.tp_doc = "GR2(source)\n\nGR2 file read from a path or from "
+		"a bytes-like object";
+	GR2_type.tp_traverse = (traverseproc)GR2_traverse;
+	GR2_type.tp_clear = (inquiry)GR2_clear;
+	GR2_type.tp_getset = GR2_getset;
+	GR2_type.tp_init = (initproc)GR2_init;
+	GR2_type.tp_new = PyType_GenericNew;
+
+	auto types = PyImport_ImportModule("types");
+	if (!types)
+		return nullptr;
+	simple_namespace = PyObject_GetAttrString(types, "SimpleNamespace");
+	Py_DECREF(types);
+	if (!simple_namespace)
+		return nullptr;
+
+	auto module = PyModule_Create(&module_def);
+	if (!module)
+		return nullptr;
+
+	if (PyType_Ready(&Floats_type) < 0
+	    || !add_type(module, &View_type, "View")
+	    || !add_type(module, &MDB_type, "MDB")
+	    || !add_type(module, &GR2_type, "GR2")) {
+		Py_DECREF(module);
+		return nullptr;
+	}
+
+	return module;
+}
@@ -0,0 +1,54 @@
+# Tests of the nwn2mdk Python module
+#
+# Run them with the built module in the path:
+#
+#     python test_nwn2mdk.py
+
+import gc
+import struct
+import unittest
+
+import nwn2mdk
+
+# A MDB with a rigid mesh of vertex_count vertices and a face
+def rigid_mesh_mdb(vertex_count):
+    verts = b"".join(struct.pack("<15f", *([float(i)] * 15))
+                     for i in range(vertex_count))
+    faces = struct.pack("<3H", 0, 1, 2)
+    header = (b"mesh".ljust(32, b"\0") + bytes(164)
+              + struct.pack("<II", vertex_count, 1))
+    packet = header + verts + faces
+
+    return (b"NWN2" + struct.pack("<HHI", 1, 12, 1)
+            + b"RIGD" + struct.pack("<I", 20)
+            + b"RIGD" + struct.pack("<I", len(packet)) + packet)
+
+def live_objects(type_name):
+    gc.collect()
+    return sum(1 for o in gc.get_objects() if type(o).__name__ == type_name)
+
+class Test_MDB(unittest.TestCase):
+    def test_positions(self):
+        mdb = nwn2mdk.MDB(rigid_mesh_mdb(3))
+        positions = memoryview(mdb.packets[0].positions)
+        self.assertEqual(positions.shape, (3, 3))
+        self.assertEqual(positions[2, 1], 2.0)
+
+    def test_dropped_mdb_is_freed(self):
+        data = rigid_mesh_mdb(1000)
+        before = live_objects("MDB")
+        for _ in range(100):
+            mdb = nwn2mdk.MDB(data)
+            positions = mdb.packets[0].positions
+            del mdb, positions
+        self.assertEqual(live_objects("MDB"), before)
+
+    def test_view_keeps_mdb_alive(self):
+        mdb = nwn2mdk.MDB(rigid_mesh_mdb(3))
+        positions = mdb.packets[0].positions
+        del mdb
+        gc.collect()
+        self.assertEqual(memoryview(positions)[1, 0], 1.0)
+
+if __name__ == "__main__":
+    unittest.main()
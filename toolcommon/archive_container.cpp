@@ -0,0 +1,803 @@
+// Copyright 2017 Jose M. Arbos
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include "archive_container.h"
+#include "log.h"
+#include "parallel.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+static const char cache_signature[4] = { 'N', 'W', 'A', 'C' };
+static const uint32_t cache_version = 2;
+
+static std::string to_upper(std::string s)
+{
+	for (auto& c : s)
+		c = toupper(c);
+
+	return s;
+}
+
+static std::string basename(const std::string& s)
+{
+	auto pos = s.find_last_of("/\\");
+	return pos == string::npos ? s : s.substr(pos + 1);
+}
+
+static uint32_t trigram(const char* s)
+{
+	return uint32_t((unsigned char)s[0]) |
+	       uint32_t((unsigned char)s[1]) << 8 |
+	       uint32_t((unsigned char)s[2]) << 16;
+}
+
+bool match_glob(const char* pattern, const char* s)
+{
+	// Iterative matching, backtracking only to the last '*'
+	const char* star = nullptr;
+	const char* star_s = nullptr;
+
+	while (*s) {
+		if (*pattern == '*') {
+			star = pattern++;
+			star_s = s;
+		}
+		else if (*pattern == '?' || *pattern == *s) {
+			++pattern;
+			++s;
+		}
+		else if (star) {
+			pattern = star + 1;
+			s = ++star_s;
+		}
+		else
+			return false;
+	}
+
+	while (*pattern == '*')
+		++pattern;
+
+	return *pattern == '\0';
+}
+
+template <typename T>
+static void read(std::istream& in, T& x)
+{
+	in.read((char*)&x, sizeof(T));
+}
+
+static void read(std::istream& in, std::string& s)
+{
+	uint32_t size = 0;
+	read(in, size);
+	if (!in || size > MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE * 16)
+		return in.setstate(ios::failbit);
+
+	s.resize(size);
+	in.read(s.data(), size);
+}
+
+template <typename T>
+static void write(std::ostream& out, const T& x)
+{
+	out.write((const char*)&x, sizeof(T));
+}
+
+static void write(std::ostream& out, const std::string& s)
+{
+	write(out, uint32_t(s.size()));
+	out.write(s.data(), s.size());
+}
+
+void Archive_container::set_memory_mapped(bool memory_mapped)
+{
+	this->memory_mapped = memory_mapped;
+}
+
+bool Archive_container::add_archive(const char* filename)
+{
+	return add_archives({ filename }).front();
+}
+
+std::vector<bool>
+Archive_container::add_archives(const std::vector<std::string>& filenames)
+{
+	// Reading the central directories is the slow part and doesn't touch
+	// the container, so it's done in parallel. The indices are then built
+	// sequentially to keep the precedence order.
+	vector<Opened_archive> opened(filenames.size());
+	vector<char> status(filenames.size());
+
+	parallel_for(filenames.size(), [&](size_t i) {
+		status[i] = open_archive(filenames[i], opened[i]);
+	});
+
+	vector<bool> added(filenames.size());
+
+	for (size_t i = 0; i < filenames.size(); ++i) {
+		if (status[i]) {
+			merge_archive(opened[i]);
+			added[i] = true;
+		}
+	}
+
+	return added;
+}
+
+bool Archive_container::open_archive(const std::string& filename,
+                                     Opened_archive& opened) const
+{
+	auto& e = opened.entry;
+	e.filename = filename;
+
+	error_code ec;
+	e.size = file_size(e.filename, ec);
+	if (ec)
+		return false;
+
+	e.mtime = last_write_time(e.filename, ec).time_since_epoch().count();
+	if (ec)
+		return false;
+
+	auto it = cache.find(e.filename);
+	if (it != cache.end() && it->second.size == e.size &&
+	    it->second.mtime == e.mtime) {
+		opened.cached = &it->second.files;
+		return true;
+	}
+
+	return read_directory(e, opened.directory);
+}
+
+void Archive_container::merge_archive(Opened_archive& opened)
+{
+	opened.entry.first_file = files.size();
+	archives.push_back(std::move(opened.entry));
+
+	if (opened.cached) {
+		index_archive(archives.size() - 1, *opened.cached);
+	}
+	else {
+		index_archive(archives.size() - 1, opened.directory);
+		cache_dirty = true;
+	}
+}
+
+bool Archive_container::read_directory(
+    Archive_entry& entry, std::vector<Cached_file>& directory) const
+{
+	mz_zip_archive zip;
+	if (!init_reader(entry, &zip)) {
+		entry.mapping.reset();
+		return false;
+	}
+
+	// Only the directory is needed now. The archive is opened (and
+	// mapped) again if a file is extracted from it.
+	struct Close_reader {
+		const Archive_entry& entry;
+		mz_zip_archive& zip;
+		~Close_reader()
+		{
+			mz_zip_reader_end(&zip);
+			entry.mapping.reset();
+		}
+	} close_reader{ entry, zip };
+
+	unsigned file_count = mz_zip_reader_get_num_files(&zip);
+	directory.resize(file_count);
+
+	for (unsigned i = 0; i < file_count; ++i) {
+		mz_zip_archive_file_stat file_stat;
+		if (!mz_zip_reader_file_stat(&zip, i, &file_stat)) {
+			Log::info() << "Cannot get file stat\n";
+			return false;
+		}
+
+		auto& f = directory[i];
+		f.filename = file_stat.m_filename;
+		f.is_directory = file_stat.m_is_directory;
+		f.method = file_stat.m_method;
+		f.local_header_offset = file_stat.m_local_header_ofs;
+		f.compressed_size = file_stat.m_comp_size;
+		f.uncompressed_size = file_stat.m_uncomp_size;
+		f.crc32 = file_stat.m_crc32;
+	}
+
+	return true;
+}
+
+void Archive_container::index_archive(
+    unsigned archive_index, const std::vector<Cached_file>& directory)
+{
+	archives[archive_index].file_count = directory.size();
+	files.reserve(files.size() + directory.size());
+
+	for (unsigned i = 0; i < directory.size(); ++i) {
+		auto& d = directory[i];
+
+		File_entry f;
+		f.filename = d.filename;
+		f.uppercase = to_upper(f.filename);
+		f.archive_index = archive_index;
+		f.file_index = i;
+		f.is_directory = d.is_directory;
+		f.method = d.method;
+		f.local_header_offset = d.local_header_offset;
+		f.compressed_size = d.compressed_size;
+		f.uncompressed_size = d.uncompressed_size;
+		f.crc32 = d.crc32;
+		files.push_back(std::move(f));
+
+		if (d.is_directory)
+			continue;
+
+		// Archives added first take precedence, so a basename that is
+		// already indexed is an overridden copy.
+		unsigned entry = files.size() - 1;
+		string name = basename(files.back().uppercase);
+		if (!basename_index.emplace(name, entry).second)
+			continue;
+
+		winning_entries.push_back(entry);
+
+		auto dot = name.rfind('.');
+		if (dot == string::npos) {
+			stem_index[name].push_back(entry);
+		}
+		else {
+			stem_index[name.substr(0, dot)].push_back(entry);
+			extension_index[name.substr(dot + 1)].push_back(entry);
+		}
+
+		index_trigrams(entry);
+	}
+}
+
+void Archive_container::index_trigrams(unsigned entry)
+{
+	auto& s = files[entry].uppercase;
+
+	for (size_t i = 0; i + 3 <= s.size(); ++i) {
+		auto& postings = trigram_index[trigram(&s[i])];
+
+		// Entries are indexed in order, so each list stays sorted
+		if (postings.empty() || postings.back() != entry)
+			postings.push_back(entry);
+	}
+}
+
+void Archive_container::load_cache(const char* filename)
+{
+	ifstream in(filename, ios::binary);
+	if (!in)
+		return;
+
+	char signature[4];
+	uint32_t version = 0;
+	uint32_t archive_count = 0;
+	in.read(signature, 4);
+	read(in, version);
+	read(in, archive_count);
+	if (!in || memcmp(signature, cache_signature, 4) != 0 ||
+	    version != cache_version)
+		return;
+
+	unordered_map<string, Cached_archive> loaded;
+
+	for (uint32_t i = 0; i < archive_count; ++i) {
+		string archive_filename;
+		Cached_archive a;
+		uint32_t file_count = 0;
+		read(in, archive_filename);
+		read(in, a.size);
+		read(in, a.mtime);
+		read(in, file_count);
+		if (!in)
+			return;
+
+		a.files.reserve(file_count);
+
+		for (uint32_t j = 0; j < file_count; ++j) {
+			Cached_file f;
+			uint8_t is_directory = 0;
+			read(in, f.filename);
+			read(in, is_directory);
+			read(in, f.method);
+			read(in, f.local_header_offset);
+			read(in, f.compressed_size);
+			read(in, f.uncompressed_size);
+			read(in, f.crc32);
+			if (!in)
+				return;
+
+			f.is_directory = is_directory != 0;
+			a.files.push_back(std::move(f));
+		}
+
+		loaded[archive_filename] = std::move(a);
+	}
+
+	cache = std::move(loaded);
+}
+
+bool Archive_container::save_cache(const char* filename) const
+{
+	if (!cache_dirty)
+		return true;
+
+	// Other processes may be reading or writing the cache. It's written
+	// to a file of our own, and then replaces the cache at once.
+	path tmp = filename;
+	tmp += "." + to_string(random_device()()) + ".tmp";
+
+	ofstream out(tmp, ios::binary);
+	if (!out)
+		return false;
+
+	out.write(cache_signature, 4);
+	write(out, cache_version);
+	write(out, uint32_t(archives.size()));
+
+	for (auto& a : archives) {
+		write(out, a.filename);
+		write(out, a.size);
+		write(out, a.mtime);
+		write(out, uint32_t(a.file_count));
+
+		for (unsigned i = 0; i < a.file_count; ++i) {
+			auto& f = files[a.first_file + i];
+			write(out, f.filename);
+			write(out, uint8_t(f.is_directory));
+			write(out, f.method);
+			write(out, f.local_header_offset);
+			write(out, f.compressed_size);
+			write(out, f.uncompressed_size);
+			write(out, f.crc32);
+		}
+	}
+
+	out.close();
+
+	error_code ec;
+	if (out)
+		rename(tmp, filename, ec);
+
+	if (!out || ec) {
+		remove(tmp, ec);
+		return false;
+	}
+
+	return true;
+}
+
+mz_zip_archive* Archive_container::zip(unsigned archive_index) const
+{
+	auto& entry = archives[archive_index];
+
+	if (!entry.zip) {
+		entry.zip.reset(new mz_zip_archive);
+		if (!init_reader(entry, entry.zip.get())) {
+			Log::info() << "Cannot open " << entry.filename << endl;
+			entry.zip.reset();
+			return nullptr;
+		}
+	}
+
+	return entry.zip.get();
+}
+
+const Mapped_file*
+Archive_container::map_archive(const Archive_entry& entry) const
+{
+	if (!entry.mapping) {
+		entry.mapping = make_shared<Mapped_file>(entry.filename.c_str());
+		if (!*entry.mapping) {
+			entry.mapping.reset();
+			return nullptr;
+		}
+	}
+
+	return entry.mapping.get();
+}
+
+bool Archive_container::init_reader(const Archive_entry& entry,
+                                    mz_zip_archive* zip) const
+{
+	mz_zip_zero_struct(zip);
+
+	if (!memory_mapped)
+		return mz_zip_reader_init_file(zip, entry.filename.c_str(), 0);
+
+	// Readers of the same archive share the mapping, and so the pages
+	// already loaded. Deflated files are inflated from the mapping.
+	// Archives that can't be mapped (e.g. out of address space) are read
+	// from the file.
+	auto mapping = map_archive(entry);
+	if (!mapping)
+		return mz_zip_reader_init_file(zip, entry.filename.c_str(), 0);
+
+	return mz_zip_reader_init_mem(zip, mapping->data(), mapping->size(),
+	                              0);
+}
+
+unsigned Archive_container::archive_count() const
+{
+	return archives.size();
+}
+
+unsigned Archive_container::file_count(unsigned archive_index) const
+{
+	if (archive_index >= archives.size())
+		return 0;
+
+	return archives[archive_index].file_count;
+}
+
+bool Archive_container::extract_file(unsigned archive_index,
+                                     unsigned file_index,
+                                     const char* dest_filename) const
+{
+	if (archive_index >= archives.size())
+		return false;
+
+	auto z = zip(archive_index);
+	if (!z)
+		return false;
+
+	if (!mz_zip_reader_extract_to_file(z, file_index, dest_filename, 0)) {
+		return false;
+	}
+
+	return true;
+}
+
+std::vector<bool> Archive_container::extract_files(
+    const std::vector<Extraction>& extractions) const
+{
+	struct Reader {
+		unique_ptr<mz_zip_archive> zip;
+		bool failed = false;
+	};
+
+	// Map the archives before starting, so the workers only read the
+	// shared mappings.
+	if (memory_mapped) {
+		for (auto& e : extractions) {
+			if (e.archive_index < archives.size())
+				map_archive(archives[e.archive_index]);
+		}
+	}
+
+	unsigned thread_count = parallel_thread_count(extractions.size());
+	vector<Reader> readers(thread_count * archives.size());
+	vector<char> status(extractions.size());
+
+	parallel_for_worker(extractions.size(), [&](unsigned worker, size_t i) {
+		auto& e = extractions[i];
+		if (e.archive_index >= archives.size())
+			return;
+
+		auto& r = readers[worker * archives.size() + e.archive_index];
+		if (!r.zip && !r.failed) {
+			r.zip.reset(new mz_zip_archive);
+			if (!init_reader(archives[e.archive_index], r.zip.get())) {
+				r.zip.reset();
+				r.failed = true;
+			}
+		}
+
+		if (r.zip)
+			status[i] = mz_zip_reader_extract_to_file(
+			    r.zip.get(), e.file_index, e.dest_filename.c_str(), 0);
+	});
+
+	for (auto& r : readers) {
+		if (r.zip)
+			mz_zip_reader_end(r.zip.get());
+	}
+
+	return vector<bool>(status.begin(), status.end());
+}
+
+bool Archive_container::extract_file_to_mem(
+    unsigned archive_index, unsigned file_index,
+    std::vector<unsigned char>& buffer) const
+{
+	auto f = file_entry(archive_index, file_index);
+	if (!f)
+		return false;
+
+	auto stored = stored_file(archive_index, file_index);
+	if (!stored.empty()) {
+		buffer.assign(stored.begin(), stored.end());
+		return true;
+	}
+
+	auto z = zip(archive_index);
+	if (!z)
+		return false;
+
+	buffer.resize(f->uncompressed_size);
+
+	if (!mz_zip_reader_extract_to_mem(z, file_index, buffer.data(),
+	                                  buffer.size(), 0)) {
+		return false;
+	}
+
+	return true;
+}
+
+std::span<const unsigned char>
+Archive_container::stored_file(unsigned archive_index,
+                               unsigned file_index) const
+{
+	auto f = file_entry(archive_index, file_index);
+	if (!memory_mapped || !f || f->is_directory || f->method != 0 ||
+	    f->compressed_size != f->uncompressed_size)
+		return {};
+
+	auto mapping = map_archive(archives[archive_index]);
+	if (!mapping)
+		return {};
+
+	// Local file header: signature, ..., flags at 6, name and extra field
+	// lengths at 26 and 28, followed by the name, extra field and data.
+	auto offset = f->local_header_offset;
+	if (offset + 30 > mapping->size())
+		return {};
+
+	auto header = mapping->data() + offset;
+	auto u16 = [&](unsigned i) {
+		return uint32_t(header[i] | header[i + 1] << 8);
+	};
+
+	if (u16(0) != 0x4b50 || u16(2) != 0x0403 || (u16(6) & 1))
+		return {};
+
+	offset += 30 + u16(26) + u16(28);
+	if (offset + f->uncompressed_size > mapping->size())
+		return {};
+
+	return { mapping->data() + offset, size_t(f->uncompressed_size) };
+}
+
+std::string Archive_container::filename(unsigned archive_index,
+                                        unsigned file_index) const
+{
+	auto f = file_entry(archive_index, file_index);
+
+	return f ? f->filename : "";
+}
+
+uint64_t Archive_container::uncompressed_size(unsigned archive_index,
+                                              unsigned file_index) const
+{
+	auto f = file_entry(archive_index, file_index);
+
+	return f ? f->uncompressed_size : 0;
+}
+
+uint32_t Archive_container::file_crc32(unsigned archive_index,
+                                       unsigned file_index) const
+{
+	auto f = file_entry(archive_index, file_index);
+
+	return f ? f->crc32 : 0;
+}
+
+const Archive_container::File_entry*
+Archive_container::file_entry(unsigned archive_index,
+                              unsigned file_index) const
+{
+	if (archive_index >= archives.size())
+		return nullptr;
+
+	auto& entry = archives[archive_index];
+	if (file_index >= entry.file_count)
+		return nullptr;
+
+	return &files[entry.first_file + file_index];
+}
+
+Archive_container::Find_result
+Archive_container::find_result(const std::vector<unsigned>& entries) const
+{
+	Find_result res;
+	res.matches = entries.size();
+	res.archive_index = archives.size();
+	res.file_index = -1;
+
+	if (Log::enabled(Log::LEVEL_DEBUG)) {
+		for (auto entry : entries) {
+			auto& f = files[entry];
+			Log::debug() << "  " << f.filename << " ("
+			             << archives[f.archive_index].filename << ")\n";
+		}
+	}
+
+	if (!entries.empty()) {
+		res.archive_index = files[entries.front()].archive_index;
+		res.file_index = files[entries.front()].file_index;
+	}
+
+	Log::debug() << "  # " << res.matches << " total matches\n";
+
+	return res;
+}
+
+Archive_container::Find_result
+Archive_container::find_file(const char* str) const
+{
+	Log::debug() << "Searching: \"" << str << "\"\n";
+
+	return find_result(match_entries(to_upper(str)));
+}
+
+std::vector<Archive_container::Find_result>
+Archive_container::find_files(const char* str) const
+{
+	vector<Find_result> v;
+
+	for (auto entry : match_entries(to_upper(str))) {
+		Find_result res;
+		res.matches = 1;
+		res.archive_index = files[entry].archive_index;
+		res.file_index = files[entry].file_index;
+		v.push_back(res);
+	}
+
+	return v;
+}
+
+std::vector<unsigned>
+Archive_container::match_entries(const std::string& str) const
+{
+	auto it = basename_index.find(str);
+	if (it != basename_index.end())
+		return { it->second };
+
+	if (str.find_first_of("*?") != string::npos)
+		return find_glob(str);
+
+	return find_substring(str);
+}
+
+std::vector<unsigned>
+Archive_container::trigram_candidates(const std::string& str) const
+{
+	vector<const vector<unsigned>*> lists;
+
+	for (size_t i = 0; i + 3 <= str.size(); ++i) {
+		auto it = trigram_index.find(trigram(&str[i]));
+		if (it == trigram_index.end())
+			return {};
+
+		lists.push_back(&it->second);
+	}
+
+	// Intersect starting with the shortest posting list
+	sort(lists.begin(), lists.end(),
+	     [](auto a, auto b) { return a->size() < b->size(); });
+
+	vector<unsigned> candidates = *lists.front();
+	vector<unsigned> tmp;
+
+	for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+		tmp.clear();
+		set_intersection(candidates.begin(), candidates.end(),
+		                 lists[i]->begin(), lists[i]->end(),
+		                 back_inserter(tmp));
+		candidates.swap(tmp);
+	}
+
+	return candidates;
+}
+
+std::vector<unsigned>
+Archive_container::find_substring(const std::string& str) const
+{
+	vector<unsigned> entries;
+
+	// Only the winning copy of each basename is indexed
+	if (str.size() >= 3) {
+		for (auto entry : trigram_candidates(str)) {
+			if (files[entry].uppercase.find(str) != string::npos)
+				entries.push_back(entry);
+		}
+
+		return entries;
+	}
+
+	for (auto entry : winning_entries) {
+		if (files[entry].uppercase.find(str) != string::npos)
+			entries.push_back(entry);
+	}
+
+	return entries;
+}
+
+std::vector<unsigned>
+Archive_container::find_glob(const std::string& pattern) const
+{
+	// The longest literal run of the pattern selects the candidates
+	string literal;
+	string run;
+	for (auto c : pattern + '*') {
+		if (c == '*' || c == '?') {
+			if (run.size() > literal.size())
+				literal = run;
+			run.clear();
+		}
+		else
+			run += c;
+	}
+
+	vector<unsigned> trigram_matches;
+	if (literal.size() >= 3)
+		trigram_matches = trigram_candidates(literal);
+	auto& candidates = literal.size() >= 3 ? trigram_matches
+	                                       : winning_entries;
+
+	vector<unsigned> entries;
+	for (auto entry : candidates) {
+		auto& name = files[entry].uppercase;
+		auto pos = name.find_last_of("/\\");
+		if (match_glob(pattern.c_str(),
+		               name.c_str() + (pos == string::npos ? 0 : pos + 1)))
+			entries.push_back(entry);
+	}
+
+	return entries;
+}
+
+Archive_container::Find_result
+Archive_container::find_file_by_stem(const char* str) const
+{
+	Log::debug() << "Searching: \"" << str << ".*\"\n";
+
+	auto it = stem_index.find(to_upper(str));
+	if (it == stem_index.end())
+		return find_result({});
+
+	return find_result(it->second);
+}
+
+std::vector<Archive_container::Find_result>
+Archive_container::files_with_extension(const char* ext) const
+{
+	std::vector<Find_result> v;
+
+	auto it = extension_index.find(to_upper(ext));
+	if (it == extension_index.end())
+		return v;
+
+	for (auto entry : it->second) {
+		Find_result res;
+		res.matches = 1;
+		res.archive_index = files[entry].archive_index;
+		res.file_index = files[entry].file_index;
+		v.push_back(res);
+	}
+
+	return v;
+}
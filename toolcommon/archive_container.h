@@ -0,0 +1,196 @@
+// Copyright 2017 Jose M. Arbos
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+#include "miniz.h"
+
+// Matches s against a pattern where '*' matches any sequence of
+// characters and '?' any single character.
+bool match_glob(const char* pattern, const char* s);
+
+class Archive_container {
+public:
+	struct Find_result {
+		unsigned matches;
+		unsigned archive_index;
+		unsigned file_index;
+	};
+
+	struct Extraction {
+		unsigned archive_index;
+		unsigned file_index;
+		std::string dest_filename;
+	};
+
+	// Reads the archives through read-only memory mappings instead of
+	// file reads, when they can be mapped. An archive stays mapped once a
+	// file is extracted from it, so it's meant for 64-bit builds. Must be
+	// set before adding archives.
+	void set_memory_mapped(bool memory_mapped);
+
+	bool add_archive(const char* filename);
+
+	// Opens and indexes several archives concurrently. Precedence is the
+	// order of filenames, as if add_archive was called for each one.
+	// Returns whether each archive could be added.
+	std::vector<bool> add_archives(const std::vector<std::string>& filenames);
+
+	// Loads a cache of archive directories saved by save_cache. Archives
+	// added afterwards whose path, size and modification time match an
+	// entry of the cache are indexed from it, and the zip is not opened
+	// until a file is extracted.
+	void load_cache(const char* filename);
+
+	// Saves the directories of the added archives, if any of them was
+	// not found in the loaded cache. The cache file is replaced at once,
+	// so processes loading it concurrently never read a partial file.
+	bool save_cache(const char* filename) const;
+
+	unsigned archive_count() const;
+	unsigned file_count(unsigned archive_index) const;
+	bool extract_file(unsigned archive_index, unsigned file_index,
+	                  const char* dest_filename) const;
+	bool extract_file_to_mem(unsigned archive_index, unsigned file_index,
+	                         std::vector<unsigned char> &buffer) const;
+
+	// Extracts several files concurrently. Each worker thread opens its
+	// own zip readers, since a miniz reader can't be shared. Returns
+	// whether each file could be extracted.
+	std::vector<bool>
+	extract_files(const std::vector<Extraction>& extractions) const;
+
+	// Returns the contents of a stored (uncompressed) file in place. The
+	// span is empty if the file is compressed or the archives aren't
+	// memory mapped.
+	std::span<const unsigned char> stored_file(unsigned archive_index,
+	                                           unsigned file_index) const;
+
+	std::string filename(unsigned archive_index, unsigned file_index) const;
+	uint64_t uncompressed_size(unsigned archive_index,
+	                           unsigned file_index) const;
+	uint32_t file_crc32(unsigned archive_index, unsigned file_index) const;
+
+	// Finds a file by name. An exact (case insensitive) basename is
+	// looked up in the index. A pattern with '*' or '?' is matched as a
+	// glob against the basenames, anything else is searched as a
+	// substring of the file paths. Files with the same basename in
+	// several archives count as a single match, resolved to the first
+	// archive added.
+	Find_result find_file(const char* str) const;
+
+	// Like find_file, but returns every match, in precedence order.
+	std::vector<Find_result> find_files(const char* str) const;
+
+	// Finds the files whose basename without extension is str.
+	Find_result find_file_by_stem(const char* str) const;
+
+	// Returns the files with the specified extension (without dot).
+	std::vector<Find_result> files_with_extension(const char* ext) const;
+
+private:
+	struct Archive_entry {
+		std::string filename;
+		uint64_t size;
+		int64_t mtime;
+		mutable std::unique_ptr<mz_zip_archive> zip; // Opened on demand
+		mutable std::shared_ptr<Mapped_file> mapping;
+		unsigned first_file; // Index of the first file in files
+		unsigned file_count;
+	};
+
+	struct File_entry {
+		std::string filename;  // Path inside the archive
+		std::string uppercase; // Uppercase path, for substring search
+		unsigned archive_index;
+		unsigned file_index;
+		bool is_directory;
+		uint16_t method;
+		uint64_t local_header_offset;
+		uint64_t compressed_size;
+		uint64_t uncompressed_size;
+		uint32_t crc32;
+	};
+
+	struct Cached_file {
+		std::string filename;
+		bool is_directory;
+		uint16_t method;
+		uint64_t local_header_offset;
+		uint64_t compressed_size;
+		uint64_t uncompressed_size;
+		uint32_t crc32;
+	};
+
+	struct Cached_archive {
+		uint64_t size;
+		int64_t mtime;
+		std::vector<Cached_file> files;
+	};
+
+	// An archive opened by open_archive, waiting to be merged in order
+	struct Opened_archive {
+		Archive_entry entry;
+		const std::vector<Cached_file>* cached = nullptr;
+		std::vector<Cached_file> directory;
+	};
+
+	std::vector<Archive_entry> archives;
+	std::vector<File_entry> files;
+
+	// Archive path -> directory loaded from the cache
+	std::unordered_map<std::string, Cached_archive> cache;
+	bool cache_dirty = false;
+	bool memory_mapped = false;
+
+	// Uppercase basename -> winning entry in files
+	std::unordered_map<std::string, unsigned> basename_index;
+
+	// Winning entries in files, sorted. Searched when a query is too
+	// short for the trigram index.
+	std::vector<unsigned> winning_entries;
+
+	// Uppercase stem/extension -> winning entries in files
+	std::unordered_map<std::string, std::vector<unsigned>> stem_index;
+	std::unordered_map<std::string, std::vector<unsigned>> extension_index;
+
+	// Trigram of the uppercase path -> sorted winning entries in files
+	std::unordered_map<uint32_t, std::vector<unsigned>> trigram_index;
+
+	mz_zip_archive* zip(unsigned archive_index) const;
+	const Mapped_file* map_archive(const Archive_entry& entry) const;
+	bool init_reader(const Archive_entry& entry, mz_zip_archive* zip) const;
+	bool open_archive(const std::string& filename,
+	                  Opened_archive& opened) const;
+	void merge_archive(Opened_archive& opened);
+	bool read_directory(Archive_entry& entry,
+	                    std::vector<Cached_file>& directory) const;
+	void index_archive(unsigned archive_index,
+	                   const std::vector<Cached_file>& directory);
+	Find_result find_result(const std::vector<unsigned>& entries) const;
+	std::vector<unsigned> match_entries(const std::string& str) const;
+	void index_trigrams(unsigned entry);
+	std::vector<unsigned> trigram_candidates(const std::string& str) const;
+	std::vector<unsigned> find_substring(const std::string& str) const;
+	std::vector<unsigned> find_glob(const std::string& pattern) const;
+	const File_entry* file_entry(unsigned archive_index,
+	                             unsigned file_index) const;
+};
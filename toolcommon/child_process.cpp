@@ -0,0 +1,310 @@
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "child_process.h"
+
+using namespace std;
+
+// Serializes pipe creation and process creation, so a child doesn't
+// inherit the pipes of another child created concurrently. Otherwise the
+// other child wouldn't see the end of its input while this one runs.
+static std::mutex start_mutex;
+
+Child_process::~Child_process()
+{
+	wait();
+}
+
+bool Child_process::read_line(std::string& line)
+{
+	for (;;) {
+		auto pos = buffer.find('\n');
+		if (pos != string::npos) {
+			line.assign(buffer, 0, pos);
+			buffer.erase(0, pos + 1);
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			return true;
+		}
+
+		if (!read_more()) {
+			// Last line without terminator
+			if (buffer.empty())
+				return false;
+			line = move(buffer);
+			buffer.clear();
+			return true;
+		}
+	}
+}
+
+#ifdef _WIN32
+
+static std::string quote_arg(const std::string& arg)
+{
+	if (!arg.empty() && arg.find_first_of(" \t\"") == string::npos)
+		return arg;
+
+	// See "Parsing C++ command-line arguments" in MSDN
+	string s = "\"";
+	unsigned backslashes = 0;
+	for (char c : arg) {
+		if (c == '\\') {
+			++backslashes;
+			continue;
+		}
+		if (c == '"')
+			backslashes = backslashes * 2 + 1;
+		s.append(backslashes, '\\');
+		s += c;
+		backslashes = 0;
+	}
+	s.append(backslashes * 2, '\\');
+	s += '"';
+
+	return s;
+}
+
+bool Child_process::start(const std::vector<std::string>& args)
+{
+	SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+	HANDLE child_input, child_output;
+
+	// Held until the inheritable child ends are closed
+	lock_guard<mutex> lock(start_mutex);
+
+	if (!CreatePipe(&child_input, (HANDLE*)&input, &sa, 0))
+		return false;
+	if (!CreatePipe((HANDLE*)&output, &child_output, &sa, 0)) {
+		CloseHandle(child_input);
+		CloseHandle(input);
+		input = nullptr;
+		return false;
+	}
+
+	// Only the child ends are inherited
+	SetHandleInformation(input, HANDLE_FLAG_INHERIT, 0);
+	SetHandleInformation(output, HANDLE_FLAG_INHERIT, 0);
+
+	string cmd_line;
+	for (auto& arg : args) {
+		if (!cmd_line.empty())
+			cmd_line += ' ';
+		cmd_line += quote_arg(arg);
+	}
+
+	STARTUPINFOA si = {};
+	si.cb = sizeof(si);
+	si.dwFlags = STARTF_USESTDHANDLES;
+	si.hStdInput = child_input;
+	si.hStdOutput = child_output;
+	si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+	PROCESS_INFORMATION pi;
+	// The executable is searched like the command processor does
+	bool ok = CreateProcessA(nullptr, cmd_line.data(), nullptr,
+	                         nullptr, TRUE, 0, nullptr, nullptr, &si, &pi);
+
+	CloseHandle(child_input);
+	CloseHandle(child_output);
+
+	if (!ok) {
+		CloseHandle(input);
+		CloseHandle(output);
+		input = output = nullptr;
+		return false;
+	}
+
+	CloseHandle(pi.hThread);
+	process = pi.hProcess;
+	output_eof = false;
+	buffer.clear();
+
+	return true;
+}
+
+bool Child_process::write(const std::string& s)
+{
+	DWORD written;
+
+	return input && WriteFile(input, s.data(), DWORD(s.size()), &written,
+	                          nullptr) && written == s.size();
+}
+
+bool Child_process::read_more()
+{
+	if (!output || output_eof)
+		return false;
+
+	char buf[4096];
+	DWORD bytes_read;
+	if (!ReadFile(output, buf, sizeof(buf), &bytes_read, nullptr)
+	    || bytes_read == 0) {
+		output_eof = true;
+		return false;
+	}
+
+	buffer.append(buf, bytes_read);
+
+	return true;
+}
+
+void Child_process::close_input()
+{
+	if (input) {
+		CloseHandle(input);
+		input = nullptr;
+	}
+}
+
+int Child_process::wait()
+{
+	close_input();
+
+	if (output) {
+		CloseHandle(output);
+		output = nullptr;
+	}
+
+	if (!process)
+		return -1;
+
+	DWORD exit_code;
+	WaitForSingleObject(process, INFINITE);
+	bool ok = GetExitCodeProcess(process, &exit_code);
+	CloseHandle(process);
+	process = nullptr;
+
+	return ok ? int(exit_code) : -1;
+}
+
+#else
+
+static bool cloexec_pipe(int fds[2])
+{
+	if (pipe(fds) != 0)
+		return false;
+
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	return true;
+}
+
+bool Child_process::start(const std::vector<std::string>& args)
+{
+	// Writing to a child that exited must fail instead of killing us
+	signal(SIGPIPE, SIG_IGN);
+
+	lock_guard<mutex> lock(start_mutex);
+
+	int in_fds[2], out_fds[2];
+	if (!cloexec_pipe(in_fds))
+		return false;
+	if (!cloexec_pipe(out_fds)) {
+		close(in_fds[0]);
+		close(in_fds[1]);
+		return false;
+	}
+
+	vector<char*> argv;
+	for (auto& arg : args)
+		argv.push_back(const_cast<char*>(arg.c_str()));
+	argv.push_back(nullptr);
+
+	pid = fork();
+	if (pid == 0) {
+		// dup2 clears close-on-exec in the new descriptors
+		dup2(in_fds[0], STDIN_FILENO);
+		dup2(out_fds[1], STDOUT_FILENO);
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+
+	close(in_fds[0]);
+	close(out_fds[1]);
+
+	if (pid < 0) {
+		close(in_fds[1]);
+		close(out_fds[0]);
+		return false;
+	}
+
+	input = in_fds[1];
+	output = out_fds[0];
+	output_eof = false;
+	buffer.clear();
+
+	return true;
+}
+
+bool Child_process::write(const std::string& s)
+{
+	size_t written = 0;
+
+	while (input >= 0 && written < s.size()) {
+		auto n = ::write(input, s.data() + written, s.size() - written);
+		if (n < 0)
+			return false;
+		written += n;
+	}
+
+	return input >= 0;
+}
+
+bool Child_process::read_more()
+{
+	if (output < 0 || output_eof)
+		return false;
+
+	char buf[4096];
+	auto n = read(output, buf, sizeof(buf));
+	if (n <= 0) {
+		output_eof = true;
+		return false;
+	}
+
+	buffer.append(buf, n);
+
+	return true;
+}
+
+void Child_process::close_input()
+{
+	if (input >= 0) {
+		close(input);
+		input = -1;
+	}
+}
+
+int Child_process::wait()
+{
+	close_input();
+
+	if (output >= 0) {
+		close(output);
+		output = -1;
+	}
+
+	if (pid <= 0)
+		return -1;
+
+	int status;
+	auto ret = waitpid(pid, &status, 0);
+	pid = -1;
+
+	if (ret < 0 || !WIFEXITED(status))
+		return -1;
+
+	return WEXITSTATUS(status);
+}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A child process with pipes connected to its standard input and output.
+// The standard error of the child is inherited.
+class Child_process {
+public:
+	Child_process() = default;
+	Child_process(const Child_process&) = delete;
+	Child_process& operator=(const Child_process&) = delete;
+
+	// Closes the pipes and waits for the process, if it was started.
+	~Child_process();
+
+	// Starts a process. args[0] is the executable, searched in the PATH
+	// if it has no directory.
+	bool start(const std::vector<std::string>& args);
+
+	// Writes to the standard input of the process.
+	bool write(const std::string& s);
+
+	// Reads a line from the standard output of the process, without the
+	// line terminator. Returns false at the end of the output.
+	bool read_line(std::string& line);
+
+	// Closes the standard input of the process, so it reads EOF.
+	void close_input();
+
+	// Closes the pipes and waits for the process to exit. Returns its
+	// exit code, or -1 if it could not be retrieved.
+	int wait();
+
+private:
+#ifdef _WIN32
+	void* process = nullptr; // HANDLEs, windows.h is not included here
+	void* input = nullptr;
+	void* output = nullptr;
+#else
+	int pid = -1;
+	int input = -1;
+	int output = -1;
+#endif
+	std::string buffer; // Read but not yet returned output
+	bool output_eof = false;
+
+	bool read_more();
+};
@@ -14,13 +14,13 @@
 
 #include <filesystem>
 #include <fstream>
-#include <iostream>
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
 #include "config.h"
+#include "log.h"
 #include "yaml-cpp/yaml.h"
 
 using namespace std;
@@ -31,6 +31,10 @@ static void create_config_file(const char *filename)
 	ofstream out(filename);
 	out << "# (Optional) Directory where NWN2 is installed.\n";
 	out << "# nwn2_home: C:\\Program Files\\Atari\\Neverwinter Nights 2\n";
+	out << "\n";
+	out << "# (Optional) Directories of loose files that override the NWN2 data.\n";
+	out << "# override_dirs:\n";
+	out << "#   - C:\\Users\\<user>\\Documents\\Neverwinter Nights 2\\override\n";
 }
 
 static bool find_nwn2_home_in_config(Config& config, YAML::Node& config_file)
@@ -41,7 +45,7 @@ static bool find_nwn2_home_in_config(Config& config, YAML::Node& config_file)
 		if (exists(nwn2_home))
 			config.nwn2_home = nwn2_home;
 		else
-			cout << "ERROR: The NWN2 installation directory specified in config.yml doesn't exist: \"" << nwn2_home << "\"\n";
+			Log::error() << "The NWN2 installation directory specified in config.yml doesn't exist: \"" << nwn2_home << "\"\n";
 
 		return true;
 	}
@@ -117,6 +121,21 @@ static bool find_nwn2_home_in_registry(Config& config)
 	return false;
 }
 
+static void read_override_dirs(Config& config, YAML::Node& config_file)
+{
+	auto dirs = config_file["override_dirs"];
+	if (!dirs || !dirs.IsSequence())
+		return;
+
+	for (auto dir : dirs) {
+		auto s = dir.as<string>("");
+		if (exists(s))
+			config.override_dirs.push_back(s);
+		else
+			Log::warning() << "The override directory specified in config.yml doesn't exist: \"" << s << "\"\n";
+	}
+}
+
 static void find_nwn2_home(Config& config, YAML::Node& config_file)
 {
 	if (find_nwn2_home_in_config(config, config_file))
@@ -126,27 +145,30 @@ static void find_nwn2_home(Config& config, YAML::Node& config_file)
 	else if (find_nwn2_home_in_list(config))
 		return;
 
-	cout << "ERROR: Cannot find a NWN2 installation directory. Edit the "
+	Log::error() << "Cannot find a NWN2 installation directory. Edit the "
 		"config.yml file and put the directory where NWN2 is "
 		"installed.\n";
 }
 
 Config::Config(const char *filename)
 {
+	config_dir = path(filename).parent_path().string();
+
 	if (!exists(filename))
 		create_config_file(filename);
 
 	try {
 		auto config_file = YAML::LoadFile(filename);
 		if (!config_file) {
-			cout << "ERROR: Cannot open " << filename << endl;
+			Log::error() << "Cannot open " << filename << endl;
 			return;
 		}
 
 		find_nwn2_home(*this, config_file);
+		read_override_dirs(*this, config_file);
 	}
 	catch (...) {
-		cout << "ERROR: Cannot open " << filename << ": It's ill-formed." << endl;
+		Log::error() << "Cannot open " << filename << ": It's ill-formed." << endl;
 		return;
 	}
 }
\ No newline at end of file
@@ -15,11 +15,19 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 class Config {
 public:
 	/// Directory where NWN2 is installed.
 	std::string nwn2_home;
 
+	/// Directory containing config.yml. Caches are stored here too.
+	std::string config_dir;
+
+	/// Directories of loose files that take precedence over the NWN2
+	/// archives, in order of precedence.
+	std::vector<std::string> override_dirs;
+
 	Config(const char *filename);
 };
@@ -0,0 +1,376 @@
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "local_server.h"
+#include "log.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+// Requests are a few paths, anything larger is not a client of ours
+static const uint32_t max_frame_size = 1 << 20;
+
+Local_connection::~Local_connection()
+{
+	close();
+}
+
+bool Local_connection::read_frame(std::string& frame)
+{
+	unsigned char header[4];
+	if (!read((char*)header, sizeof(header)))
+		return false;
+
+	uint32_t size = header[0] | (header[1] << 8) | (header[2] << 16)
+		| (uint32_t(header[3]) << 24);
+	if (size > max_frame_size)
+		return false;
+
+	frame.resize(size);
+
+	return read(frame.data(), size);
+}
+
+bool Local_connection::write_frame(const std::string& frame)
+{
+	uint32_t size = uint32_t(frame.size());
+	unsigned char header[4] = { (unsigned char)size,
+		(unsigned char)(size >> 8), (unsigned char)(size >> 16),
+		(unsigned char)(size >> 24) };
+
+	return write((const char*)header, sizeof(header))
+		&& write(frame.data(), frame.size());
+}
+
+const std::string& Local_server::name() const
+{
+	return name_;
+}
+
+#ifdef _WIN32
+
+static HANDLE create_pipe_instance(const std::string& name, bool first)
+{
+	return CreateNamedPipeA(name.c_str(),
+		PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+		PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT
+		| PIPE_REJECT_REMOTE_CLIENTS,
+		PIPE_UNLIMITED_INSTANCES, 64 * 1024, 64 * 1024, 0, nullptr);
+}
+
+bool Local_connection::read(char* data, size_t size)
+{
+	while (pipe && size > 0) {
+		DWORD bytes_read;
+		if (!ReadFile(pipe, data, DWORD(size), &bytes_read, nullptr)
+		    || bytes_read == 0)
+			return false;
+		data += bytes_read;
+		size -= bytes_read;
+	}
+
+	return pipe != nullptr;
+}
+
+bool Local_connection::write(const char* data, size_t size)
+{
+	while (pipe && size > 0) {
+		DWORD written;
+		if (!WriteFile(pipe, data, DWORD(size), &written, nullptr))
+			return false;
+		data += written;
+		size -= written;
+	}
+
+	return pipe != nullptr;
+}
+
+void Local_connection::close()
+{
+	if (pipe) {
+		FlushFileBuffers(pipe);
+		DisconnectNamedPipe(pipe);
+		CloseHandle(pipe);
+		pipe = nullptr;
+	}
+}
+
+Local_server::~Local_server()
+{
+	if (pipe)
+		CloseHandle(pipe);
+}
+
+bool Local_server::listen(const std::string& name)
+{
+	string pipe_name = name;
+	if (pipe_name.compare(0, 9, "\\\\.\\pipe\\") != 0)
+		pipe_name = "\\\\.\\pipe\\" + pipe_name;
+
+	// The first instance fails if another server owns the name
+	auto h = create_pipe_instance(pipe_name, true);
+	if (h == INVALID_HANDLE_VALUE)
+		return false;
+
+	pipe = h;
+	name_ = pipe_name;
+
+	return true;
+}
+
+bool Local_server::accept(Local_connection& connection)
+{
+	if (!pipe)
+		return false;
+
+	if (!ConnectNamedPipe(pipe, nullptr)
+	    && GetLastError() != ERROR_PIPE_CONNECTED)
+		return false;
+
+	connection.close();
+	connection.pipe = pipe;
+
+	// The next client waits on a new instance
+	auto h = create_pipe_instance(name_, false);
+	pipe = h == INVALID_HANDLE_VALUE ? nullptr : h;
+
+	return true;
+}
+
+#else
+
+bool Local_connection::read(char* data, size_t size)
+{
+	while (socket >= 0 && size > 0) {
+		auto n = ::recv(socket, data, size, 0);
+		if (n <= 0)
+			return false;
+		data += n;
+		size -= n;
+	}
+
+	return socket >= 0;
+}
+
+bool Local_connection::write(const char* data, size_t size)
+{
+	while (socket >= 0 && size > 0) {
+		auto n = ::send(socket, data, size, 0);
+		if (n < 0)
+			return false;
+		data += n;
+		size -= n;
+	}
+
+	return socket >= 0;
+}
+
+void Local_connection::close()
+{
+	if (socket >= 0) {
+		::close(socket);
+		socket = -1;
+	}
+}
+
+Local_server::~Local_server()
+{
+	if (socket >= 0) {
+		::close(socket);
+		unlink(name_.c_str());
+	}
+}
+
+static bool socket_address(const std::string& name, sockaddr_un& addr)
+{
+	addr = {};
+	addr.sun_family = AF_UNIX;
+	if (name.size() >= sizeof(addr.sun_path))
+		return false;
+	name.copy(addr.sun_path, name.size());
+
+	return true;
+}
+
+bool Local_server::listen(const std::string& name)
+{
+	// Writing to a client that disconnected must fail instead of killing
+	// us
+	signal(SIGPIPE, SIG_IGN);
+
+	sockaddr_un addr;
+	if (!socket_address(name, addr))
+		return false;
+
+	int s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0)
+		return false;
+
+	// A socket file nobody accepts on was left by a server that crashed
+	if (::connect(s, (sockaddr*)&addr, sizeof(addr)) == 0) {
+		::close(s);
+		return false;
+	}
+	::close(s);
+	unlink(name.c_str());
+
+	s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0)
+		return false;
+
+	// Only the user can connect
+	auto old_mask = umask(0077);
+	bool ok = ::bind(s, (sockaddr*)&addr, sizeof(addr)) == 0
+		&& ::listen(s, 8) == 0;
+	umask(old_mask);
+
+	if (!ok) {
+		::close(s);
+		return false;
+	}
+
+	socket = s;
+	name_ = name;
+
+	return true;
+}
+
+bool Local_server::accept(Local_connection& connection)
+{
+	if (socket < 0)
+		return false;
+
+	int s = ::accept(socket, nullptr, nullptr);
+	if (s < 0)
+		return false;
+
+	connection.close();
+	connection.socket = s;
+
+	return true;
+}
+
+#endif
+
+static std::vector<std::string> split_request(const std::string& request)
+{
+	vector<string> fields;
+	size_t begin = 0;
+
+	for (;;) {
+		auto end = request.find('\0', begin);
+		fields.push_back(request.substr(begin, end - begin));
+		if (end == string::npos)
+			break;
+		begin = end + 1;
+	}
+
+	return fields;
+}
+
+static std::string response(bool ok, const std::string& output)
+{
+	string r = { char(ok ? 0 : 1), 0, 0, 0 };
+	return r + output;
+}
+
+// Runs a job in its working directory, capturing its output
+static bool run_request(std::vector<std::string>& fields, std::string& output,
+	const std::function<bool(std::vector<std::string>& args)>& run_job)
+{
+	error_code ec;
+	auto server_dir = current_path();
+	current_path(fields[0], ec);
+	if (ec) {
+		output = "ERROR: Cannot change to directory " + fields[0] + '\n';
+		return false;
+	}
+
+	vector<string> args(fields.begin() + 1, fields.end());
+	auto server_level = Log::level.load();
+
+	ostringstream out;
+	Log::flush();
+	auto cout_rdbuf = cout.rdbuf(out.rdbuf());
+
+	bool ok;
+	try {
+		ok = run_job(args);
+	}
+	catch (const exception& e) {
+		Log::error() << e.what() << endl;
+		ok = false;
+	}
+
+	Log::flush();
+	cout.rdbuf(cout_rdbuf);
+
+	Log::level = server_level;
+	Log::error_count = 0;
+	current_path(server_dir, ec);
+
+	output = out.str();
+
+	return ok;
+}
+
+int serve_jobs(const std::string& name,
+	const std::function<bool(std::vector<std::string>& args)>& run_job)
+{
+	Local_server server;
+	if (!server.listen(name)) {
+		Log::error() << "Cannot listen on " << name
+		             << ". Is another server running?\n";
+		return 1;
+	}
+
+	Log::info() << "Listening on " << server.name() << endl;
+
+	for (bool shutdown = false; !shutdown;) {
+		Local_connection connection;
+		if (!server.accept(connection)) {
+			Log::error() << "Cannot accept connections on "
+			             << server.name() << endl;
+			return 1;
+		}
+
+		for (string request; !shutdown && connection.read_frame(request);) {
+			auto fields = split_request(request);
+			if (fields.size() == 2 && fields[1] == "-shutdown") {
+				Log::info() << "Shutting down\n";
+				connection.write_frame(response(true, ""));
+				shutdown = true;
+				continue;
+			}
+
+			string job;
+			for (size_t i = 1; i < fields.size(); ++i)
+				job += (i > 1 ? " " : "") + fields[i];
+
+			string output;
+			bool ok = false;
+			if (fields.size() < 2)
+				output = "ERROR: No arguments\n";
+			else
+				ok = run_request(fields, output, run_job);
+			Log::info() << (ok ? "Done: " : "FAILED: ") << job << endl;
+
+			if (!connection.write_frame(response(ok, output)))
+				break;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// A connection with a client of a Local_server. Messages are sent as
+// frames: a 32-bit little-endian length followed by the bytes of the
+// message.
+class Local_connection {
+public:
+	Local_connection() = default;
+	Local_connection(const Local_connection&) = delete;
+	Local_connection& operator=(const Local_connection&) = delete;
+
+	// Closes the connection.
+	~Local_connection();
+
+	// Reads a frame. Returns false if the client closed the connection or
+	// the frame is too large.
+	bool read_frame(std::string& frame);
+
+	// Writes a frame.
+	bool write_frame(const std::string& frame);
+
+	void close();
+
+private:
+	friend class Local_server;
+
+#ifdef _WIN32
+	void* pipe = nullptr; // HANDLE, windows.h is not included here
+#else
+	int socket = -1;
+#endif
+
+	bool read(char* data, size_t size);
+	bool write(const char* data, size_t size);
+};
+
+// Server for clients of the same machine. It listens on a Unix domain
+// socket, or a named pipe on Windows, so it can't be reached from the
+// network.
+class Local_server {
+public:
+	Local_server() = default;
+	Local_server(const Local_server&) = delete;
+	Local_server& operator=(const Local_server&) = delete;
+
+	// Stops listening, and removes the socket file.
+	~Local_server();
+
+	// Starts listening. The name is the path of the socket file, or the
+	// name of the pipe on Windows (with or without the "\\.\pipe\"
+	// prefix). Fails if another server is listening with the same name.
+	bool listen(const std::string& name);
+
+	// Waits for a client to connect.
+	bool accept(Local_connection& connection);
+
+	// Returns the name of the socket or pipe, or an empty string if the
+	// server isn't listening.
+	const std::string& name() const;
+
+private:
+	std::string name_;
+#ifdef _WIN32
+	void* pipe = nullptr; // Instance waiting for the next client
+#else
+	int socket = -1;
+#endif
+};
+
+// Runs the jobs requested by the clients of a Local_server, one at a time,
+// until a client requests "-shutdown".
+//
+// A request is a frame with the working directory of the job followed by
+// its arguments, separated by '\0'. The job runs in that directory, and
+// its output is captured from Log. The response is a frame with the exit
+// code of the job (0 or 1) as a 32-bit little-endian integer, followed by
+// the output. A client can send several requests through a connection.
+//
+// Returns the exit code of the server.
+int serve_jobs(const std::string& name,
+	const std::function<bool(std::vector<std::string>& args)>& run_job);
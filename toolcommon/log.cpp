@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log.h"
+
+using namespace std;
+
+namespace {
+
+// Bounded multi-producer multi-consumer queue, after Dmitry Vyukov's. The
+// sequence number of a cell tells whether it's free for the producer of
+// its position, or it holds the message for the consumer.
+class Ring {
+public:
+	Ring(size_t capacity) : cells(capacity), mask(capacity - 1)
+	{
+		for (size_t i = 0; i < capacity; ++i)
+			cells[i].sequence.store(i, memory_order_relaxed);
+	}
+
+	// Returns false if the ring is full.
+	bool push(string& message)
+	{
+		auto pos = enqueue_pos.load(memory_order_relaxed);
+		for (;;) {
+			auto& cell = cells[pos & mask];
+			auto seq = cell.sequence.load(memory_order_acquire);
+			auto diff = intptr_t(seq) - intptr_t(pos);
+			if (diff == 0) {
+				if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+					memory_order_relaxed)) {
+					cell.message = move(message);
+					cell.sequence.store(pos + 1, memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false;
+			else
+				pos = enqueue_pos.load(memory_order_relaxed);
+		}
+	}
+
+	// Returns false if the ring is empty.
+	bool pop(string& message)
+	{
+		auto pos = dequeue_pos.load(memory_order_relaxed);
+		for (;;) {
+			auto& cell = cells[pos & mask];
+			auto seq = cell.sequence.load(memory_order_acquire);
+			auto diff = intptr_t(seq) - intptr_t(pos + 1);
+			if (diff == 0) {
+				if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+					memory_order_relaxed)) {
+					message = move(cell.message);
+					cell.sequence.store(pos + mask + 1,
+						memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false;
+			else
+				pos = dequeue_pos.load(memory_order_relaxed);
+		}
+	}
+
+	// Number of messages pushed so far
+	size_t pushed() const
+	{
+		return enqueue_pos.load(memory_order_relaxed);
+	}
+
+private:
+	struct Cell {
+		atomic<size_t> sequence;
+		string message;
+	};
+
+	vector<Cell> cells;
+	size_t mask;
+	alignas(64) atomic<size_t> enqueue_pos = 0;
+	alignas(64) atomic<size_t> dequeue_pos = 0;
+};
+
+// Drains the ring to std::cout in a background thread. Producers only
+// wake it if it's sleeping. A wakeup lost in a race is bounded by the
+// sleep timeout.
+class Writer {
+public:
+	Writer() : ring(4096), thread([this] { run(); }) {}
+
+	~Writer()
+	{
+		stop = true;
+		wake();
+		thread.join();
+	}
+
+	void write(string& message)
+	{
+		// When full, wait for the writer instead of dropping messages
+		while (!ring.push(message)) {
+			wake();
+			this_thread::yield();
+		}
+
+		if (sleeping.load(memory_order_relaxed))
+			wake();
+	}
+
+	void flush()
+	{
+		auto target = ring.pushed();
+		wake();
+
+		unique_lock<mutex> lock(m);
+		flushed.wait(lock, [&] { return written >= target; });
+	}
+
+private:
+	Ring ring;
+	mutex m;
+	condition_variable wakeup;
+	condition_variable flushed;
+	size_t written = 0; // Messages written, guarded by m
+	atomic<bool> sleeping = false;
+	atomic<bool> stop = false;
+	std::thread thread;
+
+	void wake()
+	{
+		lock_guard<mutex> lock(m);
+		wakeup.notify_one();
+	}
+
+	void run()
+	{
+		string batch, message;
+
+		for (;;) {
+			size_t count = 0;
+			while (batch.size() < 65536 && ring.pop(message)) {
+				batch += message;
+				++count;
+			}
+
+			if (count > 0) {
+				cout.write(batch.data(), batch.size());
+				cout.flush();
+				batch.clear();
+
+				lock_guard<mutex> lock(m);
+				written += count;
+				flushed.notify_all();
+				continue;
+			}
+
+			unique_lock<mutex> lock(m);
+			if (stop)
+				break;
+			sleeping = true;
+			wakeup.wait_for(lock, chrono::milliseconds(20));
+			sleeping = false;
+		}
+	}
+};
+
+Writer& writer()
+{
+	static Writer w;
+	return w;
+}
+
+// Formatting streams are reused. A thread may format a message while
+// another is still open (a logging function called inside a << chain),
+// so each thread has a stack of them.
+thread_local vector<unique_ptr<ostringstream>> streams;
+thread_local size_t streams_used = 0;
+
+}
+
+namespace Log {
+	atomic<int> error_count = 0;
+	atomic<int> level = LEVEL_INFO;
+
+	void set_level(Level l)
+	{
+		level = clamp(l, LEVEL_ERROR, LEVEL_TRACE);
+	}
+
+	Line::Line(Level l, const char* prefix)
+	{
+		if (!enabled(l)) {
+			stream = nullptr;
+			return;
+		}
+
+		if (streams_used == streams.size())
+			streams.emplace_back(new ostringstream);
+		auto s = streams[streams_used++].get();
+
+		// Formatting state doesn't carry over from a previous message
+		s->flags(ios_base::dec | ios_base::skipws);
+		s->precision(6);
+		s->fill(' ');
+		if (prefix)
+			*s << prefix;
+		stream = s;
+	}
+
+	Line::~Line()
+	{
+		if (!stream)
+			return;
+
+		auto s = static_cast<ostringstream*>(stream);
+		auto message = s->str();
+		s->str("");
+		--streams_used;
+
+		writer().write(message);
+	}
+
+	Line& Line::operator<<(std::ostream& (*f)(std::ostream&))
+	{
+		if (stream)
+			f(*stream);
+		return *this;
+	}
+
+	Line& Line::operator<<(std::ios_base& (*f)(std::ios_base&))
+	{
+		if (stream)
+			f(*stream);
+		return *this;
+	}
+
+	Line error()
+	{
+		++error_count;
+		return Line(LEVEL_ERROR, "ERROR: ");
+	}
+
+	Line warning()
+	{
+		return Line(LEVEL_WARNING, "WARNING: ");
+	}
+
+	Line info()
+	{
+		return Line(LEVEL_INFO);
+	}
+
+	Line debug()
+	{
+		return Line(LEVEL_DEBUG);
+	}
+
+	Line trace()
+	{
+		return Line(LEVEL_TRACE);
+	}
+
+	void flush()
+	{
+		writer().flush();
+	}
+}
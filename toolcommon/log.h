@@ -0,0 +1,79 @@
+// Leveled logging library
+//
+// Messages are formatted by the calling thread and queued in a lock-free
+// ring buffer. A background thread writes them to std::cout (and so to
+// log.txt if the output is redirected), so hot paths never wait for the
+// output. The messages of a thread are written in order. A message is
+// written as is: it includes its own line terminator, and can be a part
+// of a line.
+//
+// Messages above the current level are discarded without formatting.
+
+#pragma once
+
+#include <atomic>
+#include <ostream>
+#include <utility>
+
+namespace Log {
+	enum Level {
+		LEVEL_ERROR,
+		LEVEL_WARNING,
+		LEVEL_INFO,    // Default
+		LEVEL_DEBUG,   // -v
+		LEVEL_TRACE    // -v -v, only if compiled with LOG_TRACE_ENABLED
+	};
+
+	extern std::atomic<int> error_count;
+	extern std::atomic<int> level;
+
+	void set_level(Level l);
+
+	inline bool enabled(Level l)
+	{
+		return l <= level.load(std::memory_order_relaxed);
+	}
+
+	// A message being formatted. It's queued when destroyed, at the end of
+	// the statement that created it.
+	class Line {
+	public:
+		Line(Level l, const char* prefix = nullptr);
+		Line(const Line&) = delete;
+		Line& operator=(const Line&) = delete;
+		~Line();
+
+		template <typename T> Line& operator<<(T&& value)
+		{
+			if (stream)
+				*stream << std::forward<T>(value);
+			return *this;
+		}
+
+		// Manipulators (endl, hex, ...)
+		Line& operator<<(std::ostream& (*f)(std::ostream&));
+		Line& operator<<(std::ios_base& (*f)(std::ios_base&));
+
+	private:
+		std::ostream* stream; // nullptr if the level is disabled
+	};
+
+	Line error();   // "ERROR: " prefix, counted in error_count
+	Line warning(); // "WARNING: " prefix
+	Line info();
+	Line debug();
+	Line trace();   // Use LOG_TRACE instead
+
+	// Waits until the queued messages are written and std::cout is
+	// flushed. Needed before writing to std::cout directly, or before
+	// changing its buffer.
+	void flush();
+}
+
+// Trace messages are only compiled if LOG_TRACE_ENABLED is defined.
+// Otherwise their arguments aren't even evaluated.
+#ifdef LOG_TRACE_ENABLED
+#define LOG_TRACE if (!Log::enabled(Log::LEVEL_TRACE)) ; else Log::trace()
+#else
+#define LOG_TRACE if (true) ; else Log::trace()
+#endif
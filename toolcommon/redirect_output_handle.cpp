@@ -5,6 +5,7 @@
 #include <windows.h>
 #endif
 
+#include "log.h"
 #include "redirect_output_handle.h"
 
 using namespace std;
@@ -28,6 +29,9 @@ Redirect_output_handle::Redirect_output_handle()
 
 Redirect_output_handle::~Redirect_output_handle()
 {
+	// The queued messages go to the redirected output
+	Log::flush();
+
 	if (original_cerr_rdbuf)
 		cerr.rdbuf(original_cerr_rdbuf);
 
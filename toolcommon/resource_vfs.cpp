@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+
+#include "resource_vfs.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+static std::string to_upper(std::string s)
+{
+	for (auto& c : s)
+		c = toupper(c);
+
+	return s;
+}
+
+static std::string basename(const std::string& s)
+{
+	auto pos = s.find_last_of("/\\");
+	return pos == string::npos ? s : s.substr(pos + 1);
+}
+
+bool Resource_vfs::add_directory(const char* dir)
+{
+	error_code ec;
+	if (!is_directory(dir, ec))
+		return false;
+
+	Source source;
+	source.dir = dir;
+	sources.push_back(std::move(source));
+
+	vector<path> paths;
+	for (auto it = recursive_directory_iterator(dir, ec);
+	     it != recursive_directory_iterator(); it.increment(ec)) {
+		if (ec)
+			break;
+
+		if (it->is_regular_file(ec))
+			paths.push_back(it->path());
+	}
+
+	// Directory iteration order is unspecified
+	sort(paths.begin(), paths.end());
+
+	for (auto& p : paths) {
+		Resource r;
+		r.name = p.filename().string();
+		r.source = sources.size() - 1;
+		r.path = p.string();
+		r.archive_index = 0;
+		r.file_index = 0;
+		r.size = file_size(p, ec);
+		r.crc32 = 0;
+		add_resource(std::move(r));
+	}
+
+	return true;
+}
+
+void Resource_vfs::add_archives(Archive_container&& archives)
+{
+	Source source;
+	source.archives = make_unique<Archive_container>(std::move(archives));
+	sources.push_back(std::move(source));
+
+	auto& a = *sources.back().archives;
+
+	for (unsigned i = 0; i < a.archive_count(); ++i) {
+		for (unsigned j = 0; j < a.file_count(i); ++j) {
+			auto filename = a.filename(i, j);
+			if (filename.empty() || filename.back() == '/')
+				continue;
+
+			Resource r;
+			r.name = basename(filename);
+			r.source = sources.size() - 1;
+			r.archive_index = i;
+			r.file_index = j;
+			r.size = a.uncompressed_size(i, j);
+			r.crc32 = a.file_crc32(i, j);
+			add_resource(std::move(r));
+		}
+	}
+}
+
+void Resource_vfs::add_resource(Resource&& resource)
+{
+	auto name = to_upper(resource.name);
+	if (name_index.find(name) != name_index.end())
+		return; // Overridden by a previous source
+
+	resources.push_back(std::move(resource));
+	auto r = &resources.back();
+	name_index[name] = r;
+
+	auto& source = sources[r->source];
+	if (!source.archives)
+		source.files.emplace_back(name, r);
+
+	auto dot = name.rfind('.');
+	stem_index[dot == string::npos ? name : name.substr(0, dot)].push_back(r);
+}
+
+unsigned Resource_vfs::source_count() const
+{
+	return sources.size();
+}
+
+void Resource_vfs::set_cache_capacity(size_t bytes)
+{
+	lock_guard<mutex> lock(cache_mutex);
+	cache_capacity = bytes;
+	trim_cache();
+}
+
+const Resource_vfs::Resource* Resource_vfs::find(const char* name) const
+{
+	auto it = name_index.find(to_upper(name));
+
+	return it == name_index.end() ? nullptr : it->second;
+}
+
+std::vector<const Resource_vfs::Resource*>
+Resource_vfs::find_by_stem(const char* stem) const
+{
+	auto it = stem_index.find(to_upper(stem));
+	if (it == stem_index.end())
+		return {};
+
+	return it->second;
+}
+
+std::vector<const Resource_vfs::Resource*>
+Resource_vfs::search(const char* str) const
+{
+	if (auto r = find(str))
+		return { r };
+
+	string str_uppercase = to_upper(str);
+	bool glob = str_uppercase.find_first_of("*?") != string::npos;
+	vector<const Resource*> v;
+
+	for (unsigned s = 0; s < sources.size(); ++s) {
+		if (!sources[s].archives) {
+			for (auto& [name, r] : sources[s].files) {
+				if (glob ? match_glob(str_uppercase.c_str(), name.c_str())
+				         : name.find(str_uppercase) != string::npos)
+					v.push_back(r);
+			}
+			continue;
+		}
+
+		// The archive set searches its own trigram index. Only keep the
+		// matches that won in the merged index.
+		auto& a = *sources[s].archives;
+		for (auto& m : a.find_files(str)) {
+			auto r = find(basename(a.filename(m.archive_index,
+			                                  m.file_index)).c_str());
+			if (r && r->source == s && r->archive_index == m.archive_index
+			    && r->file_index == m.file_index)
+				v.push_back(r);
+		}
+	}
+
+	return v;
+}
+
+std::shared_ptr<const std::vector<unsigned char>>
+Resource_vfs::read(const Resource& resource) const
+{
+	lock_guard<mutex> lock(cache_mutex);
+
+	auto it = cache.find(&resource);
+	if (it != cache.end()) {
+		lru.splice(lru.begin(), lru, it->second.lru_position);
+		return it->second.data;
+	}
+
+	auto data = make_shared<vector<unsigned char>>();
+	auto& source = sources[resource.source];
+
+	if (source.archives) {
+		if (!source.archives->extract_file_to_mem(resource.archive_index,
+		                                          resource.file_index,
+		                                          *data))
+			return nullptr;
+	}
+	else {
+		ifstream in(resource.path, ios::binary);
+		if (!in)
+			return nullptr;
+
+		data->resize(resource.size);
+		in.read((char*)data->data(), data->size());
+		if (!in)
+			return nullptr;
+	}
+
+	// Resources bigger than the whole cache are not kept
+	if (data->size() <= cache_capacity) {
+		lru.push_front(&resource);
+		cache[&resource] = { data, lru.begin() };
+		cache_size += data->size();
+		trim_cache();
+	}
+
+	return data;
+}
+
+void Resource_vfs::trim_cache() const
+{
+	while (cache_size > cache_capacity && !lru.empty()) {
+		auto it = cache.find(lru.back());
+		cache_size -= it->second.data->size();
+		cache.erase(it);
+		lru.pop_back();
+	}
+}
+
+static bool file_crc32(const path& p, uint32_t& crc)
+{
+	ifstream in(p, ios::binary);
+	if (!in)
+		return false;
+
+	crc = MZ_CRC32_INIT;
+	vector<char> buffer(1 << 16);
+
+	while (in) {
+		in.read(buffer.data(), buffer.size());
+		crc = mz_crc32(crc, (const unsigned char*)buffer.data(),
+		               size_t(in.gcount()));
+	}
+
+	return in.eof();
+}
+
+// Checks if a file has the size and CRC32 of a resource
+static bool same_contents(const path& p, const Resource_vfs::Resource& r)
+{
+	error_code ec;
+	if (file_size(p, ec) != r.size || ec)
+		return false;
+
+	uint32_t crc;
+	return file_crc32(p, crc) && crc == r.crc32;
+}
+
+void Resource_vfs::set_extraction_cache(const char* dir)
+{
+	extraction_cache_dir = dir;
+}
+
+bool Resource_vfs::has_extraction_cache() const
+{
+	return !extraction_cache_dir.empty();
+}
+
+std::vector<bool>
+Resource_vfs::extract(const std::vector<Extraction>& extractions) const
+{
+	vector<bool> status(extractions.size());
+
+	// Extractions from archives are batched per archive set
+	vector<vector<Archive_container::Extraction>> batches(sources.size());
+	vector<vector<size_t>> batch_indices(sources.size());
+
+	// With an extraction cache, archive files are extracted once into
+	// the cache, named after their CRC32 and size, and then linked to
+	// their destinations.
+	bool use_cache = has_extraction_cache();
+	vector<path> cache_paths(extractions.size());
+	set<path> pending_cache_paths;
+
+	error_code ec;
+	if (use_cache && !create_directories(extraction_cache_dir, ec) && ec)
+		use_cache = false;
+
+	random_device tmp_id;
+
+	for (size_t i = 0; i < extractions.size(); ++i) {
+		auto r = extractions[i].resource;
+		auto& dest = extractions[i].dest_filename;
+		auto& source = sources[r->source];
+
+		if (!source.archives) {
+			copy_file(r->path, dest, copy_options::overwrite_existing,
+			          ec);
+			status[i] = !ec;
+			continue;
+		}
+
+		if (!use_cache) {
+			batches[r->source].push_back(
+			    { r->archive_index, r->file_index, dest });
+			batch_indices[r->source].push_back(i);
+			continue;
+		}
+
+		char key[32];
+		snprintf(key, sizeof(key), "%08x-%llu", r->crc32,
+		         (unsigned long long)r->size);
+		cache_paths[i] = path(extraction_cache_dir) / key;
+
+		// Cached files are checked before use, in case they were
+		// modified through a link.
+		if (pending_cache_paths.count(cache_paths[i]) ||
+		    same_contents(cache_paths[i], *r))
+			continue;
+
+		// Other processes may be extracting the same file. It's written
+		// to a file of our own, and then published at once.
+		pending_cache_paths.insert(cache_paths[i]);
+		path tmp = cache_paths[i];
+		tmp += "." + to_string(tmp_id()) + ".tmp";
+		batches[r->source].push_back(
+		    { r->archive_index, r->file_index, tmp.string() });
+		batch_indices[r->source].push_back(i);
+	}
+
+	for (size_t s = 0; s < sources.size(); ++s) {
+		if (batches[s].empty())
+			continue;
+
+		auto batch_status = sources[s].archives->extract_files(batches[s]);
+		for (size_t i = 0; i < batch_status.size(); ++i) {
+			auto j = batch_indices[s][i];
+			status[j] = batch_status[i];
+
+			if (!use_cache)
+				continue;
+
+			// Publish complete files only
+			path tmp = batches[s][i].dest_filename;
+			if (status[j])
+				rename(tmp, cache_paths[j], ec);
+
+			if (!status[j] || ec) {
+				remove(tmp, ec);
+
+				// Another process may have published it. On Windows,
+				// rename fails while the file is open.
+				status[j] = same_contents(cache_paths[j],
+				                          *extractions[j].resource);
+				if (!status[j])
+					cache_paths[j].clear();
+			}
+		}
+	}
+
+	if (!use_cache)
+		return status;
+
+	for (size_t i = 0; i < extractions.size(); ++i) {
+		if (cache_paths[i].empty())
+			continue;
+
+		auto& r = *extractions[i].resource;
+		path dest = extractions[i].dest_filename;
+
+		if (!exists(cache_paths[i], ec)) {
+			status[i] = false;
+			continue;
+		}
+
+		if (exists(dest, ec)) {
+			// Up to date destinations are kept, stale ones replaced
+			if (equivalent(dest, cache_paths[i], ec) ||
+			    same_contents(dest, r)) {
+				status[i] = true;
+				continue;
+			}
+
+			remove(dest, ec);
+		}
+
+		// Hard links need the cache in the same volume, otherwise copy
+		ec.clear();
+		create_hard_link(cache_paths[i], dest, ec);
+		if (ec) {
+			ec.clear();
+			copy_file(cache_paths[i], dest,
+			          copy_options::overwrite_existing, ec);
+		}
+
+		status[i] = !ec;
+	}
+
+	return status;
+}
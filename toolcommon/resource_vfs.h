@@ -0,0 +1,115 @@
+#pragma once
+
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "archive_container.h"
+
+/// Resolves resource names over loose override directories and archive
+/// sets, in the order they are added.
+///
+/// All the sources are merged in a single index of basenames. When the
+/// same basename is in several sources, the first source added wins.
+/// Decompressed contents are kept in a LRU cache bounded in bytes.
+class Resource_vfs {
+public:
+	/// A resource found in one of the sources.
+	struct Resource {
+		std::string name;        ///< Basename, as found in the source.
+		unsigned source;         ///< Index of the source.
+		std::string path;        ///< Path of a loose file.
+		unsigned archive_index;  ///< Archive within an archive set.
+		unsigned file_index;     ///< File within the archive.
+		uint64_t size;           ///< Uncompressed size.
+		uint32_t crc32;          ///< CRC32 of archive files.
+	};
+
+	struct Extraction {
+		const Resource* resource;
+		std::string dest_filename;
+	};
+
+	/// Adds a directory of loose files, searched recursively.
+	///
+	/// @return False if the directory doesn't exist.
+	bool add_directory(const char* dir);
+
+	/// Adds a set of archives.
+	void add_archives(Archive_container&& archives);
+
+	/// Returns the number of sources added.
+	unsigned source_count() const;
+
+	/// Sets the maximum number of bytes kept in the cache.
+	void set_cache_capacity(size_t bytes);
+
+	/// Sets a directory where files extracted from archives are kept
+	/// across runs, named after their CRC32 and size. extract() then
+	/// links the destinations to the cached files (or copies them if
+	/// links aren't possible), and replaces stale destinations.
+	void set_extraction_cache(const char* dir);
+
+	/// Checks if an extraction cache directory was set.
+	bool has_extraction_cache() const;
+
+	/// Finds a resource by basename (case insensitive).
+	///
+	/// @return Null pointer if not found.
+	const Resource* find(const char* name) const;
+
+	/// Finds the resources whose basename without extension is stem, in
+	/// precedence order.
+	std::vector<const Resource*> find_by_stem(const char* stem) const;
+
+	/// Finds the resources matching str. An exact basename is looked up
+	/// in the index, a pattern with '*' or '?' is matched as a glob and
+	/// anything else as a substring. Overridden copies are not returned.
+	std::vector<const Resource*> search(const char* str) const;
+
+	/// Returns the contents of a resource, from the cache if possible.
+	///
+	/// @return Null pointer if the resource can't be read.
+	std::shared_ptr<const std::vector<unsigned char>>
+	read(const Resource& resource) const;
+
+	/// Writes resources to files. Archive files are extracted in
+	/// parallel. Returns whether each resource could be written.
+	std::vector<bool> extract(const std::vector<Extraction>& extractions) const;
+
+private:
+	struct Source {
+		std::string dir; // Empty for archive sets
+		std::unique_ptr<Archive_container> archives;
+
+		// Winning loose files and their uppercase basenames, searched
+		// by search(). Archive sets have their own index.
+		std::vector<std::pair<std::string, const Resource*>> files;
+	};
+
+	struct Cache_entry {
+		std::shared_ptr<const std::vector<unsigned char>> data;
+		std::list<const Resource*>::iterator lru_position;
+	};
+
+	std::vector<Source> sources;
+	std::deque<Resource> resources; // Stable addresses
+
+	// Uppercase basename/stem -> winning resources
+	std::unordered_map<std::string, const Resource*> name_index;
+	std::unordered_map<std::string, std::vector<const Resource*>> stem_index;
+
+	mutable std::mutex cache_mutex;
+	mutable std::unordered_map<const Resource*, Cache_entry> cache;
+	mutable std::list<const Resource*> lru; // Most recently used first
+	mutable size_t cache_size = 0;
+	size_t cache_capacity = 64 * 1024 * 1024;
+	std::string extraction_cache_dir;
+
+	void add_resource(Resource&& resource);
+	void trim_cache() const;
+};